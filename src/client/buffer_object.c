@@ -0,0 +1,213 @@
+#include "config.h"
+#include "buffer_object.h"
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+static size_t
+_page_size (void)
+{
+    static size_t page_size = 0;
+    if (! page_size)
+        page_size = sysconf (_SC_PAGESIZE);
+    return page_size;
+}
+
+static size_t
+_mapping_size (GLsizeiptr size)
+{
+    size_t page_size = _page_size ();
+    return (size + page_size - 1) / page_size * page_size;
+}
+
+static void
+_buffer_object_release_mapping (buffer_object_t *buffer)
+{
+    if (buffer->mapping)
+        munmap (buffer->mapping, buffer->mapping_size);
+    free (buffer->snapshot);
+    buffer->mapping = NULL;
+    buffer->snapshot = NULL;
+    buffer->mapping_size = 0;
+    buffer->mapped = false;
+}
+
+static bool
+_buffer_object_create_mapping (buffer_object_t *buffer)
+{
+    if (buffer->mapping)
+        return true;
+
+    /* Both start out zeroed, so they agree. */
+    size_t size = _mapping_size (buffer->size);
+    void *mapping = mmap (NULL, size, PROT_READ | PROT_WRITE,
+                          MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    char *snapshot = mapping == MAP_FAILED ? NULL : calloc (1, size);
+    if (! snapshot) {
+        if (mapping != MAP_FAILED)
+            munmap (mapping, size);
+        buffer->contents_known = false;
+        return false;
+    }
+
+    buffer->mapping = mapping;
+    buffer->snapshot = snapshot;
+    buffer->mapping_size = size;
+    return true;
+}
+
+buffer_object_t *
+buffer_object_new (GLuint id)
+{
+    buffer_object_t *buffer = malloc (sizeof (buffer_object_t));
+    buffer->id = id;
+    buffer->size = 0;
+    buffer->usage = GL_STATIC_DRAW;
+    buffer->mapping = NULL;
+    buffer->snapshot = NULL;
+    buffer->mapping_size = 0;
+    buffer->mapped = false;
+    buffer->contents_known = false;
+    buffer->keep_contents = false;
+    return buffer;
+}
+
+void
+buffer_object_destroy (void *abstract_buffer)
+{
+    buffer_object_t *buffer = abstract_buffer;
+    _buffer_object_release_mapping (buffer);
+    free (buffer);
+}
+
+void
+buffer_object_set_data (buffer_object_t *buffer,
+                        GLsizeiptr size,
+                        GLenum usage,
+                        const void *data)
+{
+    /* New contents also end a mapping in progress, unless they are the
+     * mapping being uploaded. */
+    if (buffer->mapping &&
+        ((buffer->mapped && data != buffer->mapping) ||
+         buffer->mapping_size != _mapping_size (size)))
+        _buffer_object_release_mapping (buffer);
+
+    buffer->size = size;
+    buffer->usage = usage;
+
+    /* Undefined contents may as well be whatever the mapping holds. */
+    if (! data) {
+        buffer->contents_known = true;
+        return;
+    }
+
+    if (usage != GL_STATIC_DRAW)
+        buffer->keep_contents = true;
+    if (! buffer->keep_contents) {
+        _buffer_object_release_mapping (buffer);
+        buffer->contents_known = false;
+        return;
+    }
+
+    buffer->contents_known = true;
+    if (size <= 0 || ! _buffer_object_create_mapping (buffer))
+        return;
+    if (data != buffer->mapping)
+        memcpy (buffer->mapping, data, size);
+    memcpy (buffer->snapshot, data, size);
+}
+
+void
+buffer_object_set_sub_data (buffer_object_t *buffer,
+                            GLintptr offset,
+                            GLsizeiptr size,
+                            const void *data)
+{
+    if (! buffer->contents_known ||
+        offset < 0 || size <= 0 || offset + size > buffer->size)
+        return;
+
+    /* The upload of a range of the mapping itself. */
+    if (data == buffer->mapping + offset) {
+        memcpy (buffer->snapshot + offset, data, size);
+        return;
+    }
+    if (buffer->mapped)
+        return;
+
+    if (_buffer_object_create_mapping (buffer)) {
+        memcpy (buffer->mapping + offset, data, size);
+        memcpy (buffer->snapshot + offset, data, size);
+    }
+}
+
+void *
+buffer_object_map (buffer_object_t *buffer)
+{
+    /* Whether or not this map is ours, later ones are more likely. */
+    buffer->keep_contents = true;
+
+    if (buffer->size <= 0 || ! buffer->contents_known ||
+        ! _buffer_object_create_mapping (buffer))
+        return NULL;
+
+    buffer->mapped = true;
+    return buffer->mapping;
+}
+
+/* Narrows [*start, *end) to its first and last differing bytes. */
+static void
+_trim_range (const char *mapping,
+             const char *snapshot,
+             size_t *start,
+             size_t *end)
+{
+    while (*start < *end && mapping[*start] == snapshot[*start])
+        (*start)++;
+    while (*end > *start && mapping[*end - 1] == snapshot[*end - 1])
+        (*end)--;
+}
+
+size_t
+buffer_object_unmap (buffer_object_t *buffer,
+                     buffer_object_range_func_t func,
+                     void *user_data)
+{
+    if (! buffer->mapped)
+        return 0;
+    buffer->mapped = false;
+
+    size_t size = buffer->size;
+    size_t page_size = _page_size ();
+    size_t uploaded = 0;
+    size_t offset = 0;
+
+    /* Runs of pages that differ from the snapshot become one range each,
+     * trimmed to the bytes that changed at both ends. */
+    while (offset < size) {
+        size_t end = offset + page_size < size ? offset + page_size : size;
+        if (! memcmp (buffer->mapping + offset, buffer->snapshot + offset,
+                      end - offset)) {
+            offset = end;
+            continue;
+        }
+
+        size_t start = offset;
+        while (end < size) {
+            size_t next = end + page_size < size ? end + page_size : size;
+            if (! memcmp (buffer->mapping + end, buffer->snapshot + end,
+                          next - end))
+                break;
+            end = next;
+        }
+        offset = end;
+
+        _trim_range (buffer->mapping, buffer->snapshot, &start, &end);
+        memcpy (buffer->snapshot + start, buffer->mapping + start, end - start);
+        func (buffer, start, end - start, user_data);
+        uploaded += end - start;
+    }
+    return uploaded;
+}
@@ -0,0 +1,78 @@
+#ifndef GPUPROCESS_BUFFER_OBJECT_H
+#define GPUPROCESS_BUFFER_OBJECT_H
+
+#include "compiler_private.h"
+#include <GLES2/gl2.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+/* What the client knows about a buffer object, enough to map it without
+ * asking the server. A write-only glMapBufferOES returns a mapping of
+ * anonymous memory the client owns, holding the contents of the buffer,
+ * and glUnmapBufferOES compares it page by page with a snapshot of what
+ * the server has, to upload only the bytes that changed.
+ *
+ * Keeping the contents costs twice their size, so they are only kept for
+ * buffers that are likely to be mapped: those given data that is not
+ * GL_STATIC_DRAW, those created with undefined contents and those that
+ * have been mapped before. Any other buffer is mapped by the driver. */
+
+typedef struct _buffer_object {
+    GLuint id;
+    GLsizeiptr size;
+    GLenum usage;
+
+    /* The mapping the application writes to and the contents the server
+     * has, equal while the buffer is not mapped. Kept across maps of the
+     * same size. */
+    char *mapping;
+    char *snapshot;
+    size_t mapping_size;
+    bool mapped;
+
+    /* The snapshot, or no snapshot yet, stands for the contents. */
+    bool contents_known;
+    /* Whether data given later is kept. */
+    bool keep_contents;
+} buffer_object_t;
+
+typedef void (*buffer_object_range_func_t) (buffer_object_t *buffer,
+                                            size_t offset,
+                                            size_t size,
+                                            void *user_data);
+
+private buffer_object_t *
+buffer_object_new (GLuint id);
+
+private void
+buffer_object_destroy (void *abstract_buffer);
+
+/* Records the new size and usage, releases a mapping of another size and
+ * keeps a copy of `data` if the buffer may be mapped. `data` is NULL for
+ * undefined contents. */
+private void
+buffer_object_set_data (buffer_object_t *buffer,
+                        GLsizeiptr size,
+                        GLenum usage,
+                        const void *data);
+
+private void
+buffer_object_set_sub_data (buffer_object_t *buffer,
+                            GLintptr offset,
+                            GLsizeiptr size,
+                            const void *data);
+
+/* Returns NULL if the contents are not known or the memory could not
+ * be mapped. */
+private void *
+buffer_object_map (buffer_object_t *buffer);
+
+/* Calls `func` for each range of the mapping that differs from what the
+ * server has, and ends the map. Returns the number of bytes passed to
+ * `func`. */
+private size_t
+buffer_object_unmap (buffer_object_t *buffer,
+                     buffer_object_range_func_t func,
+                     void *user_data);
+
+#endif /* GPUPROCESS_BUFFER_OBJECT_H */
@@ -2,21 +2,33 @@
 
 #include "caching_client.h"
 #include "caching_client_private.h"
+#include "buffer_object.h"
 #include "client.h"
 #include "command.h"
+#include "driver_capabilities.h"
 #include "enum_validation.h"
 #include "egl_state.h"
+#include "egl_state_diff.h"
+#include "gles2_utils.h"
+#include "gpuprocess_extensions.h"
+#include "index_buffer_cache.h"
+#include "index_range.h"
 #include "name_handler.h"
+#include "registry.h"
+#include "texture_update_batch.h"
 #include "types_private.h"
+#include "vertex_cache.h"
 #include <EGL/eglext.h>
 #include <EGL/egl.h>
 #include <GLES2/gl2ext.h>
 #include <GLES2/gl2.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
 mutex_static_init (cached_gl_states_mutex);
 mutex_static_init (cached_gl_display_list_mutex);
+mutex_static_init (client_syncs_mutex);
 
 static texture_t *
 caching_client_get_default_texture ()
@@ -46,6 +58,63 @@ caching_client_glSetError (void* client, GLenum error)
         egl_state->error = error;
 }
 
+/* The first time a context is current, whatever implementation limits
+ * it does not know yet are fetched with a single command that nothing
+ * waits for. A glGet of one of them collects the answers, and so does
+ * the context stopping being current if they are there by then; only
+ * freeing the state waits for a prefetch nobody collected. With virtual
+ * contexts the server has the backing context current, which answers
+ * for the same driver. */
+static void
+caching_client_prefetch_limits (void *client,
+                                egl_state_t *state)
+{
+    if (state->limits_prefetched)
+        return;
+    state->limits_prefetched = true;
+
+    limits_prefetch_t *prefetch = malloc (sizeof (limits_prefetch_t));
+    prefetch->count = driver_capabilities_get_unknown_limits (state, prefetch->limits);
+    if (! prefetch->count) {
+        free (prefetch);
+        return;
+    }
+
+    command_t *command = client_get_space_for_command (COMMAND_PREFETCH_LIMITS);
+    command_prefetch_limits_t *prefetch_command = (command_prefetch_limits_t *) command;
+    prefetch_command->ctx = state->runs_on ? state->runs_on->context : state->context;
+    prefetch_command->count = prefetch->count;
+    prefetch_command->limits = prefetch->limits;
+    prefetch_command->fetched = &state->limits_fetched;
+
+    state->limits_prefetch = prefetch;
+    client_run_command_async_filling_slot (command, &state->limits_fetched);
+}
+
+void
+caching_client_collect_limits (void *client,
+                               egl_state_t *state)
+{
+    limits_prefetch_t *prefetch = state->limits_prefetch;
+    if (! prefetch)
+        return;
+
+    client_wait_for_result_slot (CLIENT (client), &state->limits_fetched);
+    if (state->limits_fetched.value == GL_TRUE)
+        driver_capabilities_set_limits (state, prefetch->limits, prefetch->count);
+
+    state->limits_prefetch = NULL;
+    free (prefetch);
+}
+
+void
+caching_client_collect_fetched_limits (void *client,
+                                       egl_state_t *state)
+{
+    if (state->limits_prefetch && ! result_slot_is_pending (&state->limits_fetched))
+        caching_client_collect_limits (client, state);
+}
+
 static bool
 caching_client_does_index_overflow (void* client,
                                     GLuint index)
@@ -54,9 +123,14 @@ caching_client_does_index_overflow (void* client,
     if (state->max_vertex_attribs_queried)
         goto FINISH;
 
+    caching_client_collect_limits (client, state);
+    if (state->max_vertex_attribs_queried)
+        goto FINISH;
+
     CACHING_CLIENT(client)->super_dispatch.glGetIntegerv (client, GL_MAX_VERTEX_ATTRIBS,
                                                           &state->max_vertex_attribs);
     state->max_vertex_attribs_queried = true;
+    driver_capabilities_add_limits (state);
 
 FINISH:
     if (index <= state->max_vertex_attribs)
@@ -82,37 +156,35 @@ static void
 _caching_client_destroy_state (client_t* client,
                                egl_state_t *egl_state)
 {
-    egl_state->contexts_sharing--;
-
-    /* Wait until we've deleted the children sharing us to delete ourself.*/
-    if (egl_state->contexts_sharing > 0)
-        return;
-
-    egl_state_t* share_context = egl_state->share_context;
-    if (share_context) {
-        share_context->contexts_sharing--;
-        _caching_client_destroy_state (client, share_context);
-    }
-
-    link_list_delete_first_entry_matching_data (cached_gl_states (), egl_state);
+    /* The objects it shared stay with the other contexts of its share
+     * group, which goes with the last of them. */
+    cached_gl_state_remove (egl_state);
 }
 
 static egl_state_t *
 find_state_with_display_and_context (EGLDisplay display,
                                      EGLContext context)
 {
-    link_list_t **states = cached_gl_states ();
+    return cached_gl_state_find (display, context);
+}
 
-    link_list_t *current = *states;
-    while (current) {
-        egl_state_t *state = (egl_state_t *)current->data;
-        if (state->context == context && state->display == display) {
-            return current->data;
-        }
-        current = current->next;
-    }
+/* The EGL_VENDOR and EGL_VERSION of the display, asked of the driver
+ * itself: behind a dispatch library they name the vendor driver that
+ * runs the display. NULL if it does not say. */
+static const char *
+_caching_client_get_driver_name (EGLDisplay dpy,
+                                 char *name,
+                                 size_t size)
+{
+    dispatch_table_t *base = dispatch_table_get_base ();
+    const char *vendor = base->eglQueryString (NULL, dpy, EGL_VENDOR);
+    const char *version = base->eglQueryString (NULL, dpy, EGL_VERSION);
 
-    return NULL;
+    if (! vendor || ! version ||
+        snprintf (name, size, "%s %s", vendor, version) >= (int) size ||
+        strchr (name, '\n'))
+        return NULL;
+    return name;
 }
 
 static egl_state_t *
@@ -122,12 +194,135 @@ _caching_client_get_or_create_state (EGLDisplay dpy,
     /* We should already be holding the cached states mutex. */
     egl_state_t *state = find_state_with_display_and_context(dpy, ctx);
     if (!state) {
+        char driver[256];
         state = egl_state_new (dpy, ctx);
-        link_list_append (cached_gl_states (), state, egl_state_destroy);
+        driver_capabilities_fill_state (state,
+                                        _caching_client_get_driver_name (dpy, driver,
+                                                                         sizeof (driver)));
+        cached_gl_state_add (state);
     }
     return state;
 }
 
+static bool
+_caching_client_state_needs_cleanup (egl_state_t *state)
+{
+    return state->destroy_read || state->destroy_draw ||
+           state->destroy_ctx || state->destroy_dpy;
+}
+
+/* Forgets the surfaces of the state that were destroyed while it was
+ * current. We should already be holding the display list mutex. */
+static void
+_caching_client_drop_destroyed_surfaces (egl_state_t *state)
+{
+    EGLSurface drawable = state->drawable;
+    EGLSurface readable = state->readable;
+
+    if (state->destroy_read) {
+        cached_gl_surface_destroy (state->display, readable);
+        readable = EGL_NO_SURFACE;
+    }
+    if (state->destroy_draw) {
+        if (drawable != state->readable)
+            cached_gl_surface_destroy (state->display, drawable);
+        drawable = EGL_NO_SURFACE;
+    }
+    state->destroy_read = false;
+    state->destroy_draw = false;
+    egl_state_set_surfaces (state, drawable, readable);
+}
+
+/* Cleans up whatever was destroyed while the state was current, now that
+ * it is not. We should already be holding the cached states mutex. */
+static void
+_caching_client_leave_state (client_t *client,
+                             egl_state_t *state)
+{
+    EGLDisplay display = state->display;
+
+    /* Another thread may have destroyed it as soon as it went inactive. */
+    if (find_state_with_display_and_context (display, state->context) != state)
+        return;
+
+    mutex_lock (cached_gl_display_list_mutex);
+    _caching_client_drop_destroyed_surfaces (state);
+
+    /* A backing context still runs the new context's commands, it is
+     * destroyed once the driver leaves it. */
+    bool backing = state == CACHING_CLIENT(client)->virtual_backing;
+    bool destroy_ctx = state->destroy_ctx;
+    EGLContext context = state->context;
+    if (! backing && (state->destroy_dpy || destroy_ctx))
+        _caching_client_destroy_state (client, state);
+
+    if (! backing && destroy_ctx)
+        cached_gl_context_destroy (display, context);
+    mutex_unlock (cached_gl_display_list_mutex);
+}
+
+/* Rebinding the current context, or switching to one that has been
+ * current before, takes no lock unless the state we leave has something
+ * to clean up. A thread destroying a context sets its destroy flag before
+ * it looks at `active`, and we set `active` before we look at the flag,
+ * so either it leaves the state to us or we see the flag and take the
+ * locked path. Returns false when the locked path has to run. */
+static bool
+_caching_client_make_current_unlocked (client_t *client,
+                                       EGLDisplay display,
+                                       EGLSurface drawable,
+                                       EGLSurface readable,
+                                       EGLContext context)
+{
+    egl_state_t *current_state = (egl_state_t *) CLIENT(client)->active_state;
+
+    if (context == EGL_NO_CONTEXT || display == EGL_NO_DISPLAY ||
+        CACHING_CLIENT(client)->virtual_contexts)
+        return false;
+
+    registry_read_lock ();
+    egl_state_t *new_state = find_state_with_display_and_context (display, context);
+    if (! new_state) {
+        registry_read_unlock ();
+        return false;
+    }
+
+    /* Surfaces destroyed while it was current are dropped on the locked
+     * path before it takes new ones. */
+    if (new_state == current_state) {
+        bool cleanup = new_state->destroy_read || new_state->destroy_draw;
+        if (! cleanup)
+            egl_state_set_surfaces (new_state, drawable, readable);
+        registry_read_unlock ();
+        return ! cleanup;
+    }
+
+    new_state->active = true;
+    __sync_synchronize ();
+    if (_caching_client_state_needs_cleanup (new_state)) {
+        new_state->active = false;
+        registry_read_unlock ();
+        return false;
+    }
+    egl_state_set_surfaces (new_state, drawable, readable);
+    CLIENT(client)->active_state = new_state;
+
+    if (current_state) {
+        current_state->active = false;
+        __sync_synchronize ();
+
+        /* The read section keeps it alive until we have the lock. */
+        if (_caching_client_state_needs_cleanup (current_state)) {
+            mutex_lock (cached_gl_states_mutex);
+            _caching_client_leave_state (client, current_state);
+            mutex_unlock (cached_gl_states_mutex);
+        }
+    }
+
+    registry_read_unlock ();
+    return true;
+}
+
 /* we should call real eglMakeCurrent() before, and wait for result
  * if eglMakeCurrent() returns EGL_TRUE, then we call this
  */
@@ -138,20 +333,39 @@ _caching_client_make_current (client_t *client,
                               EGLSurface readable,
                               EGLContext context)
 {
+    egl_state_t *current_state = (egl_state_t *) CLIENT(client)->active_state;
+    if (current_state &&
+        (current_state->display != display || current_state->context != context))
+        caching_client_collect_fetched_limits (client, current_state);
+
+    if (_caching_client_make_current_unlocked (client, display,
+                                               drawable, readable, context))
+        return;
+
     mutex_lock (cached_gl_states_mutex);
 
     /* If we aren't switching to the "none" context, the new_state isn't null. */
     egl_state_t *new_state = NULL;
     if (context != EGL_NO_CONTEXT && display != EGL_NO_DISPLAY) {
         new_state = _caching_client_get_or_create_state (display, context);
-        new_state->drawable = drawable;
-        new_state->readable = readable;
+
+        /* A state that was not current left the destroyed surfaces to
+         * the thread that destroyed them. */
+        if (new_state == CLIENT(client)->active_state) {
+            mutex_lock (cached_gl_display_list_mutex);
+            _caching_client_drop_destroyed_surfaces (new_state);
+            mutex_unlock (cached_gl_display_list_mutex);
+        } else {
+            new_state->destroy_read = false;
+            new_state->destroy_draw = false;
+        }
+        egl_state_set_surfaces (new_state, drawable, readable);
         new_state->active = true;
     }
 
     /* We aren't switching contexts, so do nothing. Note that we may have
      * still updated the read and write surfaces above. */
-    egl_state_t *current_state = (egl_state_t *) CLIENT(client)->active_state;
+    current_state = (egl_state_t *) CLIENT(client)->active_state;
     if (current_state == new_state) {
         mutex_unlock (cached_gl_states_mutex);
         return;
@@ -161,76 +375,47 @@ _caching_client_make_current (client_t *client,
 
     /* Deactivate the old surface and clean up any previously destroyed bits of it. */
     if (current_state) {
-        mutex_lock (cached_gl_display_list_mutex);
         current_state->active = false;
-        EGLSurface temp = current_state->readable;
-
-        if (current_state->destroy_read) {
-            cached_gl_surface_destroy (display, current_state->readable);
-            current_state->readable = EGL_NO_SURFACE;
-        }
-        if (current_state->destroy_draw) {
-            if (temp != current_state->drawable)
-                cached_gl_surface_destroy (display, current_state->drawable);
-            current_state->drawable = EGL_NO_SURFACE;
-        }
-
-        if (current_state->destroy_dpy || current_state->destroy_ctx)
-            _caching_client_destroy_state (client, current_state);
-
-        if (current_state->destroy_ctx)
-            cached_gl_context_destroy (current_state->display,
-                                       current_state->context);
-        mutex_unlock (cached_gl_display_list_mutex);
+        __sync_synchronize ();
+        _caching_client_leave_state (client, current_state);
     }
 
     mutex_unlock (cached_gl_states_mutex);
 }
 
+/* The states drawing to or reading from the surface are marked, and the
+ * last of the active ones to be left forgets the surface. A state marks
+ * itself active before it looks at the marks, and we mark before we look
+ * at `active`, so one of us sees the other. */
 static void
 _caching_client_destroy_surface (client_t *client,
                                  EGLDisplay display,
                                  EGLSurface surface)
 {
-    egl_state_t *state;
-    link_list_t **states = cached_gl_states ();
-    link_list_t *list = *states;
-    link_list_t *current;
+    unsigned int count;
+    unsigned int i;
+    bool in_use = false;
 
-    mutex_lock (cached_gl_states_mutex);
-    if (! *states) {
-        mutex_unlock (cached_gl_states_mutex);
-        return;
+    registry_read_lock ();
+    egl_state_t **states = cached_gl_surface_find_states (display, surface, &count);
+    for (i = 0; i < count; i++) {
+        egl_state_t *state = states[i];
+        if (state->readable == surface)
+            state->destroy_read = true;
+        if (state->drawable == surface)
+            state->destroy_draw = true;
     }
+    __sync_synchronize ();
+    for (i = 0; i < count; i++)
+        in_use |= states[i]->active;
+    registry_read_unlock ();
 
-    while (list != NULL) {
-        current = list;
-        list = list->next;
-        state = (egl_state_t *)current->data;
-
-        if (state->display == display) {
-            if (state->readable == surface)
-                state->destroy_read = true;
-            if (state->drawable == surface)
-                state->destroy_draw = true;
-
-            if (state->active == false) {
-                if (state->readable == surface &&
-                    state->destroy_read == true)
-                    state->readable = EGL_NO_SURFACE;
-                if (state->drawable == surface &&
-                    state->destroy_draw == true)
-                    state->drawable = EGL_NO_SURFACE;
-
-                mutex_lock (cached_gl_display_list_mutex);
-                cached_gl_surface_destroy (display, surface);
-                mutex_unlock (cached_gl_display_list_mutex);
-            }
-
-        }
-    }
+    if (in_use)
+        return;
 
-    mutex_unlock (cached_gl_states_mutex);
+    mutex_lock (cached_gl_display_list_mutex);
+    cached_gl_surface_destroy (display, surface);
+    mutex_unlock (cached_gl_display_list_mutex);
 }
 
 static void
@@ -350,10 +535,11 @@ caching_client_glActiveTexture (void* client,
          * invalid object, we save here to save time in glGetError()
          */
         state->active_texture = texture;
-        /* reset texture binding */
-        state->texture_binding[0] = 0;
-        state->texture_binding[1] = 0;
-        state->texture_binding_3d = 0;
+        /* The bindings of the unit we switch to are still there. */
+        GLint *unit_binding = state->texture_unit_binding[texture - GL_TEXTURE0];
+        state->texture_binding[0] = unit_binding[0];
+        state->texture_binding[1] = unit_binding[1];
+        state->texture_binding_3d = unit_binding[2];
     }
 }
 
@@ -391,6 +577,133 @@ caching_client_glBindBuffer (void* client, GLenum target, GLuint buffer)
     }
 }
 
+static GLuint
+caching_client_buffer_binding (egl_state_t *state, GLenum target)
+{
+    if (target == GL_ARRAY_BUFFER)
+        return state->array_buffer_binding;
+    if (target == GL_ELEMENT_ARRAY_BUFFER)
+        return state->element_array_buffer_binding;
+    return 0;
+}
+
+static buffer_object_t *
+caching_client_lookup_buffer_object (egl_state_t *state, GLenum target)
+{
+    GLuint id = caching_client_buffer_binding (state, target);
+    if (! id)
+        return NULL;
+
+    share_group_lock (state->share_group);
+    buffer_object_t *buffer = hash_lookup (egl_state_get_buffer_objects (state), id);
+    share_group_unlock (state->share_group);
+    return buffer;
+}
+
+/* Drops the shadow of an element array buffer, see index_buffer_cache.h.
+ * Called with the share group locked. */
+static void
+caching_client_forget_index_buffer (egl_state_t *state,
+                                    GLuint id)
+{
+    HashTable *cache = egl_state_get_index_buffer_cache (state);
+    index_buffer_t *index_buffer = hash_lookup (cache, id);
+    if (! index_buffer)
+        return;
+
+    state->share_group->index_buffer_cache_size -= index_buffer->size;
+    hash_remove (cache, id);
+}
+
+static void
+caching_client_glBufferData (void* client, GLenum target, GLsizeiptr size,
+                             const void* data, GLenum usage)
+{
+    INSTRUMENT();
+
+    egl_state_t *state = client_get_current_state (CLIENT (client));
+    if (! state)
+        return;
+
+    /* Remember the size, glMapBufferOES needs it. */
+    GLuint id = caching_client_buffer_binding (state, target);
+    if (id && size >= 0 &&
+        (usage == GL_STREAM_DRAW || usage == GL_STATIC_DRAW || usage == GL_DYNAMIC_DRAW)) {
+        share_group_lock (state->share_group);
+        HashTable *buffer_objects = egl_state_get_buffer_objects (state);
+        buffer_object_t *buffer = hash_lookup (buffer_objects, id);
+        if (! buffer) {
+            buffer = buffer_object_new (id);
+            hash_insert (buffer_objects, id, buffer);
+        }
+        buffer_object_set_data (buffer, size, usage, data);
+        share_group_unlock (state->share_group);
+    }
+
+    /* Keep a copy of index data, glDrawElements needs it when the
+     * attributes are client arrays. A buffer filled through another
+     * target may still have a shadow from when it held indices. */
+    share_group_t *group = state->share_group;
+    if (id && group->index_buffer_cache_budget) {
+        share_group_lock (group);
+        HashTable *cache = egl_state_get_index_buffer_cache (state);
+        index_buffer_t *index_buffer = hash_lookup (cache, id);
+        size_t shadowed = group->index_buffer_cache_size -
+                          (index_buffer ? index_buffer->size : 0);
+        bool fits = size >= 0 &&
+            (usage == GL_STREAM_DRAW || usage == GL_STATIC_DRAW || usage == GL_DYNAMIC_DRAW) &&
+            shadowed + size <= group->index_buffer_cache_budget;
+
+        if (index_buffer && ! fits)
+            caching_client_forget_index_buffer (state, id);
+        else if (fits && (index_buffer || target == GL_ELEMENT_ARRAY_BUFFER)) {
+            if (! index_buffer) {
+                index_buffer = index_buffer_new (id);
+                hash_insert (cache, id, index_buffer);
+            }
+            index_buffer_set_data (index_buffer, size, data);
+            group->index_buffer_cache_size = shadowed + size;
+        }
+        share_group_unlock (group);
+    }
+
+    CACHING_CLIENT(client)->super_dispatch.glBufferData (client, target, size, data, usage);
+}
+
+static void
+caching_client_glBufferSubData (void* client, GLenum target, GLintptr offset,
+                                GLsizeiptr size, const void* data)
+{
+    INSTRUMENT();
+
+    egl_state_t *state = client_get_current_state (CLIENT (client));
+    if (! state)
+        return;
+
+    buffer_object_t *buffer = caching_client_lookup_buffer_object (state, target);
+    if (buffer && data) {
+        share_group_lock (state->share_group);
+        buffer_object_set_sub_data (buffer, offset, size, data);
+        share_group_unlock (state->share_group);
+    }
+
+    /* The shadow follows the buffer whichever target it is updated
+     * through. One that cannot be updated no longer matches it. */
+    GLuint id = caching_client_buffer_binding (state, target);
+    if (id) {
+        share_group_lock (state->share_group);
+        index_buffer_t *index_buffer =
+            hash_lookup (egl_state_get_index_buffer_cache (state), id);
+        if (index_buffer &&
+            (offset < 0 || size < 0 || ! data ||
+             ! index_buffer_set_sub_data (index_buffer, offset, size, data)))
+            caching_client_forget_index_buffer (state, id);
+        share_group_unlock (state->share_group);
+    }
+
+    CACHING_CLIENT(client)->super_dispatch.glBufferSubData (client, target, offset, size, data);
+}
+
 static void
 caching_client_glBindFramebuffer (void* client, GLenum target, GLuint framebuffer)
 {
@@ -462,20 +775,25 @@ caching_client_glBindTexture (void* client, GLenum target, GLuint texture)
     }
 
     /* look up in cache */
-    if (texture != 0 && !egl_state_lookup_cached_texture (state, texture)) {
-        name_handler_alloc_name (state->texture_name_handler, texture);
-        egl_state_create_cached_texture (state, texture);
+    if (texture != 0) {
+        share_group_lock (state->share_group);
+        if (! egl_state_lookup_cached_texture (state, texture)) {
+            name_handler_alloc_name (state->share_group->texture_name_handler, texture);
+            egl_state_create_cached_texture (state, texture);
+        }
+        share_group_unlock (state->share_group);
     }
 
     CACHING_CLIENT(client)->super_dispatch.glBindTexture (client, target, texture);
 
     /* FIXME: do we need to save them ? */
+    GLint *unit_binding = state->texture_unit_binding[state->active_texture - GL_TEXTURE0];
     if (target == GL_TEXTURE_2D)
-        state->texture_binding[0] = texture;
+        state->texture_binding[0] = unit_binding[0] = texture;
     else if (target == GL_TEXTURE_CUBE_MAP)
-        state->texture_binding[1] = texture;
+        state->texture_binding[1] = unit_binding[1] = texture;
     else
-        state->texture_binding_3d = texture;
+        state->texture_binding_3d = unit_binding[2] = texture;
 }
 
 static void
@@ -597,7 +915,7 @@ caching_client_glBlendFuncSeparate (void* client, GLenum srcRGB, GLenum dstRGB,
     state->blend_src[0] = srcRGB;
     state->blend_src[1] = srcAlpha;
     state->blend_dst[0] = dstRGB;
-    state->blend_dst[0] = dstAlpha;
+    state->blend_dst[1] = dstAlpha;
 
     CACHING_CLIENT(client)->super_dispatch.glBlendFuncSeparate (client, srcRGB, dstRGB, srcAlpha, dstAlpha);
 }
@@ -867,7 +1185,9 @@ caching_client_glCreateProgram (void* client)
     if (!state)
         return 0;
 
-    name_handler_alloc_names (state->shader_objects_name_handler, 1, &result);
+    share_group_lock (state->share_group);
+    name_handler_alloc_names (state->share_group->shader_objects_name_handler, 1, &result);
+    share_group_unlock (state->share_group);
     command = client_get_space_for_command (COMMAND_GLCREATEPROGRAM);
     command_glcreateprogram_init (command);
     ((command_glcreateprogram_t *)command)->result = result;
@@ -928,6 +1248,8 @@ caching_client_glDeleteProgram (void *client,
         return;
     }
 
+    /* The server may still be about to write the link status. */
+    client_wait_for_result_slot (CLIENT (client), &cached_program->base.status);
     egl_state_destroy_cached_shader_object (state, &cached_program->base);
 }
 
@@ -947,7 +1269,9 @@ caching_client_glCreateShader (void* client, GLenum shaderType)
     GLuint result = 0;
     command_t *command = client_get_space_for_command (COMMAND_GLCREATESHADER);
 
-    name_handler_alloc_names (state->shader_objects_name_handler, 1, &result);
+    share_group_lock (state->share_group);
+    name_handler_alloc_names (state->share_group->shader_objects_name_handler, 1, &result);
+    share_group_unlock (state->share_group);
     command_glcreateshader_init (command, shaderType);
     ((command_glcreateshader_t *)command)->result = result;
 
@@ -961,6 +1285,78 @@ caching_client_glCreateShader (void* client, GLenum shaderType)
     return result;
 }
 
+static shader_object_t *
+egl_state_lookup_cached_shader_err (void *client,
+                                    GLuint shader_object_id,
+                                    GLenum shader_error)
+{
+    egl_state_t *state = client_get_current_state (CLIENT (client));
+    if (!state)
+        return 0;
+
+    shader_object_t *cached_shader = egl_state_lookup_cached_shader_object (state, shader_object_id);
+    if (!cached_shader) {
+        caching_client_glSetError (client, shader_error);
+        return 0;
+    }
+
+    if (cached_shader->type != SHADER_OBJECT_SHADER) {
+        caching_client_glSetError (client, GL_INVALID_OPERATION);
+        return 0;
+    }
+
+    return cached_shader;
+}
+
+static void
+caching_client_glCompileShader (void* client,
+                                GLuint shader)
+{
+    INSTRUMENT();
+    egl_state_t *state = client_get_current_state (CLIENT (client));
+    if (! state)
+        return;
+
+    shader_t *cached_shader = (shader_t *) egl_state_lookup_cached_shader_err (client, shader, GL_INVALID_VALUE);
+    if (! cached_shader)
+        return;
+
+    cached_shader->compiled_source = cached_shader->source;
+
+    /* Compiling is asynchronous; the server leaves GL_COMPILE_STATUS
+     * in the shader's result slot, so only glGetShaderiv waits for it. */
+    command_t *command = client_get_space_for_command (COMMAND_GLCOMPILESHADER);
+    command_glcompileshader_init (command, shader);
+    ((command_glcompileshader_t *)command)->status = &cached_shader->base.status;
+
+    caching_client_set_needs_get_error (CLIENT (client));
+    client_run_command_async_filling_slot (command, &cached_shader->base.status);
+}
+
+static void
+caching_client_glGetShaderiv (void* client,
+                              GLuint shader,
+                              GLenum pname,
+                              GLint *params)
+{
+    INSTRUMENT();
+    egl_state_t *state = client_get_current_state (CLIENT (client));
+    if (! state)
+        return;
+
+    if (pname == GL_COMPILE_STATUS) {
+        shader_object_t *cached_shader = egl_state_lookup_cached_shader_err (client, shader, GL_INVALID_VALUE);
+        if (! cached_shader)
+            return;
+
+        client_wait_for_result_slot (CLIENT (client), &cached_shader->status);
+        *params = cached_shader->status.value;
+        return;
+    }
+
+    CACHING_CLIENT(client)->super_dispatch.glGetShaderiv (client, shader, pname, params);
+}
+
 static void
 caching_client_glShaderSource (void *client, GLuint shader, GLsizei count,
                                const GLchar **string, const GLint *length)
@@ -975,6 +1371,35 @@ caching_client_glShaderSource (void *client, GLuint shader, GLsizei count,
 	return;
     }
 
+    unsigned i = 0;
+    for (i = 0; i < count; i++) {
+        if (! string[i]) {
+            caching_client_glSetError (client, GL_INVALID_OPERATION);
+            return;
+        }
+    }
+
+    shader_t *cached_shader = (shader_t *) egl_state_lookup_cached_shader_err (client, shader, GL_INVALID_VALUE);
+    if (! cached_shader)
+        return;
+
+    caching_client_set_needs_get_error (CLIENT (client));
+
+    /* Identical sources are stored once per share group. Only a
+     * reference to the stored text goes through the command buffer. */
+    share_group_lock (state->share_group);
+    cached_shader->source = shader_source_cache_get (egl_state_get_shader_source_cache (state),
+                                                     count, string, length);
+    share_group_unlock (state->share_group);
+    if (cached_shader->source) {
+        command_t *command = client_get_space_for_command (COMMAND_GLSHADERSOURCE);
+        command_glshadersource_init (command, shader, 1, NULL, NULL);
+        ((command_glshadersource_t *)command)->source = cached_shader->source;
+        client_run_command_async (command);
+        return;
+    }
+
+    /* Another source already has this hash, send a private copy. */
     GLint *caching_client_length = NULL;
     if (length != NULL) {
         size_t lengths_size = sizeof (GLint *) * count;
@@ -985,21 +1410,9 @@ caching_client_glShaderSource (void *client, GLuint shader, GLsizei count,
     char **caching_client_string;
     caching_client_string = malloc (sizeof (GLchar *) * count);
 
-    unsigned i = 0;
-    int n;
     bool null_terminated = false;
 
     for (i = 0; i < count; i++) {
-        if (! string[i]) {
-            if (caching_client_length)
-                free (caching_client_length);
-            for (n = 0; n < i; n++)
-                free (caching_client_string[n]);
-            free (caching_client_string);
-            caching_client_glSetError (client, GL_INVALID_OPERATION);
-	    return;
-        }
-
         size_t string_length = length ? length[i] : strlen (string[i]);
         if (string_length < 0)
             string_length = strlen (string[i]);
@@ -1019,8 +1432,6 @@ caching_client_glShaderSource (void *client, GLuint shader, GLsizei count,
             caching_client_string[i][string_length] = 0;
     }
 
-    caching_client_set_needs_get_error (CLIENT (client));
-
     CACHING_CLIENT(client)->super_dispatch.glShaderSource(client, shader, count,
                                                           (const char **)caching_client_string,
                                                           caching_client_length);
@@ -1068,10 +1479,19 @@ caching_client_glDeleteBuffers (void* client, GLsizei n, const GLuint *buffers)
 
     CACHING_CLIENT(client)->super_dispatch.glDeleteBuffers (client, n, buffers);
 
-    name_handler_delete_names (state->buffer_name_handler, n, buffers);
+    share_group_lock (state->share_group);
+    name_handler_delete_names (state->share_group->buffer_name_handler, n, buffers);
+    share_group_unlock (state->share_group);
 
     /* check array_buffer_binding and element_array_buffer_binding */
+    HashTable *buffer_objects = egl_state_get_buffer_objects (state);
     for (i = 0; i < n; i++) {
+        if (buffers[i]) {
+            share_group_lock (state->share_group);
+            caching_client_forget_index_buffer (state, buffers[i]);
+            hash_remove (buffer_objects, buffers[i]);
+            share_group_unlock (state->share_group);
+        }
         if (buffers[i] == state->array_buffer_binding)
             state->array_buffer_binding = 0;
         else if (buffers[i] == state->element_array_buffer_binding)
@@ -1110,7 +1530,9 @@ caching_client_glDeleteFramebuffers (void* client, GLsizei n, const GLuint *fram
         return;
     }
 
-    name_handler_delete_names (state->framebuffer_name_handler, n, framebuffers);
+    share_group_lock (state->share_group);
+    name_handler_delete_names (state->share_group->framebuffer_name_handler, n, framebuffers);
+    share_group_unlock (state->share_group);
 
     CACHING_CLIENT(client)->super_dispatch.glDeleteFramebuffers (client, n, framebuffers);
 
@@ -1168,7 +1590,9 @@ caching_client_glDeleteRenderbuffers (void* client, GLsizei n, const GLuint *ren
         return;
     }
 
-    name_handler_delete_names (state->renderbuffer_name_handler, n, renderbuffers);
+    share_group_lock (state->share_group);
+    name_handler_delete_names (state->share_group->renderbuffer_name_handler, n, renderbuffers);
+    share_group_unlock (state->share_group);
 
     CACHING_CLIENT(client)->super_dispatch.glDeleteRenderbuffers (client, n, renderbuffers);
     int i;
@@ -1198,7 +1622,7 @@ caching_client_glDeleteRenderbuffers (void* client, GLsizei n, const GLuint *ren
 static void
 caching_client_glDeleteTextures (void* client, GLsizei n, const GLuint *textures)
 {
-    int i;
+    int i, unit, target;
 
     texture_t *tex = NULL;
     framebuffer_t *framebuffer = NULL;
@@ -1235,9 +1659,14 @@ caching_client_glDeleteTextures (void* client, GLsizei n, const GLuint *textures
             state->texture_binding[1] = 0;
         else if (state->texture_binding_3d == textures[i])
             state->texture_binding_3d = 0;
-        if (state->active_texture == textures[i])
-            state->active_texture = 0;
 
+        /* Deleting a texture unbinds it from every unit. */
+        for (unit = 0; unit < EGL_STATE_MAX_TEXTURE_UNITS; unit++) {
+            for (target = 0; target < 3; target++) {
+                if (state->texture_unit_binding[unit][target] == (GLint) textures[i])
+                    state->texture_unit_binding[unit][target] = 0;
+            }
+        }
     }
 }
 
@@ -1455,6 +1884,7 @@ caching_client_glSetVertexAttribArray (void* client,
         attribs[i].array_normalized = GL_FALSE;
         attribs[i].pointer = NULL;
         attribs[i].data = NULL;
+        attribs[i].in_vertex_cache = false;
         attribs[i].next_enabled = NULL;
         attribs[i].chunk = 0;
         attribs[i].array_buffer_binding = bound_buffer;
@@ -1476,6 +1906,7 @@ caching_client_glSetVertexAttribArray (void* client,
         new_attribs[count].array_normalized = GL_FALSE;
         new_attribs[count].pointer = NULL;
         new_attribs[count].data = NULL;
+        new_attribs[count].in_vertex_cache = false;
         new_attribs[count].next_enabled = NULL;
         new_attribs[count].chunk = 0;
         new_attribs[count].array_buffer_binding = bound_buffer;
@@ -1528,8 +1959,10 @@ caching_client_clear_attribute_list_data (client_t *client)
     vertex_attrib_list_t *attrib_list = &state->vertex_attribs;
 
     int i = -1;
-    for (i = 0; i < attrib_list->count; i++)
+    for (i = 0; i < attrib_list->count; i++) {
         attrib_list->attribs[i].data = NULL;
+        attrib_list->attribs[i].in_vertex_cache = false;
+    }
 }
 
 static bool
@@ -1564,37 +1997,206 @@ caching_client_vertex_chunk_size (vertex_attrib_t *first,
     return stride * count + (char *)last->pointer - (char*) first->pointer;
 }
 
+/* Smaller chunks cost less to copy than to fingerprint and look up. */
+#define VERTEX_CACHE_MIN_CHUNK_SIZE 1024
+
 static void
-caching_client_setup_vertex_attrib_pointer_if_necessary (client_t *client,
-                                                         size_t count,
-                                                         command_t **command,
-                                                         size_t *array_size,
-                                                         size_t index_array_size)
+caching_client_vertex_cache_delete_buffer (GLuint buffer,
+                                           void *client)
 {
-    INSTRUMENT();
-
     egl_state_t *state = client_get_current_state (CLIENT (client));
-    if (! state)
+    CACHING_CLIENT(client)->super_dispatch.glDeleteBuffers (client, 1, &buffer);
+    share_group_lock (state->share_group);
+    name_handler_delete_names (state->share_group->buffer_name_handler, 1, &buffer);
+    share_group_unlock (state->share_group);
+}
+
+/* Deletes the vertex cache buffers of contexts of the group that are
+ * gone. */
+static void
+caching_client_delete_released_buffers (client_t *client,
+                                        egl_state_t *state)
+{
+    share_group_t *group = state->share_group;
+    if (! __atomic_load_n (&group->released_buffer_count, __ATOMIC_RELAXED))
         return;
 
-    vertex_attrib_list_t *attrib_list = &state->vertex_attribs;
-    vertex_attrib_t *enabled_attrib = attrib_list->enabled_attribs;
+    GLuint *buffers;
+    unsigned int count = share_group_take_released_buffers (group, &buffers);
+    if (! count)
+        return;
 
-    size_t draw_command_size = index_array_size ?
-        command_get_size (COMMAND_GLDRAWELEMENTS) :
-        command_get_size (COMMAND_GLDRAWARRAYS);
-    size_t commands_size =
-        command_get_size (COMMAND_GLVERTEXATTRIBPOINTER) * attrib_list->enabled_count +
-        draw_command_size;
+    CACHING_CLIENT(client)->super_dispatch.glDeleteBuffers (client, count, buffers);
+    share_group_lock (group);
+    name_handler_delete_names (group->buffer_name_handler, count, buffers);
+    share_group_unlock (group);
+    free (buffers);
+}
 
-    command_t *glDraw_command = NULL;
-    *command = client_get_space_for_size (client, commands_size + index_array_size);
+static bool
+caching_client_vertex_cache_upload (client_t *client,
+                                    egl_state_t *state,
+                                    vertex_cache_entry_t *entry,
+                                    const void *data)
+{
+    if (! vertex_cache_make_room (state->vertex_cache, entry->size,
+                                  caching_client_vertex_cache_delete_buffer,
+                                  client))
+        return false;
+
+    GLuint buffer;
+    share_group_lock (state->share_group);
+    name_handler_alloc_names (state->share_group->buffer_name_handler, 1, &buffer);
+    share_group_unlock (state->share_group);
+    GLuint *server_buffer = (GLuint *)malloc (sizeof (GLuint));
+    *server_buffer = buffer;
+
+    CACHING_CLIENT(client)->super_dispatch.glGenBuffers (client, 1, server_buffer);
+    CACHING_CLIENT(client)->super_dispatch.glBindBuffer (client, GL_ARRAY_BUFFER, buffer);
+    CACHING_CLIENT(client)->super_dispatch.glBufferData (client, GL_ARRAY_BUFFER,
+                                                         entry->size, data,
+                                                         GL_STATIC_DRAW);
+
+    vertex_cache_set_buffer (state->vertex_cache, entry, buffer);
+    return true;
+}
+
+/* Points the attributes of every client array chunk the server already
+ * holds in a vertex cache buffer at that buffer, and marks them so that
+ * their data is not copied again. The buffers hold the chunks from vertex
+ * 0, the attributes point at `first_vertex`. Returns the number of
+ * enabled attributes that still need to be sent with the draw. */
+static int
+caching_client_setup_cached_vertex_attribs (client_t *client,
+                                            egl_state_t *state,
+                                            size_t first_vertex,
+                                            size_t count)
+{
+    vertex_attrib_list_t *attrib_list = &state->vertex_attribs;
+    vertex_attrib_t *enabled_attrib = attrib_list->enabled_attribs;
+    vertex_cache_t *cache = state->vertex_cache;
+    int remaining_count = attrib_list->enabled_count;
+    bool bound_cache_buffer = false;
+    bool need_get_error = state->need_get_error;
+
+    caching_client_delete_released_buffers (client, state);
+    vertex_cache_begin_draw (cache);
+
+    while (enabled_attrib) {
+        vertex_attrib_t *first = enabled_attrib;
+        vertex_attrib_t *last = enabled_attrib;
+
+        while (enabled_attrib && (first->chunk == enabled_attrib->chunk)) {
+            last = enabled_attrib;
+            enabled_attrib = enabled_attrib->next_enabled;
+        }
+
+        size_t chunk_size = caching_client_vertex_chunk_size (first, last,
+                                                              first_vertex + count);
+        if (chunk_size < VERTEX_CACHE_MIN_CHUNK_SIZE)
+            continue;
+        size_t skipped_size =
+            chunk_size - caching_client_vertex_chunk_size (first, last, count);
+
+        uint64_t fingerprint = vertex_cache_fingerprint (first->pointer, chunk_size);
+        vertex_cache_entry_t *entry =
+            vertex_cache_lookup (cache, fingerprint, chunk_size,
+                                 caching_client_vertex_cache_delete_buffer,
+                                 client);
+        if (! entry)
+            continue;
+
+        /* Only chunks seen in an earlier draw are worth a buffer. */
+        if (entry->buffer) {
+            CACHING_CLIENT(client)->super_dispatch.glBindBuffer (client, GL_ARRAY_BUFFER,
+                                                                 entry->buffer);
+        } else if (entry->uses < 2 ||
+                   ! caching_client_vertex_cache_upload (client, state, entry,
+                                                         first->pointer)) {
+            continue;
+        }
+        bound_cache_buffer = true;
+
+        last = first;
+        while (last && (first->chunk == last->chunk)) {
+            CACHING_CLIENT(client)->super_dispatch.glVertexAttribPointer (client,
+                last->index, last->size, last->type, last->array_normalized,
+                last->stride,
+                (const void *)((char *)last->pointer - (char *)first->pointer +
+                               skipped_size));
+            last->in_vertex_cache = true;
+            remaining_count--;
+            last = last->next_enabled;
+        }
+    }
+
+    if (bound_cache_buffer)
+        CACHING_CLIENT(client)->super_dispatch.glBindBuffer (client, GL_ARRAY_BUFFER,
+                                                             state->array_buffer_binding);
+
+    /* These calls are ours, they must not change the error the
+     * application sees. */
+    state->need_get_error = need_get_error;
+    return remaining_count;
+}
+
+/* Draws can only be renumbered to start at the first vertex copied from
+ * client arrays when no enabled attribute reads from a buffer object. */
+static bool
+caching_client_can_rebase_draw (egl_state_t *state)
+{
+    vertex_attrib_list_t *attrib_list = &state->vertex_attribs;
+    int i;
+
+    for (i = 0; i < attrib_list->count; i++) {
+        if (attrib_list->attribs[i].array_enabled &&
+            attrib_list->attribs[i].array_buffer_binding)
+            return false;
+    }
+    return true;
+}
+
+/* Copies vertices [first_vertex, first_vertex + count) of the enabled
+ * client arrays into the command buffer and points the attributes at the
+ * first of them, so the draw must number the vertices from
+ * `first_vertex`. */
+static void
+caching_client_setup_vertex_attrib_pointer_if_necessary (client_t *client,
+                                                         size_t first_vertex,
+                                                         size_t count,
+                                                         command_t **command,
+                                                         size_t *array_size,
+                                                         size_t index_array_size)
+{
+    INSTRUMENT();
+
+    egl_state_t *state = client_get_current_state (CLIENT (client));
+    if (! state)
+        return;
+
+    vertex_attrib_list_t *attrib_list = &state->vertex_attribs;
+    vertex_attrib_t *enabled_attrib = attrib_list->enabled_attribs;
+
+    int enabled_count = attrib_list->enabled_count;
+    if (state->vertex_cache)
+        enabled_count = caching_client_setup_cached_vertex_attribs (client, state,
+                                                                    first_vertex, count);
+
+    size_t draw_command_size = index_array_size ?
+        command_get_size (COMMAND_GLDRAWELEMENTS) :
+        command_get_size (COMMAND_GLDRAWARRAYS);
+    size_t commands_size =
+        command_get_size (COMMAND_GLVERTEXATTRIBPOINTER) * enabled_count +
+        draw_command_size;
+
+    command_t *glDraw_command = NULL;
+    *command = client_get_space_for_size (client, commands_size + index_array_size);
     if (! *command)
         goto BIG_DATA;
 
     glDraw_command = (command_t *)((char*)*command +
                                    command_get_size (COMMAND_GLVERTEXATTRIBPOINTER) *
-                                   attrib_list->enabled_count);
+                                   enabled_count);
 
     int attrib_count = 0;
     while (enabled_attrib) {
@@ -1608,9 +2210,14 @@ caching_client_setup_vertex_attrib_pointer_if_necessary (client_t *client,
             enabled_attrib = enabled_attrib->next_enabled;
         }
 
+        if (first->in_vertex_cache)
+            continue;
+
         chunk_size = caching_client_vertex_chunk_size (first, last, count);
         if (! chunk_size)
             return;
+        size_t skipped_size =
+            caching_client_vertex_chunk_size (first, last, first_vertex + count) - chunk_size;
 
         *array_size += chunk_size;
 
@@ -1621,7 +2228,7 @@ caching_client_setup_vertex_attrib_pointer_if_necessary (client_t *client,
             goto BIG_DATA;
 
         char *chunk_location = (char *)*command + commands_size + *array_size - chunk_size;
-        memcpy (chunk_location, first->pointer, chunk_size);
+        memcpy (chunk_location, (char *)first->pointer + skipped_size, chunk_size);
 
         last = first;
         while (last && (first->chunk == last->chunk)) {
@@ -1702,15 +2309,20 @@ caching_client_glDrawArrays (void* client,
         }
     }
 
+    /* Only the drawn vertices are copied, and the draw starts at the
+     * first of them unless buffer objects hold some of the attributes. */
     command_t *command = NULL;
     size_t array_size = 0;
     if (! state->vertex_array_binding) {
-        size_t true_count = first > 0 ? first + count : count;
+        bool rebase = caching_client_can_rebase_draw (state);
         caching_client_setup_vertex_attrib_pointer_if_necessary (CLIENT(client),
-                                                                 true_count,
+                                                                 rebase ? first : 0,
+                                                                 rebase ? count : first + count,
                                                                  &command,
                                                                  &array_size,
                                                                  0);
+        if (command && rebase)
+            first = 0;
     }
 
     if (!command)
@@ -1729,117 +2341,6 @@ caching_client_glDrawArrays (void* client,
         caching_client_set_needs_get_error (CLIENT (client));
 }
 
-#ifdef __ARM_NEON__
-#include <arm_neon.h>
-union __char_result {
-    unsigned char     chars[16];
-    uint8x16_t result;
-};
-
-union __short_result {
-    uint16x8_t result;
-    unsigned short shorts[8];
-};
-
-static size_t
-_get_elements_count (GLenum type, const GLvoid *indices, GLsizei count)
-{
-    uint8x16_t *char_indices;
-    unsigned char *char_idx;
-    uint16x8_t *short_indices;
-    unsigned short *short_idx;
-
-    size_t elements_count = 0;
-    int i;
-    int num;
-    int remain;
-    int j;
-
-    union __short_result short_result = { {0, 0, 0, 0,
-                                           0, 0, 0, 0} };
-    union __char_result char_result = { {0, 0, 0, 0,
-                                        0, 0, 0, 0,
-                                        0, 0, 0, 0,
-                                        0, 0, 0, 0 } };
-
-    INSTRUMENT();
-
-    if (type == GL_UNSIGNED_BYTE) {
-        num = count / 16;
-        remain = count - num * 16;
-    }
-    else {
-        num = count / 8;
-        remain = count - num * 8;
-    }
-
-    if (type == GL_UNSIGNED_BYTE) {
-        char_indices = (uint8x16_t *)indices;
-        for (i = 0; i < num ; i++) {
-            char_result.result = vmaxq_u8 (*(char_indices + i),
-                                           char_result.result);
-        }
-        char_idx = (unsigned char *)char_result.chars;
-        for (j = 0; j < 16; j++) {
-            if (elements_count < (size_t)char_idx[j])
-                elements_count = (size_t)char_idx[j];
-        }
-        char_idx = (unsigned char *)indices + num * 16;
-        for (i = 0; i < remain; i++) {
-            if ((size_t) char_idx[i] > elements_count)
-                elements_count = (size_t) char_idx[i];
-        }
-    }
-    else {
-        short_indices = (uint16x8_t *)indices;
-        for (i = 0; i < num ; i++) {
-            short_result.result = vmaxq_u16 (*(short_indices + i),
-                                             short_result.result);
-        }
-        short_idx = (unsigned short *)short_result.shorts;
-        for (j = 0; j < 8; j++) {
-            if (elements_count < (size_t)short_idx[j])
-                elements_count = (size_t)short_idx[j];
-        }
-        short_idx = (unsigned short *)indices + num * 8;
-        for (i = 0; i < (size_t) remain; i++) {
-            if ((size_t)short_idx[i] > elements_count)
-                elements_count = (size_t)short_idx[i];
-        }
-    }
-
-    return elements_count + 1;
-}
-#else
-static size_t
-_get_elements_count (GLenum type, const GLvoid *indices, GLsizei count)
-{
-    unsigned char *char_indices = NULL;
-    unsigned short *short_indices = NULL;
-    size_t elements_count = 0;
-    size_t i;
-
-    INSTRUMENT();
-
-    if (type == GL_UNSIGNED_BYTE) {
-        char_indices = (unsigned char *)indices;
-        for (i = 0; i < (size_t) count; i++) {
-            if ((size_t) char_indices[i] > elements_count)
-                elements_count = (size_t) char_indices[i];
-        }
-    }
-    else {
-        short_indices = (unsigned short *)indices;
-        for (i = 0; i < (size_t) count; i++) {
-            if ((size_t)short_indices[i] > elements_count)
-                elements_count = (size_t)short_indices[i];
-        }
-    }
-
-    return elements_count + 1;
-}
-#endif
-
 static size_t
 calculate_index_array_size (GLenum type,
                             int count)
@@ -1848,6 +2349,8 @@ calculate_index_array_size (GLenum type,
        return sizeof (char) * count;
     if (type == GL_UNSIGNED_SHORT)
         return sizeof (unsigned short) * count;
+    if (type == GL_UNSIGNED_INT)
+        return sizeof (unsigned int) * count;
     return 0;
 }
 
@@ -1916,34 +2419,64 @@ caching_client_glDrawElements (void* client,
     command_gldrawelements_t *command = NULL;
     size_t array_size = 0;
 
-    /* FIXME:  We do not handle where indices is in element_array_buffer
-       while vertex attribs are not in array_buffer, because in
-       this case, we could not compute the number of vertex attrib
-       elements */
-    if (copy_indices) {
-        size_t elements_count = _get_elements_count (type, indices, count);
+    /* The vertices to copy along with client arrays are the range the
+     * indices cover. When the indices are in an element array buffer the
+     * range comes from the client's copy of its contents. */
+    GLuint min_index = 0;
+    GLuint max_index = 0;
+    bool copy_vertices = false;
+    if (copy_indices)
+        copy_vertices = index_range_scan (type, indices, count, &min_index, &max_index);
+    else if (! state->vertex_array_binding && state->vertex_attribs.enabled_attribs) {
+        share_group_lock (state->share_group);
+        index_buffer_t *index_buffer =
+            hash_lookup (egl_state_get_index_buffer_cache (state),
+                         state->element_array_buffer_binding);
+        copy_vertices = index_buffer &&
+            index_buffer_get_range (index_buffer, type, (size_t) indices, count,
+                                    &min_index, &max_index);
+        share_group_unlock (state->share_group);
+    }
+
+    /* Copied indices are renumbered to start at the first vertex copied;
+     * indices in a buffer object, or attributes in one, need the vertices
+     * from 0. */
+    bool rebase = copy_vertices && copy_indices &&
+                  caching_client_can_rebase_draw (state);
+    if (copy_vertices && ! rebase)
+        min_index = 0;
+
+    if (copy_vertices) {
+        size_t copied_index_size = copy_indices ? index_array_size : 0;
         caching_client_setup_vertex_attrib_pointer_if_necessary (
             CLIENT (client),
-            elements_count,
+            min_index,
+            max_index - min_index + 1,
             (command_t **)&command,
             &array_size,
-            index_array_size);
+            copied_index_size);
 
         if (command) {
             ((command_t *)command)->type = COMMAND_GLDRAWELEMENTS;
-            ((command_t *)command)->size = command_get_size (COMMAND_GLDRAWELEMENTS) + array_size + index_array_size;
+            ((command_t *)command)->size = command_get_size (COMMAND_GLDRAWELEMENTS) + array_size + copied_index_size;
             ((command_t *)command)->token = 0;
-            indices_to_pass = ((char *) command) + command_get_size (COMMAND_GLDRAWELEMENTS) + array_size;
-        } else
+            if (copy_indices)
+                indices_to_pass = ((char *) command) + command_get_size (COMMAND_GLDRAWELEMENTS) + array_size;
+        } else if (copy_indices)
             indices_to_pass = malloc (index_array_size);
 
-        memcpy (indices_to_pass, indices, index_array_size);
+        if (command && rebase)
+            index_range_copy_rebased (type, indices_to_pass, indices, count, min_index);
+        else if (copy_indices)
+            memcpy (indices_to_pass, indices, index_array_size);
     }
 
     if (! command)
         command = (command_gldrawelements_t *) client_get_space_for_command (COMMAND_GLDRAWELEMENTS);
 
     command_gldrawelements_init (&command->header, mode, count, type, indices_to_pass);
+    if (copy_vertices)
+        command->vertex_count = max_index - min_index + 1;
     client_run_command_async (&command->header);
 
 finish:
@@ -2067,7 +2600,9 @@ caching_client_glGenBuffers (void* client, GLsizei n, GLuint *buffers)
         return;
     }
 
-    name_handler_alloc_names (state->buffer_name_handler, n, buffers);
+    share_group_lock (state->share_group);
+    name_handler_alloc_names (state->share_group->buffer_name_handler, n, buffers);
+    share_group_unlock (state->share_group);
     GLuint *server_buffers = (GLuint *)malloc (n * sizeof (GLuint));
     memcpy (server_buffers, buffers, n * sizeof (GLuint));
 
@@ -2089,7 +2624,9 @@ caching_client_glGenFramebuffers (void* client, GLsizei n, GLuint *framebuffers)
         return;
     }
 
-    name_handler_alloc_names (state->framebuffer_name_handler, n, framebuffers);
+    share_group_lock (state->share_group);
+    name_handler_alloc_names (state->share_group->framebuffer_name_handler, n, framebuffers);
+    share_group_unlock (state->share_group);
     GLuint *server_framebuffers = (GLuint *)malloc (n * sizeof (GLuint));
     memcpy (server_framebuffers, framebuffers, n * sizeof (GLuint));
 
@@ -2116,7 +2653,9 @@ caching_client_glGenRenderbuffers (void* client, GLsizei n, GLuint *renderbuffer
         return;
     }
 
-    name_handler_alloc_names (state->renderbuffer_name_handler, n, renderbuffers);
+    share_group_lock (state->share_group);
+    name_handler_alloc_names (state->share_group->renderbuffer_name_handler, n, renderbuffers);
+    share_group_unlock (state->share_group);
     GLuint *server_renderbuffers = (GLuint *)malloc (n * sizeof (GLuint));
     memcpy (server_renderbuffers, renderbuffers, n * sizeof (GLuint));
 
@@ -2144,7 +2683,9 @@ caching_client_glGenTextures (void* client, GLsizei n, GLuint *textures)
         return;
     }
 
-    name_handler_alloc_names (state->texture_name_handler, n, textures);
+    share_group_lock (state->share_group);
+    name_handler_alloc_names (state->share_group->texture_name_handler, n, textures);
+    share_group_unlock (state->share_group);
 
     GLuint *server_textures = (GLuint *)malloc (n * sizeof (GLuint));
     memcpy (server_textures, textures, n * sizeof (GLuint));
@@ -2246,6 +2787,120 @@ caching_client_glGetAttribLocation (void* client,
     return result;
 }
 
+/* Two links with the same key produce the same program, so the server
+ * can reuse the driver binary of the first one instead of linking again.
+ * Sharing the server program itself is not possible because uniform
+ * values belong to the program object. */
+static char *
+caching_client_program_link_key (egl_state_t *state,
+                                 program_t *program)
+{
+    unsigned int serials[2];
+    int i;
+    for (i = 0; i < 2; i++) {
+        shader_t *shader = (shader_t *) egl_state_lookup_cached_shader_object (state, program->attached_shaders[i]);
+        if (! program->attached_shaders[i] || ! shader || ! shader->compiled_source)
+            return NULL;
+        serials[i] = shader->compiled_source->serial;
+    }
+
+    if (serials[0] > serials[1]) {
+        unsigned int swap = serials[0];
+        serials[0] = serials[1];
+        serials[1] = swap;
+    }
+
+    size_t key_length = 2 * 11 + 2;
+    link_list_t *current = program->attrib_bindings;
+    while (current) {
+        attrib_binding_t *binding = current->data;
+        key_length += 11 + 2 + strlen (binding->name);
+        current = current->next;
+    }
+
+    char *key = malloc (key_length);
+    int offset = sprintf (key, "%u %u\n", serials[0], serials[1]);
+    for (current = program->attrib_bindings; current; current = current->next) {
+        attrib_binding_t *binding = current->data;
+        offset += sprintf (key + offset, "%u %s\n", binding->index, binding->name);
+    }
+    return key;
+}
+
+static void
+caching_client_glAttachShader (void* client,
+                               GLuint program,
+                               GLuint shader)
+{
+    INSTRUMENT();
+    egl_state_t *state = client_get_current_state (CLIENT (client));
+    if (! state)
+        return;
+
+    CACHING_CLIENT(client)->super_dispatch.glAttachShader (client, program, shader);
+
+    program_t *saved_program = (program_t *) egl_state_lookup_cached_shader_object (state, program);
+    if (! saved_program || saved_program->base.type != SHADER_OBJECT_PROGRAM)
+        return;
+
+    /* GLES2 allows one shader of each type. A third attach fails on the
+     * server, leaving nothing to remember here. */
+    int i;
+    for (i = 0; i < 2; i++) {
+        if (saved_program->attached_shaders[i] == shader)
+            return;
+    }
+    for (i = 0; i < 2; i++) {
+        if (! saved_program->attached_shaders[i]) {
+            saved_program->attached_shaders[i] = shader;
+            return;
+        }
+    }
+}
+
+static void
+caching_client_glDetachShader (void* client,
+                               GLuint program,
+                               GLuint shader)
+{
+    INSTRUMENT();
+    egl_state_t *state = client_get_current_state (CLIENT (client));
+    if (! state)
+        return;
+
+    CACHING_CLIENT(client)->super_dispatch.glDetachShader (client, program, shader);
+
+    program_t *saved_program = (program_t *) egl_state_lookup_cached_shader_object (state, program);
+    if (! saved_program || saved_program->base.type != SHADER_OBJECT_PROGRAM)
+        return;
+
+    int i;
+    for (i = 0; i < 2; i++) {
+        if (saved_program->attached_shaders[i] == shader)
+            saved_program->attached_shaders[i] = 0;
+    }
+}
+
+static void
+caching_client_glBindAttribLocation (void* client,
+                                     GLuint program,
+                                     GLuint index,
+                                     const GLchar *name)
+{
+    INSTRUMENT();
+    egl_state_t *state = client_get_current_state (CLIENT (client));
+    if (! state)
+        return;
+
+    CACHING_CLIENT(client)->super_dispatch.glBindAttribLocation (client, program, index, name);
+
+    program_t *saved_program = (program_t *) egl_state_lookup_cached_shader_object (state, program);
+    if (! saved_program || saved_program->base.type != SHADER_OBJECT_PROGRAM || ! name)
+        return;
+
+    program_bind_attrib_location (saved_program, index, name);
+}
+
 static void
 caching_client_glLinkProgram (void* client,
                               GLuint program)
@@ -2258,7 +2913,40 @@ caching_client_glLinkProgram (void* client,
     if (!saved_program)
         return;
 
-    CACHING_CLIENT(client)->super_dispatch.glLinkProgram (client, program);
+    /* Like glCompileShader, linking does not block the client. Draws
+     * and location queries are ordered after the link by the buffer. */
+    command_t *command = client_get_space_for_command (COMMAND_GLLINKPROGRAM);
+    command_gllinkprogram_init (command, program);
+    ((command_gllinkprogram_t *)command)->status = &saved_program->base.status;
+    ((command_gllinkprogram_t *)command)->link_key =
+        caching_client_program_link_key (state, saved_program);
+
+    caching_client_set_needs_get_error (CLIENT (client));
+    client_run_command_async_filling_slot (command, &saved_program->base.status);
+}
+
+static void
+caching_client_glGetProgramiv (void* client,
+                               GLuint program,
+                               GLenum pname,
+                               GLint *params)
+{
+    INSTRUMENT();
+    egl_state_t *state = client_get_current_state (CLIENT (client));
+    if (! state)
+        return;
+
+    if (pname == GL_LINK_STATUS) {
+        program_t *saved_program = egl_state_lookup_cached_program_err (client, program, GL_INVALID_VALUE);
+        if (! saved_program)
+            return;
+
+        client_wait_for_result_slot (CLIENT (client), &saved_program->base.status);
+        *params = saved_program->base.status.value;
+        return;
+    }
+
+    CACHING_CLIENT(client)->super_dispatch.glGetProgramiv (client, program, pname, params);
 }
 
 static GLint
@@ -2408,8 +3096,10 @@ caching_client_glGetString (void* client, GLenum name)
 
     result = CACHING_CLIENT(client)->super_dispatch.glGetString (client, name);
 
-    if (result == 0)
+    if (result == 0) {
         caching_client_set_needs_get_error (CLIENT (client));
+        return NULL;
+    }
 
     length = strlen ((char *)result);
     switch (name) {
@@ -2434,17 +3124,18 @@ caching_client_glGetString (void* client, GLenum name)
         state->shading_language_version_string[length] = 0;
         break;
     case GL_EXTENSIONS:
-        state->extensions_string = (char *)malloc (sizeof (char) * (length+1));
-        memcpy (state->extensions_string, result, length);
-        state->extensions_string[length] = 0;
-
-        state->supports_element_index_uint = strstr (state->extensions_string, "GL_OES_element_index_uint") ? true : false;
-        state->supports_bgra = strstr (state->extensions_string, "GL_EXT_texture_format_BGRA8888") ? true : false;
+        egl_state_set_extensions_string (state, (const char *)result);
         break;
     default:
-        break;
+        return result;
     }
 
+    /* New contexts of the display, in this run and the next ones, start
+     * out knowing it. */
+    driver_capabilities_add_string (state, name, (const char *)result);
+
+    if (name == GL_EXTENSIONS)
+        return (const GLubyte *)state->extensions_string;
     return result;
 }
 
@@ -2604,8 +3295,13 @@ caching_client_glGetVertexAttribfv (void* client, GLuint index, GLenum pname,
     if (caching_client_does_index_overflow (client, index))
         return;
 
+    if (pname == GL_CURRENT_VERTEX_ATTRIB && index < EGL_STATE_MAX_VERTEX_ATTRIBS) {
+        memcpy (params, state->vertex_attrib_values[index], sizeof (GLfloat) * 4);
+        return;
+    }
+
     /* we cannot use client state */
-    if (state->vertex_array_binding) {
+    if (state->vertex_array_binding || pname == GL_CURRENT_VERTEX_ATTRIB) {
         caching_client_set_needs_get_error (CLIENT (client));
         CACHING_CLIENT(client)->super_dispatch.glGetVertexAttribfv (client, index, pname, params);
         return;
@@ -2633,9 +3329,6 @@ caching_client_glGetVertexAttribfv (void* client, GLuint index, GLenum pname,
             case GL_VERTEX_ATTRIB_ARRAY_NORMALIZED:
                 *params = attribs[i].array_normalized;
                 break;
-            default:
-                memcpy (params, attribs[i].current_attrib, sizeof (GLfloat) * 4);
-                break;
             }
             return;
         }
@@ -2661,9 +3354,6 @@ caching_client_glGetVertexAttribfv (void* client, GLuint index, GLenum pname,
     case GL_VERTEX_ATTRIB_ARRAY_NORMALIZED:
         *params = GL_FALSE;
         break;
-    default:
-        memset (params, 0, sizeof (GLfloat) * 4);
-        break;
     }
 }
 
@@ -2841,6 +3531,11 @@ caching_client_glPixelStorei (void* client, GLenum pname, GLint param)
     if (! state)
         return;
 
+    if (pname == GL_PACK_ASYNC_READ_PIXELS_GPUPROCESS) {
+        state->pack_async_read_pixels = param ? true : false;
+        return;
+    }
+
     if ((pname == GL_PACK_ALIGNMENT && state->pack_alignment == param) ||
         (pname == GL_UNPACK_ALIGNMENT && state->unpack_alignment == param) ||
         (pname == GL_UNPACK_ROW_LENGTH && state->unpack_row_length == param) ||
@@ -2881,6 +3576,33 @@ caching_client_glPixelStorei (void* client, GLenum pname, GLint param)
     CACHING_CLIENT(client)->super_dispatch.glPixelStorei (client, pname, param);
 }
 
+/* With GL_GPUPROCESS_async_read_pixels the server writes the pixels
+ * straight into the application's memory, which it shares as a thread of
+ * the same process, and the application waits on a later fence. */
+static void
+caching_client_glReadPixels (void* client, GLint x, GLint y,
+                             GLsizei width, GLsizei height,
+                             GLenum format, GLenum type, void *pixels)
+{
+    INSTRUMENT();
+
+    egl_state_t *state = client_get_current_state (CLIENT (client));
+    if (! state)
+        return;
+
+    if (! state->pack_async_read_pixels || ! pixels) {
+        CACHING_CLIENT(client)->super_dispatch.glReadPixels (client, x, y, width, height,
+                                                             format, type, pixels);
+        return;
+    }
+
+    caching_client_set_needs_get_error (CLIENT (client));
+
+    command_t *command = client_get_space_for_command (COMMAND_GLREADPIXELS);
+    command_glreadpixels_init (command, x, y, width, height, format, type, pixels);
+    client_run_command_async (command);
+}
+
 static void
 caching_client_glPolygonOffset (void* client, GLfloat factor, GLfloat units)
 {
@@ -3264,27 +3986,293 @@ caching_client_glTexParameterf (void* client, GLenum target, GLenum pname, GLflo
     caching_client_glTexParameteri (client, target, pname, parami);
 }
 
-static void
-caching_client_glTexImage2D (void* client, GLenum target, GLint level,
-                             GLint internalformat, GLsizei width,
-                             GLsizei height, GLint border, GLenum format,
-                             GLenum type, const void *pixels)
+/* Texture uploads are repacked straight into the command buffer, right
+ * after their command, instead of into a heap copy. Images that do not
+ * fit in a quarter of the buffer are sent as bands of rows with
+ * glTexSubImage2D, so the server can upload one band while the next one
+ * is written. */
+static size_t
+caching_client_texture_band_budget (client_t *client)
 {
-    GLuint tex_id;
-
-    egl_state_t *state = client_get_current_state (CLIENT (client));
+    return client_get_buffer_size (client) / 4;
+}
 
-    INSTRUMENT();
+typedef struct _texture_upload {
+    uint32_t size;
+    uint32_t unpadded_row_size;
+    uint32_t padded_row_size;
+    uint32_t source_padded_row_size;
+} texture_upload_t;
 
-    if (! state)
-        return;
+static bool
+caching_client_compute_texture_upload (egl_state_t *state,
+                                       GLsizei width,
+                                       GLsizei height,
+                                       GLenum format,
+                                       GLenum type,
+                                       texture_upload_t *upload)
+{
+    if (! width || ! height)
+        return false;
+    return compute_image_data_sizes (width, height, format, type,
+                                     state->unpack_alignment, &upload->size,
+                                     &upload->unpadded_row_size,
+                                     &upload->padded_row_size) &&
+           compute_image_source_row_size (width, format, type,
+                                          state->unpack_alignment,
+                                          state->unpack_row_length,
+                                          &upload->source_padded_row_size);
+}
+
+/* Row length, skip rows and skip pixels are not forwarded to the server,
+ * so the rows are repacked as the server expects them. */
+static void
+caching_client_copy_texture_rows (egl_state_t *state,
+                                  const texture_upload_t *upload,
+                                  const void *pixels,
+                                  void *destination,
+                                  GLenum format,
+                                  GLenum type,
+                                  GLsizei first_row,
+                                  GLsizei rows)
+{
+    copy_rect_to_buffer ((const char *) pixels + first_row * upload->source_padded_row_size,
+                         destination, format, type, rows,
+                         state->unpack_skip_pixels, state->unpack_skip_rows,
+                         upload->unpadded_row_size, upload->source_padded_row_size,
+                         upload->padded_row_size);
+}
+
+static command_t *
+caching_client_get_space_for_texture_upload (client_t *client,
+                                             command_type_t command_type,
+                                             size_t pixels_size)
+{
+    size_t size = command_get_size (command_type) + pixels_size;
+    size = (size + sizeof (void *) - 1) & ~(sizeof (void *) - 1);
+
+    command_t *command = client_get_space_for_size (client, size);
+    command->type = command_type;
+    command->size = size;
+    command->token = 0;
+    return command;
+}
+
+/* Returns false, without sending anything, if even a single row is too
+ * big to go through the command buffer. */
+static bool
+caching_client_tex_sub_image_in_bands (client_t *client,
+                                       egl_state_t *state,
+                                       const texture_upload_t *upload,
+                                       GLenum target,
+                                       GLint level,
+                                       GLint xoffset,
+                                       GLint yoffset,
+                                       GLsizei width,
+                                       GLsizei height,
+                                       GLenum format,
+                                       GLenum type,
+                                       const void *pixels)
+{
+    size_t command_size = command_get_size (COMMAND_GLTEXSUBIMAGE2D);
+    size_t budget = caching_client_texture_band_budget (client);
+    if (command_size + upload->unpadded_row_size > budget)
+        return false;
 
-    if (level < 0 || width < 0 || height < 0) {
-        caching_client_glSetError (client, GL_INVALID_VALUE);
-        return;
+    GLsizei band_rows = 1 + (budget - command_size - upload->unpadded_row_size) /
+                            upload->padded_row_size;
+    GLsizei row;
+    for (row = 0; row < height; row += band_rows) {
+        GLsizei rows = height - row < band_rows ? height - row : band_rows;
+        size_t band_size = (rows - 1) * upload->padded_row_size + upload->unpadded_row_size;
+
+        command_t *command =
+            caching_client_get_space_for_texture_upload (client, COMMAND_GLTEXSUBIMAGE2D,
+                                                         band_size);
+        command_gltexsubimage2d_t *sub_image = (command_gltexsubimage2d_t *) command;
+        sub_image->target = target;
+        sub_image->level = level;
+        sub_image->xoffset = xoffset;
+        sub_image->yoffset = yoffset + row;
+        sub_image->width = width;
+        sub_image->height = rows;
+        sub_image->format = format;
+        sub_image->type = type;
+        sub_image->pixels = (char *) command + command_size;
+
+        caching_client_copy_texture_rows (state, upload, pixels, sub_image->pixels,
+                                          format, type, row, rows);
+        client_run_command_async (command);
     }
+    return true;
+}
 
-    if (internalformat != format) {
+static void
+caching_client_write_tex_sub_image (client_t *client,
+                                    GLenum target,
+                                    GLint level,
+                                    GLint xoffset,
+                                    GLint yoffset,
+                                    GLsizei width,
+                                    GLsizei height,
+                                    GLenum format,
+                                    GLenum type,
+                                    const void *packed_pixels,
+                                    size_t size)
+{
+    command_t *command =
+        caching_client_get_space_for_texture_upload (client, COMMAND_GLTEXSUBIMAGE2D, size);
+    command_gltexsubimage2d_t *sub_image = (command_gltexsubimage2d_t *) command;
+    sub_image->target = target;
+    sub_image->level = level;
+    sub_image->xoffset = xoffset;
+    sub_image->yoffset = yoffset;
+    sub_image->width = width;
+    sub_image->height = height;
+    sub_image->format = format;
+    sub_image->type = type;
+    sub_image->pixels = (char *) command + command_get_size (COMMAND_GLTEXSUBIMAGE2D);
+
+    memcpy (sub_image->pixels, packed_pixels, size);
+    client_run_command_async (command);
+}
+
+static void
+caching_client_write_texture_updates (client_t *client)
+{
+    texture_update_batch_t *batch = CACHING_CLIENT(client)->texture_updates;
+    unsigned int i;
+
+    texture_update_batch_merge (batch);
+    for (i = 0; i < batch->count; i++) {
+        texture_update_t *update = &batch->updates[i];
+        caching_client_write_tex_sub_image (client, batch->target, batch->level,
+                                            update->xoffset, update->yoffset,
+                                            update->width, update->height,
+                                            batch->format, batch->type,
+                                            batch->data + update->offset,
+                                            update->size);
+    }
+    texture_update_batch_clear (batch);
+}
+
+/* Small updates wait in the texture update batch until another command
+ * is written; the server only ever sees them in submission order. */
+static bool
+caching_client_defer_tex_sub_image (client_t *client,
+                                    egl_state_t *state,
+                                    const texture_upload_t *upload,
+                                    GLenum target,
+                                    GLint level,
+                                    GLint xoffset,
+                                    GLint yoffset,
+                                    GLsizei width,
+                                    GLsizei height,
+                                    GLenum format,
+                                    GLenum type,
+                                    const void *pixels)
+{
+    texture_update_batch_t *batch = CACHING_CLIENT(client)->texture_updates;
+    void *data = NULL;
+
+    if (upload->size > TEXTURE_UPDATE_MAX_SIZE)
+        return false;
+
+    /* Most threads never upload a texture. */
+    if (! batch)
+        batch = CACHING_CLIENT(client)->texture_updates = texture_update_batch_new ();
+
+    if (! batch->count ||
+        texture_update_batch_matches (batch, target, level, format, type,
+                                      state->unpack_alignment))
+        data = texture_update_batch_add (batch, target, level, xoffset, yoffset,
+                                         width, height, format, type,
+                                         state->unpack_alignment, upload->size);
+    if (! data) {
+        client_write_deferred_commands (client);
+        data = texture_update_batch_add (batch, target, level, xoffset, yoffset,
+                                         width, height, format, type,
+                                         state->unpack_alignment, upload->size);
+    }
+
+    caching_client_copy_texture_rows (state, upload, pixels, data,
+                                      format, type, 0, height);
+    client->has_deferred_commands = true;
+    return true;
+}
+
+static bool
+caching_client_tex_image_in_buffer (client_t *client,
+                                    egl_state_t *state,
+                                    GLenum target,
+                                    GLint level,
+                                    GLint internalformat,
+                                    GLsizei width,
+                                    GLsizei height,
+                                    GLint border,
+                                    GLenum format,
+                                    GLenum type,
+                                    const void *pixels)
+{
+    texture_upload_t upload;
+    if (! pixels ||
+        ! caching_client_compute_texture_upload (state, width, height, format, type, &upload))
+        return false;
+
+    size_t command_size = command_get_size (COMMAND_GLTEXIMAGE2D);
+    if (command_size + upload.size > caching_client_texture_band_budget (client)) {
+        if (command_size + upload.unpadded_row_size > caching_client_texture_band_budget (client))
+            return false;
+
+        /* Allocate the storage first, then fill it band by band. */
+        CACHING_CLIENT(client)->super_dispatch.glTexImage2D (client, target, level,
+                                                             internalformat, width, height,
+                                                             border, format, type, NULL);
+        return caching_client_tex_sub_image_in_bands (client, state, &upload, target, level,
+                                                      0, 0, width, height, format, type,
+                                                      pixels);
+    }
+
+    command_t *command =
+        caching_client_get_space_for_texture_upload (client, COMMAND_GLTEXIMAGE2D, upload.size);
+    command_glteximage2d_t *image = (command_glteximage2d_t *) command;
+    image->target = target;
+    image->level = level;
+    image->internalformat = internalformat;
+    image->width = width;
+    image->height = height;
+    image->border = border;
+    image->format = format;
+    image->type = type;
+    image->pixels = (char *) command + command_size;
+
+    caching_client_copy_texture_rows (state, &upload, pixels, image->pixels,
+                                      format, type, 0, height);
+    client_run_command_async (command);
+    return true;
+}
+
+static void
+caching_client_glTexImage2D (void* client, GLenum target, GLint level,
+                             GLint internalformat, GLsizei width,
+                             GLsizei height, GLint border, GLenum format,
+                             GLenum type, const void *pixels)
+{
+    GLuint tex_id;
+
+    egl_state_t *state = client_get_current_state (CLIENT (client));
+
+    INSTRUMENT();
+
+    if (! state)
+        return;
+
+    if (level < 0 || width < 0 || height < 0) {
+        caching_client_glSetError (client, GL_INVALID_VALUE);
+        return;
+    }
+
+    if (internalformat != format) {
         caching_client_glSetError (client, GL_INVALID_OPERATION);
         return;
     }
@@ -3332,9 +4320,12 @@ caching_client_glTexImage2D (void* client, GLenum target, GLint level,
         texture->data_type = type;
     }
 
-    CACHING_CLIENT(client)->super_dispatch.glTexImage2D (client, target, level, internalformat,
-                                                         width, height, border, format, type, pixels);
-    
+    if (! caching_client_tex_image_in_buffer (CLIENT (client), state, target, level,
+                                              internalformat, width, height, border,
+                                              format, type, pixels))
+        CACHING_CLIENT(client)->super_dispatch.glTexImage2D (client, target, level, internalformat,
+                                                             width, height, border, format, type, pixels);
+
     /* update framebuffer in cache */
     if (texture && texture->framebuffer_id) {
         framebuffer_t *framebuffer = egl_state_lookup_cached_framebuffer (state, texture->framebuffer_id);
@@ -3419,6 +4410,21 @@ caching_client_glTexSubImage2D (void* client,
 
     /* FIXME: we need to check level */
 
+    texture_upload_t upload;
+    if (pixels &&
+        caching_client_compute_texture_upload (state, width, height, format, type, &upload)) {
+        if (texture->internal_format == format &&
+            caching_client_defer_tex_sub_image (CLIENT (client), state, &upload, target, level,
+                                                xoffset, yoffset, width, height,
+                                                format, type, pixels))
+            return;
+
+        if (caching_client_tex_sub_image_in_bands (CLIENT (client), state, &upload, target,
+                                                   level, xoffset, yoffset, width, height,
+                                                   format, type, pixels))
+            return;
+    }
+
     CACHING_CLIENT(client)->super_dispatch.glTexSubImage2D (client, target, level, xoffset, yoffset,
                                                             width, height, format, type, pixels);
 }
@@ -3807,70 +4813,42 @@ caching_client_glUseProgram (void* client,
     /* this maybe not right because this program may be invalid
      * object, we save here to save time in glGetError() */
     program_t *current_program = (program_t *) egl_state_lookup_cached_shader_object (state, state->current_program);
-    if (current_program && current_program->mark_for_deletion)
+    if (current_program && current_program->mark_for_deletion) {
+        client_wait_for_result_slot (CLIENT (client), &current_program->base.status);
         egl_state_destroy_cached_shader_object (state, &current_program->base);
+    }
     state->current_program = program_id;
 }
 
+/* Current values are context state, not vertex array state, so they are
+ * kept whatever vertex array is bound, for glGetVertexAttrib and for
+ * switching virtual contexts. */
 static void
-caching_client_set_current_vertex_attrib (void* client, GLuint index, void *curr_attrib)
+caching_client_set_current_vertex_attrib (egl_state_t *state,
+                                          GLuint index,
+                                          const GLfloat *value)
 {
-    GLfloat *current_attrib = curr_attrib;
-    vertex_attrib_list_t *attrib_list;
-    vertex_attrib_t *attribs;
-    int i, found_index = -1;
-    int count;
-    egl_state_t *state = client_get_current_state (CLIENT (client));
-    if (! state)
-        return;
-
-    if (caching_client_does_index_overflow (client, index))
-        return;
-
-    attrib_list = &state->vertex_attribs;
-    attribs = attrib_list->attribs;
-    count = attrib_list->count;
-
-    /* check existing client state */
-    for (i = 0; i < count; i++) {
-        if (attribs[i].index == index)
-	    found_index = i;
-    }
-
-    if (found_index != -1) {
-	memcpy (attribs[found_index].current_attrib, current_attrib, 4 * sizeof (GLfloat));
+    if (index >= EGL_STATE_MAX_VERTEX_ATTRIBS)
         return;
-    }
-
-    /* we have not found index */
-    if (i < NUM_EMBEDDED) {
-	memcpy (attribs[i].current_attrib, current_attrib, 4 * sizeof (GLfloat));
-        attrib_list->count ++;
-    } else {
-        vertex_attrib_t *new_attribs = (vertex_attrib_t *)malloc (sizeof (vertex_attrib_t) * (count + 1));
 
-        memcpy (new_attribs, attribs, (count+1) * sizeof (vertex_attrib_t));
-        if (attribs != attrib_list->embedded_attribs)
-            free (attribs);
-
-	memcpy (attribs[i].current_attrib, current_attrib, 4 * sizeof (GLfloat));
-
-        attrib_list->attribs = new_attribs;
-        attrib_list->count ++;
-    }
+    memcpy (state->vertex_attrib_values[index], value, 4 * sizeof (GLfloat));
+    state->vertex_attrib_values_set |= 1u << index;
 }
 
-
 static void
 caching_client_glVertexAttrib1f (void* client, GLuint index, GLfloat v0)
 {
     INSTRUMENT();
     egl_state_t *state = client_get_current_state (CLIENT (client));
-    GLfloat v[4] = {v0, 0, 0, 0};
+    GLfloat v[4] = {v0, 0, 0, 1};
     if (! state)
         return;
 
-    caching_client_set_current_vertex_attrib (client, index, &v);
+    if (caching_client_does_index_overflow (client, index))
+        return;
+
+    caching_client_set_current_vertex_attrib (state, index, v);
+    CACHING_CLIENT(client)->super_dispatch.glVertexAttrib1f (client, index, v0);
 }
 
 static void
@@ -3878,11 +4856,15 @@ caching_client_glVertexAttrib2f (void* client, GLuint index, GLfloat v0, GLfloat
 {
     INSTRUMENT();
     egl_state_t *state = client_get_current_state (CLIENT (client));
-    GLfloat v[4] = {v0, v1, 0, 0};
+    GLfloat v[4] = {v0, v1, 0, 1};
     if (! state)
         return;
 
-    caching_client_set_current_vertex_attrib (client, index, &v);
+    if (caching_client_does_index_overflow (client, index))
+        return;
+
+    caching_client_set_current_vertex_attrib (state, index, v);
+    CACHING_CLIENT(client)->super_dispatch.glVertexAttrib2f (client, index, v0, v1);
 }
 
 static void
@@ -3891,11 +4873,15 @@ caching_client_glVertexAttrib3f (void* client, GLuint index, GLfloat v0,
 {
     INSTRUMENT();
     egl_state_t *state = client_get_current_state (CLIENT (client));
-    GLfloat v[4] = {v0, v1, v2, 0};
+    GLfloat v[4] = {v0, v1, v2, 1};
     if (! state)
         return;
 
-    caching_client_set_current_vertex_attrib (client, index, &v);
+    if (caching_client_does_index_overflow (client, index))
+        return;
+
+    caching_client_set_current_vertex_attrib (state, index, v);
+    CACHING_CLIENT(client)->super_dispatch.glVertexAttrib3f (client, index, v0, v1, v2);
 }
 
 static void
@@ -3908,7 +4894,11 @@ caching_client_glVertexAttrib4f (void* client, GLuint index, GLfloat v0, GLfloat
     if (! state)
         return;
 
-    caching_client_set_current_vertex_attrib (client, index, &v);
+    if (caching_client_does_index_overflow (client, index))
+        return;
+
+    caching_client_set_current_vertex_attrib (state, index, v);
+    CACHING_CLIENT(client)->super_dispatch.glVertexAttrib4f (client, index, v0, v1, v2, v3);
 }
 
 static void
@@ -4032,6 +5022,7 @@ caching_client_glVertexAttribPointer (void* client, GLuint index, GLint size,
         attribs[i].array_normalized = normalized;
         attribs[i].pointer = (GLvoid *)pointer;
         attribs[i].data = NULL;
+        attribs[i].in_vertex_cache = false;
         attribs[i].array_enabled = GL_FALSE;
         attribs[i].next_enabled = NULL;
         attribs[i].chunk = 0;
@@ -4052,6 +5043,7 @@ caching_client_glVertexAttribPointer (void* client, GLuint index, GLint size,
         new_attribs[count].array_normalized = normalized;
         new_attribs[count].pointer = (GLvoid *)pointer;
         new_attribs[count].data = NULL;
+        new_attribs[count].in_vertex_cache = false;
         new_attribs[count].array_enabled = GL_FALSE;
         new_attribs[count].next_enabled = NULL;
         new_attribs[count].chunk = 0;
@@ -4284,6 +5276,29 @@ caching_client_glMapBufferOES (void* client, GLenum target, GLenum access)
         return result;
     }
 
+    /* Buffers whose contents we know are mapped to client memory, and
+     * the server only hears about the writes on unmap. */
+    egl_state_t *state = client_get_current_state (CLIENT (client));
+    buffer_object_t *buffer = state ? caching_client_lookup_buffer_object (state, target) : NULL;
+    if (buffer && buffer->mapped) {
+        caching_client_glSetError (client, GL_INVALID_OPERATION);
+        return result;
+    }
+    if (buffer && buffer->size > 0) {
+        result = buffer_object_map (buffer);
+        if (result)
+            return result;
+    }
+
+    /* What the application writes to the driver's mapping never reaches
+     * the client's copy of the indices. */
+    GLuint id = state ? caching_client_buffer_binding (state, target) : 0;
+    if (id) {
+        share_group_lock (state->share_group);
+        caching_client_forget_index_buffer (state, id);
+        share_group_unlock (state->share_group);
+    }
+
     result = CACHING_CLIENT(client)->super_dispatch.glMapBufferOES (client, target, access);
 
     if (result == NULL)
@@ -4291,6 +5306,25 @@ caching_client_glMapBufferOES (void* client, GLenum target, GLenum access)
     return result;
 }
 
+static void
+caching_client_upload_mapped_range (buffer_object_t *buffer,
+                                    size_t offset,
+                                    size_t size,
+                                    void *user_data)
+{
+    void **arguments = user_data;
+    void *client = arguments[0];
+    GLenum target = *(GLenum *) arguments[1];
+
+    /* All of it: orphan the old storage instead of updating it. */
+    if (offset == 0 && size == (size_t) buffer->size)
+        caching_client_glBufferData (client, target, buffer->size,
+                                     buffer->mapping, buffer->usage);
+    else
+        caching_client_glBufferSubData (client, target, offset, size,
+                                        buffer->mapping + offset);
+}
+
 static GLboolean
 caching_client_glUnmapBufferOES (void* client, GLenum target)
 {
@@ -4303,6 +5337,14 @@ caching_client_glUnmapBufferOES (void* client, GLenum target)
         return result;
     }
 
+    egl_state_t *state = client_get_current_state (CLIENT (client));
+    buffer_object_t *buffer = state ? caching_client_lookup_buffer_object (state, target) : NULL;
+    if (buffer && buffer->mapped) {
+        void *arguments[] = { client, &target };
+        buffer_object_unmap (buffer, caching_client_upload_mapped_range, arguments);
+        return GL_TRUE;
+    }
+
     result = CACHING_CLIENT(client)->super_dispatch.glUnmapBufferOES (client, target);
 
     if (result != GL_TRUE)
@@ -4320,6 +5362,13 @@ caching_client_glGetBufferPointervOES (void* client, GLenum target, GLenum pname
         return;
     }
 
+    egl_state_t *state = client_get_current_state (CLIENT (client));
+    buffer_object_t *buffer = state ? caching_client_lookup_buffer_object (state, target) : NULL;
+    if (buffer && buffer->mapped && pname == GL_BUFFER_MAP_POINTER_OES && params) {
+        *params = buffer->mapping;
+        return;
+    }
+
     CACHING_CLIENT(client)->super_dispatch.glGetBufferPointervOES (client, target, pname, params);
 }
 
@@ -4580,9 +5629,43 @@ caching_client_glFramebufferTexture2DMultisampleIMG (void* client, GLenum target
     }
 }
 
+/* A fence cannot have completed before the server has submitted its
+ * glSetFenceNV, and a completed fence stays completed until it is set
+ * again, so neither answer needs the driver. */
+static bool
+caching_client_fence_status_is_known (void *client,
+                                      fence_t *fence,
+                                      GLboolean *status)
+{
+    if (fence->signaled) {
+        *status = GL_TRUE;
+        return true;
+    }
+
+    /* Only our own ring buffer tells us how far the server has gone. */
+    if (fence->client == client &&
+        ! client_has_reached_token (CLIENT (client), fence->token)) {
+        *status = GL_FALSE;
+        return true;
+    }
+    return false;
+}
+
+static fence_t *
+caching_client_lookup_fence (void *client,
+                             GLuint id)
+{
+    egl_state_t *state = client_get_current_state (CLIENT (client));
+    if (! state || ! id)
+        return NULL;
+    return hash_lookup (state->fences, id);
+}
+
 static void
 caching_client_glDeleteFencesNV (void* client, GLsizei n, const GLuint *fences)
 {
+    GLsizei i;
+
     INSTRUMENT();
 
     if (n <= 0) {
@@ -4591,6 +5674,14 @@ caching_client_glDeleteFencesNV (void* client, GLsizei n, const GLuint *fences)
     }
 
     CACHING_CLIENT(client)->super_dispatch.glDeleteFencesNV (client, n, fences);
+
+    egl_state_t *state = client_get_current_state (CLIENT (client));
+    if (! state)
+        return;
+    for (i = 0; i < n; i++) {
+        if (fences[i])
+            hash_remove (state->fences, fences[i]);
+    }
 }
 
 static void
@@ -4606,29 +5697,107 @@ caching_client_glGenFencesNV (void* client, GLsizei n, GLuint *fences)
     CACHING_CLIENT(client)->super_dispatch.glGenFencesNV (client, n, fences);
 }
 
+static void
+caching_client_glSetFenceNV (void* client, GLuint fence, GLenum condition)
+{
+    INSTRUMENT();
+
+    if (condition != GL_ALL_COMPLETED_NV) {
+        caching_client_glSetError (client, GL_INVALID_ENUM);
+        return;
+    }
+
+    egl_state_t *state = client_get_current_state (CLIENT (client));
+    if (! state)
+        return;
+
+    /* Names that were never generated are an error only the server
+     * can report. */
+    caching_client_set_needs_get_error (CLIENT (client));
+
+    command_t *command = client_get_space_for_command (COMMAND_GLSETFENCENV);
+    command_glsetfencenv_init (command, fence, condition);
+    unsigned int token = client_run_command_async_with_token (command);
+
+    if (! fence)
+        return;
+
+    fence_t *record = hash_lookup (state->fences, fence);
+    if (! record) {
+        record = malloc (sizeof (fence_t));
+        record->id = fence;
+        hash_insert (state->fences, fence, record);
+    }
+    record->condition = condition;
+    record->client = client;
+    record->token = token;
+    record->signaled = false;
+}
+
 static GLboolean
 caching_client_glTestFenceNV (void* client, GLuint fence)
 {
+    GLboolean status;
+
     INSTRUMENT();
 
+    fence_t *record = caching_client_lookup_fence (client, fence);
+    if (record && caching_client_fence_status_is_known (client, record, &status))
+        return status;
+
     GLboolean result = CACHING_CLIENT(client)->super_dispatch.glTestFenceNV (client, fence);
 
     if (result == GL_FALSE)
         caching_client_set_needs_get_error (CLIENT (client));
+    else if (record)
+        record->signaled = true;
     return result;
 }
 
+static void
+caching_client_glFinishFenceNV (void* client, GLuint fence)
+{
+    INSTRUMENT();
+
+    fence_t *record = caching_client_lookup_fence (client, fence);
+    if (record && record->signaled)
+        return;
+
+    /* Waiting for the GPU is the one thing the driver fence is for. */
+    CACHING_CLIENT(client)->super_dispatch.glFinishFenceNV (client, fence);
+
+    /* The server has waited for the fence by the time this returns. */
+    if (record)
+        record->signaled = true;
+}
+
 static void
 caching_client_glGetFenceivNV (void* client, GLuint fence, GLenum pname, int *params)
 {
     int original_params = *params;
+    GLboolean status;
 
     INSTRUMENT();
 
+    fence_t *record = caching_client_lookup_fence (client, fence);
+    if (record) {
+        if (pname == GL_FENCE_CONDITION_NV) {
+            *params = record->condition;
+            return;
+        }
+        if (pname == GL_FENCE_STATUS_NV &&
+            caching_client_fence_status_is_known (client, record, &status)) {
+            *params = status;
+            return;
+        }
+    }
+
     CACHING_CLIENT(client)->super_dispatch.glGetFenceivNV (client, fence, pname, params);
 
     if (original_params == *params)
         caching_client_set_needs_get_error (CLIENT (client));
+    else if (record && pname == GL_FENCE_STATUS_NV && *params == GL_TRUE)
+        record->signaled = true;
 }
 
 static void
@@ -4653,9 +5822,8 @@ caching_client_eglGetDisplay (void *client,
 
     if (result != EGL_NO_DISPLAY && cached_gl_display_find (result) == NULL) {
         mutex_lock (cached_gl_display_list_mutex);
-        display_ctxs_surfaces_t *dpy = cached_gl_display_new (native_display, result);
-        link_list_t **dpys = cached_gl_displays ();
-        link_list_append (dpys, (void *)dpy, destroy_dpy);
+        if (! cached_gl_display_find (result))
+            cached_gl_display_add (cached_gl_display_new (native_display, result));
         mutex_unlock (cached_gl_display_list_mutex);
     }
     return result;
@@ -4670,50 +5838,434 @@ caching_client_eglQueryString (void *client, EGLDisplay display,  EGLint name)
         if (strstr (result, "EGL_KHR_surfaceless_context") ||
             strstr (result, "EGL_KHR_surfaceless_opengl")) {
             mutex_lock (cached_gl_display_list_mutex);
-            link_list_t **dpys = cached_gl_displays ();
-            link_list_t *dpy = *dpys;
-            while (dpy) {
-                display_ctxs_surfaces_t *d = (display_ctxs_surfaces_t *)dpy->data;
-                if (d->display == display) {
-                    d->support_surfaceless = true;
-                    break;
-                }
-                dpy = dpy->next;
-            }
+            display_ctxs_surfaces_t *d = cached_gl_display_find (display);
+            if (d)
+                d->support_surfaceless = true;
             mutex_unlock (cached_gl_display_list_mutex);
         }
     }
     return result;
 }
 
+static void
+caching_client_set_binding (egl_binding_t *binding,
+                            EGLDisplay display,
+                            EGLSurface draw,
+                            EGLSurface read,
+                            EGLContext context)
+{
+    binding->display = display;
+    binding->draw = draw;
+    binding->read = read;
+    binding->context = context;
+}
+
+/* Picks up the results of queued eglMakeCurrent calls in the order they
+ * ran, waiting for the oldest `wait_count` ones. After a failure, the
+ * server kept what it had current, so the rest are waited for and the
+ * cached states go back to what the server has current. */
+static void
+caching_client_settle_make_currents (caching_client_t *client,
+                                     unsigned int wait_count)
+{
+    bool failed = false;
+    unsigned int i;
+
+    for (i = 0; i < CACHING_CLIENT_MAX_PENDING_MAKE_CURRENTS; i++) {
+        unsigned int index = (client->next_make_current + i) %
+                             CACHING_CLIENT_MAX_PENDING_MAKE_CURRENTS;
+        pending_make_current_t *pending = &client->pending_make_currents[index];
+
+        if (! pending->in_flight)
+            continue;
+        if (result_slot_is_pending (&pending->made_current) && ! wait_count && ! failed)
+            break;
+        if (wait_count)
+            wait_count--;
+
+        client_wait_for_result_slot (&client->super, &pending->made_current);
+        pending->in_flight = false;
+
+        if (pending->made_current.value == EGL_SUCCESS) {
+            client->server_binding = pending->binding;
+            continue;
+        }
+        if (client->make_current_error == EGL_SUCCESS)
+            client->make_current_error = pending->made_current.value;
+        failed = true;
+    }
+
+    if (failed) {
+        egl_binding_t *binding = &client->server_binding;
+        _caching_client_make_current (&client->super, binding->display,
+                                      binding->draw, binding->read,
+                                      binding->context);
+    }
+}
+
+static void
+caching_client_queue_make_current (caching_client_t *client,
+                                   EGLDisplay display,
+                                   EGLSurface draw,
+                                   EGLSurface read,
+                                   EGLContext ctx)
+{
+    pending_make_current_t *pending =
+        &client->pending_make_currents[client->next_make_current];
+
+    /* This is the oldest one, the others are further behind. */
+    caching_client_settle_make_currents (client, pending->in_flight ? 1 : 0);
+
+    client->next_make_current = (client->next_make_current + 1) %
+                                CACHING_CLIENT_MAX_PENDING_MAKE_CURRENTS;
+    caching_client_set_binding (&pending->binding, display, draw, read, ctx);
+    pending->in_flight = true;
+
+    command_t *command = client_get_space_for_command (COMMAND_EGLMAKECURRENT);
+    command_eglmakecurrent_init (command, display, draw, read, ctx);
+    ((command_eglmakecurrent_t *) command)->made_current = &pending->made_current;
+
+    /* Set before the state we leave stops being active, so a thread that
+     * sees it inactive waits for the server, see
+     * caching_client_wait_for_release. */
+    egl_state_t *leaving = client_get_current_state (&client->super);
+    if (leaving && (leaving->display != display || leaving->context != ctx)) {
+        client_wait_for_result_slot (&client->super, &leaving->released);
+        leaving->released.pending = true;
+        leaving->released.client = &client->super;
+        ((command_eglmakecurrent_t *) command)->released = &leaving->released;
+    }
+
+    client_run_command_async_filling_slot (command, &pending->made_current);
+}
+
+/* Virtual contexts: with GPUPROCESS_VIRTUAL_CONTEXTS set, the contexts of a
+ * share group that have the config of the first one made current run on
+ * its driver context, the backing context. Switching between them writes
+ * the difference of the states we keep instead of switching driver
+ * contexts. Before the driver leaves the backing context, it gets its own
+ * state back. A share group has to be used from the thread that has its
+ * backing context current. */
+static bool
+caching_client_virtual_contexts_from_environment (void)
+{
+    const char *virtual_contexts = getenv ("GPUPROCESS_VIRTUAL_CONTEXTS");
+    return virtual_contexts && strtol (virtual_contexts, NULL, 10) > 0;
+}
+
+static EGLConfig
+caching_client_context_config (EGLDisplay display,
+                               EGLContext context)
+{
+    EGLConfig config = NULL;
+
+    mutex_lock (cached_gl_display_list_mutex);
+    context_t *entry = cached_gl_context_find (display, context);
+    if (entry)
+        config = entry->config;
+    mutex_unlock (cached_gl_display_list_mutex);
+    return config;
+}
+
+static void
+_caching_client_forget_runs_on (egl_state_t *state,
+                                void *backing)
+{
+    if (state->runs_on == backing && state != backing)
+        state->runs_on = NULL;
+}
+
+/* We should already be holding the cached states mutex. The contexts that
+ * ran on a destroyed backing context start over on the next one. */
+static void
+caching_client_forget_backing (egl_state_t *backing)
+{
+    share_group_t *group = backing->share_group;
+    if (group->virtual_backing != backing)
+        return;
+
+    group->virtual_backing = NULL;
+    group->virtual_backing_client = NULL;
+
+    /* They run on a context of the same display. */
+    cached_gl_states_foreach (backing->display, _caching_client_forget_runs_on,
+                              backing);
+}
+
+/* The errors of a context are kept by the driver context it runs on, so
+ * they are taken out before another context runs there. */
+static void
+caching_client_save_pending_errors (void *client,
+                                    egl_state_t *state)
+{
+    GLenum error;
+
+    if (! state->need_get_error)
+        return;
+
+    do {
+        error = CACHING_CLIENT(client)->super_dispatch.glGetError (client);
+        if (state->error == GL_NO_ERROR)
+            state->error = error;
+    } while (error != GL_NO_ERROR);
+    state->need_get_error = false;
+}
+
+/* The driver gives a context the size of its draw surface as viewport and
+ * scissor box the first time it is made current. A virtual context has to
+ * be given them, and the states we keep have to know them to be diffed. */
+static void
+caching_client_init_virtual_state (void *client,
+                                   egl_state_t *state,
+                                   EGLDisplay display,
+                                   EGLSurface draw)
+{
+    dispatch_table_t *dispatch = &CACHING_CLIENT(client)->super_dispatch;
+    EGLint width = 0, height = 0;
+
+    if (state->has_been_current)
+        return;
+    state->has_been_current = true;
+    if (draw == EGL_NO_SURFACE)
+        return;
+
+    dispatch->eglQuerySurface (client, display, draw, EGL_WIDTH, &width);
+    dispatch->eglQuerySurface (client, display, draw, EGL_HEIGHT, &height);
+    state->viewport[2] = state->scissor_box[2] = width;
+    state->viewport[3] = state->scissor_box[3] = height;
+}
+
+/* Gives the backing context its own state back before the driver switches
+ * away from it. Returns true if it had another context's state. */
+static bool
+caching_client_restore_backing (void *client)
+{
+    caching_client_t *caching_client = CACHING_CLIENT (client);
+    egl_state_t *backing = caching_client->virtual_backing;
+    egl_state_t *current_state = client_get_current_state (CLIENT (client));
+
+    if (! backing || ! current_state || current_state == backing)
+        return false;
+
+    caching_client_save_pending_errors (client, current_state);
+    if (backing->destroy_ctx || backing->destroy_dpy)
+        return false;
+
+    egl_state_write_diff (current_state, backing, &caching_client->super_dispatch, client);
+    return true;
+}
+
+/* Once the driver has left the backing context, another thread may take
+ * it, and a destroyed one can go. */
+static void
+caching_client_release_backing (void *client)
+{
+    caching_client_t *caching_client = CACHING_CLIENT (client);
+    egl_state_t *backing = caching_client->virtual_backing;
+
+    if (! backing)
+        return;
+    caching_client->virtual_backing = NULL;
+
+    mutex_lock (cached_gl_states_mutex);
+    backing->share_group->virtual_backing_client = NULL;
+
+    if (backing->destroy_ctx || backing->destroy_dpy) {
+        caching_client_forget_backing (backing);
+
+        /* If it is still current, the switch destroys it. */
+        if (! backing->active) {
+            EGLDisplay display = backing->display;
+            EGLContext context = backing->context;
+            bool destroy_ctx = backing->destroy_ctx;
+
+            mutex_lock (cached_gl_display_list_mutex);
+            _caching_client_destroy_state (client, backing);
+            if (destroy_ctx)
+                cached_gl_context_destroy (display, context);
+            mutex_unlock (cached_gl_display_list_mutex);
+        }
+    }
+    mutex_unlock (cached_gl_states_mutex);
+}
+
 static EGLBoolean
-caching_client_eglTerminate (void* client,
-                             EGLDisplay display)
+caching_client_make_current_real (void *client,
+                                  EGLDisplay display,
+                                  EGLSurface draw,
+                                  EGLSurface read,
+                                  EGLContext ctx)
 {
-    INSTRUMENT();
+    caching_client_t *caching_client = CACHING_CLIENT (client);
+    dispatch_table_t *dispatch = &caching_client->super_dispatch;
+    egl_state_t *current_state = client_get_current_state (CLIENT (client));
 
-    if (CACHING_CLIENT(client)->super_dispatch.eglTerminate (client, display) == EGL_FALSE)
+    bool restored = caching_client_restore_backing (client);
+    if (dispatch->eglMakeCurrent (client, display, draw, read, ctx) == EGL_FALSE) {
+        if (restored)
+            egl_state_write_diff (caching_client->virtual_backing, current_state, dispatch, client);
         return EGL_FALSE;
+    }
+
+    caching_client_release_backing (client);
+    _caching_client_make_current (client, display, draw, read, ctx);
+
+    egl_state_t *new_state = client_get_current_state (CLIENT (client));
+    if (! new_state)
+        return EGL_TRUE;
 
     mutex_lock (cached_gl_states_mutex);
+    /* Its backing context was destroyed, so its driver context has never
+     * run its commands. */
+    bool orphaned = new_state->has_been_current && ! new_state->runs_on;
+
+    share_group_t *group = new_state->share_group;
+    new_state->runs_on = new_state;
+    if (! group->virtual_backing)
+        group->virtual_backing = new_state;
+    if (group->virtual_backing == new_state) {
+        group->virtual_backing_client = client;
+        caching_client->virtual_backing = new_state;
+        caching_client->virtual_draw = draw;
+        caching_client->virtual_read = read;
+    }
+    mutex_unlock (cached_gl_states_mutex);
+
+    if (orphaned) {
+        egl_state_t *defaults = egl_state_new (display, ctx);
+        egl_state_write_diff (defaults, new_state, dispatch, client);
+        egl_state_destroy (defaults);
+    } else
+        caching_client_init_virtual_state (client, new_state, display, draw);
+
+    return EGL_TRUE;
+}
 
-    link_list_t **states = cached_gl_states ();
-    if (! *states) {
+static EGLBoolean
+caching_client_make_current_virtual (void *client,
+                                     EGLDisplay display,
+                                     EGLSurface draw,
+                                     EGLSurface read,
+                                     egl_state_t *new_state,
+                                     egl_state_t *backing)
+{
+    caching_client_t *caching_client = CACHING_CLIENT (client);
+    dispatch_table_t *dispatch = &caching_client->super_dispatch;
+    egl_state_t *current_state = client_get_current_state (CLIENT (client));
+    egl_state_t *from;
+
+    if (caching_client->virtual_backing == backing) {
+        from = current_state;
+        if (from != new_state)
+            caching_client_save_pending_errors (client, from);
+
+        if (draw != caching_client->virtual_draw || read != caching_client->virtual_read) {
+            if (dispatch->eglMakeCurrent (client, display, draw, read,
+                                          backing->context) == EGL_FALSE)
+                return EGL_FALSE;
+        }
+    } else {
+        bool restored = caching_client_restore_backing (client);
+        if (dispatch->eglMakeCurrent (client, display, draw, read,
+                                      backing->context) == EGL_FALSE) {
+            if (restored)
+                egl_state_write_diff (caching_client->virtual_backing, current_state,
+                                      dispatch, client);
+            return EGL_FALSE;
+        }
+
+        caching_client_release_backing (client);
+        mutex_lock (cached_gl_states_mutex);
+        backing->share_group->virtual_backing_client = client;
         mutex_unlock (cached_gl_states_mutex);
-        return EGL_TRUE;
+        caching_client->virtual_backing = backing;
+        from = backing;
     }
+    caching_client->virtual_draw = draw;
+    caching_client->virtual_read = read;
 
-    link_list_t *list = *states;
-    while (list != NULL) {
+    mutex_lock (cached_gl_states_mutex);
+    new_state->runs_on = backing;
+    mutex_unlock (cached_gl_states_mutex);
 
-        /* We might delete current in the following code. */
-        link_list_t *current = list;
-        list = current->next;
+    caching_client_init_virtual_state (client, new_state, display, draw);
+    if (from != new_state)
+        egl_state_write_diff (from, new_state, dispatch, client);
+
+    _caching_client_make_current (client, display, draw, read, new_state->context);
+    return EGL_TRUE;
+}
+
+static EGLBoolean
+caching_client_make_current_with_virtual_contexts (void *client,
+                                                   EGLDisplay display,
+                                                   EGLSurface draw,
+                                                   EGLSurface read,
+                                                   EGLContext ctx)
+{
+    if (display == EGL_NO_DISPLAY || ctx == EGL_NO_CONTEXT)
+        return caching_client_make_current_real (client, display, draw, read, ctx);
 
-        egl_state_t *egl_state = (egl_state_t *) current->data;
-        if (egl_state->display == display && ! egl_state->active)
-            _caching_client_destroy_state (client, egl_state);
+    mutex_lock (cached_gl_states_mutex);
+    egl_state_t *new_state = find_state_with_display_and_context (display, ctx);
+    egl_state_t *backing = NULL;
+    bool must_run_on_backing = false;
+
+    if (new_state) {
+        share_group_t *group = new_state->share_group;
+        if (new_state->runs_on) {
+            must_run_on_backing = new_state->runs_on != new_state;
+            if (must_run_on_backing || group->virtual_backing == new_state)
+                backing = new_state->runs_on;
+        } else if (group->virtual_backing &&
+                   ! new_state->active &&
+                   caching_client_context_config (display, ctx) ==
+                       caching_client_context_config (display, group->virtual_backing->context))
+            backing = group->virtual_backing;
+
+        if (backing &&
+            group->virtual_backing_client &&
+            group->virtual_backing_client != client) {
+            if (must_run_on_backing) {
+                mutex_unlock (cached_gl_states_mutex);
+                return EGL_FALSE;
+            }
+            backing = NULL;
+        }
     }
+    mutex_unlock (cached_gl_states_mutex);
+
+    if (! backing)
+        return caching_client_make_current_real (client, display, draw, read, ctx);
+    return caching_client_make_current_virtual (client, display, draw, read,
+                                                new_state, backing);
+}
+
+/* Contexts current in other threads go when they are left. */
+static void
+_caching_client_terminate_state (egl_state_t *egl_state,
+                                 void *client)
+{
+    egl_state->destroy_dpy = true;
+    __sync_synchronize ();
+    if (egl_state->active || egl_state == CACHING_CLIENT(client)->virtual_backing)
+        return;
+
+    caching_client_forget_backing (egl_state);
+    _caching_client_destroy_state (client, egl_state);
+}
+
+static EGLBoolean
+caching_client_eglTerminate (void* client,
+                             EGLDisplay display)
+{
+    INSTRUMENT();
+
+    if (CACHING_CLIENT(client)->super_dispatch.eglTerminate (client, display) == EGL_FALSE)
+        return EGL_FALSE;
+
+    mutex_lock (cached_gl_states_mutex);
+    cached_gl_states_foreach (display, _caching_client_terminate_state, client);
 
     egl_state_t *egl_state = client_get_current_state (CLIENT (client));
     if (egl_state && egl_state->display == display)
@@ -4752,9 +6304,20 @@ caching_client_eglReleaseThread (void* client)
 {
     INSTRUMENT();
 
-    if (CACHING_CLIENT(client)->super_dispatch.eglReleaseThread (client) == EGL_FALSE)
+    bool restored = caching_client_restore_backing (client);
+    if (CACHING_CLIENT(client)->super_dispatch.eglReleaseThread (client) == EGL_FALSE) {
+        if (restored)
+            egl_state_write_diff (CACHING_CLIENT(client)->virtual_backing,
+                                  client_get_current_state (CLIENT (client)),
+                                  &CACHING_CLIENT(client)->super_dispatch, client);
         return EGL_FALSE;
+    }
 
+    caching_client_release_backing (client);
+    caching_client_settle_make_currents (CACHING_CLIENT (client),
+                                         CACHING_CLIENT_MAX_PENDING_MAKE_CURRENTS);
+    caching_client_set_binding (&CACHING_CLIENT (client)->server_binding, EGL_NO_DISPLAY,
+                                EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
     _caching_client_make_current (client,
                                   EGL_NO_DISPLAY,
                                   EGL_NO_SURFACE,
@@ -4782,14 +6345,15 @@ caching_client_eglDestroyContext (void* client,
         return EGL_TRUE;
     }
 
-    if (! state->active) {
+    state->destroy_ctx = true;
+    __sync_synchronize ();
+    if (! state->active && state != CACHING_CLIENT(client)->virtual_backing) {
+        caching_client_forget_backing (state);
         _caching_client_destroy_state (client, state);
         mutex_lock (cached_gl_display_list_mutex);
         cached_gl_context_destroy (dpy, ctx);
         mutex_unlock (cached_gl_display_list_mutex);
     }
-    else
-        state->destroy_ctx = true;
 
     mutex_unlock (cached_gl_states_mutex);
     return EGL_TRUE;
@@ -4842,6 +6406,58 @@ caching_client_eglGetCurrentSurface (void* client,
     return surface;
 }
 
+/* How many swaps the client may queue before waiting for the oldest
+ * one. With 0, every eglSwapBuffers waits for the driver. */
+#define CACHING_CLIENT_MAX_FRAMES_IN_FLIGHT 8
+
+static unsigned int
+caching_client_frames_in_flight_from_environment (void)
+{
+    const char *frames = getenv ("GPUPROCESS_FRAMES_IN_FLIGHT");
+    if (! frames)
+        return 0;
+
+    long count = strtol (frames, NULL, 10);
+    if (count <= 0)
+        return 0;
+    if (count > CACHING_CLIENT_MAX_FRAMES_IN_FLIGHT)
+        return CACHING_CLIENT_MAX_FRAMES_IN_FLIGHT;
+    return count;
+}
+
+/* Waits for a queued swap. A failure is kept for the next
+ * eglSwapBuffers to return, as the call that queued it already has. */
+static void
+caching_client_retire_swap (caching_client_t *client,
+                            pending_swap_t *swap)
+{
+    client_wait_for_result_slot (&client->super, &swap->swapped);
+    swap->in_flight = false;
+    client->frames_retired++;
+
+    if (swap->swapped.value == EGL_FALSE)
+        client->swap_failed = true;
+
+#if ENABLE_PROFILING
+    long latency = (swap->swapped_time.tv_sec - swap->queued_time.tv_sec) * 1000000 +
+                   (swap->swapped_time.tv_nsec - swap->queued_time.tv_nsec) / 1000;
+    printf ("frame %lu: %ld us from eglSwapBuffers to swap, %u frames in flight allowed\n",
+            client->frames_retired, latency, client->frames_in_flight);
+#endif
+}
+
+static void
+caching_client_retire_all_swaps (caching_client_t *client)
+{
+    unsigned int i;
+    for (i = 0; i < client->frames_in_flight; i++) {
+        pending_swap_t *swap = &client->pending_swaps[(client->next_swap + i) %
+                                                      client->frames_in_flight];
+        if (swap->in_flight)
+            caching_client_retire_swap (client, swap);
+    }
+}
+
 static EGLBoolean
 caching_client_eglSwapBuffers (void* client,
                                EGLDisplay display,
@@ -4857,7 +6473,217 @@ caching_client_eglSwapBuffers (void* client,
            state->drawable == surface))
         return EGL_FALSE;
 
-    EGLBoolean result = CACHING_CLIENT(client)->super_dispatch.eglSwapBuffers (client, display, surface);
+    caching_client_t *caching_client = CACHING_CLIENT (client);
+    if (! caching_client->frames_in_flight) {
+        EGLBoolean result = caching_client->super_dispatch.eglSwapBuffers (client, display, surface);
+        return result;
+    }
+
+    /* Picks up the swaps that are done without waiting for them, the
+     * oldest one is only waited for if the client is that far ahead.
+     * The swap interval still paces the server, and through the oldest
+     * swap, the client. */
+    unsigned int i;
+    for (i = 0; i < caching_client->frames_in_flight; i++) {
+        pending_swap_t *swap = &caching_client->pending_swaps[i];
+        if (swap->in_flight && ! result_slot_is_pending (&swap->swapped))
+            caching_client_retire_swap (caching_client, swap);
+    }
+
+    pending_swap_t *swap = &caching_client->pending_swaps[caching_client->next_swap];
+    caching_client->next_swap = (caching_client->next_swap + 1) %
+                                caching_client->frames_in_flight;
+    if (swap->in_flight)
+        caching_client_retire_swap (caching_client, swap);
+
+    swap->in_flight = true;
+    clock_gettime (CLOCK_MONOTONIC, &swap->queued_time);
+
+    command_t *command = client_get_space_for_command (COMMAND_EGLSWAPBUFFERS);
+    command_eglswapbuffers_init (command, display, surface);
+    ((command_eglswapbuffers_t *) command)->pending_swap = swap;
+    client_run_command_async_filling_slot (command, &swap->swapped);
+
+    if (caching_client->swap_failed) {
+        caching_client->swap_failed = false;
+        return EGL_FALSE;
+    }
+    return EGL_TRUE;
+}
+
+/* The fence syncs created by caching_client_eglCreateSyncKHR. */
+static link_list_t *client_syncs = NULL;
+
+static egl_sync_t *
+caching_client_lookup_sync (EGLSyncKHR handle)
+{
+    egl_sync_t *sync = NULL;
+    link_list_t *element;
+
+    mutex_lock (client_syncs_mutex);
+    for (element = client_syncs; element; element = element->next) {
+        if (element->data == handle) {
+            sync = element->data;
+            break;
+        }
+    }
+    mutex_unlock (client_syncs_mutex);
+    return sync;
+}
+
+/* The driver's sync can only be used once the server has created it,
+ * which only takes the server catching up with the commands before it. */
+static EGLSyncKHR
+caching_client_get_driver_sync (void *client,
+                                egl_sync_t *sync)
+{
+    client_wait_for_result_slot (CLIENT (client), &sync->created);
+    return sync->driver_sync;
+}
+
+static EGLSyncKHR
+caching_client_eglCreateSyncKHR (void* client,
+                                 EGLDisplay dpy,
+                                 EGLenum type,
+                                 const EGLint *attrib_list)
+{
+    INSTRUMENT();
+
+    /* Anything but a plain fence on the current display is the driver's
+     * to validate. */
+    egl_state_t *state = client_get_current_state (CLIENT (client));
+    if (type != EGL_SYNC_FENCE_KHR ||
+        (attrib_list && attrib_list[0] != EGL_NONE) ||
+        ! state || state->display != dpy)
+        return CACHING_CLIENT(client)->super_dispatch.eglCreateSyncKHR (client, dpy,
+                                                                        type, attrib_list);
+
+    egl_sync_t *sync = malloc (sizeof (egl_sync_t));
+    sync->driver_sync = EGL_NO_SYNC_KHR;
+    sync->signaled = false;
+
+    command_t *command = client_get_space_for_command (COMMAND_EGLCREATESYNCKHR);
+    command_eglcreatesynckhr_init (command, dpy, type, NULL);
+    ((command_eglcreatesynckhr_t *) command)->client_sync = sync;
+    client_run_command_async_filling_slot (command, &sync->created);
+
+    mutex_lock (client_syncs_mutex);
+    link_list_prepend (&client_syncs, sync, free);
+    mutex_unlock (client_syncs_mutex);
+    return (EGLSyncKHR) sync;
+}
+
+static EGLBoolean
+caching_client_eglDestroySyncKHR (void* client,
+                                  EGLDisplay dpy,
+                                  EGLSyncKHR handle)
+{
+    INSTRUMENT();
+
+    egl_sync_t *sync = caching_client_lookup_sync (handle);
+    if (! sync)
+        return CACHING_CLIENT(client)->super_dispatch.eglDestroySyncKHR (client, dpy, handle);
+
+    EGLSyncKHR driver_sync = caching_client_get_driver_sync (client, sync);
+
+    mutex_lock (client_syncs_mutex);
+    link_list_delete_first_entry_matching_data (&client_syncs, sync);
+    mutex_unlock (client_syncs_mutex);
+
+    if (driver_sync == EGL_NO_SYNC_KHR)
+        return EGL_FALSE;
+    return CACHING_CLIENT(client)->super_dispatch.eglDestroySyncKHR (client, dpy, driver_sync);
+}
+
+static EGLint
+caching_client_eglClientWaitSyncKHR (void* client,
+                                     EGLDisplay dpy,
+                                     EGLSyncKHR handle,
+                                     EGLint flags,
+                                     EGLTimeKHR timeout)
+{
+    INSTRUMENT();
+
+    egl_sync_t *sync = caching_client_lookup_sync (handle);
+    if (! sync)
+        return CACHING_CLIENT(client)->super_dispatch.eglClientWaitSyncKHR (client, dpy, handle,
+                                                                            flags, timeout);
+
+    if (sync->signaled)
+        return EGL_CONDITION_SATISFIED_KHR;
+
+    /* A poll of a fence the driver has not even seen yet. */
+    if (! timeout && result_slot_is_pending (&sync->created))
+        return EGL_TIMEOUT_EXPIRED_KHR;
+
+    EGLSyncKHR driver_sync = caching_client_get_driver_sync (client, sync);
+    if (driver_sync == EGL_NO_SYNC_KHR)
+        return EGL_FALSE;
+
+    EGLint result =
+        CACHING_CLIENT(client)->super_dispatch.eglClientWaitSyncKHR (client, dpy, driver_sync,
+                                                                     flags, timeout);
+    if (result == EGL_CONDITION_SATISFIED_KHR)
+        sync->signaled = true;
+    return result;
+}
+
+static EGLBoolean
+caching_client_eglSignalSyncKHR (void* client,
+                                 EGLDisplay dpy,
+                                 EGLSyncKHR handle,
+                                 EGLenum mode)
+{
+    INSTRUMENT();
+
+    /* Fences cannot be signaled, but the driver reports the error. */
+    egl_sync_t *sync = caching_client_lookup_sync (handle);
+    if (sync)
+        handle = caching_client_get_driver_sync (client, sync);
+
+    return CACHING_CLIENT(client)->super_dispatch.eglSignalSyncKHR (client, dpy, handle, mode);
+}
+
+static EGLBoolean
+caching_client_eglGetSyncAttribKHR (void* client,
+                                    EGLDisplay dpy,
+                                    EGLSyncKHR handle,
+                                    EGLint attribute,
+                                    EGLint *value)
+{
+    INSTRUMENT();
+
+    egl_sync_t *sync = caching_client_lookup_sync (handle);
+    if (! sync)
+        return CACHING_CLIENT(client)->super_dispatch.eglGetSyncAttribKHR (client, dpy, handle,
+                                                                           attribute, value);
+
+    if (value) {
+        switch (attribute) {
+        case EGL_SYNC_TYPE_KHR:
+            *value = EGL_SYNC_FENCE_KHR;
+            return EGL_TRUE;
+        case EGL_SYNC_CONDITION_KHR:
+            *value = EGL_SYNC_PRIOR_COMMANDS_COMPLETE_KHR;
+            return EGL_TRUE;
+        case EGL_SYNC_STATUS_KHR:
+            if (sync->signaled || result_slot_is_pending (&sync->created)) {
+                *value = sync->signaled ? EGL_SIGNALED_KHR : EGL_UNSIGNALED_KHR;
+                return EGL_TRUE;
+            }
+            break;
+        }
+    }
+
+    EGLSyncKHR driver_sync = caching_client_get_driver_sync (client, sync);
+    if (driver_sync == EGL_NO_SYNC_KHR)
+        return EGL_FALSE;
+
+    EGLBoolean result =
+        CACHING_CLIENT(client)->super_dispatch.eglGetSyncAttribKHR (client, dpy, driver_sync,
+                                                                    attribute, value);
+    if (result && attribute == EGL_SYNC_STATUS_KHR && *value == EGL_SIGNALED_KHR)
+        sync->signaled = true;
     return result;
 }
 
@@ -4949,13 +6775,55 @@ caching_client_eglCreateContext (void *client,
     if (share_context != EGL_NO_CONTEXT) {
 	mutex_lock (cached_gl_states_mutex);
         egl_state_t *new_state = _caching_client_get_or_create_state (dpy, result);
-        new_state->share_context = _caching_client_get_or_create_state (dpy, share_context);
-        new_state->share_context->contexts_sharing++;
+        egl_state_join_share_group (new_state,
+                                    _caching_client_get_or_create_state (dpy, share_context));
 	mutex_unlock (cached_gl_states_mutex);
     }
     return result;
 }
 
+/* Whether eglMakeCurrent can be queued with a successful result: the
+ * surfaces and the context were created here with the same config and
+ * the context is not current in another thread. We should be in a
+ * registry read section. */
+static bool
+caching_client_make_current_can_be_queued (egl_state_t *current_state,
+                                           EGLDisplay display,
+                                           EGLSurface draw,
+                                           EGLSurface read,
+                                           EGLContext ctx)
+{
+    if (current_state &&
+        current_state->display == display &&
+        current_state->context == ctx)
+        return cached_gl_surface_match (display, draw) &&
+               cached_gl_surface_match (display, read);
+
+    egl_state_t *state = cached_gl_state_find (display, ctx);
+    if (state && (state->active || state->destroy_ctx || state->destroy_dpy))
+        return false;
+    return cached_gl_find_display_context_surface_matching (display, ctx, draw, read);
+}
+
+/* A context another thread switched away from with a queued
+ * eglMakeCurrent stays current in that thread's server until it has run
+ * the switch, and until then the server would refuse it to us. We should
+ * be in a registry read section. */
+static void
+caching_client_wait_for_release (client_t *client,
+                                 EGLDisplay display,
+                                 EGLContext ctx)
+{
+    egl_state_t *state = cached_gl_state_find (display, ctx);
+    if (! state || state->active)
+        return;
+
+    /* Pairs with the barrier after the leaving thread clears `active`. */
+    __sync_synchronize ();
+    if (state->released.client != client)
+        client_wait_for_result_slot (client, &state->released);
+}
+
 static EGLBoolean
 caching_client_eglMakeCurrent (void* client,
                                EGLDisplay display,
@@ -4974,53 +6842,75 @@ caching_client_eglMakeCurrent (void* client,
         return EGL_TRUE;
 
     /* Everything matches, so this is a no-op. */
-    egl_state_t *matching_state = NULL;
-    bool find_draw, find_read;
-
-    bool display_and_context_match = current_state &&
-                                     current_state->display == display &&
-                                     current_state->context == ctx;
-    if (display_and_context_match) {
-        if (current_state->drawable == draw &&
-            current_state->readable == read) {
-            return EGL_TRUE;
-        }
-
-        mutex_lock (cached_gl_states_mutex);
- 
-        link_list_t **surfaces = cached_gl_surfaces (display);
+    if (current_state &&
+        current_state->display == display &&
+        current_state->context == ctx &&
+        current_state->drawable == draw &&
+        current_state->readable == read)
+        return EGL_TRUE;
 
-        matching_state = current_state;
-        find_draw = cached_gl_surface_match (surfaces, draw);
-        if (! find_draw)
-            matching_state = NULL;
+    if (CACHING_CLIENT(client)->virtual_contexts) {
+        if (caching_client_make_current_with_virtual_contexts (client, display,
+                                                               draw, read, ctx) == EGL_FALSE)
+            return EGL_FALSE;
+        if (! switching_to_none)
+            caching_client_prefetch_limits (client, client_get_current_state (CLIENT (client)));
+        return EGL_TRUE;
+    }
 
-        find_read = cached_gl_surface_match (surfaces, read);
-        if (! find_read)
-            matching_state = NULL;
+    caching_client_t *caching_client = CACHING_CLIENT (client);
+    caching_client_settle_make_currents (caching_client, 0);
 
-        mutex_unlock (cached_gl_states_mutex);
+    /* A switch to what we know the server can make current does not
+     * wait: it returns EGL_TRUE and a failure is reported by the next
+     * eglGetError. Releasing the context stays synchronous. */
+    bool queue = false;
+    if (! switching_to_none) {
+        registry_read_lock ();
+        caching_client_wait_for_release (CLIENT (client), display, ctx);
+        queue = caching_client_make_current_can_be_queued (current_state, display,
+                                                           draw, read, ctx);
+        registry_read_unlock ();
     }
 
-    /* We have found previously used draw and read surface.  Because
-     * the display and context are matching, it means we are not
-     * releasing the context in the thread, we can do async
-     */
-    if (display_and_context_match && matching_state) {
-        command_t *command = client_get_space_for_command (COMMAND_EGLMAKECURRENT);
-        command_eglmakecurrent_init (command, display, draw, read, ctx);
-        client_run_command_async (command);
-    } else {
-        /* Otherwise we must do this synchronously. */
-        if (CACHING_CLIENT(client)->super_dispatch.eglMakeCurrent (client, display,
-                                                                   draw, read, ctx) == EGL_FALSE)
+    if (queue)
+        caching_client_queue_make_current (caching_client, display, draw, read, ctx);
+    else {
+        EGLBoolean result = caching_client->super_dispatch.eglMakeCurrent (client, display,
+                                                                           draw, read, ctx);
+
+        /* The server has run the queued ones by now. */
+        caching_client_settle_make_currents (caching_client,
+                                             CACHING_CLIENT_MAX_PENDING_MAKE_CURRENTS);
+        if (result == EGL_FALSE)
             return EGL_FALSE; /* Don't do anything else if we fail. */
+        caching_client_set_binding (&caching_client->server_binding,
+                                    display, draw, read, ctx);
     }
 
     _caching_client_make_current (client, display, draw, read, ctx);
+    if (! switching_to_none)
+        caching_client_prefetch_limits (client, client_get_current_state (CLIENT (client)));
     return EGL_TRUE;
 }
 
+static EGLint
+caching_client_eglGetError (void* client)
+{
+    INSTRUMENT();
+
+    caching_client_t *caching_client = CACHING_CLIENT (client);
+    caching_client_settle_make_currents (caching_client,
+                                         CACHING_CLIENT_MAX_PENDING_MAKE_CURRENTS);
+
+    EGLint error = caching_client->super_dispatch.eglGetError (client);
+    if (caching_client->make_current_error != EGL_SUCCESS) {
+        error = caching_client->make_current_error;
+        caching_client->make_current_error = EGL_SUCCESS;
+    }
+    return error;
+}
+
 #include "caching_client_glget.c"
 
 static void
@@ -5028,11 +6918,26 @@ caching_client_init (caching_client_t *client)
 {
     client_init (&client->super);
     client->super_dispatch = client->super.dispatch;
-
-    /* Initialize the cached GL states. */
-    mutex_lock (cached_gl_states_mutex);
-    cached_gl_states ();
-    mutex_unlock (cached_gl_states_mutex);
+    client->texture_updates = NULL;
+    client->super.write_deferred_commands = caching_client_write_texture_updates;
+
+    client->frames_in_flight = caching_client_frames_in_flight_from_environment ();
+    client->pending_swaps = client->frames_in_flight ?
+        calloc (client->frames_in_flight, sizeof (pending_swap_t)) : NULL;
+    client->next_swap = 0;
+    client->frames_retired = 0;
+    client->swap_failed = false;
+
+    memset (client->pending_make_currents, 0, sizeof (client->pending_make_currents));
+    client->next_make_current = 0;
+    caching_client_set_binding (&client->server_binding, EGL_NO_DISPLAY,
+                                EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+    client->make_current_error = EGL_SUCCESS;
+
+    client->virtual_contexts = caching_client_virtual_contexts_from_environment ();
+    client->virtual_backing = NULL;
+    client->virtual_draw = EGL_NO_SURFACE;
+    client->virtual_read = EGL_NO_SURFACE;
 
     #include "caching_client_dispatch_autogen.c"
 }
@@ -5048,5 +6953,16 @@ caching_client_new ()
 void
 caching_client_destroy (caching_client_t *client)
 {
+    /* Nothing can use the updates once the server is shut down. */
+    client->super.has_deferred_commands = false;
+    if (client->texture_updates)
+        texture_update_batch_destroy (client->texture_updates);
+
+    /* The server writes into the pending swaps until it has run them. */
+    if (client->pending_swaps) {
+        caching_client_retire_all_swaps (client);
+        free (client->pending_swaps);
+    }
+
     client_destroy ((client_t *)client);
 }
@@ -10,6 +10,22 @@
  *   COMMAND_NAME_initialize (command, parameter1, parameter2, ...);
  *   client_write_command (command);
  */
+#define CACHING_CLIENT_MAX_PENDING_MAKE_CURRENTS 8
+
+typedef struct egl_binding {
+    EGLDisplay display;
+    EGLSurface draw;
+    EGLSurface read;
+    EGLContext context;
+} egl_binding_t;
+
+/* An eglMakeCurrent the client did not wait for. */
+typedef struct pending_make_current {
+    result_slot_t made_current;
+    egl_binding_t binding;
+    bool in_flight;
+} pending_make_current_t;
+
 typedef struct caching_client {
     client_t super;
 
@@ -17,6 +33,32 @@ typedef struct caching_client {
      * that we can chain up to the superclass. The process of subclassing
      * overrides the original dispatch table. */
     dispatch_table_t super_dispatch;
+
+    struct _texture_update_batch *texture_updates;
+
+    /* Swaps queued without waiting, see caching_client_eglSwapBuffers.
+     * frames_in_flight is 0 when every swap waits for the driver. */
+    pending_swap_t *pending_swaps;
+    unsigned int frames_in_flight;
+    unsigned int next_swap;
+    unsigned long frames_retired;
+    bool swap_failed;
+
+    /* eglMakeCurrent calls queued without waiting, oldest first from
+     * next_make_current, see caching_client_eglMakeCurrent. The server
+     * has server_binding current once they have all run, and the first
+     * error among them waits for eglGetError. */
+    pending_make_current_t pending_make_currents[CACHING_CLIENT_MAX_PENDING_MAKE_CURRENTS];
+    unsigned int next_make_current;
+    egl_binding_t server_binding;
+    EGLint make_current_error;
+
+    /* See caching_client_eglMakeCurrent. virtual_backing is the backing
+     * context the server has current for us, with these surfaces. */
+    bool virtual_contexts;
+    egl_state_t *virtual_backing;
+    EGLSurface virtual_draw;
+    EGLSurface virtual_read;
 } caching_client_t;
 
 private caching_client_t *
@@ -4,7 +4,26 @@
 #include "compiler_private.h"
 #include "types_private.h"
 #include "caching_client.h"
+#include "driver_capabilities.h"
 
 #define CACHING_CLIENT(object) ((caching_client_t *) (object))
 
+/* What caching_client_prefetch_limits asked the server for, filled in
+ * by it before it fills the limits_fetched slot of the state. */
+typedef struct _limits_prefetch {
+    int count;
+    limit_value_t limits[DRIVER_CAPABILITIES_MAX_LIMITS];
+} limits_prefetch_t;
+
+/* Waits for the prefetch of `state`, if there is one, and stores what
+ * the server fetched. */
+private void
+caching_client_collect_limits (void *client,
+                               egl_state_t *state);
+
+/* The same, but only if the server has answered already. */
+private void
+caching_client_collect_fetched_limits (void *client,
+                                       egl_state_t *state);
+
 #endif /* CACHING_CLIENT_PRIVATE_H */
@@ -7,6 +7,7 @@
 #include "caching_client.h"
 #include "caching_client_private.h"
 #include "command.h"
+#include "cpu_topology.h"
 #include "name_handler.h"
 
 #include <sys/prctl.h>
@@ -26,10 +27,14 @@ __thread bool initialized
     __attribute__(( tls_model ("initial-exec"))) = false;
 
 mutex_static_init (client_thread_mutex);
+mutex_static_init (server_pool_mutex);
 
 static void
 client_fill_dispatch_table (dispatch_table_t *client);
 
+static void
+client_start_server_thread (client_t *client);
+
 static bool
 on_client_thread ()
 {
@@ -71,70 +76,246 @@ start_server_thread_func (void *ptr)
     mutex_unlock (client->server_started_mutex);
     prctl (PR_SET_TIMERSLACK, 1);
 
-    pthread_t id = pthread_self ();
-    
-    int online_cpus = sysconf (_SC_NPROCESSORS_ONLN);
-    int available_cpus = sysconf (_SC_NPROCESSORS_CONF);
-
-    if (online_cpus > 1) {
-        cpu_set_t cpu_set;
-        CPU_ZERO (&cpu_set);
-        if (pthread_getaffinity_np (id, sizeof (cpu_set_t), &cpu_set) == 0) {
-
-            /* find first cpu to run on */
-            int cpu = 0;
-            int i;
-            for (i = 1; i < available_cpus; i++) {
-                if (CPU_ISSET (i, &cpu_set)) {
-                    cpu = i;
-                    break;
-                }
-            }
-            /* force server to run on cpu1 */
-            if (cpu == 0)
-                cpu = 1;
-            if (cpu != 0) {
-                for (i = 0; i < available_cpus; i++) {
-                    if (i != cpu)
-                        CPU_CLR (i, &cpu_set);
-                }
-                CPU_SET (cpu, &cpu_set);
-                pthread_setaffinity_np (id, sizeof (cpu_set_t), &cpu_set);
-            }
-        }
-    }
-
     server_start_work_loop (server);
 
     server_destroy(server);
     return NULL;
 }
 
+/* By default each client gets a server thread of its own. Setting
+ * GPUPROCESS_SERVER_THREADS makes the servers of all the clients share
+ * that many worker threads instead. A worker runs one ring at a time, so
+ * a command that blocks (a swap waiting for vsync, glFinish,
+ * glReadPixels) holds up every other ring on it, and moving between
+ * rings costs an eglMakeCurrent. The pool only pays off for processes
+ * with many clients that are mostly idle. */
+
+static void
+client_server_pool_thread_init (void)
+{
+    cpu_set_t allowed, worker_cpus;
+
+    client_thread = false;
+    prctl (PR_SET_TIMERSLACK, 1);
+
+    if (pthread_getaffinity_np (pthread_self (), sizeof (cpu_set_t), &allowed) == 0 &&
+        thread_placement_place_workers (thread_placement_from_environment (),
+                                        &allowed, &worker_cpus))
+        pthread_setaffinity_np (pthread_self (), sizeof (cpu_set_t), &worker_cpus);
+}
+
+static server_pool_t *pool = NULL;
+static bool pool_initialized = false;
+
+static server_pool_t *
+client_get_server_pool (void)
+{
+    mutex_lock (server_pool_mutex);
+    if (! pool_initialized) {
+        const char *threads = getenv ("GPUPROCESS_SERVER_THREADS");
+        long count = threads ? strtol (threads, NULL, 10) : 0;
+
+        if (count > 0)
+            pool = server_pool_new (count, client_server_pool_thread_init);
+        pool_initialized = true;
+    }
+    mutex_unlock (server_pool_mutex);
+    return pool;
+}
+
+/* Creating a ring takes a shared memory file and two mappings, so a few
+ * are made ahead of time by a thread the first client starts.
+ * The rings of destroyed clients go back there too.
+ * GPUPROCESS_PREWARMED_CLIENTS sets how many are kept, 0 turns it off. */
+#define CLIENT_BUFFER_SIZE_KB 1024
+#define CLIENT_DEFAULT_PREWARMED_RINGS 2
+#define CLIENT_MAX_PREWARMED_RINGS 16
+
+mutex_static_init (warm_rings_mutex);
+static buffer_t warm_rings[CLIENT_MAX_PREWARMED_RINGS];
+static unsigned int warm_ring_count = 0;
+static unsigned int warm_ring_target = 0;
+static bool prewarm_started = false;
+
+static bool
+client_take_warm_ring (buffer_t *buffer)
+{
+    bool taken = false;
+
+    mutex_lock (warm_rings_mutex);
+    if (warm_ring_count) {
+        *buffer = warm_rings[--warm_ring_count];
+        taken = true;
+    }
+    mutex_unlock (warm_rings_mutex);
+    return taken;
+}
+
+static void
+client_release_ring (buffer_t *buffer)
+{
+    mutex_lock (warm_rings_mutex);
+    if (warm_ring_count < warm_ring_target) {
+        /* The next client counts its tokens from 0 again. */
+        buffer_clear (buffer);
+        buffer->last_token = 0;
+        warm_rings[warm_ring_count++] = *buffer;
+        buffer = NULL;
+    }
+    mutex_unlock (warm_rings_mutex);
+
+    if (buffer)
+        buffer_free (buffer);
+}
+
+static void *
+client_prewarm_thread_func (void *ptr)
+{
+    client_thread = false;
+    client_get_server_pool ();
+
+    while (true) {
+        buffer_t buffer;
+        buffer_create (&buffer, CLIENT_BUFFER_SIZE_KB, "command");
+
+        mutex_lock (warm_rings_mutex);
+        bool full = warm_ring_count >= warm_ring_target;
+        if (! full)
+            warm_rings[warm_ring_count++] = buffer;
+        mutex_unlock (warm_rings_mutex);
+
+        if (full) {
+            buffer_free (&buffer);
+            break;
+        }
+    }
+    return NULL;
+}
+
+/* The pool workers, the prewarm thread and the servers of the clients
+ * do not exist in a forked child, and the rings are still mapped shared
+ * with the parent; so the child forgets all of them and starts its own on
+ * first use. */
+static void
+client_prepare_fork (void)
+{
+    mutex_lock (server_pool_mutex);
+    mutex_lock (warm_rings_mutex);
+}
+
+static void
+client_parent_after_fork (void)
+{
+    mutex_unlock (warm_rings_mutex);
+    mutex_unlock (server_pool_mutex);
+}
+
+static void
+client_child_after_fork (void)
+{
+    /* The workers of the parent's pool are gone, so it is left behind. */
+    pool = NULL;
+    pool_initialized = false;
+
+    while (warm_ring_count)
+        buffer_free (&warm_rings[--warm_ring_count]);
+    prewarm_started = false;
+
+    /* Its server runs in the parent; the commands of this thread would
+     * land in the parent's ring. */
+    thread_local_client = NULL;
+
+    mutex_unlock (warm_rings_mutex);
+    mutex_unlock (server_pool_mutex);
+}
+
+static void
+client_register_fork_handlers (void)
+{
+    pthread_atfork (client_prepare_fork,
+                    client_parent_after_fork,
+                    client_child_after_fork);
+}
+
+static void
+client_prewarm (void)
+{
+    static pthread_once_t fork_handlers_once = PTHREAD_ONCE_INIT;
+    pthread_once (&fork_handlers_once, client_register_fork_handlers);
+
+    mutex_lock (warm_rings_mutex);
+    bool started = prewarm_started;
+    prewarm_started = true;
+    mutex_unlock (warm_rings_mutex);
+    if (started)
+        return;
+
+    long count = CLIENT_DEFAULT_PREWARMED_RINGS;
+    const char *clients = getenv ("GPUPROCESS_PREWARMED_CLIENTS");
+    if (clients)
+        count = strtol (clients, NULL, 10);
+    if (count <= 0)
+        return;
+    if (count > CLIENT_MAX_PREWARMED_RINGS)
+        count = CLIENT_MAX_PREWARMED_RINGS;
+
+    mutex_lock (warm_rings_mutex);
+    warm_ring_target = count;
+    mutex_unlock (warm_rings_mutex);
+
+    pthread_t thread;
+    pthread_attr_t attributes;
+    pthread_attr_init (&attributes);
+    pthread_attr_setdetachstate (&attributes, PTHREAD_CREATE_DETACHED);
+    pthread_create (&thread, &attributes, client_prewarm_thread_func, NULL);
+    pthread_attr_destroy (&attributes);
+}
+
 void
 client_start_server (client_t *client)
 {
+    bool was_initializing = initializing_client;
+    initializing_client = true;
+
+    client_prewarm ();
+    if (! client_take_warm_ring (&client->buffer))
+        buffer_create (&client->buffer, CLIENT_BUFFER_SIZE_KB, "command");
+    client->server_started = true;
+
+    client_start_server_thread (client);
+    initializing_client = was_initializing;
+}
+
+static void
+client_start_server_thread (client_t *client)
+{
+    server_pool_t *pool = client_get_server_pool ();
+    if (pool) {
+        server_t *server = server_new (&client->buffer);
+        server->server_signal = &client->server_signal;
+        server->client_signal = &client->client_signal;
+        client->pool_ring = server_pool_add_ring (pool, &client->buffer,
+                                                  server_run_pooled, server);
+        return;
+    }
+
     mutex_init (client->server_started_mutex);
     mutex_lock (client->server_started_mutex);
     pthread_create (&client->server_thread, NULL, start_server_thread_func, client);
     mutex_lock (client->server_started_mutex);
     mutex_destroy (client->server_started_mutex);
-   
-    /* FIXME:
-     * We did some experiments, If on PC with quard core (show 8 CPUs)
-     * without pin client thread is faster, we can see client thread
-     * being scheduled on different cores, except the core server thread
-     * is running, but on ARM with hotplug, it seems that the kernel
-     * will sometime schedule the client and server to run on the same core
-     * which slows down the performance.  So here is the HACK 
-     */
-    int available_cpus = sysconf (_SC_NPROCESSORS_CONF);
-
-    if (available_cpus <= 4) {
-        pthread_t id = pthread_self ();
-        cpu_set_t cpu_set;
-        CPU_ZERO (&cpu_set);
-        CPU_SET (0, &cpu_set);
-        pthread_setaffinity_np (id, sizeof (cpu_set_t), &cpu_set);
+
+    /* The server thread works for this thread only, so they can be
+     * placed next to each other. */
+    cpu_set_t allowed, client_cpus, server_cpus;
+    pthread_t id = pthread_self ();
+    if (pthread_getaffinity_np (id, sizeof (cpu_set_t), &allowed) == 0 &&
+        thread_placement_place_pair (thread_placement_from_environment (), &allowed,
+                                     sched_getcpu (), &client_cpus, &server_cpus)) {
+        if (CPU_COUNT (&server_cpus))
+            pthread_setaffinity_np (client->server_thread, sizeof (cpu_set_t), &server_cpus);
+        if (CPU_COUNT (&client_cpus))
+            pthread_setaffinity_np (id, sizeof (cpu_set_t), &client_cpus);
     }
 }
 
@@ -153,8 +334,6 @@ client_init (client_t *client)
     prctl (PR_SET_TIMERSLACK, 1);
     initializing_client = true;
 
-    buffer_create (&client->buffer, 1024, "command");
-
     // We initialize the base dispatch table synchronously here, so that we
     // don't have to worry about the server thread trying to initialize it
     // at the same time.
@@ -168,8 +347,13 @@ client_init (client_t *client)
     sem_init (&client->client_signal, 0, 0);
 
     client->active_state = NULL;
-   
-    client_start_server (client);
+    client->has_deferred_commands = false;
+    client->write_deferred_commands = NULL;
+    client->pool_ring = NULL;
+
+    /* The ring and the server wait for the first command; many threads
+     * never send one. */
+    client->server_started = false;
     initializing_client = false;
 }
 
@@ -184,9 +368,10 @@ client_shutdown_server (client_t *client)
 bool
 client_destroy (client_t *client)
 {
-    client_shutdown_server (client);
-
-    buffer_free (&client->buffer);
+    if (client->server_started) {
+        client_shutdown_server (client);
+        client_release_ring (&client->buffer);
+    }
 
     sem_destroy (&client->server_signal);
     sem_destroy (&client->client_signal);
@@ -222,9 +407,15 @@ client_get_space_for_size (client_t *client,
     size_t available_space;
     command_t *write_location;
 
+    if (unlikely (! client->server_started))
+        client_start_server (client);
+
     if (size > buffer_size (&client->buffer))
         return NULL;
 
+    if (unlikely (client->has_deferred_commands))
+        client_write_deferred_commands (client);
+
     write_location = (command_t *) buffer_write_address (&client->buffer,
                                                          &available_space);
     while (! write_location || available_space < size) {
@@ -236,6 +427,25 @@ client_get_space_for_size (client_t *client,
     return write_location;
 }
 
+size_t
+client_get_buffer_size (client_t *client)
+{
+    if (unlikely (! client->server_started))
+        client_start_server (client);
+    return buffer_size (&client->buffer);
+}
+
+void
+client_write_deferred_commands (client_t *client)
+{
+    if (! client->has_deferred_commands)
+        return;
+
+    /* Cleared first, the deferred commands need buffer space too. */
+    client->has_deferred_commands = false;
+    client->write_deferred_commands (client);
+}
+
 command_t *
 client_get_space_for_command (command_type_t command_type)
 {
@@ -251,21 +461,114 @@ client_get_space_for_command (command_type_t command_type)
     return command;
 }
 
-void
-client_run_command (command_t *command)
+static unsigned int
+client_next_token (client_t *client)
 {
-    client_t *client = client_get_thread_local ();
     unsigned int token = ++client->token;
 
     /* Overflow case */
     if (token == 0)
         token = 1;
+    return token;
+}
+
+/* How long to poll last_token before sleeping on client_signal. Most
+ * commands a client waits for are done well before a round trip through
+ * the scheduler, but polling only helps if the server has a CPU of its
+ * own to run on. */
+#define CLIENT_SPIN_WAIT_ITERATIONS 2000
+
+static unsigned int
+client_spin_wait_iterations (void)
+{
+    static int iterations = -1;
+    if (iterations < 0)
+        iterations = sysconf (_SC_NPROCESSORS_ONLN) > 1 ? CLIENT_SPIN_WAIT_ITERATIONS : 0;
+    return iterations;
+}
+
+void
+client_wait_for_token (client_t *client,
+                       unsigned int token)
+{
+    unsigned int iterations = client_spin_wait_iterations ();
+    unsigned int i;
+
+    for (i = 0; i < iterations; i++) {
+        if (client_has_reached_token (client, token)) {
+            /* Drop the posts we did not sleep on; every waiter checks
+             * its condition before calling sem_wait, so none is lost. */
+            while (sem_trywait (&client->client_signal) == 0)
+                ;
+            return;
+        }
+#if defined(__i386__) || defined(__x86_64__)
+        __builtin_ia32_pause ();
+#endif
+    }
+
+    while (! client_has_reached_token (client, token))
+        sem_wait (&client->client_signal);
+}
+
+void
+client_run_command (command_t *command)
+{
+    client_t *client = client_get_thread_local ();
+    unsigned int token = client_next_token (client);
 
     command->token = token;
     client_run_command_async (command);
+    client_wait_for_token (client, token);
+}
 
-    while (client->buffer.last_token < token) {
-        sem_wait (&client->client_signal);
+void
+client_run_command_async_filling_slot (command_t *command,
+                                       result_slot_t *slot)
+{
+    client_t *client = client_get_thread_local ();
+
+    slot->pending = true;
+    slot->client = client;
+
+    /* A token makes the server post client_signal once the command
+     * has run, which is what client_wait_for_result_slot sleeps on. */
+    command->token = client_next_token (client);
+    client_run_command_async (command);
+}
+
+unsigned int
+client_run_command_async_with_token (command_t *command)
+{
+    client_t *client = client_get_thread_local ();
+    unsigned int token = client_next_token (client);
+
+    command->token = token;
+    client_run_command_async (command);
+    return token;
+}
+
+bool
+client_has_reached_token (client_t *client,
+                          unsigned int token)
+{
+    /* Written by the server thread; the difference keeps working once
+     * the tokens wrap around. */
+    unsigned int last_token = *(volatile unsigned int *) &client->buffer.last_token;
+    return (int) (last_token - token) >= 0;
+}
+
+void
+client_wait_for_result_slot (client_t *client,
+                             result_slot_t *slot)
+{
+    while (result_slot_is_pending (slot)) {
+        /* Only our own server posts our semaphore; a slot filled by
+         * another thread's server (shared contexts) has to be polled. */
+        if (slot->client == client)
+            sem_wait (&client->client_signal);
+        else
+            sched_yield ();
     }
 }
 
@@ -277,7 +580,10 @@ client_run_command_async (command_t *command)
     buffer_write_advance (&client->buffer, command->size);
 
     if (client->buffer.fill_count == command->size) {
-        sem_post (&client->server_signal);
+        if (client->pool_ring)
+            server_pool_wake_ring (client->pool_ring);
+        else
+            sem_post (&client->server_signal);
     }
 }
 
@@ -34,8 +34,16 @@ struct _client {
 
     egl_state_t *active_state;
 
+    /* Subclasses that hold commands back set this, and they are written
+     * out before the next command goes into the buffer. */
+    bool has_deferred_commands;
+    void (*write_deferred_commands) (client_t *client);
+
+    bool server_started;
     mutex_t server_started_mutex;
     thread_t server_thread;
+    /* Set when a pool worker runs our server instead of server_thread. */
+    server_pool_ring_t *pool_ring;
     bool initializing;
 
     sem_t server_signal;
@@ -67,23 +75,50 @@ client_get_space_for_size (client_t *client,
 private command_t *
 client_get_space_for_command (command_type_t command_type);
 
+private void
+client_write_deferred_commands (client_t *client);
+
 private void
 client_run_command_async (command_t *command);
 
 private void
 client_run_command (command_t *command);
 
+private void
+client_run_command_async_filling_slot (command_t *command,
+                                       result_slot_t *slot);
+
+/* Returns the token the server stores in last_token once it has
+ * submitted the command to the driver. */
+private unsigned int
+client_run_command_async_with_token (command_t *command);
+
+private bool
+client_has_reached_token (client_t *client,
+                          unsigned int token);
+
+/* Returns once the server has run the command carrying `token`. */
+private void
+client_wait_for_token (client_t *client,
+                       unsigned int token);
+
+private void
+client_wait_for_result_slot (client_t *client,
+                             result_slot_t *slot);
+
 private bool
 client_flush (client_t *client);
 
 private bool
 should_use_base_dispatch ();
 
+/* Creates the ring and starts the server, which otherwise happens with
+ * the first command. */
 private void
 client_start_server (client_t *client);
 
-private void
-client_start_server (client_t *client);
+private size_t
+client_get_buffer_size (client_t *client);
 
 private client_t *
 client_new ();
@@ -100,4 +135,20 @@ client_has_valid_state (client_t *client);
 private egl_state_t *
 client_get_current_state (client_t *client);
 
+/* The entry points generated in client_entry_points.c. The extension
+ * functions are hidden: the library exports them only as
+ * __hidden_gpuproxy_<name>, and eglGetProcAddress hands them out when the
+ * context supports one of `extensions` (_EXTENSION_FUNCTIONS in
+ * build_gles2_cmd_buffer.py). */
+typedef struct _client_entry_point {
+    const char *name;
+    __eglMustCastToProperFunctionPointerType address;
+    bool hidden;
+    const char *extensions[2];
+} client_entry_point_t;
+
+/* NULL if there is no generated entry point with that name. */
+private const client_entry_point_t *
+client_entry_point_find (const char *name);
+
 #endif /* CLIENT_H */
@@ -0,0 +1,569 @@
+#include "config.h"
+#include "driver_capabilities.h"
+#include "dispatch_table.h"
+#include "library_info.h"
+#include "thread_private.h"
+#include <GLES2/gl2ext.h>
+#include <limits.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+typedef enum _limit_type {
+    LIMIT_INTEGER,
+    LIMIT_FLOAT,
+    LIMIT_FLOAT_RANGE
+} limit_type_t;
+
+typedef struct _driver_limit {
+    GLenum pname;
+    limit_type_t type;
+    size_t value_offset;
+    size_t queried_offset;
+    /* Queried only when the context has it, the query fails otherwise. */
+    const char *extension;
+} driver_limit_t;
+
+#define LIMIT(pname, type, var, extension) \
+    { pname, type, offsetof (egl_state_t, var), offsetof (egl_state_t, var##_queried), extension }
+
+/* The has_cache pnames of the glGet generator. */
+static const driver_limit_t limits[] = {
+    LIMIT (GL_MAX_COMBINED_TEXTURE_IMAGE_UNITS, LIMIT_INTEGER, max_combined_texture_image_units, NULL),
+    LIMIT (GL_MAX_CUBE_MAP_TEXTURE_SIZE, LIMIT_INTEGER, max_cube_map_texture_size, NULL),
+    LIMIT (GL_MAX_FRAGMENT_UNIFORM_VECTORS, LIMIT_INTEGER, max_fragment_uniform_vectors, NULL),
+    LIMIT (GL_MAX_RENDERBUFFER_SIZE, LIMIT_INTEGER, max_renderbuffer_size, NULL),
+    LIMIT (GL_MAX_TEXTURE_IMAGE_UNITS, LIMIT_INTEGER, max_texture_image_units, NULL),
+    LIMIT (GL_MAX_VARYING_VECTORS, LIMIT_INTEGER, max_varying_vectors, NULL),
+    LIMIT (GL_MAX_TEXTURE_SIZE, LIMIT_INTEGER, max_texture_size, NULL),
+    LIMIT (GL_MAX_VERTEX_ATTRIBS, LIMIT_INTEGER, max_vertex_attribs, NULL),
+    LIMIT (GL_MAX_VERTEX_TEXTURE_IMAGE_UNITS, LIMIT_INTEGER, max_vertex_texture_image_units, NULL),
+    LIMIT (GL_MAX_VERTEX_UNIFORM_VECTORS, LIMIT_INTEGER, max_vertex_uniform_vectors, NULL),
+    LIMIT (GL_SUBPIXEL_BITS, LIMIT_INTEGER, subpixel_bits, NULL),
+    LIMIT (GL_ALIASED_LINE_WIDTH_RANGE, LIMIT_FLOAT_RANGE, aliased_line_width_range, NULL),
+    LIMIT (GL_ALIASED_POINT_SIZE_RANGE, LIMIT_FLOAT_RANGE, aliased_point_size_range, NULL),
+    LIMIT (GL_MAX_TEXTURE_MAX_ANISOTROPY_EXT, LIMIT_FLOAT, max_texture_max_anisotropy,
+           "GL_EXT_texture_filter_anisotropic"),
+};
+#define LIMIT_COUNT (sizeof (limits) / sizeof (limits[0]))
+
+static const GLenum string_names[] = {
+    GL_VENDOR,
+    GL_RENDERER,
+    GL_VERSION,
+    GL_SHADING_LANGUAGE_VERSION,
+    GL_EXTENSIONS
+};
+#define STRING_COUNT (sizeof (string_names) / sizeof (string_names[0]))
+
+/* What a display, or a driver in the file, is known to answer. */
+typedef struct _driver_capabilities {
+    EGLDisplay display;
+    /* The EGL_VENDOR and EGL_VERSION of the display, NULL if unknown. */
+    char *driver;
+    /* A display starts from the record of its driver and does not use it
+     * until a glGetString agrees with it. */
+    bool verified;
+    char *strings[STRING_COUNT];
+    double limits[LIMIT_COUNT][2];
+    bool limits_known[LIMIT_COUNT];
+    struct _driver_capabilities *next;
+} driver_capabilities_t;
+
+/* All of it is guarded by capabilities_mutex. `drivers` holds one record
+ * for each driver, what the file holds or would if there is none. */
+static driver_capabilities_t *displays = NULL;
+static driver_capabilities_t *drivers = NULL;
+static char persisted_path[PATH_MAX];
+static pthread_once_t persisted_once = PTHREAD_ONCE_INIT;
+mutex_static_init (capabilities_mutex);
+
+static int
+_string_index (GLenum name)
+{
+    unsigned int i;
+    for (i = 0; i < STRING_COUNT; i++) {
+        if (string_names[i] == name)
+            return i;
+    }
+    return -1;
+}
+
+static int
+_limit_index (GLenum pname)
+{
+    unsigned int i;
+    for (i = 0; i < LIMIT_COUNT; i++) {
+        if (limits[i].pname == pname)
+            return i;
+    }
+    return -1;
+}
+
+/* Whether `capabilities` did not know it before. */
+static bool
+_set_string (driver_capabilities_t *capabilities,
+             int index,
+             const char *value)
+{
+    if (capabilities->strings[index] &&
+        ! strcmp (capabilities->strings[index], value))
+        return false;
+
+    free (capabilities->strings[index]);
+    capabilities->strings[index] = strdup (value);
+    return true;
+}
+
+static bool
+_set_limit (driver_capabilities_t *capabilities,
+            int index,
+            const double *values)
+{
+    if (capabilities->limits_known[index] &&
+        capabilities->limits[index][0] == values[0] &&
+        capabilities->limits[index][1] == values[1])
+        return false;
+
+    capabilities->limits[index][0] = values[0];
+    capabilities->limits[index][1] = values[1];
+    capabilities->limits_known[index] = true;
+    return true;
+}
+
+static bool
+_is_empty (const driver_capabilities_t *capabilities)
+{
+    unsigned int i;
+    for (i = 0; i < STRING_COUNT; i++) {
+        if (capabilities->strings[i])
+            return false;
+    }
+    for (i = 0; i < LIMIT_COUNT; i++) {
+        if (capabilities->limits_known[i])
+            return false;
+    }
+    return true;
+}
+
+static void
+_clear (driver_capabilities_t *capabilities)
+{
+    unsigned int i;
+    for (i = 0; i < STRING_COUNT; i++) {
+        free (capabilities->strings[i]);
+        capabilities->strings[i] = NULL;
+    }
+    memset (capabilities->limits_known, 0, sizeof (capabilities->limits_known));
+}
+
+/* Called with capabilities_mutex held, NULL when `driver` is. */
+static driver_capabilities_t *
+_get_driver (const char *driver)
+{
+    driver_capabilities_t *capabilities;
+
+    if (! driver)
+        return NULL;
+
+    for (capabilities = drivers; capabilities; capabilities = capabilities->next) {
+        if (! strcmp (capabilities->driver, driver))
+            return capabilities;
+    }
+
+    capabilities = calloc (1, sizeof (driver_capabilities_t));
+    capabilities->driver = strdup (driver);
+    capabilities->next = drivers;
+    drivers = capabilities;
+    return capabilities;
+}
+
+/* A "driver <EGL_VENDOR> <EGL_VERSION>" line starts the record of each
+ * driver, followed by one "<pname> <value>" line for each thing known,
+ * strings taking the rest of their line and ranges two values. */
+static void
+_load_persisted (void)
+{
+    library_info_t libraries[2];
+    char *line = NULL;
+    size_t line_size = 0;
+    ssize_t length;
+
+    persisted_path[0] = '\0';
+
+    const char *enabled = getenv ("GPUPROCESS_CAPABILITY_CACHE");
+    if (enabled && ! strtol (enabled, NULL, 10))
+        return;
+
+    if (! library_info_get (dispatch_table_get_libegl_handle (), &libraries[0]) ||
+        ! library_info_get (dispatch_table_get_libgl_handle (), &libraries[1]) ||
+        ! library_info_cache_path (libraries, 2, "capabilities",
+                                   persisted_path, sizeof (persisted_path))) {
+        persisted_path[0] = '\0';
+        return;
+    }
+
+    FILE *file = fopen (persisted_path, "r");
+    if (! file)
+        return;
+
+    driver_capabilities_t *record = NULL;
+    while ((length = getline (&line, &line_size, file)) > 0) {
+        char *value;
+        int index;
+
+        if (line[length - 1] == '\n')
+            line[length - 1] = '\0';
+        if (! strncmp (line, "driver ", 7)) {
+            record = _get_driver (line + 7);
+            continue;
+        }
+
+        GLenum pname = strtoul (line, &value, 16);
+        if (! record || *value++ != ' ')
+            continue;
+
+        if ((index = _string_index (pname)) >= 0)
+            _set_string (record, index, value);
+        else if ((index = _limit_index (pname)) >= 0) {
+            double values[2] = { 0, 0 };
+            char *end;
+            values[0] = strtod (value, &end);
+            if (limits[index].type == LIMIT_FLOAT_RANGE)
+                values[1] = strtod (end, NULL);
+            _set_limit (record, index, values);
+        }
+    }
+    free (line);
+    fclose (file);
+}
+
+/* Written whole to a temporary file and renamed over the old one, so a
+ * process reading it at the same time sees one or the other. Called
+ * with capabilities_mutex held. */
+static void
+_save_persisted (void)
+{
+    char temporary_path[PATH_MAX + 8];
+    unsigned int i;
+    int fd;
+
+    if (! persisted_path[0])
+        return;
+
+    snprintf (temporary_path, sizeof (temporary_path), "%s.XXXXXX", persisted_path);
+    fd = mkstemp (temporary_path);
+    if (fd < 0)
+        return;
+
+    FILE *file = fdopen (fd, "w");
+    if (! file) {
+        close (fd);
+        unlink (temporary_path);
+        return;
+    }
+
+    driver_capabilities_t *record;
+    for (record = drivers; record; record = record->next) {
+        if (_is_empty (record))
+            continue;
+
+        fprintf (file, "driver %s\n", record->driver);
+        for (i = 0; i < STRING_COUNT; i++) {
+            if (record->strings[i])
+                fprintf (file, "%x %s\n", string_names[i], record->strings[i]);
+        }
+        for (i = 0; i < LIMIT_COUNT; i++) {
+            if (! record->limits_known[i])
+                continue;
+            if (limits[i].type == LIMIT_FLOAT_RANGE)
+                fprintf (file, "%x %.9g %.9g\n", limits[i].pname,
+                         record->limits[i][0], record->limits[i][1]);
+            else
+                fprintf (file, "%x %.9g\n", limits[i].pname, record->limits[i][0]);
+        }
+    }
+
+    if (fclose (file) || rename (temporary_path, persisted_path))
+        unlink (temporary_path);
+}
+
+/* Called with capabilities_mutex held. A display seen for the first time
+ * starts from the record of `driver`. */
+static driver_capabilities_t *
+_get_display (EGLDisplay display,
+              const char *driver)
+{
+    driver_capabilities_t *capabilities;
+    unsigned int i;
+
+    for (capabilities = displays; capabilities; capabilities = capabilities->next) {
+        if (capabilities->display == display)
+            return capabilities;
+    }
+
+    capabilities = calloc (1, sizeof (driver_capabilities_t));
+    capabilities->display = display;
+    capabilities->verified = true;
+
+    driver_capabilities_t *record = _get_driver (driver);
+    if (record) {
+        capabilities->driver = strdup (driver);
+        capabilities->verified = _is_empty (record);
+        for (i = 0; i < STRING_COUNT; i++) {
+            if (record->strings[i])
+                capabilities->strings[i] = strdup (record->strings[i]);
+        }
+        memcpy (capabilities->limits, record->limits, sizeof (record->limits));
+        memcpy (capabilities->limits_known, record->limits_known,
+                sizeof (record->limits_known));
+    }
+
+    capabilities->next = displays;
+    displays = capabilities;
+    return capabilities;
+}
+
+/* A record another driver of the same name wrote, such as a device of
+ * another vendor behind a dispatch library, is dropped along with what
+ * the display took from it. Returns whether the record changed. */
+static bool
+_drop_unverified (driver_capabilities_t *capabilities)
+{
+    driver_capabilities_t *record = _get_driver (capabilities->driver);
+
+    capabilities->verified = true;
+    _clear (capabilities);
+    if (! record || _is_empty (record))
+        return false;
+    _clear (record);
+    return true;
+}
+
+static void
+_store_limit (egl_state_t *state,
+              int index,
+              const double *values)
+{
+    const driver_limit_t *limit = &limits[index];
+    char *base = (char *) state;
+
+    switch (limit->type) {
+    case LIMIT_INTEGER:
+        *(GLint *) (base + limit->value_offset) = values[0];
+        break;
+    case LIMIT_FLOAT:
+        *(GLfloat *) (base + limit->value_offset) = values[0];
+        break;
+    case LIMIT_FLOAT_RANGE:
+        ((GLfloat *) (base + limit->value_offset))[0] = values[0];
+        ((GLfloat *) (base + limit->value_offset))[1] = values[1];
+        break;
+    }
+    *(bool *) (base + limit->queried_offset) = true;
+}
+
+/* False if the state has not queried it. */
+static bool
+_load_limit (const egl_state_t *state,
+             int index,
+             double *values)
+{
+    const driver_limit_t *limit = &limits[index];
+    const char *base = (const char *) state;
+
+    if (! *(const bool *) (base + limit->queried_offset))
+        return false;
+
+    values[1] = 0;
+    switch (limit->type) {
+    case LIMIT_INTEGER:
+        values[0] = *(const GLint *) (base + limit->value_offset);
+        break;
+    case LIMIT_FLOAT:
+        values[0] = *(const GLfloat *) (base + limit->value_offset);
+        break;
+    case LIMIT_FLOAT_RANGE:
+        values[0] = ((const GLfloat *) (base + limit->value_offset))[0];
+        values[1] = ((const GLfloat *) (base + limit->value_offset))[1];
+        break;
+    }
+    return true;
+}
+
+/* Sets what the state does not know yet. */
+static void
+_fill_state (egl_state_t *state,
+             const driver_capabilities_t *capabilities)
+{
+    unsigned int i;
+
+    for (i = 0; i < STRING_COUNT; i++) {
+        const char *value = capabilities->strings[i];
+        if (! value)
+            continue;
+
+        switch (string_names[i]) {
+        case GL_VENDOR:
+            if (! state->vendor_string)
+                state->vendor_string = strdup (value);
+            break;
+        case GL_RENDERER:
+            if (! state->renderer_string)
+                state->renderer_string = strdup (value);
+            break;
+        case GL_VERSION:
+            if (! state->version_string)
+                state->version_string = strdup (value);
+            break;
+        case GL_SHADING_LANGUAGE_VERSION:
+            if (! state->shading_language_version_string)
+                state->shading_language_version_string = strdup (value);
+            break;
+        case GL_EXTENSIONS:
+            if (! state->extensions_string)
+                egl_state_set_extensions_string (state, value);
+            break;
+        }
+    }
+
+    for (i = 0; i < LIMIT_COUNT; i++) {
+        double values[2] = { 0, 0 };
+        if (capabilities->limits_known[i] && ! _load_limit (state, i, values))
+            _store_limit (state, i, capabilities->limits[i]);
+    }
+}
+
+void
+driver_capabilities_fill_state (egl_state_t *state,
+                                const char *driver)
+{
+    pthread_once (&persisted_once, _load_persisted);
+    mutex_lock (capabilities_mutex);
+    driver_capabilities_t *capabilities = _get_display (state->display, driver);
+    if (capabilities->verified)
+        _fill_state (state, capabilities);
+    mutex_unlock (capabilities_mutex);
+}
+
+void
+driver_capabilities_add_string (egl_state_t *state,
+                                GLenum name,
+                                const char *value)
+{
+    bool changed = false;
+    int index = _string_index (name);
+    if (index < 0)
+        return;
+
+    pthread_once (&persisted_once, _load_persisted);
+    mutex_lock (capabilities_mutex);
+    driver_capabilities_t *capabilities = _get_display (state->display, NULL);
+
+    if (! capabilities->verified) {
+        const char *known = capabilities->strings[index];
+        if (known && ! strcmp (known, value)) {
+            capabilities->verified = true;
+            _fill_state (state, capabilities);
+        } else
+            changed = _drop_unverified (capabilities);
+    }
+
+    driver_capabilities_t *record = _get_driver (capabilities->driver);
+    _set_string (capabilities, index, value);
+    if (record && _set_string (record, index, value))
+        changed = true;
+
+    if (changed)
+        _save_persisted ();
+    mutex_unlock (capabilities_mutex);
+}
+
+void
+driver_capabilities_add_limits (egl_state_t *state)
+{
+    bool changed = false;
+    unsigned int i;
+
+    pthread_once (&persisted_once, _load_persisted);
+    mutex_lock (capabilities_mutex);
+    driver_capabilities_t *capabilities = _get_display (state->display, NULL);
+
+    /* A limit that disagrees tells as much as a string. */
+    for (i = 0; i < LIMIT_COUNT && ! capabilities->verified; i++) {
+        double values[2] = { 0, 0 };
+        if (_load_limit (state, i, values) && capabilities->limits_known[i] &&
+            (capabilities->limits[i][0] != values[0] ||
+             capabilities->limits[i][1] != values[1]))
+            changed = _drop_unverified (capabilities);
+    }
+
+    driver_capabilities_t *record = _get_driver (capabilities->driver);
+    for (i = 0; i < LIMIT_COUNT; i++) {
+        double values[2] = { 0, 0 };
+        if (! _load_limit (state, i, values))
+            continue;
+        _set_limit (capabilities, i, values);
+        if (record && _set_limit (record, i, values))
+            changed = true;
+    }
+
+    if (changed)
+        _save_persisted ();
+    mutex_unlock (capabilities_mutex);
+}
+
+int
+driver_capabilities_get_unknown_limits (const egl_state_t *state,
+                                        limit_value_t *limit_values)
+{
+    const char *base = (const char *) state;
+    unsigned int i;
+    int count = 0;
+
+    for (i = 0; i < LIMIT_COUNT && count < DRIVER_CAPABILITIES_MAX_LIMITS; i++) {
+        if (*(const bool *) (base + limits[i].queried_offset))
+            continue;
+
+        /* Without the extension string we cannot tell, so it is left to
+         * be queried on its own. */
+        if (limits[i].extension &&
+            (! state->extension_set ||
+             ! extension_set_contains (state->extension_set, limits[i].extension)))
+            continue;
+
+        limit_values[count].pname = limits[i].pname;
+        limit_values[count].is_float = limits[i].type != LIMIT_INTEGER;
+        count++;
+    }
+    return count;
+}
+
+void
+driver_capabilities_set_limits (egl_state_t *state,
+                                const limit_value_t *limit_values,
+                                int count)
+{
+    int i;
+
+    for (i = 0; i < count; i++) {
+        const limit_value_t *limit = &limit_values[i];
+        int index = _limit_index (limit->pname);
+        double values[2] = { 0, 0 };
+
+        if (index < 0)
+            continue;
+        if (limit->is_float) {
+            values[0] = limit->value.floats[0];
+            values[1] = limit->value.floats[1];
+        } else {
+            values[0] = limit->value.integers[0];
+            values[1] = limit->value.integers[1];
+        }
+        _store_limit (state, index, values);
+    }
+
+    driver_capabilities_add_limits (state);
+}
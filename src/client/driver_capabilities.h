@@ -0,0 +1,61 @@
+#ifndef GPUPROCESS_DRIVER_CAPABILITIES_H
+#define GPUPROCESS_DRIVER_CAPABILITIES_H
+
+#include "compiler_private.h"
+#include "command.h"
+#include "egl_state.h"
+#include <EGL/egl.h>
+#include <GLES2/gl2.h>
+
+/* What glGetString and the implementation limits of glGet report depends
+ * on the driver and the display, not on the context. The first context
+ * of a display to ask the server adds the answer to a record of the
+ * display shared by the whole process, and the contexts made after that
+ * start out knowing it.
+ *
+ * The answers are also kept for each driver, named by the EGL_VENDOR and
+ * EGL_VERSION of its displays, in a file named after the build-ids of the
+ * EGL and GLES libraries (see library_info.h). A display starts from the
+ * record of its driver but does not use it until the driver has answered
+ * a glGetString the way the record says; an answer that disagrees drops
+ * the record. So the first context of a display asks once, and the
+ * answers of one driver do not reach a display of another.
+ * GPUPROCESS_CAPABILITY_CACHE=0 keeps the records in memory only. */
+
+/* Copies what is known about the display of `state` into it, for a state
+ * that is new. The limits it sets are marked queried. `driver` names the
+ * driver of the display, NULL if it is not known, and is only looked at
+ * the first time the display is seen. */
+private void
+driver_capabilities_fill_state (egl_state_t *state,
+                                const char *driver);
+
+/* `value` is the string glGetString returned for `name` in `state`, as
+ * the driver reported it. If it confirms the record of the display,
+ * `state` is filled from it. */
+private void
+driver_capabilities_add_string (egl_state_t *state,
+                                GLenum name,
+                                const char *value);
+
+/* Adds the implementation limits `state` has queried to the record of
+ * its display. */
+private void
+driver_capabilities_add_limits (egl_state_t *state);
+
+#define DRIVER_CAPABILITIES_MAX_LIMITS 16
+
+/* Writes the pnames of the limits `state` caches but does not know into
+ * `limits`, for caching_client_prefetch_limits, and returns how many. */
+private int
+driver_capabilities_get_unknown_limits (const egl_state_t *state,
+                                        limit_value_t *limits);
+
+/* Stores fetched limits in `state`, marks them queried and adds them to
+ * the record of its display. */
+private void
+driver_capabilities_set_limits (egl_state_t *state,
+                                const limit_value_t *limits,
+                                int count);
+
+#endif /* GPUPROCESS_DRIVER_CAPABILITIES_H */
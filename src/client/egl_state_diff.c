@@ -0,0 +1,422 @@
+#include "config.h"
+#include "egl_state_diff.h"
+#include <string.h>
+
+typedef struct _state_diff {
+    dispatch_table_t *dispatch;
+    void *object;
+    unsigned int calls;
+
+    /* What the driver has bound while the diff is written. */
+    GLint active_texture;
+    GLint array_buffer_binding;
+} state_diff_t;
+
+static void
+_diff_capability (state_diff_t *diff,
+                  GLenum capability,
+                  GLboolean from,
+                  GLboolean to)
+{
+    if (from == to)
+        return;
+
+    if (to)
+        diff->dispatch->glEnable (diff->object, capability);
+    else
+        diff->dispatch->glDisable (diff->object, capability);
+    diff->calls++;
+}
+
+static void
+_diff_capabilities (state_diff_t *diff,
+                    egl_state_t *from,
+                    egl_state_t *to)
+{
+    _diff_capability (diff, GL_BLEND, from->blend, to->blend);
+    _diff_capability (diff, GL_CULL_FACE, from->cull_face, to->cull_face);
+    _diff_capability (diff, GL_DEPTH_TEST, from->depth_test, to->depth_test);
+    _diff_capability (diff, GL_DITHER, from->dither, to->dither);
+    _diff_capability (diff, GL_POLYGON_OFFSET_FILL,
+                      from->polygon_offset_fill, to->polygon_offset_fill);
+    _diff_capability (diff, GL_SAMPLE_ALPHA_TO_COVERAGE,
+                      from->sample_alpha_to_coverage, to->sample_alpha_to_coverage);
+    _diff_capability (diff, GL_SAMPLE_COVERAGE,
+                      from->sample_coverage, to->sample_coverage);
+    _diff_capability (diff, GL_SCISSOR_TEST, from->scissor_test, to->scissor_test);
+    _diff_capability (diff, GL_STENCIL_TEST, from->stencil_test, to->stencil_test);
+}
+
+static void
+_diff_blending (state_diff_t *diff,
+                egl_state_t *from,
+                egl_state_t *to)
+{
+    dispatch_table_t *dispatch = diff->dispatch;
+
+    if (memcmp (from->blend_color, to->blend_color, sizeof (to->blend_color))) {
+        dispatch->glBlendColor (diff->object, to->blend_color[0], to->blend_color[1],
+                                to->blend_color[2], to->blend_color[3]);
+        diff->calls++;
+    }
+
+    if (from->blend_src[0] != to->blend_src[0] ||
+        from->blend_src[1] != to->blend_src[1] ||
+        from->blend_dst[0] != to->blend_dst[0] ||
+        from->blend_dst[1] != to->blend_dst[1]) {
+        dispatch->glBlendFuncSeparate (diff->object, to->blend_src[0], to->blend_dst[0],
+                                       to->blend_src[1], to->blend_dst[1]);
+        diff->calls++;
+    }
+
+    if (from->blend_equation[0] != to->blend_equation[0] ||
+        from->blend_equation[1] != to->blend_equation[1]) {
+        dispatch->glBlendEquationSeparate (diff->object, to->blend_equation[0],
+                                           to->blend_equation[1]);
+        diff->calls++;
+    }
+}
+
+static void
+_diff_stencil (state_diff_t *diff,
+               egl_state_t *from,
+               egl_state_t *to)
+{
+    dispatch_table_t *dispatch = diff->dispatch;
+
+    if (from->stencil_func != to->stencil_func ||
+        from->stencil_ref != to->stencil_ref ||
+        from->stencil_value_mask != to->stencil_value_mask) {
+        dispatch->glStencilFuncSeparate (diff->object, GL_FRONT, to->stencil_func,
+                                         to->stencil_ref, to->stencil_value_mask);
+        diff->calls++;
+    }
+    if (from->stencil_back_func != to->stencil_back_func ||
+        from->stencil_back_ref != to->stencil_back_ref ||
+        from->stencil_back_value_mask != to->stencil_back_value_mask) {
+        dispatch->glStencilFuncSeparate (diff->object, GL_BACK, to->stencil_back_func,
+                                         to->stencil_back_ref, to->stencil_back_value_mask);
+        diff->calls++;
+    }
+
+    if (from->stencil_fail != to->stencil_fail ||
+        from->stencil_pass_depth_fail != to->stencil_pass_depth_fail ||
+        from->stencil_pass_depth_pass != to->stencil_pass_depth_pass) {
+        dispatch->glStencilOpSeparate (diff->object, GL_FRONT, to->stencil_fail,
+                                       to->stencil_pass_depth_fail,
+                                       to->stencil_pass_depth_pass);
+        diff->calls++;
+    }
+    if (from->stencil_back_fail != to->stencil_back_fail ||
+        from->stencil_back_pass_depth_fail != to->stencil_back_pass_depth_fail ||
+        from->stencil_back_pass_depth_pass != to->stencil_back_pass_depth_pass) {
+        dispatch->glStencilOpSeparate (diff->object, GL_BACK, to->stencil_back_fail,
+                                       to->stencil_back_pass_depth_fail,
+                                       to->stencil_back_pass_depth_pass);
+        diff->calls++;
+    }
+
+    if (from->stencil_writemask != to->stencil_writemask) {
+        dispatch->glStencilMaskSeparate (diff->object, GL_FRONT, to->stencil_writemask);
+        diff->calls++;
+    }
+    if (from->stencil_back_writemask != to->stencil_back_writemask) {
+        dispatch->glStencilMaskSeparate (diff->object, GL_BACK, to->stencil_back_writemask);
+        diff->calls++;
+    }
+
+    if (from->stencil_clear_value != to->stencil_clear_value) {
+        dispatch->glClearStencil (diff->object, to->stencil_clear_value);
+        diff->calls++;
+    }
+}
+
+static void
+_diff_rasterization (state_diff_t *diff,
+                     egl_state_t *from,
+                     egl_state_t *to)
+{
+    dispatch_table_t *dispatch = diff->dispatch;
+
+    if (memcmp (from->viewport, to->viewport, sizeof (to->viewport))) {
+        dispatch->glViewport (diff->object, to->viewport[0], to->viewport[1],
+                              to->viewport[2], to->viewport[3]);
+        diff->calls++;
+    }
+    if (memcmp (from->scissor_box, to->scissor_box, sizeof (to->scissor_box))) {
+        dispatch->glScissor (diff->object, to->scissor_box[0], to->scissor_box[1],
+                             to->scissor_box[2], to->scissor_box[3]);
+        diff->calls++;
+    }
+
+    if (memcmp (from->color_clear_value, to->color_clear_value,
+                sizeof (to->color_clear_value))) {
+        dispatch->glClearColor (diff->object,
+                                to->color_clear_value[0], to->color_clear_value[1],
+                                to->color_clear_value[2], to->color_clear_value[3]);
+        diff->calls++;
+    }
+    if (memcmp (from->color_writemask, to->color_writemask, sizeof (to->color_writemask))) {
+        dispatch->glColorMask (diff->object,
+                               to->color_writemask[0], to->color_writemask[1],
+                               to->color_writemask[2], to->color_writemask[3]);
+        diff->calls++;
+    }
+
+    if (from->cull_face_mode != to->cull_face_mode) {
+        dispatch->glCullFace (diff->object, to->cull_face_mode);
+        diff->calls++;
+    }
+    if (from->front_face != to->front_face) {
+        dispatch->glFrontFace (diff->object, to->front_face);
+        diff->calls++;
+    }
+    if (from->line_width != to->line_width) {
+        dispatch->glLineWidth (diff->object, to->line_width);
+        diff->calls++;
+    }
+    if (from->polygon_offset_factor != to->polygon_offset_factor ||
+        from->polygon_offset_units != to->polygon_offset_units) {
+        dispatch->glPolygonOffset (diff->object, to->polygon_offset_factor,
+                                   to->polygon_offset_units);
+        diff->calls++;
+    }
+    if (from->sample_coverage_value != to->sample_coverage_value ||
+        from->sample_coverage_invert != to->sample_coverage_invert) {
+        dispatch->glSampleCoverage (diff->object, to->sample_coverage_value,
+                                    to->sample_coverage_invert);
+        diff->calls++;
+    }
+
+    if (from->depth_clear_value != to->depth_clear_value) {
+        dispatch->glClearDepthf (diff->object, to->depth_clear_value);
+        diff->calls++;
+    }
+    if (from->depth_func != to->depth_func) {
+        dispatch->glDepthFunc (diff->object, to->depth_func);
+        diff->calls++;
+    }
+    if (from->depth_range[0] != to->depth_range[0] ||
+        from->depth_range[1] != to->depth_range[1]) {
+        dispatch->glDepthRangef (diff->object, to->depth_range[0], to->depth_range[1]);
+        diff->calls++;
+    }
+    if (from->depth_writemask != to->depth_writemask) {
+        dispatch->glDepthMask (diff->object, to->depth_writemask);
+        diff->calls++;
+    }
+
+    if (from->generate_mipmap_hint != to->generate_mipmap_hint) {
+        dispatch->glHint (diff->object, GL_GENERATE_MIPMAP_HINT, to->generate_mipmap_hint);
+        diff->calls++;
+    }
+    if (from->pack_alignment != to->pack_alignment) {
+        dispatch->glPixelStorei (diff->object, GL_PACK_ALIGNMENT, to->pack_alignment);
+        diff->calls++;
+    }
+    if (from->unpack_alignment != to->unpack_alignment) {
+        dispatch->glPixelStorei (diff->object, GL_UNPACK_ALIGNMENT, to->unpack_alignment);
+        diff->calls++;
+    }
+}
+
+static void
+_diff_set_active_texture (state_diff_t *diff,
+                          GLint active_texture)
+{
+    if (diff->active_texture == active_texture)
+        return;
+    diff->dispatch->glActiveTexture (diff->object, active_texture);
+    diff->active_texture = active_texture;
+    diff->calls++;
+}
+
+static void
+_diff_textures (state_diff_t *diff,
+                egl_state_t *from,
+                egl_state_t *to)
+{
+    static const GLenum targets[] = { GL_TEXTURE_2D, GL_TEXTURE_CUBE_MAP, GL_TEXTURE_3D_OES };
+    unsigned int unit, target;
+
+    for (unit = 0; unit < EGL_STATE_MAX_TEXTURE_UNITS; unit++) {
+        for (target = 0; target < 3; target++) {
+            GLint texture = to->texture_unit_binding[unit][target];
+            if (from->texture_unit_binding[unit][target] == texture)
+                continue;
+
+            _diff_set_active_texture (diff, GL_TEXTURE0 + unit);
+            diff->dispatch->glBindTexture (diff->object, targets[target], texture);
+            diff->calls++;
+        }
+    }
+
+    _diff_set_active_texture (diff, to->active_texture);
+}
+
+static void
+_diff_bind_array_buffer (state_diff_t *diff,
+                         GLint buffer)
+{
+    if (diff->array_buffer_binding == buffer)
+        return;
+    diff->dispatch->glBindBuffer (diff->object, GL_ARRAY_BUFFER, buffer);
+    diff->array_buffer_binding = buffer;
+    diff->calls++;
+}
+
+static vertex_attrib_t *
+_find_attrib (egl_state_t *state,
+              GLuint index)
+{
+    int i;
+    for (i = 0; i < state->vertex_attribs.count; i++) {
+        if (state->vertex_attribs.attribs[i].index == index)
+            return &state->vertex_attribs.attribs[i];
+    }
+    return NULL;
+}
+
+/* Attributes reading client memory are specified again by every draw,
+ * so only the ones reading buffers need their pointers replayed. */
+static void
+_diff_attrib (state_diff_t *diff,
+              GLuint index,
+              vertex_attrib_t *from,
+              vertex_attrib_t *to)
+{
+    GLboolean from_enabled = from ? from->array_enabled : GL_FALSE;
+    GLboolean to_enabled = to ? to->array_enabled : GL_FALSE;
+
+    if (from_enabled != to_enabled) {
+        if (to_enabled)
+            diff->dispatch->glEnableVertexAttribArray (diff->object, index);
+        else
+            diff->dispatch->glDisableVertexAttribArray (diff->object, index);
+        diff->calls++;
+    }
+
+    if (! to || ! to->array_buffer_binding)
+        return;
+    if (from &&
+        from->array_buffer_binding == to->array_buffer_binding &&
+        from->size == to->size &&
+        from->type == to->type &&
+        from->array_normalized == to->array_normalized &&
+        from->stride == to->stride &&
+        from->pointer == to->pointer)
+        return;
+
+    _diff_bind_array_buffer (diff, to->array_buffer_binding);
+    diff->dispatch->glVertexAttribPointer (diff->object, index, to->size, to->type,
+                                           to->array_normalized, to->stride,
+                                           to->pointer);
+    diff->calls++;
+}
+
+static void
+_diff_vertex_attribs (state_diff_t *diff,
+                      egl_state_t *from,
+                      egl_state_t *to)
+{
+    int i;
+
+    for (i = 0; i < to->vertex_attribs.count; i++) {
+        vertex_attrib_t *attrib = &to->vertex_attribs.attribs[i];
+        _diff_attrib (diff, attrib->index, _find_attrib (from, attrib->index), attrib);
+    }
+
+    /* The ones `to` never touched are disabled. */
+    for (i = 0; i < from->vertex_attribs.count; i++) {
+        vertex_attrib_t *attrib = &from->vertex_attribs.attribs[i];
+        if (! _find_attrib (to, attrib->index))
+            _diff_attrib (diff, attrib->index, attrib, NULL);
+    }
+
+    _diff_bind_array_buffer (diff, to->array_buffer_binding);
+}
+
+static void
+_diff_vertex_attrib_values (state_diff_t *diff,
+                            egl_state_t *from,
+                            egl_state_t *to)
+{
+    unsigned int set = from->vertex_attrib_values_set | to->vertex_attrib_values_set;
+    GLuint index;
+
+    for (index = 0; set; index++, set >>= 1) {
+        if (! (set & 1) ||
+            ! memcmp (from->vertex_attrib_values[index],
+                      to->vertex_attrib_values[index],
+                      sizeof (to->vertex_attrib_values[index])))
+            continue;
+        diff->dispatch->glVertexAttrib4fv (diff->object, index,
+                                           to->vertex_attrib_values[index]);
+        diff->calls++;
+    }
+}
+
+static void
+_diff_bindings (state_diff_t *diff,
+                egl_state_t *from,
+                egl_state_t *to)
+{
+    dispatch_table_t *dispatch = diff->dispatch;
+    bool switch_vertex_arrays = from->vertex_array_binding != to->vertex_array_binding;
+
+    _diff_textures (diff, from, to);
+
+    /* The attributes and the element array binding the states keep are
+     * the ones of the default vertex array. */
+    if (switch_vertex_arrays && from->vertex_array_binding) {
+        dispatch->glBindVertexArrayOES (diff->object, 0);
+        diff->calls++;
+    }
+
+    _diff_vertex_attribs (diff, from, to);
+    _diff_vertex_attrib_values (diff, from, to);
+
+    if (from->element_array_buffer_binding != to->element_array_buffer_binding) {
+        dispatch->glBindBuffer (diff->object, GL_ELEMENT_ARRAY_BUFFER,
+                                to->element_array_buffer_binding);
+        diff->calls++;
+    }
+    if (switch_vertex_arrays && to->vertex_array_binding) {
+        dispatch->glBindVertexArrayOES (diff->object, to->vertex_array_binding);
+        diff->calls++;
+    }
+
+    if (from->framebuffer_binding != to->framebuffer_binding) {
+        dispatch->glBindFramebuffer (diff->object, GL_FRAMEBUFFER, to->framebuffer_binding);
+        diff->calls++;
+    }
+    if (from->renderbuffer_binding != to->renderbuffer_binding) {
+        dispatch->glBindRenderbuffer (diff->object, GL_RENDERBUFFER, to->renderbuffer_binding);
+        diff->calls++;
+    }
+    if (from->current_program != to->current_program) {
+        dispatch->glUseProgram (diff->object, to->current_program);
+        diff->calls++;
+    }
+}
+
+unsigned int
+egl_state_write_diff (egl_state_t *from,
+                      egl_state_t *to,
+                      dispatch_table_t *dispatch,
+                      void *object)
+{
+    state_diff_t diff;
+    diff.dispatch = dispatch;
+    diff.object = object;
+    diff.calls = 0;
+    diff.active_texture = from->active_texture;
+    diff.array_buffer_binding = from->array_buffer_binding;
+
+    _diff_capabilities (&diff, from, to);
+    _diff_blending (&diff, from, to);
+    _diff_stencil (&diff, from, to);
+    _diff_rasterization (&diff, from, to);
+    _diff_bindings (&diff, from, to);
+    return diff.calls;
+}
@@ -0,0 +1,21 @@
+#ifndef GPUPROCESS_EGL_STATE_DIFF_H
+#define GPUPROCESS_EGL_STATE_DIFF_H
+
+#include "compiler_private.h"
+#include "dispatch_table.h"
+#include "egl_state.h"
+
+/* With virtual contexts, several contexts of a share group run on one
+ * driver context, and switching between them only has to replay the
+ * part of the GL state that differs. The states compared are the ones
+ * the caching client keeps for each context. */
+
+/* Makes the calls, through `dispatch`, that take a context from the
+ * state in `from` to the state in `to`. Returns the number of calls. */
+private unsigned int
+egl_state_write_diff (egl_state_t *from,
+                      egl_state_t *to,
+                      dispatch_table_t *dispatch,
+                      void *object);
+
+#endif /* GPUPROCESS_EGL_STATE_DIFF_H */
@@ -0,0 +1,298 @@
+#include "config.h"
+#include "index_buffer_cache.h"
+#include "index_range.h"
+#include <stdlib.h>
+#include <string.h>
+
+/* Indices summarized by each leaf of the segment tree. Ranges are
+ * scanned directly up to the first block boundary on each end. */
+#define INDEX_BLOCK_SIZE 64
+
+struct _index_range_tree {
+    GLenum type;
+    size_t index_size;
+    size_t index_count;
+    size_t block_count;
+
+    /* Nodes 1 .. 2 * leaf_count - 1, node n has children 2n and 2n + 1,
+     * and leaf_count is a power of two. */
+    size_t leaf_count;
+    GLuint *min;
+    GLuint *max;
+};
+
+size_t
+index_buffer_budget_from_environment (void)
+{
+    const char *budget = getenv ("GPUPROCESS_INDEX_SHADOW_SIZE");
+    if (! budget || ! *budget)
+        return INDEX_BUFFER_DEFAULT_BUDGET;
+
+    long kilobytes = strtol (budget, NULL, 10);
+    if (kilobytes <= 0)
+        return 0;
+    return (size_t) kilobytes * 1024;
+}
+
+static int
+_tree_slot (GLenum type)
+{
+    if (type == GL_UNSIGNED_BYTE)
+        return 0;
+    if (type == GL_UNSIGNED_SHORT)
+        return 1;
+    if (type == GL_UNSIGNED_INT)
+        return 2;
+    return -1;
+}
+
+static size_t
+_index_size (GLenum type)
+{
+    if (type == GL_UNSIGNED_BYTE)
+        return sizeof (GLubyte);
+    if (type == GL_UNSIGNED_SHORT)
+        return sizeof (GLushort);
+    return sizeof (GLuint);
+}
+
+static void
+_merge_scan (GLenum type,
+             const char *indices,
+             size_t count,
+             GLuint *min_index,
+             GLuint *max_index)
+{
+    GLuint min, max;
+    if (! index_range_scan (type, indices, count, &min, &max))
+        return;
+    if (min < *min_index)
+        *min_index = min;
+    if (max > *max_index)
+        *max_index = max;
+}
+
+static void
+_tree_update_blocks (index_range_tree_t *tree,
+                     const char *data,
+                     size_t first_block,
+                     size_t last_block)
+{
+    size_t block;
+    for (block = first_block; block <= last_block; block++) {
+        size_t first_index = block * INDEX_BLOCK_SIZE;
+        size_t count = tree->index_count - first_index;
+        if (count > INDEX_BLOCK_SIZE)
+            count = INDEX_BLOCK_SIZE;
+
+        size_t node = tree->leaf_count + block;
+        tree->min[node] = 0xffffffff;
+        tree->max[node] = 0;
+        _merge_scan (tree->type, data + first_index * tree->index_size, count,
+                     &tree->min[node], &tree->max[node]);
+    }
+
+    size_t first = (tree->leaf_count + first_block) / 2;
+    size_t last = (tree->leaf_count + last_block) / 2;
+    while (first > 0) {
+        size_t node;
+        for (node = first; node <= last; node++) {
+            GLuint left_min = tree->min[2 * node], right_min = tree->min[2 * node + 1];
+            GLuint left_max = tree->max[2 * node], right_max = tree->max[2 * node + 1];
+            tree->min[node] = left_min < right_min ? left_min : right_min;
+            tree->max[node] = left_max > right_max ? left_max : right_max;
+        }
+        first /= 2;
+        last /= 2;
+    }
+}
+
+static index_range_tree_t *
+_tree_new (index_buffer_t *buffer,
+           GLenum type)
+{
+    index_range_tree_t *tree = malloc (sizeof (index_range_tree_t));
+    tree->type = type;
+    tree->index_size = _index_size (type);
+    tree->index_count = buffer->size / tree->index_size;
+    tree->block_count = (tree->index_count + INDEX_BLOCK_SIZE - 1) / INDEX_BLOCK_SIZE;
+
+    tree->leaf_count = 1;
+    while (tree->leaf_count < tree->block_count)
+        tree->leaf_count *= 2;
+
+    tree->min = malloc (2 * tree->leaf_count * sizeof (GLuint));
+    tree->max = malloc (2 * tree->leaf_count * sizeof (GLuint));
+    memset (tree->min, 0xff, 2 * tree->leaf_count * sizeof (GLuint));
+    memset (tree->max, 0, 2 * tree->leaf_count * sizeof (GLuint));
+
+    if (tree->block_count)
+        _tree_update_blocks (tree, buffer->data, 0, tree->block_count - 1);
+    return tree;
+}
+
+static void
+_tree_destroy (index_range_tree_t *tree)
+{
+    if (! tree)
+        return;
+    free (tree->min);
+    free (tree->max);
+    free (tree);
+}
+
+static void
+_tree_query (index_range_tree_t *tree,
+             size_t first_block,
+             size_t end_block,
+             GLuint *min_index,
+             GLuint *max_index)
+{
+    size_t left = tree->leaf_count + first_block;
+    size_t right = tree->leaf_count + end_block;
+
+    while (left < right) {
+        if (left & 1) {
+            if (tree->min[left] < *min_index)
+                *min_index = tree->min[left];
+            if (tree->max[left] > *max_index)
+                *max_index = tree->max[left];
+            left++;
+        }
+        if (right & 1) {
+            right--;
+            if (tree->min[right] < *min_index)
+                *min_index = tree->min[right];
+            if (tree->max[right] > *max_index)
+                *max_index = tree->max[right];
+        }
+        left /= 2;
+        right /= 2;
+    }
+}
+
+static void
+_index_buffer_clear_trees (index_buffer_t *buffer)
+{
+    int i;
+    for (i = 0; i < 3; i++) {
+        _tree_destroy (buffer->trees[i]);
+        buffer->trees[i] = NULL;
+    }
+}
+
+index_buffer_t *
+index_buffer_new (GLuint id)
+{
+    index_buffer_t *buffer = malloc (sizeof (index_buffer_t));
+    buffer->id = id;
+    buffer->size = 0;
+    buffer->data = NULL;
+    memset (buffer->trees, 0, sizeof (buffer->trees));
+    return buffer;
+}
+
+void
+index_buffer_destroy (void *abstract_buffer)
+{
+    index_buffer_t *buffer = abstract_buffer;
+    _index_buffer_clear_trees (buffer);
+    free (buffer->data);
+    free (buffer);
+}
+
+void
+index_buffer_set_data (index_buffer_t *buffer,
+                       size_t size,
+                       const void *data)
+{
+    _index_buffer_clear_trees (buffer);
+
+    free (buffer->data);
+    buffer->size = size;
+    buffer->data = size ? malloc (size) : NULL;
+    if (! size)
+        return;
+
+    if (data)
+        memcpy (buffer->data, data, size);
+    else
+        memset (buffer->data, 0, size);
+}
+
+bool
+index_buffer_set_sub_data (index_buffer_t *buffer,
+                           size_t offset,
+                           size_t size,
+                           const void *data)
+{
+    int i;
+
+    if (offset > buffer->size || size > buffer->size - offset)
+        return false;
+    if (! size)
+        return true;
+
+    memcpy (buffer->data + offset, data, size);
+
+    for (i = 0; i < 3; i++) {
+        index_range_tree_t *tree = buffer->trees[i];
+        if (! tree || ! tree->block_count)
+            continue;
+
+        size_t first_block = offset / tree->index_size / INDEX_BLOCK_SIZE;
+        size_t last_block = (offset + size - 1) / tree->index_size / INDEX_BLOCK_SIZE;
+        if (last_block >= tree->block_count)
+            last_block = tree->block_count - 1;
+        if (first_block <= last_block)
+            _tree_update_blocks (tree, buffer->data, first_block, last_block);
+    }
+    return true;
+}
+
+bool
+index_buffer_get_range (index_buffer_t *buffer,
+                        GLenum type,
+                        size_t offset,
+                        size_t count,
+                        GLuint *min_index,
+                        GLuint *max_index)
+{
+    int slot = _tree_slot (type);
+    if (slot < 0 || ! count)
+        return false;
+
+    size_t index_size = _index_size (type);
+    if (offset % index_size ||
+        offset > buffer->size ||
+        count > (buffer->size - offset) / index_size)
+        return false;
+
+    size_t first = offset / index_size;
+    size_t end = first + count;
+    const char *indices = buffer->data;
+
+    *min_index = 0xffffffff;
+    *max_index = 0;
+
+    size_t first_block = (first + INDEX_BLOCK_SIZE - 1) / INDEX_BLOCK_SIZE;
+    size_t end_block = end / INDEX_BLOCK_SIZE;
+    if (first_block >= end_block) {
+        _merge_scan (type, indices + first * index_size, count,
+                     min_index, max_index);
+        return true;
+    }
+
+    if (! buffer->trees[slot])
+        buffer->trees[slot] = _tree_new (buffer, type);
+
+    _merge_scan (type, indices + first * index_size,
+                 first_block * INDEX_BLOCK_SIZE - first,
+                 min_index, max_index);
+    _tree_query (buffer->trees[slot], first_block, end_block,
+                 min_index, max_index);
+    _merge_scan (type, indices + end_block * INDEX_BLOCK_SIZE * index_size,
+                 end - end_block * INDEX_BLOCK_SIZE,
+                 min_index, max_index);
+    return true;
+}
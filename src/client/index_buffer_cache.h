@@ -0,0 +1,70 @@
+#ifndef GPUPROCESS_INDEX_BUFFER_CACHE_H
+#define GPUPROCESS_INDEX_BUFFER_CACHE_H
+
+#include "compiler_private.h"
+#include <GLES2/gl2.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+/* When the indices of a draw live in an element array buffer but the
+ * attributes are client arrays, the client must know which vertices the
+ * draw reads to copy them. It keeps a shadow of the contents of element
+ * array buffers for that, with the minimum and maximum index of each
+ * block of indices kept in a segment tree, so that the range of any
+ * (offset, count, type) is found in O(log n).
+ *
+ * The shadows cost as much memory as the buffers, so each share group
+ * keeps at most INDEX_BUFFER_DEFAULT_BUDGET bytes of them, or as many
+ * kilobytes as the environment variable GPUPROCESS_INDEX_SHADOW_SIZE
+ * gives; 0 turns them off. Buffers that do not fit, or that the driver
+ * maps, have none, and their draws send no vertices. */
+
+#define INDEX_BUFFER_DEFAULT_BUDGET (8 * 1024 * 1024)
+
+typedef struct _index_range_tree index_range_tree_t;
+
+typedef struct _index_buffer {
+    GLuint id;
+    size_t size;
+    char *data;
+
+    /* Built the first time the buffer is drawn with each index type and
+     * kept up to date by later uploads. */
+    index_range_tree_t *trees[3];
+} index_buffer_t;
+
+/* Returns 0 when no shadows should be kept. */
+private size_t
+index_buffer_budget_from_environment (void);
+
+private index_buffer_t *
+index_buffer_new (GLuint id);
+
+private void
+index_buffer_destroy (void *abstract_buffer);
+
+/* A NULL data leaves the contents zeroed. */
+private void
+index_buffer_set_data (index_buffer_t *buffer,
+                       size_t size,
+                       const void *data);
+
+/* Returns false if the range falls outside of the buffer. */
+private bool
+index_buffer_set_sub_data (index_buffer_t *buffer,
+                           size_t offset,
+                           size_t size,
+                           const void *data);
+
+/* Finds the smallest and the largest of `count` indices of the given
+ * type starting at byte `offset`. Returns false if they are not all
+ * inside the buffer, or the offset is not aligned to the type. */
+private bool
+index_buffer_get_range (index_buffer_t *buffer,
+                        GLenum type,
+                        size_t offset,
+                        size_t count,
+                        GLuint *min_index,
+                        GLuint *max_index);
+
+#endif /* GPUPROCESS_INDEX_BUFFER_CACHE_H */
@@ -0,0 +1,225 @@
+#include "config.h"
+#include "texture_update_batch.h"
+#include "gles2_utils.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Leaves room for the merged updates after the ones received. */
+#define TEXTURE_UPDATE_BATCH_DATA_SIZE (4 * TEXTURE_UPDATE_BATCH_MAX_SIZE)
+
+texture_update_batch_t *
+texture_update_batch_new (void)
+{
+    texture_update_batch_t *batch = malloc (sizeof (texture_update_batch_t));
+    batch->count = 0;
+    batch->size = 0;
+    batch->data = malloc (TEXTURE_UPDATE_BATCH_DATA_SIZE);
+    batch->data_used = 0;
+    batch->data_capacity = TEXTURE_UPDATE_BATCH_DATA_SIZE;
+
+    batch->updates_received = 0;
+    batch->updates_merged = 0;
+    return batch;
+}
+
+void
+texture_update_batch_destroy (texture_update_batch_t *batch)
+{
+#if ENABLE_PROFILING
+    printf ("texture updates: %lu received, %lu merged away\n",
+            batch->updates_received, batch->updates_merged);
+#endif
+
+    free (batch->data);
+    free (batch);
+}
+
+void
+texture_update_batch_clear (texture_update_batch_t *batch)
+{
+    batch->count = 0;
+    batch->size = 0;
+    batch->data_used = 0;
+}
+
+bool
+texture_update_batch_matches (texture_update_batch_t *batch,
+                              GLenum target,
+                              GLint level,
+                              GLenum format,
+                              GLenum type,
+                              GLint unpack_alignment)
+{
+    return batch->target == target &&
+           batch->level == level &&
+           batch->format == format &&
+           batch->type == type &&
+           batch->unpack_alignment == unpack_alignment;
+}
+
+void *
+texture_update_batch_add (texture_update_batch_t *batch,
+                          GLenum target,
+                          GLint level,
+                          GLint xoffset,
+                          GLint yoffset,
+                          GLsizei width,
+                          GLsizei height,
+                          GLenum format,
+                          GLenum type,
+                          GLint unpack_alignment,
+                          size_t size)
+{
+    if (batch->count == TEXTURE_UPDATE_BATCH_MAX_UPDATES ||
+        batch->size + size > TEXTURE_UPDATE_BATCH_MAX_SIZE ||
+        batch->data_used + size > batch->data_capacity)
+        return NULL;
+
+    if (! batch->count) {
+        batch->target = target;
+        batch->level = level;
+        batch->format = format;
+        batch->type = type;
+        batch->unpack_alignment = unpack_alignment;
+    }
+
+    texture_update_t *update = &batch->updates[batch->count++];
+    update->xoffset = xoffset;
+    update->yoffset = yoffset;
+    update->width = width;
+    update->height = height;
+    update->offset = batch->data_used;
+    update->size = size;
+
+    batch->size += size;
+    batch->data_used += size;
+    batch->updates_received++;
+    return batch->data + update->offset;
+}
+
+static bool
+_updates_intersect (const texture_update_t *a,
+                    const texture_update_t *b)
+{
+    return a->xoffset < b->xoffset + b->width &&
+           b->xoffset < a->xoffset + a->width &&
+           a->yoffset < b->yoffset + b->height &&
+           b->yoffset < a->yoffset + a->height;
+}
+
+static bool
+_update_contains (const texture_update_t *a,
+                  const texture_update_t *b)
+{
+    return a->xoffset <= b->xoffset &&
+           a->yoffset <= b->yoffset &&
+           a->xoffset + a->width >= b->xoffset + b->width &&
+           a->yoffset + a->height >= b->yoffset + b->height;
+}
+
+/* True if the two updates overlap or touch along a whole edge. */
+static bool
+_union_is_rectangle (const texture_update_t *a,
+                     const texture_update_t *b)
+{
+    if (a->xoffset == b->xoffset && a->width == b->width)
+        return a->yoffset <= b->yoffset + b->height &&
+               b->yoffset <= a->yoffset + a->height;
+    if (a->yoffset == b->yoffset && a->height == b->height)
+        return a->xoffset <= b->xoffset + b->width &&
+               b->xoffset <= a->xoffset + a->width;
+    return _update_contains (a, b) || _update_contains (b, a);
+}
+
+static void
+_paint_update (texture_update_batch_t *batch,
+               const texture_update_t *update,
+               const texture_update_t *target,
+               uint32_t target_padded_row_size)
+{
+    uint32_t size, unpadded_row_size, padded_row_size;
+    uint32_t group_size = compute_image_group_size (batch->format, batch->type);
+    compute_image_data_sizes (update->width, update->height, batch->format,
+                              batch->type, batch->unpack_alignment,
+                              &size, &unpadded_row_size, &padded_row_size);
+
+    const char *source = batch->data + update->offset;
+    char *dest = batch->data + target->offset +
+                 (update->yoffset - target->yoffset) * target_padded_row_size +
+                 (update->xoffset - target->xoffset) * group_size;
+    GLsizei row;
+    for (row = 0; row < update->height; row++) {
+        memcpy (dest, source, unpadded_row_size);
+        source += padded_row_size;
+        dest += target_padded_row_size;
+    }
+}
+
+/* Replaces the update at `later` with the union of both and removes the
+ * one at `earlier`. */
+static bool
+_merge_updates (texture_update_batch_t *batch,
+                unsigned int earlier,
+                unsigned int later)
+{
+    texture_update_t *a = &batch->updates[earlier];
+    texture_update_t *b = &batch->updates[later];
+    texture_update_t merged;
+    uint32_t size, padded_row_size;
+
+    merged.xoffset = a->xoffset < b->xoffset ? a->xoffset : b->xoffset;
+    merged.yoffset = a->yoffset < b->yoffset ? a->yoffset : b->yoffset;
+    merged.width = (a->xoffset + a->width > b->xoffset + b->width ?
+                    a->xoffset + a->width : b->xoffset + b->width) - merged.xoffset;
+    merged.height = (a->yoffset + a->height > b->yoffset + b->height ?
+                     a->yoffset + a->height : b->yoffset + b->height) - merged.yoffset;
+
+    if (! compute_image_data_sizes (merged.width, merged.height, batch->format,
+                                    batch->type, batch->unpack_alignment,
+                                    &size, NULL, &padded_row_size) ||
+        batch->data_used + size > batch->data_capacity)
+        return false;
+
+    merged.offset = batch->data_used;
+    merged.size = size;
+    batch->data_used += size;
+
+    /* In submission order, so the later update wins where they overlap. */
+    _paint_update (batch, a, &merged, padded_row_size);
+    _paint_update (batch, b, &merged, padded_row_size);
+
+    batch->size = batch->size - a->size - b->size + merged.size;
+    *b = merged;
+    memmove (a, a + 1, (batch->count - earlier - 1) * sizeof (texture_update_t));
+    batch->count--;
+    batch->updates_merged++;
+    return true;
+}
+
+void
+texture_update_batch_merge (texture_update_batch_t *batch)
+{
+    unsigned int later, earlier, between;
+
+    for (later = 1; later < batch->count; later++) {
+    retry:
+        for (earlier = later; earlier-- > 0;) {
+            texture_update_t *a = &batch->updates[earlier];
+            if (! _union_is_rectangle (a, &batch->updates[later]))
+                continue;
+
+            /* Merging moves the earlier update after the ones in between. */
+            for (between = earlier + 1; between < later; between++)
+                if (_updates_intersect (a, &batch->updates[between]))
+                    break;
+            if (between < later)
+                continue;
+
+            if (_merge_updates (batch, earlier, later)) {
+                later--;
+                goto retry;
+            }
+        }
+    }
+}
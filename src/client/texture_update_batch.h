@@ -0,0 +1,92 @@
+#ifndef GPUPROCESS_TEXTURE_UPDATE_BATCH_H
+#define GPUPROCESS_TEXTURE_UPDATE_BATCH_H
+
+#include "compiler_private.h"
+#include <GLES2/gl2.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+/* Text and UI code tends to update a texture atlas with many small
+ * glTexSubImage2D calls in a row. The caching client holds such updates
+ * back in a batch until any other command is written, and then merges
+ * the ones whose union is a rectangle, so that the server makes fewer,
+ * bigger uploads. All the updates of a batch go to the same texture
+ * binding, level, format and type. */
+
+/* Only updates up to this size are held back. */
+#define TEXTURE_UPDATE_MAX_SIZE (16 * 1024)
+#define TEXTURE_UPDATE_BATCH_MAX_UPDATES 64
+#define TEXTURE_UPDATE_BATCH_MAX_SIZE (64 * 1024)
+
+typedef struct _texture_update {
+    GLint xoffset;
+    GLint yoffset;
+    GLsizei width;
+    GLsizei height;
+
+    /* Into the batch data, rows padded to the unpack alignment. */
+    size_t offset;
+    size_t size;
+} texture_update_t;
+
+typedef struct _texture_update_batch {
+    GLenum target;
+    GLint level;
+    GLenum format;
+    GLenum type;
+    GLint unpack_alignment;
+
+    texture_update_t updates[TEXTURE_UPDATE_BATCH_MAX_UPDATES];
+    unsigned int count;
+    size_t size;
+
+    /* Merged updates are appended after the ones they replace. */
+    char *data;
+    size_t data_used;
+    size_t data_capacity;
+
+    /* Statistics */
+    unsigned long updates_received;
+    unsigned long updates_merged;
+} texture_update_batch_t;
+
+private texture_update_batch_t *
+texture_update_batch_new (void);
+
+private void
+texture_update_batch_destroy (texture_update_batch_t *batch);
+
+/* Drops the updates, typically after they have been written out. */
+private void
+texture_update_batch_clear (texture_update_batch_t *batch);
+
+private bool
+texture_update_batch_matches (texture_update_batch_t *batch,
+                              GLenum target,
+                              GLint level,
+                              GLenum format,
+                              GLenum type,
+                              GLint unpack_alignment);
+
+/* Returns the space for the packed pixels of a new update, or NULL if
+ * the batch is full and must be written out first. An empty batch takes
+ * the target, level, format, type and alignment of the update. */
+private void *
+texture_update_batch_add (texture_update_batch_t *batch,
+                          GLenum target,
+                          GLint level,
+                          GLint xoffset,
+                          GLint yoffset,
+                          GLsizei width,
+                          GLsizei height,
+                          GLenum format,
+                          GLenum type,
+                          GLint unpack_alignment,
+                          size_t size);
+
+/* Merges pairs of updates whose union is a rectangle, as long as that
+ * does not reorder them with an update they overlap. */
+private void
+texture_update_batch_merge (texture_update_batch_t *batch);
+
+#endif /* GPUPROCESS_TEXTURE_UPDATE_BATCH_H */
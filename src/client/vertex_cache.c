@@ -0,0 +1,226 @@
+#include "config.h"
+#include "vertex_cache.h"
+#include "fingerprint.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+/* Chunks bigger than this are fingerprinted by sampling. */
+#define VERTEX_CACHE_SAMPLING_THRESHOLD (256 * 1024)
+#define VERTEX_CACHE_SAMPLE_SIZE 4096
+#define VERTEX_CACHE_SAMPLES 32
+
+/* Upper bound for entries, most of which only record a chunk seen once. */
+#define VERTEX_CACHE_MAX_ENTRIES 4096
+
+size_t
+vertex_cache_budget_from_environment (void)
+{
+    const char *budget = getenv ("GPUPROCESS_VERTEX_CACHE_SIZE");
+    if (! budget)
+        return 0;
+
+    long kilobytes = strtol (budget, NULL, 10);
+    if (kilobytes <= 0)
+        return 0;
+    return (size_t) kilobytes * 1024;
+}
+
+vertex_cache_t *
+vertex_cache_new (size_t budget)
+{
+    vertex_cache_t *cache = malloc (sizeof (vertex_cache_t));
+    cache->entries = new_hash_table (free);
+    cache->newest = NULL;
+    cache->oldest = NULL;
+    cache->entry_count = 0;
+    cache->size = 0;
+    cache->budget = budget;
+    cache->draw = 0;
+
+    cache->hits = 0;
+    cache->misses = 0;
+    cache->bytes_saved = 0;
+    cache->bytes_uploaded = 0;
+    return cache;
+}
+
+void
+vertex_cache_destroy (vertex_cache_t *cache)
+{
+#if ENABLE_PROFILING
+    printf ("vertex cache: %lu hits, %lu misses, %llu bytes saved, %llu bytes uploaded\n",
+            cache->hits, cache->misses, cache->bytes_saved, cache->bytes_uploaded);
+#endif
+
+    /* The server buffers must have been released. */
+    delete_hash_table (cache->entries);
+    free (cache);
+}
+
+uint64_t
+vertex_cache_fingerprint (const void *data,
+                          size_t size)
+{
+    if (size <= VERTEX_CACHE_SAMPLING_THRESHOLD)
+        return fingerprint (data, size);
+    return fingerprint_sampled (data, size,
+                                VERTEX_CACHE_SAMPLE_SIZE,
+                                VERTEX_CACHE_SAMPLES);
+}
+
+static GLuint
+_entry_key (uint64_t fingerprint)
+{
+    GLuint key = (GLuint) (fingerprint ^ (fingerprint >> 32));
+    /* Zero is not a valid hash table key. */
+    return key ? key : 1;
+}
+
+static void
+_unlink_entry (vertex_cache_t *cache,
+               vertex_cache_entry_t *entry)
+{
+    if (entry->newer)
+        entry->newer->older = entry->older;
+    else
+        cache->newest = entry->older;
+
+    if (entry->older)
+        entry->older->newer = entry->newer;
+    else
+        cache->oldest = entry->newer;
+
+    entry->newer = entry->older = NULL;
+}
+
+static void
+_link_entry_as_newest (vertex_cache_t *cache,
+                       vertex_cache_entry_t *entry)
+{
+    entry->newer = NULL;
+    entry->older = cache->newest;
+    if (cache->newest)
+        cache->newest->newer = entry;
+    cache->newest = entry;
+    if (! cache->oldest)
+        cache->oldest = entry;
+}
+
+static void
+_evict_entry (vertex_cache_t *cache,
+              vertex_cache_entry_t *entry,
+              vertex_cache_delete_buffer_t delete_buffer,
+              void *user_data)
+{
+    _unlink_entry (cache, entry);
+    hash_take (cache->entries, _entry_key (entry->fingerprint));
+    cache->entry_count--;
+
+    if (entry->buffer) {
+        delete_buffer (entry->buffer, user_data);
+        cache->size -= entry->size;
+    }
+    free (entry);
+}
+
+void
+vertex_cache_begin_draw (vertex_cache_t *cache)
+{
+    cache->draw++;
+}
+
+vertex_cache_entry_t *
+vertex_cache_lookup (vertex_cache_t *cache,
+                     uint64_t fingerprint,
+                     size_t size,
+                     vertex_cache_delete_buffer_t delete_buffer,
+                     void *user_data)
+{
+    GLuint key = _entry_key (fingerprint);
+    vertex_cache_entry_t *entry = hash_lookup (cache->entries, key);
+
+    if (entry && entry->fingerprint == fingerprint && entry->size == size) {
+        if (entry->buffer) {
+            cache->hits++;
+            cache->bytes_saved += size;
+        }
+        if (entry->last_draw != cache->draw)
+            entry->uses++;
+        entry->last_draw = cache->draw;
+        _unlink_entry (cache, entry);
+        _link_entry_as_newest (cache, entry);
+        return entry;
+    }
+
+    cache->misses++;
+
+    /* A different chunk with the same key; the newer one wins. */
+    if (entry) {
+        if (entry->last_draw == cache->draw)
+            return NULL;
+        _evict_entry (cache, entry, delete_buffer, user_data);
+    }
+
+    if (cache->entry_count >= VERTEX_CACHE_MAX_ENTRIES) {
+        if (cache->oldest->last_draw == cache->draw)
+            return NULL;
+        _evict_entry (cache, cache->oldest, delete_buffer, user_data);
+    }
+
+    entry = malloc (sizeof (vertex_cache_entry_t));
+    entry->fingerprint = fingerprint;
+    entry->size = size;
+    entry->buffer = 0;
+    entry->uses = 1;
+    entry->last_draw = cache->draw;
+    _link_entry_as_newest (cache, entry);
+    hash_insert (cache->entries, key, entry);
+    cache->entry_count++;
+    return entry;
+}
+
+bool
+vertex_cache_make_room (vertex_cache_t *cache,
+                        size_t size,
+                        vertex_cache_delete_buffer_t delete_buffer,
+                        void *user_data)
+{
+    if (size > cache->budget)
+        return false;
+
+    vertex_cache_entry_t *entry = cache->oldest;
+    while (entry && cache->size + size > cache->budget) {
+        vertex_cache_entry_t *newer = entry->newer;
+        if (entry->buffer && entry->last_draw != cache->draw)
+            _evict_entry (cache, entry, delete_buffer, user_data);
+        entry = newer;
+    }
+
+    return cache->size + size <= cache->budget;
+}
+
+void
+vertex_cache_set_buffer (vertex_cache_t *cache,
+                         vertex_cache_entry_t *entry,
+                         GLuint buffer)
+{
+    entry->buffer = buffer;
+    cache->size += entry->size;
+    cache->bytes_uploaded += entry->size;
+}
+
+void
+vertex_cache_release_buffers (vertex_cache_t *cache,
+                              vertex_cache_delete_buffer_t delete_buffer,
+                              void *user_data)
+{
+    vertex_cache_entry_t *entry;
+    for (entry = cache->newest; entry; entry = entry->older) {
+        if (! entry->buffer)
+            continue;
+        delete_buffer (entry->buffer, user_data);
+        cache->size -= entry->size;
+        entry->buffer = 0;
+        entry->uses = 1;
+    }
+}
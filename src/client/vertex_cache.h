@@ -0,0 +1,101 @@
+#ifndef GPUPROCESS_VERTEX_CACHE_H
+#define GPUPROCESS_VERTEX_CACHE_H
+
+#include "compiler_private.h"
+#include "hash.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* Client-side vertex arrays are normally copied into the command buffer
+ * on every draw. The vertex cache recognizes chunks the application draws
+ * again unchanged and keeps them in server buffer objects the proxy owns,
+ * so they are only sent once. It is disabled unless the environment
+ * variable GPUPROCESS_VERTEX_CACHE_SIZE gives a budget in kilobytes. */
+
+typedef struct _vertex_cache_entry vertex_cache_entry_t;
+
+struct _vertex_cache_entry {
+    uint64_t fingerprint;
+    size_t   size;
+
+    /* 0 until the chunk has been seen twice and uploaded. */
+    GLuint   buffer;
+    unsigned int uses;
+
+    /* Entries used by the draw being set up must not be evicted, the
+     * server would unbind their buffers from the attributes. */
+    unsigned long last_draw;
+
+    vertex_cache_entry_t *newer;
+    vertex_cache_entry_t *older;
+};
+
+typedef void (*vertex_cache_delete_buffer_t) (GLuint buffer,
+                                              void *user_data);
+
+typedef struct _vertex_cache {
+    HashTable            *entries;
+    vertex_cache_entry_t *newest;
+    vertex_cache_entry_t *oldest;
+    unsigned int         entry_count;
+
+    size_t               size;          /* bytes held in server buffers */
+    size_t               budget;
+    unsigned long        draw;
+
+    /* Statistics */
+    unsigned long        hits;
+    unsigned long        misses;
+    unsigned long long   bytes_saved;
+    unsigned long long   bytes_uploaded;
+} vertex_cache_t;
+
+/* Returns 0 when the cache should not be used. */
+private size_t
+vertex_cache_budget_from_environment (void);
+
+private vertex_cache_t *
+vertex_cache_new (size_t budget);
+
+private void
+vertex_cache_destroy (vertex_cache_t *cache);
+
+private uint64_t
+vertex_cache_fingerprint (const void *data,
+                          size_t size);
+
+private void
+vertex_cache_begin_draw (vertex_cache_t *cache);
+
+/* Finds the entry for the given chunk, creating one if this is the first
+ * time it is seen. Entries are kept in least recently used order. Returns
+ * NULL if there is no room for a new entry during this draw. */
+private vertex_cache_entry_t *
+vertex_cache_lookup (vertex_cache_t *cache,
+                     uint64_t fingerprint,
+                     size_t size,
+                     vertex_cache_delete_buffer_t delete_buffer,
+                     void *user_data);
+
+/* Evicts least recently used entries until `size` more bytes fit in
+ * the budget. Returns false if they never will. */
+private bool
+vertex_cache_make_room (vertex_cache_t *cache,
+                        size_t size,
+                        vertex_cache_delete_buffer_t delete_buffer,
+                        void *user_data);
+
+private void
+vertex_cache_set_buffer (vertex_cache_t *cache,
+                         vertex_cache_entry_t *entry,
+                         GLuint buffer);
+
+/* Hands every server buffer the cache holds to `delete_buffer` and
+ * forgets it; the entries stay, as chunks seen once. */
+private void
+vertex_cache_release_buffers (vertex_cache_t *cache,
+                              vertex_cache_delete_buffer_t delete_buffer,
+                              void *user_data);
+
+#endif /* GPUPROCESS_VERTEX_CACHE_H */
@@ -10,6 +10,7 @@ command_get_size (command_type_t command_type)
     if (!initialized) {
         command_sizes[COMMAND_NO_OP] = 0;
         command_sizes[COMMAND_SHUTDOWN] = sizeof (command_t);
+        command_sizes[COMMAND_PREFETCH_LIMITS] = sizeof (command_prefetch_limits_t);
         command_initialize_sizes (command_sizes);
         initialized = true;
     }
@@ -14,6 +14,7 @@
 typedef enum command_type {
     COMMAND_NO_OP,
     COMMAND_SHUTDOWN,
+    COMMAND_PREFETCH_LIMITS,
 
 #include "generated/command_types_autogen.h"
 
@@ -30,6 +30,7 @@ command_glteximage2d_init (command_t *abstract_command,
     uint32_t dest_size;
     uint32_t unpadded_row_size;
     uint32_t padded_row_size;
+    uint32_t source_padded_row_size;
     uint32_t unpack_alignment = client_get_unpack_alignment ();
     uint32_t unpack_row_length = client_get_unpack_row_length ();
     uint32_t unpack_skip_pixels = client_get_unpack_skip_pixels ();
@@ -38,9 +39,10 @@ command_glteximage2d_init (command_t *abstract_command,
     if (! pixels)
         return;
 
-    if (!compute_image_data_sizes (width, height, format, type,
-                                   unpack_alignment, unpack_row_length, unpack_skip_rows, &dest_size,
-                                   &unpadded_row_size, &padded_row_size)) {
+    if (! compute_image_data_sizes (width, height, format, type, unpack_alignment,
+                                    &dest_size, &unpadded_row_size, &padded_row_size) ||
+        ! compute_image_source_row_size (width, format, type, unpack_alignment,
+                                         unpack_row_length, &source_padded_row_size)) {
         /* TODO: Set an error on the client-side.
          SetGLError(GL_INVALID_VALUE, "glTexImage2D", "dimension < 0"); */
         return;
@@ -49,7 +51,7 @@ command_glteximage2d_init (command_t *abstract_command,
     command->pixels = malloc (dest_size);
     copy_rect_to_buffer (pixels, command->pixels, format, type, height,
                          unpack_skip_pixels, unpack_skip_rows,
-                         unpadded_row_size, padded_row_size, padded_row_size);
+                         unpadded_row_size, source_padded_row_size, padded_row_size);
 }
 
 void
@@ -74,19 +76,24 @@ command_gltexsubimage2d_init (command_t *abstract_command,
     command->height = (GLsizei) height;
     command->format = (GLenum) format;
     command->type = (GLenum) type;
+    command->pixels = NULL;
 
     uint32_t dest_size;
     uint32_t unpadded_row_size;
     uint32_t padded_row_size;
+    uint32_t source_padded_row_size;
     uint32_t unpack_alignment = client_get_unpack_alignment ();
     uint32_t unpack_row_length = client_get_unpack_row_length ();
     uint32_t unpack_skip_pixels = client_get_unpack_skip_pixels ();
     uint32_t unpack_skip_rows = client_get_unpack_skip_rows ();
 
-    if (! compute_image_data_sizes (width, height, format,
-                                    type, unpack_alignment, unpack_skip_rows, unpack_row_length,
-                                    &dest_size, &unpadded_row_size,
-                                    &padded_row_size)) {
+    if (! pixels)
+        return;
+
+    if (! compute_image_data_sizes (width, height, format, type, unpack_alignment,
+                                    &dest_size, &unpadded_row_size, &padded_row_size) ||
+        ! compute_image_source_row_size (width, format, type, unpack_alignment,
+                                         unpack_row_length, &source_padded_row_size)) {
         /* XXX: Set a GL error on the client side here. */
         /* SetGLError(GL_INVALID_VALUE, "glTexSubImage2D", "size to large"); */
         return;
@@ -95,7 +102,25 @@ command_gltexsubimage2d_init (command_t *abstract_command,
     command->pixels = malloc (dest_size);
     copy_rect_to_buffer (pixels, command->pixels, format, type, height,
                          unpack_skip_pixels, unpack_skip_rows,
-                         unpadded_row_size, padded_row_size, padded_row_size);
+                         unpadded_row_size, source_padded_row_size, padded_row_size);
+}
+
+/* Pixels that the client wrote into the command buffer right after the
+ * command are released along with the command itself. */
+void
+command_glteximage2d_destroy_arguments (command_glteximage2d_t *command)
+{
+    if (command->pixels &&
+        (char *) command->pixels != (char *) command + command_get_size (COMMAND_GLTEXIMAGE2D))
+        free (command->pixels);
+}
+
+void
+command_gltexsubimage2d_destroy_arguments (command_gltexsubimage2d_t *command)
+{
+    if (command->pixels &&
+        (char *) command->pixels != (char *) command + command_get_size (COMMAND_GLTEXSUBIMAGE2D))
+        free (command->pixels);
 }
 
 /* XXX: command_glshadersource_init: could be auto generated, however it will break the logic */
@@ -113,12 +138,13 @@ command_glshadersource_init (command_t *abstract_command,
     command->count = (GLsizei) count;
     command->string = ( char**) string;
     command->length = ( GLint*) length;
+    command->source = NULL;
 }
 
 void
 command_glshadersource_destroy_arguments (command_glshadersource_t *command)
 {
-    if (command->count <= 0)
+    if (command->count <= 0 || ! command->string)
         return;
 
     unsigned i = 0;
@@ -166,3 +192,93 @@ command_glvertexattribpointer_destroy_arguments (command_glvertexattribpointer_t
     /* This command is asynchronous, but we don't want to free the pointer
      * until after glDraw(Elements/Arrays). */
 }
+
+void
+command_gldrawelements_init (command_t *abstract_command,
+                             GLenum mode,
+                             GLsizei count,
+                             GLenum type,
+                             const void* indices)
+{
+    command_gldrawelements_t *command =
+        (command_gldrawelements_t *) abstract_command;
+    command->mode = (GLenum) mode;
+    command->count = (GLsizei) count;
+    command->type = (GLenum) type;
+    command->indices = (void*) indices;
+    command->vertex_count = 0;
+}
+
+void
+command_glcompileshader_init (command_t *abstract_command,
+                              GLuint shader)
+{
+    command_glcompileshader_t *command =
+        (command_glcompileshader_t *) abstract_command;
+    command->shader = (GLuint) shader;
+    command->status = NULL;
+}
+
+void
+command_gllinkprogram_init (command_t *abstract_command,
+                            GLuint program)
+{
+    command_gllinkprogram_t *command =
+        (command_gllinkprogram_t *) abstract_command;
+    command->program = (GLuint) program;
+    command->status = NULL;
+    command->link_key = NULL;
+}
+
+void
+command_gllinkprogram_destroy_arguments (command_gllinkprogram_t *command)
+{
+    if (command->link_key)
+        free (command->link_key);
+}
+
+void
+command_eglcreatesynckhr_init (command_t *abstract_command,
+                               EGLDisplay dpy,
+                               EGLenum type,
+                               const EGLint *attrib_list)
+{
+    command_eglcreatesynckhr_t *command =
+        (command_eglcreatesynckhr_t *) abstract_command;
+    command->dpy = dpy;
+    command->type = type;
+    command->attrib_list = (EGLint *) attrib_list;
+    command->result = EGL_NO_SYNC_KHR;
+    command->client_sync = NULL;
+}
+
+void
+command_eglswapbuffers_init (command_t *abstract_command,
+                             EGLDisplay dpy,
+                             EGLSurface surface)
+{
+    command_eglswapbuffers_t *command =
+        (command_eglswapbuffers_t *) abstract_command;
+    command->dpy = dpy;
+    command->surface = surface;
+    command->result = EGL_FALSE;
+    command->pending_swap = NULL;
+}
+
+void
+command_eglmakecurrent_init (command_t *abstract_command,
+                             EGLDisplay dpy,
+                             EGLSurface draw,
+                             EGLSurface read,
+                             EGLContext ctx)
+{
+    command_eglmakecurrent_t *command =
+        (command_eglmakecurrent_t *) abstract_command;
+    command->dpy = dpy;
+    command->draw = draw;
+    command->read = read;
+    command->ctx = ctx;
+    command->result = EGL_FALSE;
+    command->made_current = NULL;
+    command->released = NULL;
+}
@@ -4,6 +4,11 @@ typedef struct _command_gldrawelements {
     GLsizei count;
     GLenum type;
     void* indices;
+
+    /* The number of vertices sent along with the indices when the
+     * attributes use client arrays, 0 otherwise. The indices count them
+     * from the first one sent. */
+    GLsizei vertex_count;
 } command_gldrawelements_t;
 
 typedef struct _command_gldrawarrays {
@@ -12,3 +17,89 @@ typedef struct _command_gldrawarrays {
     GLint first;
     GLsizei count;
 } command_gldrawarrays_t;
+
+typedef struct _command_glcompileshader {
+    command_t header;
+    GLuint shader;
+    result_slot_t *status;
+} command_glcompileshader_t;
+
+typedef struct _command_gllinkprogram {
+    command_t header;
+    GLuint program;
+    result_slot_t *status;
+
+    /* Identifies identical links, see caching_client_glLinkProgram. */
+    char *link_key;
+} command_gllinkprogram_t;
+
+typedef struct _command_glshadersource {
+    command_t header;
+    GLuint shader;
+    GLsizei count;
+    char **string;
+    GLint *length;
+
+    /* When set, string is unused and the server reads the text from
+     * the share group's shader source cache instead. */
+    struct _shader_source *source;
+} command_glshadersource_t;
+
+typedef struct _command_eglcreatesynckhr {
+    command_t header;
+    EGLDisplay dpy;
+    EGLenum type;
+    EGLint* attrib_list;
+    EGLSyncKHR result;
+
+    /* When set, the server stores the new sync here instead of the
+     * client waiting for the result. */
+    egl_sync_t *client_sync;
+} command_eglcreatesynckhr_t;
+
+typedef struct _command_eglswapbuffers {
+    command_t header;
+    EGLDisplay dpy;
+    EGLSurface surface;
+    EGLBoolean result;
+
+    /* When set, the client did not wait and reads the result here. */
+    pending_swap_t *pending_swap;
+} command_eglswapbuffers_t;
+
+typedef struct _command_eglmakecurrent {
+    command_t header;
+    EGLDisplay dpy;
+    EGLSurface draw;
+    EGLSurface read;
+    EGLContext ctx;
+    EGLBoolean result;
+
+    /* When set, the client did not wait. The server stores EGL_SUCCESS
+     * or the error of the call here. */
+    result_slot_t *made_current;
+    /* When set, filled the same way, for the context it switches away
+     * from. */
+    result_slot_t *released;
+} command_eglmakecurrent_t;
+
+/* One implementation limit, as glGetIntegerv or glGetFloatv returns it. */
+typedef struct _limit_value {
+    GLenum pname;
+    bool is_float;
+    union {
+        GLint integers[2];
+        GLfloat floats[2];
+    } value;
+} limit_value_t;
+
+/* Not a GL call: the server fetches each of the limits into `limits`
+ * and fills `fetched` with GL_TRUE, or with GL_FALSE when `ctx` is not
+ * its current context. */
+typedef struct _command_prefetch_limits {
+    command_t header;
+    EGLContext ctx;
+    GLsizei count;
+    limit_value_t *limits;
+    result_slot_t *fetched;
+} command_prefetch_limits_t;
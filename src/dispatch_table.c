@@ -3,17 +3,29 @@
 
 #include "types_private.h"
 #include "thread_private.h"
+#include "symbol_cache.h"
 #include <dlfcn.h>
 #include <stdlib.h>
 
+/* Called the first time a function runs, by its resolver. Only symbols
+ * exported by the library itself go to the cache: what getProcAddress
+ * returns may live anywhere. */
 static void *
 find_gl_symbol (void *handle,
+                symbol_cache_t *cache,
                 __eglMustCastToProperFunctionPointerType (*getProcAddress) (const char *procname),
                 const char *symbol_name)
 {
-    void *symbol = dlsym (handle, symbol_name);
+    void *symbol = cache ? symbol_cache_lookup (cache, symbol_name) : NULL;
+    if (symbol)
+        return symbol;
+
+    symbol = dlsym (handle, symbol_name);
     if (symbol == NULL)
-        symbol = getProcAddress (symbol_name);
+        return getProcAddress (symbol_name);
+
+    if (cache)
+        symbol_cache_add (cache, symbol_name, symbol);
     return symbol;
 }
 
@@ -45,8 +57,52 @@ libegl_handle ()
     return handle;
 }
 
+static symbol_cache_t *
+library_symbol_cache (void *handle,
+                      symbol_cache_t **cache,
+                      bool *opened)
+{
+    mutex_static_init (symbol_cache_mutex);
+
+    mutex_lock (symbol_cache_mutex);
+    if (! *opened) {
+        *cache = symbol_cache_open (handle);
+        *opened = true;
+    }
+    mutex_unlock (symbol_cache_mutex);
+    return *cache;
+}
+
+static symbol_cache_t *
+libgl_symbol_cache ()
+{
+    static symbol_cache_t *cache = NULL;
+    static bool opened = false;
+    return library_symbol_cache (libgl_handle (), &cache, &opened);
+}
+
+static symbol_cache_t *
+libegl_symbol_cache ()
+{
+    static symbol_cache_t *cache = NULL;
+    static bool opened = false;
+    return library_symbol_cache (libegl_handle (), &cache, &opened);
+}
+
 #include "dispatch_table_autogen.c"
 
+void *
+dispatch_table_get_libgl_handle ()
+{
+    return libgl_handle ();
+}
+
+void *
+dispatch_table_get_libegl_handle ()
+{
+    return libegl_handle ();
+}
+
 dispatch_table_t *
 dispatch_table_get_base ()
 {
@@ -6,4 +6,11 @@
 private dispatch_table_t *
 dispatch_table_get_base ();
 
+/* The driver's libraries, NULL if they could not be opened. */
+private void *
+dispatch_table_get_libgl_handle ();
+
+private void *
+dispatch_table_get_libegl_handle ();
+
 #endif /* DISPATCH_TABLE_H */
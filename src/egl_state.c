@@ -1,10 +1,12 @@
 #include "config.h"
 #include "egl_state.h"
+#include "gpuprocess_extensions.h"
+#include "registry.h"
+#include "vertex_cache.h"
+#include <sched.h>
 #include <stdlib.h>
 #include <string.h>
 
-static link_list_t *null_list = NULL;
-
 void
 egl_state_init (egl_state_t *state,
                 EGLDisplay display,
@@ -20,9 +22,9 @@ egl_state_init (egl_state_t *state,
     state->version_string = NULL;
     state->shading_language_version_string = NULL;
     state->extensions_string = NULL;
+    state->extension_set = NULL;
 
-    state->share_context = NULL;
-    state->contexts_sharing = 0;
+    state->share_group = share_group_new ();
 
     state->active = false;
 
@@ -31,15 +33,22 @@ egl_state_init (egl_state_t *state,
     state->destroy_draw = false;
     state->destroy_read = false;
 
+    state->runs_on = NULL;
+    state->has_been_current = false;
+    state->released.pending = false;
+    state->released.client = NULL;
+
     state->vertex_attribs.count = 0;
     state->vertex_attribs.enabled_count = 0;
     state->vertex_attribs.attribs = state->vertex_attribs.embedded_attribs;
     state->vertex_attribs.enabled_attribs = NULL;
 
     state->max_combined_texture_image_units = 8;
+    state->max_combined_texture_image_units_queried = false;
     state->max_vertex_attribs_queried = false;
     state->max_vertex_attribs = 8;
     state->max_cube_map_texture_size = 16;
+    state->max_cube_map_texture_size_queried = false;
     state->max_fragment_uniform_vectors = 16;
     state->max_fragment_uniform_vectors_queried = false;
     state->max_renderbuffer_size = 1;
@@ -49,17 +58,23 @@ egl_state_init (egl_state_t *state,
     state->max_texture_size = 64;
     state->max_texture_size_queried = false;
     state->max_varying_vectors = 8;
+    state->max_varying_vectors_queried = false;
     state->max_vertex_uniform_vectors = 128;
+    state->max_vertex_uniform_vectors_queried = false;
     state->max_vertex_texture_image_units = 0;
+    state->max_vertex_texture_image_units_queried = false;
     state->max_texture_max_anisotropy_queried = false;
     state->max_texture_max_anisotropy = 2.0;
+    state->aliased_line_width_range[0] = state->aliased_line_width_range[1] = 1;
+    state->aliased_line_width_range_queried = false;
+    state->aliased_point_size_range[0] = state->aliased_point_size_range[1] = 1;
+    state->aliased_point_size_range_queried = false;
+    state->subpixel_bits = 4;
+    state->subpixel_bits_queried = false;
 
     state->error = GL_NO_ERROR;
     state->need_get_error = false;
 
-    /* We add a head to the list so we can get a reference. */
-    state->shader_objects = NULL;
-
     state->active_texture = GL_TEXTURE0;
     state->array_buffer_binding = 0;
     state->vertex_array_binding = 0;
@@ -73,6 +88,14 @@ egl_state_init (egl_state_t *state,
         state->blend_src[i] = GL_ONE;
     }
 
+    for (i = 0; i < EGL_STATE_MAX_VERTEX_ATTRIBS; i++) {
+        state->vertex_attrib_values[i][0] = 0;
+        state->vertex_attrib_values[i][1] = 0;
+        state->vertex_attrib_values[i][2] = 0;
+        state->vertex_attrib_values[i][3] = 1;
+    }
+    state->vertex_attrib_values_set = 0;
+
     state->blend_equation[0] = state->blend_equation[1] = GL_FUNC_ADD;
 
     memset (state->color_clear_value, 0, sizeof (GLfloat) * 4);
@@ -108,6 +131,7 @@ egl_state_init (egl_state_t *state,
     state->unpack_row_length = 0;
     state->unpack_skip_pixels = 0;
     state->unpack_skip_rows = 0;
+    state->pack_async_read_pixels = false;
 
     state->polygon_offset_factor = 0;
     state->polygon_offset_fill = GL_FALSE;
@@ -115,6 +139,8 @@ egl_state_init (egl_state_t *state,
 
     state->sample_alpha_to_coverage = 0;
     state->sample_coverage = GL_FALSE;
+    state->sample_coverage_value = 1;
+    state->sample_coverage_invert = GL_FALSE;
 
     memset (state->scissor_box, 0, sizeof (GLint) * 4);
     state->scissor_test = GL_FALSE;
@@ -140,20 +166,23 @@ egl_state_init (egl_state_t *state,
     memset (&state->stencil_back_writemask, 1, sizeof (GLint));
 
     memset (state->texture_binding, 0, sizeof (GLint) * 2);
+    state->texture_binding_3d = 0;
+    memset (state->texture_unit_binding, 0, sizeof (state->texture_unit_binding));
 
     memset (state->viewport, 0, sizeof (GLint) * 4);
 
     state->buffer_size[0] = state->buffer_size[1] = 0;
     state->buffer_usage[0] = state->buffer_usage[1] = GL_STATIC_DRAW;
-    state->texture_cache = new_hash_table(free);
-    state->framebuffer_cache = new_hash_table (free);
-    state->renderbuffer_cache = new_hash_table (free);
+    state->fences = new_hash_table (free);
+
+    size_t vertex_cache_budget = vertex_cache_budget_from_environment ();
+    state->vertex_cache = vertex_cache_budget ?
+        vertex_cache_new (vertex_cache_budget) : NULL;
 
-    state->shader_objects_name_handler = name_handler_create ();
-    state->texture_name_handler = name_handler_create ();
-    state->framebuffer_name_handler = name_handler_create ();
-    state->renderbuffer_name_handler = name_handler_create ();
-    state->buffer_name_handler = name_handler_create ();
+    state->limits_prefetched = false;
+    state->limits_prefetch = NULL;
+    state->limits_fetched.pending = false;
+    state->limits_fetched.client = NULL;
 
     state->supports_element_index_uint = false;
     state->supports_bgra = false;
@@ -167,15 +196,36 @@ egl_state_new (EGLDisplay display, EGLContext context)
     return new_state;
 }
 
+static void
+_release_vertex_cache_buffer (GLuint buffer,
+                              void *group)
+{
+    share_group_release_buffer (group, buffer);
+}
+
 void
 egl_state_destroy (void *abstract_state)
 {
     egl_state_t *state = abstract_state;
 
+    /* The server of the thread that left it may still have to fill
+     * these, and write the limits. */
+    while (result_slot_is_pending (&state->released) ||
+           result_slot_is_pending (&state->limits_fetched))
+        sched_yield ();
+
     if (state->vertex_attribs.attribs != state->vertex_attribs.embedded_attribs)
         free (state->vertex_attribs.attribs);
 
-    link_list_clear (&state->shader_objects);
+    if (state->vertex_cache) {
+        vertex_cache_release_buffers (state->vertex_cache,
+                                      _release_vertex_cache_buffer,
+                                      state->share_group);
+        vertex_cache_destroy (state->vertex_cache);
+    }
+    share_group_unreference (state->share_group);
+    delete_hash_table (state->fences);
+    free (state->limits_prefetch);
 
     if (state->vendor_string)
         free (state->vendor_string);
@@ -184,29 +234,79 @@ egl_state_destroy (void *abstract_state)
     if (state->version_string)
         free (state->version_string);
     if (state->shading_language_version_string)
-        free (state->version_string);
+        free (state->shading_language_version_string);
     if (state->extensions_string)
         free (state->extensions_string);
-
-    if (state->shader_objects_name_handler)
-        name_handler_destroy (state->shader_objects_name_handler);
-    if (state->texture_name_handler)
-        name_handler_destroy (state->texture_name_handler);
-    if (state->framebuffer_name_handler)
-        name_handler_destroy (state->framebuffer_name_handler);
-    if (state->renderbuffer_name_handler)
-        name_handler_destroy (state->renderbuffer_name_handler);
-    if (state->buffer_name_handler)
-        name_handler_destroy (state->buffer_name_handler);
+    if (state->extension_set)
+        extension_set_destroy (state->extension_set);
 
     free (state);
 }
 
-link_list_t **
-cached_gl_displays ()
+void
+egl_state_set_extensions_string (egl_state_t *state,
+                                 const char *driver_extensions)
+{
+    size_t length = strlen (driver_extensions);
+    char *extensions = malloc (length + sizeof (GPUPROCESS_GL_EXTENSIONS) + 1);
+
+    memcpy (extensions, driver_extensions, length);
+    extensions[length] = 0;
+    if (length)
+        strcat (extensions, " ");
+    strcat (extensions, GPUPROCESS_GL_EXTENSIONS);
+
+    state->extensions_string = extensions;
+    state->extension_set = extension_set_new (extensions);
+    state->supports_element_index_uint =
+        extension_set_contains (state->extension_set, "GL_OES_element_index_uint");
+    state->supports_bgra =
+        extension_set_contains (state->extension_set, "GL_EXT_texture_format_BGRA8888");
+}
+
+void
+egl_state_join_share_group (egl_state_t *state,
+                            egl_state_t *share_state)
 {
-    static link_list_t *displays = NULL;
-    return &displays;
+    share_group_t *group = share_group_reference (share_state->share_group);
+    share_group_unreference (state->share_group);
+    state->share_group = group;
+}
+
+/* Lookups in these take no lock, see registry.h. Displays are keyed by
+ * the display alone, everything else by its display and its handle. */
+static registry_t *display_registry = NULL;
+static registry_t *surface_registry = NULL;
+static registry_t *context_registry = NULL;
+static registry_t *state_registry = NULL;
+static registry_t *surface_states_registry = NULL;
+static pthread_once_t registries_once = PTHREAD_ONCE_INIT;
+
+/* The states that draw to or read from a surface, keyed like the surface.
+ * An array is replaced whole, never changed, so it is walked without a
+ * lock; surface_states_mutex serializes the writers. */
+typedef struct _surface_states {
+    unsigned int count;
+    egl_state_t *states[1];
+} surface_states_t;
+
+mutex_static_init (surface_states_mutex);
+
+static void
+_create_registries (void)
+{
+    display_registry = registry_new ();
+    surface_registry = registry_new ();
+    context_registry = registry_new ();
+    state_registry = registry_new ();
+    surface_states_registry = registry_new ();
+}
+
+static registry_t *
+_get_registry (registry_t **registry)
+{
+    pthread_once (&registries_once, _create_registries);
+    return *registry;
 }
 
 display_ctxs_surfaces_t *
@@ -216,8 +316,6 @@ cached_gl_display_new (NativeDisplayType native_display, EGLDisplay display)
     dpy->display = display;
     dpy->native_display = native_display;
     dpy->native_display_locked = false;
-    dpy->surfaces = NULL;
-    dpy->contexts = NULL;
     dpy->support_surfaceless = false;
     return dpy;
 }
@@ -225,204 +323,126 @@ cached_gl_display_new (NativeDisplayType native_display, EGLDisplay display)
 void
 destroy_dpy (void *abstract_dpy)
 {
-    display_ctxs_surfaces_t *dpy_sur = (display_ctxs_surfaces_t *)abstract_dpy;
-    link_list_clear (&(dpy_sur)->surfaces);
-    link_list_clear (&(dpy_sur)->contexts);
-    free (dpy_sur);
+    free (abstract_dpy);
 }
 
 void
-cached_gl_display_destroy (EGLDisplay display)
+cached_gl_display_add (display_ctxs_surfaces_t *dpy)
 {
-    link_list_t **dpys = cached_gl_displays ();
-    link_list_t *dpy = *dpys;
-
-    if (! dpy)
-        return;
-    
-    while (dpy) {
-        display_ctxs_surfaces_t *dpy_surfaces = (display_ctxs_surfaces_t *)dpy->data;
-        if (dpy_surfaces->display == display) {
-            link_list_delete_first_entry_matching_data (dpys, (void *)dpy_surfaces);
-            return;
-        }
-
-        dpy = dpy->next;
-    }
+    void *old_dpy = registry_insert (_get_registry (&display_registry),
+                                     dpy->display, NULL, dpy);
+    if (old_dpy)
+        registry_retire (old_dpy, destroy_dpy);
 }
 
-link_list_t **
-cached_gl_surfaces (EGLDisplay display)
+void
+cached_gl_display_destroy (EGLDisplay display)
 {
-    link_list_t **dpys = cached_gl_displays ();
-    if (! *dpys) {
-        return &null_list;
-    }
+    void *dpy = registry_remove (_get_registry (&display_registry), display, NULL);
+    if (! dpy)
+        return;
 
-    link_list_t *dpy = *dpys;
-    while (dpy) {
-        display_ctxs_surfaces_t *dpy_surfaces = (display_ctxs_surfaces_t *)dpy->data;
-        if (dpy_surfaces->display == display)
-            return &(dpy_surfaces->surfaces);
+    registry_retire (dpy, destroy_dpy);
+    registry_remove_key (_get_registry (&surface_registry), display, free);
+    registry_remove_key (_get_registry (&context_registry), display, free);
 
-        dpy = dpy->next;
-    }
+    mutex_lock (surface_states_mutex);
+    registry_remove_key (_get_registry (&surface_states_registry), display, free);
+    mutex_unlock (surface_states_mutex);
+}
 
-    return &null_list;
+display_ctxs_surfaces_t *
+cached_gl_display_find (EGLDisplay display)
+{
+    if (display == EGL_NO_DISPLAY)
+        return NULL;
+    return registry_lookup (_get_registry (&display_registry), display, NULL);
 }
 
 void
 cached_gl_surface_add (EGLDisplay display, EGLConfig config, EGLSurface surface)
 {
-    link_list_t **dpys = cached_gl_displays ();
-    if (! *dpys)
+    if (! cached_gl_display_find (display))
         return;
 
-    link_list_t *dpy = *dpys;
-    display_ctxs_surfaces_t *matched_dpy = NULL;
-    while (dpy) {
-        display_ctxs_surfaces_t *dpy_surfaces = (display_ctxs_surfaces_t *)dpy->data;
-        if (dpy_surfaces->display == display) {
-            matched_dpy = dpy_surfaces;
-            break;
-        }
-
-        dpy = dpy->next;
-    }
+    surface_t *s = malloc (sizeof (surface_t));
+    s->config = config;
+    s->surface = surface;
 
-    if (matched_dpy) {
-        surface_t *s = malloc (sizeof (surface_t));
-        s->config = config;
-        s->surface = surface;
-        link_list_append (&(matched_dpy->surfaces), (void *)s, free);
-    }
+    void *old_surface = registry_insert (_get_registry (&surface_registry),
+                                         display, surface, s);
+    if (old_surface)
+        registry_retire (old_surface, free);
 }
 
-void cached_gl_surface_destroy (EGLDisplay display, EGLSurface surface)
+void
+cached_gl_surface_destroy (EGLDisplay display, EGLSurface surface)
 {
-    link_list_t **dpys = cached_gl_displays ();
-    if (! *dpys)
-        return;
+    void *s = registry_remove (_get_registry (&surface_registry), display, surface);
+    if (s)
+        registry_retire (s, free);
 
-    link_list_t *dpy = *dpys;
-    display_ctxs_surfaces_t *matched_dpy = NULL;
-    while (dpy) {
-        display_ctxs_surfaces_t *dpy_surfaces = (display_ctxs_surfaces_t *)dpy->data;
-        if (dpy_surfaces->display == display) {
-            matched_dpy = dpy_surfaces;
-            break;
-        }
+    /* A surface made later with the same handle starts with no states. */
+    mutex_lock (surface_states_mutex);
+    s = registry_remove (_get_registry (&surface_states_registry), display, surface);
+    mutex_unlock (surface_states_mutex);
+    if (s)
+        registry_retire (s, free);
+}
 
-        dpy = dpy->next;
-    }
+surface_t *
+cached_gl_surface_find (EGLDisplay display, EGLSurface surface)
+{
+    return registry_lookup (_get_registry (&surface_registry), display, surface);
+}
 
-    if (matched_dpy) 
-        link_list_delete_first_entry_matching_data (&(matched_dpy->surfaces), (void *)surface);
+egl_state_t **
+cached_gl_surface_find_states (EGLDisplay display,
+                               EGLSurface surface,
+                               unsigned int *count)
+{
+    surface_states_t *states = registry_lookup (_get_registry (&surface_states_registry),
+                                                display, surface);
+    *count = states ? states->count : 0;
+    return states ? states->states : NULL;
 }
 
 bool
-cached_gl_surface_match (link_list_t **surfaces, EGLSurface egl_surface)
+cached_gl_surface_match (EGLDisplay display, EGLSurface egl_surface)
 {
     if (egl_surface == EGL_NO_SURFACE)
         return true;
-
-    if (! *surfaces)
-        return false;
-
-    link_list_t *current = *surfaces;
-
-    while (current) {
-        surface_t *surface = (surface_t *)current->data;
-        if (surface->surface == egl_surface)
-            return true;
-
-        current = current->next;
-    }
-    return false;
-}
-
-link_list_t **
-cached_gl_contexts (EGLDisplay display)
-{
-    link_list_t **dpys = cached_gl_displays ();
-    if (! *dpys)
-        return &null_list;
-
-    link_list_t *dpy = *dpys;
-    while (dpy) {
-        display_ctxs_surfaces_t *dpy_surfaces = (display_ctxs_surfaces_t *)dpy->data;
-        if (dpy_surfaces->display == display)
-            return &(dpy_surfaces->contexts);
-
-        dpy = dpy->next;
-    }
-    return &null_list;
+    return cached_gl_surface_find (display, egl_surface) != NULL;
 }
 
 void
 cached_gl_context_add (EGLDisplay display, EGLConfig config, EGLContext context)
 {
-    link_list_t **dpys = cached_gl_displays ();
-    if (! *dpys)
+    if (! cached_gl_display_find (display))
         return;
 
-    link_list_t *dpy = *dpys;
-    display_ctxs_surfaces_t *matched_dpy = NULL;
-    while (dpy) {
-        display_ctxs_surfaces_t *dpy_surfaces = (display_ctxs_surfaces_t *)dpy->data;
-        if (dpy_surfaces->display == display) {
-            matched_dpy = dpy_surfaces;
-            break;
-        }
-
-        dpy = dpy->next;
-    }
+    context_t *c = malloc (sizeof (context_t));
+    c->config = config;
+    c->context = context;
 
-    if (matched_dpy) {
-        context_t *c = malloc (sizeof (context_t));
-        c->config = config;
-        c->context = context;
-        link_list_append (&(matched_dpy->contexts), (void *)c, free);
-    }
+    void *old_context = registry_insert (_get_registry (&context_registry),
+                                         display, context, c);
+    if (old_context)
+        registry_retire (old_context, free);
 }
 
-void cached_gl_context_destroy (EGLDisplay display, EGLContext context)
+void
+cached_gl_context_destroy (EGLDisplay display, EGLContext context)
 {
-    link_list_t **dpys = cached_gl_displays ();
-    if (! *dpys)
-        return;
-
-    link_list_t *dpy = *dpys;
-    display_ctxs_surfaces_t *matched_dpy = NULL;
-    while (dpy) {
-        display_ctxs_surfaces_t *dpy_surfaces = (display_ctxs_surfaces_t *)dpy->data;
-        if (dpy_surfaces->display == display) {
-            matched_dpy = dpy_surfaces;
-            break;
-        }
-
-        dpy = dpy->next;
-    }
-
-    if (matched_dpy) 
-        link_list_delete_first_entry_matching_data (&(matched_dpy->contexts), (void *)context);
+    void *c = registry_remove (_get_registry (&context_registry), display, context);
+    if (c)
+        registry_retire (c, free);
 }
 
-display_ctxs_surfaces_t *
-cached_gl_display_find (EGLDisplay display)
+context_t *
+cached_gl_context_find (EGLDisplay display, EGLContext context)
 {
-    if (display == EGL_NO_DISPLAY)
-        return NULL;
-
-    link_list_t **dpys = cached_gl_displays();
-    link_list_t *dpy = *dpys;
-    while (dpy) {
-        display_ctxs_surfaces_t *d = (display_ctxs_surfaces_t *)dpy->data;
-        if (d->display == display)
-            return d;
-        dpy = dpy->next;
-    }
-    return NULL;
+    return registry_lookup (_get_registry (&context_registry), display, context);
 }
 
 bool
@@ -431,81 +451,134 @@ cached_gl_find_display_context_surface_matching (EGLDisplay display,
                                                  EGLSurface draw,
                                                  EGLSurface read)
 {
-    link_list_t **ctxs = cached_gl_contexts (display);
-    link_list_t **surfaces = cached_gl_surfaces (display);
-    EGLConfig ctx_config = 0;
-    EGLConfig draw_config = 0;
-    EGLConfig read_config = 0;
-    display_ctxs_surfaces_t *dpy;
-
-    if (! ctxs || !surfaces)
-        return false;
-
-    if ((dpy = cached_gl_display_find (display)) == NULL)
+    display_ctxs_surfaces_t *dpy = cached_gl_display_find (display);
+    if (! dpy)
         return false;
 
-    link_list_t *lt = *ctxs;
-    while (lt) {
-        context_t *c = (context_t *) lt->data;
-        if (c->context == context) {
-            ctx_config = c->config;
-            break;
-        }
-        lt = lt->next;
-    }
-
-    if (ctx_config == 0)
+    context_t *c = cached_gl_context_find (display, context);
+    if (! c || c->config == 0)
         return false;
 
     if (dpy->support_surfaceless && !read && !draw)
         return true;
 
-    lt = *surfaces;
-    bool find_read = false;
-    bool find_draw = false;
-    while (lt) {
-        surface_t *s = (surface_t *) lt->data;
-        if (! find_draw) {
-            if (s->surface == draw) {
-                draw_config = s->config;
-                find_draw = true;
-            }
-        }
-        if (! find_read) {
-            if (s->surface == read) {
-                read_config = s->config;
-                find_read = true;
-            }
-        }
-        if (find_draw && find_read)
-            break;
-        lt = lt->next;
+    surface_t *draw_surface = cached_gl_surface_find (display, draw);
+    surface_t *read_surface = cached_gl_surface_find (display, read);
+    EGLConfig draw_config = draw_surface ? draw_surface->config : 0;
+    EGLConfig read_config = read_surface ? read_surface->config : 0;
+    return draw_config == read_config && draw_config == c->config;
+}
+
+/* Called with surface_states_mutex held. */
+static void
+_surface_states_update (EGLDisplay display,
+                        EGLSurface surface,
+                        egl_state_t *state,
+                        bool add)
+{
+    registry_t *registry = _get_registry (&surface_states_registry);
+    surface_states_t *old_states = registry_lookup (registry, display, surface);
+    unsigned int old_count = old_states ? old_states->count : 0;
+    unsigned int count = 0;
+    unsigned int i;
+
+    surface_states_t *states = malloc (sizeof (surface_states_t) +
+                                       old_count * sizeof (egl_state_t *));
+    for (i = 0; i < old_count; i++) {
+        if (old_states->states[i] != state)
+            states->states[count++] = old_states->states[i];
     }
-    if (draw_config == read_config && draw_config == ctx_config)
-        return true;
-    return false;
+    if (add)
+        states->states[count++] = state;
+    states->count = count;
+
+    if (count)
+        old_states = registry_insert (registry, display, surface, states);
+    else {
+        free (states);
+        old_states = registry_remove (registry, display, surface);
+    }
+    if (old_states)
+        registry_retire (old_states, free);
 }
-          
-link_list_t **
-cached_gl_states ()
+
+void
+egl_state_set_surfaces (egl_state_t *state,
+                        EGLSurface drawable,
+                        EGLSurface readable)
 {
-    static link_list_t *states = NULL;
-    return &states;
+    EGLSurface old_drawable = state->drawable;
+    EGLSurface old_readable = state->readable;
+
+    if (drawable == old_drawable && readable == old_readable)
+        return;
+
+    /* The fields change first: a state found through a surface it has
+     * just left no longer names it. */
+    state->drawable = drawable;
+    state->readable = readable;
+
+    mutex_lock (surface_states_mutex);
+    if (old_drawable != EGL_NO_SURFACE &&
+        old_drawable != drawable && old_drawable != readable)
+        _surface_states_update (state->display, old_drawable, state, false);
+    if (old_readable != EGL_NO_SURFACE && old_readable != old_drawable &&
+        old_readable != drawable && old_readable != readable)
+        _surface_states_update (state->display, old_readable, state, false);
+    if (drawable != EGL_NO_SURFACE &&
+        drawable != old_drawable && drawable != old_readable)
+        _surface_states_update (state->display, drawable, state, true);
+    if (readable != EGL_NO_SURFACE && readable != drawable &&
+        readable != old_drawable && readable != old_readable)
+        _surface_states_update (state->display, readable, state, true);
+    mutex_unlock (surface_states_mutex);
 }
 
-static HashTable *
-egl_state_get_texture_cache (egl_state_t *egl_state)
+void
+cached_gl_state_add (egl_state_t *state)
 {
-    if (egl_state->share_context)
-        return egl_state->share_context->texture_cache;
-    return egl_state->texture_cache;
+    registry_insert (_get_registry (&state_registry),
+                     state->display, state->context, state);
 }
 
-texture_t *
-egl_state_lookup_cached_texture (egl_state_t *egl_state,
-                                 GLuint texture_id)
+void
+cached_gl_state_remove (egl_state_t *state)
+{
+    registry_t *registry = _get_registry (&state_registry);
+
+    egl_state_set_surfaces (state, EGL_NO_SURFACE, EGL_NO_SURFACE);
+    if (registry_lookup (registry, state->display, state->context) == state)
+        registry_remove (registry, state->display, state->context);
+    registry_retire (state, egl_state_destroy);
+}
+
+typedef struct _state_foreach {
+    cached_gl_state_func_t func;
+    void *user_data;
+} state_foreach_t;
+
+static void
+_call_state_func (void *state,
+                  void *abstract_foreach)
+{
+    state_foreach_t *foreach = abstract_foreach;
+    foreach->func (state, foreach->user_data);
+}
+
+void
+cached_gl_states_foreach (EGLDisplay display,
+                          cached_gl_state_func_t func,
+                          void *user_data)
 {
-    return (texture_t *) hash_lookup (egl_state_get_texture_cache (egl_state), texture_id);
+    state_foreach_t foreach = { func, user_data };
+    registry_foreach (_get_registry (&state_registry), display,
+                      _call_state_func, &foreach);
+}
+
+egl_state_t *
+cached_gl_state_find (EGLDisplay display, EGLContext context)
+{
+    return registry_lookup (_get_registry (&state_registry), display, context);
 }
 
 static texture_t *
@@ -525,156 +598,184 @@ _create_texture (GLuint id)
     tex->texture_3d_wrap_r = GL_REPEAT;         /* initial GL_REPEAT */
     return tex;
 }
+
+static framebuffer_t *
+_create_framebuffer (GLuint id)
+{
+    framebuffer_t *framebuffer = (framebuffer_t *) malloc (sizeof (framebuffer_t));
+    framebuffer->id = id;
+    framebuffer->complete = FRAMEBUFFER_COMPLETE;
+    framebuffer->attached_image = 0;
+    framebuffer->attached_color_buffer = 0;
+    framebuffer->attached_stencil_buffer = 0;
+    framebuffer->attached_depth_buffer = 0;
+    return framebuffer; 
+}
+
+static renderbuffer_t *
+_create_renderbuffer (GLuint id)
+{
+    renderbuffer_t *renderbuffer = (renderbuffer_t *) malloc (sizeof (renderbuffer_t));
+    renderbuffer->id = id;
+    renderbuffer->framebuffer_id = 0;
+    return renderbuffer; 
+}
+
+static void *
+_lookup (share_group_t *group,
+         HashTable *table,
+         GLuint id)
+{
+    share_group_lock (group);
+    void *object = hash_lookup (table, id);
+    share_group_unlock (group);
+    return object;
+}
+
+static void
+_insert (share_group_t *group,
+         HashTable *table,
+         GLuint id,
+         void *object)
+{
+    share_group_lock (group);
+    hash_insert (table, id, object);
+    share_group_unlock (group);
+}
+
+static void
+_remove (share_group_t *group,
+         HashTable *table,
+         GLuint id)
+{
+    if (id == 0)
+        return;
+
+    share_group_lock (group);
+    hash_remove (table, id);
+    share_group_unlock (group);
+}
+
+texture_t *
+egl_state_lookup_cached_texture (egl_state_t *egl_state,
+                                 GLuint texture_id)
+{
+    share_group_t *group = egl_state->share_group;
+    return _lookup (group, group->texture_cache, texture_id);
+}
+
 void
 egl_state_create_cached_texture (egl_state_t *egl_state,
                                  GLuint texture_id)
 {
-    hash_insert (egl_state_get_texture_cache (egl_state),
-                texture_id, _create_texture (texture_id));
-
+    share_group_t *group = egl_state->share_group;
+    _insert (group, group->texture_cache, texture_id, _create_texture (texture_id));
 }
 
 void
 egl_state_delete_cached_texture (egl_state_t *egl_state,
                                   GLuint texture_id)
 {
-    if (texture_id != 0)
-        hash_remove (egl_state_get_texture_cache (egl_state), texture_id);
-}
-
-static HashTable *
-egl_state_get_framebuffer_cache (egl_state_t *egl_state)
-{
-    if (egl_state->share_context)
-        return egl_state->share_context->framebuffer_cache;
-    return egl_state->framebuffer_cache;
+    share_group_t *group = egl_state->share_group;
+    _remove (group, group->texture_cache, texture_id);
 }
 
 framebuffer_t *
 egl_state_lookup_cached_framebuffer (egl_state_t *egl_state,
                                      GLuint framebuffer_id)
 {
-    return (framebuffer_t *) hash_lookup (egl_state_get_framebuffer_cache (egl_state), framebuffer_id);
+    share_group_t *group = egl_state->share_group;
+    return _lookup (group, group->framebuffer_cache, framebuffer_id);
 }
 
-static framebuffer_t *
-_create_framebuffer (GLuint id)
-{
-    framebuffer_t *framebuffer = (framebuffer_t *) malloc (sizeof (framebuffer_t));
-    framebuffer->id = id;
-    framebuffer->complete = FRAMEBUFFER_COMPLETE;
-    framebuffer->attached_image = 0;
-    framebuffer->attached_color_buffer = 0;
-    framebuffer->attached_stencil_buffer = 0;
-    framebuffer->attached_depth_buffer = 0;
-    return framebuffer; 
-}
 void
 egl_state_create_cached_framebuffer (egl_state_t *egl_state,
                                      GLuint framebuffer_id)
 {
-    hash_insert (egl_state_get_framebuffer_cache (egl_state),
-                framebuffer_id, _create_framebuffer (framebuffer_id));
-
+    share_group_t *group = egl_state->share_group;
+    _insert (group, group->framebuffer_cache, framebuffer_id,
+             _create_framebuffer (framebuffer_id));
 }
 
 void
 egl_state_delete_cached_framebuffer (egl_state_t *egl_state,
                                      GLuint framebuffer_id)
 {
-    if (framebuffer_id != 0)
-        hash_remove (egl_state_get_texture_cache (egl_state), framebuffer_id);
-}
-
-static HashTable *
-egl_state_get_renderbuffer_cache (egl_state_t *egl_state)
-{
-    if (egl_state->share_context)
-        return egl_state->share_context->renderbuffer_cache;
-    return egl_state->renderbuffer_cache;
+    share_group_t *group = egl_state->share_group;
+    _remove (group, group->framebuffer_cache, framebuffer_id);
 }
 
 renderbuffer_t *
 egl_state_lookup_cached_renderbuffer (egl_state_t *egl_state,
                                       GLuint renderbuffer_id)
 {
-    return (renderbuffer_t *) hash_lookup (egl_state_get_renderbuffer_cache (egl_state), renderbuffer_id);
+    share_group_t *group = egl_state->share_group;
+    return _lookup (group, group->renderbuffer_cache, renderbuffer_id);
 }
 
-static renderbuffer_t *
-_create_renderbuffer (GLuint id)
-{
-    renderbuffer_t *renderbuffer = (renderbuffer_t *) malloc (sizeof (renderbuffer_t));
-    renderbuffer->id = id;
-    renderbuffer->framebuffer_id = 0;
-    return renderbuffer; 
-}
 void
 egl_state_create_cached_renderbuffer (egl_state_t *egl_state,
                                       GLuint renderbuffer_id)
 {
-    hash_insert (egl_state_get_renderbuffer_cache (egl_state),
-                renderbuffer_id, _create_renderbuffer (renderbuffer_id));
-
+    share_group_t *group = egl_state->share_group;
+    _insert (group, group->renderbuffer_cache, renderbuffer_id,
+             _create_renderbuffer (renderbuffer_id));
 }
 
 void
 egl_state_delete_cached_renderbuffer (egl_state_t *egl_state,
                                       GLuint renderbuffer_id)
 {
-    if (renderbuffer_id != 0)
-        hash_remove (egl_state_get_texture_cache (egl_state), renderbuffer_id);
-}
-
-static link_list_t **
-egl_state_get_shader_object_list (egl_state_t *egl_state)
-{
-    if (egl_state->share_context)
-        return &egl_state->share_context->shader_objects;
-    return &egl_state->shader_objects;
+    share_group_t *group = egl_state->share_group;
+    _remove (group, group->renderbuffer_cache, renderbuffer_id);
 }
 
 void
 egl_state_create_cached_program (egl_state_t *egl_state,
                                  GLuint program_id)
 {
-    link_list_t **program_list = egl_state_get_shader_object_list (egl_state);
-    link_list_append (program_list, program_new (program_id), program_destroy);
+    share_group_t *group = egl_state->share_group;
+    _insert (group, group->shader_objects, program_id, program_new (program_id));
 }
 
 void
 egl_state_create_cached_shader (egl_state_t *egl_state,
                                 GLuint shader_id)
 {
-    link_list_t **program_list = egl_state_get_shader_object_list (egl_state);
-    shader_object_t *shader_object = (shader_object_t *)malloc (sizeof (shader_object_t));
-    shader_object->id = shader_id;
-    shader_object->type = SHADER_OBJECT_SHADER;
-    link_list_append (program_list, shader_object, free);
+    share_group_t *group = egl_state->share_group;
+    _insert (group, group->shader_objects, shader_id, shader_new (shader_id));
 }
 
 shader_object_t *
 egl_state_lookup_cached_shader_object (egl_state_t *egl_state,
                                        GLuint shader_object_id)
 {
-    link_list_t **program_list = egl_state_get_shader_object_list (egl_state);
-    link_list_t *current = *program_list;
-    while (current) {
-        shader_object_t *shader_object = (shader_object_t *)current->data;
-        if (shader_object->id == shader_object_id)
-            return shader_object;
-        current = current->next;
-    }
-    return NULL;
+    share_group_t *group = egl_state->share_group;
+    return _lookup (group, group->shader_objects, shader_object_id);
 }
 
 void
 egl_state_destroy_cached_shader_object (egl_state_t *egl_state,
                                         shader_object_t *shader_object)
 {
-    link_list_delete_first_entry_matching_data (
-        egl_state_get_shader_object_list (egl_state),
-        shader_object);
+    share_group_t *group = egl_state->share_group;
+    _remove (group, group->shader_objects, shader_object->id);
+}
+
+HashTable *
+egl_state_get_shader_source_cache (egl_state_t *egl_state)
+{
+    return egl_state->share_group->shader_source_cache;
 }
 
+HashTable *
+egl_state_get_index_buffer_cache (egl_state_t *egl_state)
+{
+    return egl_state->share_group->index_buffer_cache;
+}
 
+HashTable *
+egl_state_get_buffer_objects (egl_state_t *egl_state)
+{
+    return egl_state->share_group->buffer_objects;
+}
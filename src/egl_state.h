@@ -1,9 +1,11 @@
 #ifndef GPUPROCESS_EGL_STATE_H
 #define GPUPROCESS_EGL_STATE_H
 
+#include "extension_set.h"
 #include "hash.h"
 #include "name_handler.h"
 #include "program.h"
+#include "share_group.h"
 #include "thread_private.h"
 #include <EGL/egl.h>
 #include <EGL/eglext.h>
@@ -11,6 +13,8 @@
 
 #define NUM_EMBEDDED 32
 #define ATTRIB_BUFFER_SIZE (1024 * 512)
+#define EGL_STATE_MAX_TEXTURE_UNITS 32
+#define EGL_STATE_MAX_VERTEX_ATTRIBS 32
 
 typedef struct vertex_attrib vertex_attrib_t;
 
@@ -25,8 +29,8 @@ struct vertex_attrib
     GLenum        type;                   /* initial GL_FLOAT */
     GLvoid        *pointer;               /* initial is 0 */
     GLboolean     array_normalized;       /* initial is GL_FALSE */
-    GLfloat       current_attrib[4];      /* initial is (0, 0, 0, 1) */
     char          *data;
+    bool          in_vertex_cache;        /* data is in a proxy-owned VBO */
 
     /* Linked list of memory chunks to handle buffer memory
      * allocation. */
@@ -82,21 +86,31 @@ typedef struct _framebuffer
     framebuffer_status_t complete;
 } framebuffer_t;
 
+typedef struct _fence
+{
+    GLuint id;
+    GLenum condition;
+
+    /* The fence cannot complete before the server has submitted its
+     * glSetFenceNV, which it reports by reaching this token. */
+    void *client;
+    unsigned int token;
+    bool signaled;
+} fence_t;
+
 
 typedef struct egl_state  egl_state_t;
 struct egl_state {
     NativeDisplayType    native_display;
     EGLContext           context;        /* active context, initial EGL_NO_CONTEXT */
     EGLDisplay           display;        /* active display, initial EGL_NO_SURFACE */
-    EGLSurface           drawable;        /* active draw drawable, initial EGL_NO_SURFACE */
-    EGLSurface           readable;        /* active read drawable, initial EGL_NO_SURFACE */
-    egl_state_t         *share_context;
-    size_t              contexts_sharing; /* Number of contexts using this one as a sharing context.
-                                             This is always at least one, since a context shares with itself
-                                             by default. Thus it's a hackish reference count. */
+    EGLSurface           drawable;        /* active draw drawable, initial EGL_NO_SURFACE, set with egl_state_set_surfaces */
+    EGLSurface           readable;        /* active read drawable, initial EGL_NO_SURFACE, set with egl_state_set_surfaces */
+    share_group_t       *share_group;    /* object names and caches, see share_group.h */
     
     char             *version_string;
     char             *extensions_string;
+    extension_set_t  *extension_set;   /* the names in extensions_string */
     char             *renderer_string;
     char             *vendor_string;
     char             *shading_language_version_string;
@@ -107,17 +121,34 @@ struct egl_state {
     bool             destroy_read;
     bool             destroy_draw;
 
+    /* Virtual contexts, see caching_client_eglMakeCurrent. runs_on is
+     * the context whose driver context runs this one's commands, NULL
+     * until it is first made current. */
+    egl_state_t     *runs_on;
+    bool             has_been_current;
+
+    /* Filled by the server once it has run a queued eglMakeCurrent that
+     * switched away from this context. Until then the context may still
+     * be current in the server of the thread that left it. */
+    result_slot_t    released;
+
     GLenum                  error;             /* initial is GL_NO_ERROR */
     bool                    need_get_error;
-    link_list_t           *shader_objects;         /* initial is NULL */
     vertex_attrib_list_t  vertex_attribs;    /* client states */
-    name_handler_t        *shader_objects_name_handler;
+    /* Current values of the generic vertex attributes, initial
+     * (0, 0, 0, 1). Attributes set by the application have their bit
+     * set in vertex_attrib_values_set. */
+    GLfloat                 vertex_attrib_values[EGL_STATE_MAX_VERTEX_ATTRIBS][4];
+    unsigned int            vertex_attrib_values_set;
+    HashTable             *fences;                 /* fence_t */
 
 /* GL states from glGet () */
     /* used */
     GLint         active_texture;              /* initial GL_TEXTURE0 */
     GLfloat       aliased_line_width_range[2]; /* must include 1 */
+    bool          aliased_line_width_range_queried;
     GLfloat       aliased_point_size_range[2]; /* must include 1 */
+    bool          aliased_point_size_range_queried;
     GLint         bits[4];                     /* alpha, red, green and
                                                 * blue bits 
                                                 */        
@@ -217,6 +248,7 @@ struct egl_state {
     GLint         unpack_row_length;                /* initial is 0 */
     GLint         unpack_skip_rows;                 /* initial is 0 */
     GLint         unpack_skip_pixels;               /* initial is 0 */
+    bool          pack_async_read_pixels;           /* initial is false */
     /* used */
     GLfloat       polygon_offset_factor;            /* initial 0 */
     /* used */
@@ -268,8 +300,11 @@ struct egl_state {
     GLint         stencil_writemask;                 /* initial 0xffffffff */
     
     GLint         subpixel_bits;                     /* at least 4 */
+    bool          subpixel_bits_queried;
     /*used */
     GLint         texture_binding[2];                /* 2D, cube_map, initial 0 */
+    /* 2D, cube map and 3D bindings of every unit, initial 0 */
+    GLint         texture_unit_binding[EGL_STATE_MAX_TEXTURE_UNITS][3];
     /* used */
     GLint         viewport[4];                       /* initial (0, 0, 0, 0) */
     
@@ -304,14 +339,15 @@ struct egl_state {
 
     GLint        texture_max_level;
 
-    HashTable    *texture_cache;
-    HashTable    *framebuffer_cache;
-    HashTable    *renderbuffer_cache;
+    /* NULL unless GPUPROCESS_VERTEX_CACHE_SIZE is set. */
+    struct _vertex_cache *vertex_cache;
 
-    name_handler_t *texture_name_handler;
-    name_handler_t *framebuffer_name_handler;
-    name_handler_t *renderbuffer_name_handler;
-    name_handler_t *buffer_name_handler;
+    /* The limits asked for when the context was first made current and
+     * not collected yet, see caching_client_prefetch_limits. The server
+     * fills limits_fetched once it has written them. */
+    bool         limits_prefetched;
+    struct _limits_prefetch *limits_prefetch;
+    result_slot_t limits_fetched;
 
     bool         supports_element_index_uint;     /* GL_OES_element_index_uint */
     bool	 supports_bgra;	                  /* GL_EXT_texture_format_BGRA8888 */
@@ -322,8 +358,6 @@ typedef struct display_ctxs_surfaces {
     bool native_display_locked;
     EGLDisplay display;
     bool support_surfaceless;
-    link_list_t *surfaces;
-    link_list_t *contexts;
 } display_ctxs_surfaces_t;
 
 typedef struct egl_surface {
@@ -348,11 +382,49 @@ egl_state_new (EGLDisplay display,
 private void
 egl_state_destroy (void *abstract_state);
 
-private link_list_t **
-cached_gl_states ();
+/* Sets the extensions of the context from those the driver reports,
+ * adding the ones the proxy implements itself, and parses them. */
+private void
+egl_state_set_extensions_string (egl_state_t *egl_state,
+                                 const char *driver_extensions);
+
+/* Called before the state is first used, for a context created sharing
+ * with `share_state`: drops the state's own share group for that of
+ * `share_state`. */
+private void
+egl_state_join_share_group (egl_state_t *egl_state,
+                            egl_state_t *share_state);
+
+/* Also keeps the states of each surface, see
+ * cached_gl_surface_find_states. Only the thread the state is current in,
+ * or one that holds cached_gl_states_mutex, changes its surfaces. */
+private void
+egl_state_set_surfaces (egl_state_t *state,
+                        EGLSurface drawable,
+                        EGLSurface readable);
+
+private void
+cached_gl_state_add (egl_state_t *state);
+
+/* The state is destroyed once no thread can be looking at it. */
+private void
+cached_gl_state_remove (egl_state_t *state);
+
+/* The find functions below take no lock. Their results stay valid within
+ * registry_read_lock and registry_read_unlock, or while the caller holds
+ * the lock it takes to change what it looks up. */
+private egl_state_t *
+cached_gl_state_find (EGLDisplay display, EGLContext context);
+
+typedef void (*cached_gl_state_func_t) (egl_state_t *state,
+                                        void *user_data);
 
-private link_list_t **
-cached_gl_displays ();
+/* Calls `func` with every state of the display, which `func` may remove.
+ * It walks every state there is, so it is for eglTerminate and the like. */
+private void
+cached_gl_states_foreach (EGLDisplay display,
+                          cached_gl_state_func_t func,
+                          void *user_data);
 
 private display_ctxs_surfaces_t *
 cached_gl_display_new (NativeDisplayType native_display, EGLDisplay display);
@@ -360,11 +432,15 @@ cached_gl_display_new (NativeDisplayType native_display, EGLDisplay display);
 private void
 destroy_dpy (void *abstract_dpy);
 
+private void
+cached_gl_display_add (display_ctxs_surfaces_t *dpy);
+
+/* Also forgets the surfaces and contexts of the display. */
 private void
 cached_gl_display_destroy (EGLDisplay display);
 
-private link_list_t **
-cached_gl_surfaces (EGLDisplay display);
+private display_ctxs_surfaces_t *
+cached_gl_display_find (EGLDisplay display);
 
 private void
 cached_gl_surface_add (EGLDisplay display, EGLConfig config, EGLSurface surface);
@@ -372,11 +448,18 @@ cached_gl_surface_add (EGLDisplay display, EGLConfig config, EGLSurface surface)
 private void
 cached_gl_surface_destroy (EGLDisplay display, EGLSurface surface);
 
-private bool 
-cached_gl_surface_match (link_list_t **surfaces, EGLSurface egl_surface);
+private surface_t *
+cached_gl_surface_find (EGLDisplay display, EGLSurface surface);
 
-private link_list_t **
-cached_gl_contexts (EGLDisplay display);
+/* The states that draw to or read from the surface, `count` of them. */
+private egl_state_t **
+cached_gl_surface_find_states (EGLDisplay display,
+                               EGLSurface surface,
+                               unsigned int *count);
+
+/* EGL_NO_SURFACE always matches. */
+private bool
+cached_gl_surface_match (EGLDisplay display, EGLSurface egl_surface);
 
 private void
 cached_gl_context_add (EGLDisplay display, EGLConfig config, EGLContext context);
@@ -384,8 +467,8 @@ cached_gl_context_add (EGLDisplay display, EGLConfig config, EGLContext context)
 private void
 cached_gl_context_destroy (EGLDisplay display, EGLContext context);
 
-private display_ctxs_surfaces_t *
-cached_gl_display_find (EGLDisplay display);
+private context_t *
+cached_gl_context_find (EGLDisplay display, EGLContext context);
 
 private bool
 cached_gl_find_display_context_surface_matching (EGLDisplay display, 
@@ -393,6 +476,8 @@ cached_gl_find_display_context_surface_matching (EGLDisplay display,
                                                  EGLSurface draw,
                                                  EGLSurface read);
 
+/* The functions below work on the state's share group and take its lock
+ * themselves. */
 private texture_t *
 egl_state_lookup_cached_texture (egl_state_t *egl_state,
                                  GLuint texture_id);
@@ -444,4 +529,14 @@ private void
 egl_state_destroy_cached_shader_object (egl_state_t *egl_state,
                                         shader_object_t *shader_object);
 
+/* Callers hold share_group_lock around any use of these tables. */
+private HashTable *
+egl_state_get_shader_source_cache (egl_state_t *egl_state);
+
+private HashTable *
+egl_state_get_index_buffer_cache (egl_state_t *egl_state);
+
+private HashTable *
+egl_state_get_buffer_objects (egl_state_t *egl_state);
+
 #endif /* GPUPROCESS_EGL_STATE_H */
@@ -81,10 +81,11 @@ _FUNCTION_INFO = {
   'eglGetProcAddress': {
     'type': 'Manual',
   },
-  'glFlush' : {
+  'glFinish' : {
     'type': 'Synchronous',
   },
-  'glFinish' : {
+  # Returns once the fence has completed.
+  'glFinishFenceNV' : {
     'type': 'Synchronous',
   },
   # This pointer should be valid until glDrawElements or glDrawArray is
@@ -628,6 +629,116 @@ FUNCTIONS_GENERATING_ERRORS = [
  'glEndTilingQCOM',
 ]
 
+# The GL extensions that expose each hidden entry point. eglGetProcAddress
+# hands a function out when the current context supports one of them.
+_EXTENSION_FUNCTIONS = {
+  'GL_AMD_performance_monitor': [
+    'glBeginPerfMonitorAMD',
+    'glDeletePerfMonitorsAMD',
+    'glEndPerfMonitorAMD',
+    'glGenPerfMonitorsAMD',
+    'glGetPerfMonitorCounterDataAMD',
+    'glGetPerfMonitorCounterInfoAMD',
+    'glGetPerfMonitorCounterStringAMD',
+    'glGetPerfMonitorCountersAMD',
+    'glGetPerfMonitorGroupStringAMD',
+    'glGetPerfMonitorGroupsAMD',
+    'glSelectPerfMonitorCountersAMD',
+  ],
+  'GL_ANGLE_framebuffer_blit': [
+    'glBlitFramebufferANGLE',
+  ],
+  'GL_ANGLE_framebuffer_multisample': [
+    'glBlitFramebufferANGLE',
+    'glRenderbufferStorageMultisampleANGLE',
+  ],
+  'GL_APPLE_framebuffer_multisample': [
+    'glRenderbufferStorageMultisampleAPPLE',
+    'glResolveMultisampleFramebufferAPPLE',
+  ],
+  'GL_EXT_discard_framebuffer': [
+    'glDiscardFramebufferEXT',
+  ],
+  'GL_EXT_multi_draw_arrays': [
+    'glMultiDrawArraysEXT',
+    'glMultiDrawElementsEXT',
+  ],
+  'GL_EXT_multisampled_render_to_texture': [
+    'glFramebufferTexture2DMultisampleEXT',
+    'glRenderbufferStorageMultisampleEXT',
+  ],
+  'GL_IMG_multisampled_render_to_texture': [
+    'glFramebufferTexture2DMultisampleIMG',
+    'glRenderbufferStorageMultisampleIMG',
+  ],
+  'GL_NV_coverage_sample': [
+    'glCoverageMaskNV',
+    'glCoverageOperationNV',
+  ],
+  'GL_NV_fence': [
+    'glDeleteFencesNV',
+    'glFinishFenceNV',
+    'glGenFencesNV',
+    'glGetFenceivNV',
+    'glIsFenceNV',
+    'glSetFenceNV',
+    'glTestFenceNV',
+  ],
+  'GL_OES_EGL_image': [
+    'glEGLImageTargetRenderbufferStorageOES',
+    'glEGLImageTargetTexture2DOES',
+  ],
+  'GL_OES_get_program_binary': [
+    'glGetProgramBinaryOES',
+    'glProgramBinaryOES',
+  ],
+  'GL_OES_mapbuffer': [
+    'glGetBufferPointervOES',
+    'glMapBufferOES',
+    'glUnmapBufferOES',
+  ],
+  'GL_OES_texture_3D': [
+    'glCompressedTexImage3DOES',
+    'glCompressedTexSubImage3DOES',
+    'glCopyTexSubImage3DOES',
+    'glFramebufferTexture3DOES',
+    'glTexImage3DOES',
+    'glTexSubImage3DOES',
+  ],
+  'GL_OES_vertex_array_object': [
+    'glBindVertexArrayOES',
+    'glDeleteVertexArraysOES',
+    'glGenVertexArraysOES',
+    'glIsVertexArrayOES',
+  ],
+  'GL_QCOM_driver_control': [
+    'glDisableDriverControlQCOM',
+    'glEnableDriverControlQCOM',
+    'glGetDriverControlStringQCOM',
+    'glGetDriverControlsQCOM',
+  ],
+  'GL_QCOM_extended_get': [
+    'glExtGetBufferPointervQCOM',
+    'glExtGetBuffersQCOM',
+    'glExtGetFramebuffersQCOM',
+    'glExtGetRenderbuffersQCOM',
+    'glExtGetTexLevelParameterivQCOM',
+    'glExtGetTexSubImageQCOM',
+    'glExtGetTexturesQCOM',
+    'glExtTexObjectStateOverrideiQCOM',
+  ],
+  'GL_QCOM_extended_get2': [
+    'glExtGetProgramBinarySourceQCOM',
+    'glExtGetProgramsQCOM',
+    'glExtGetShadersQCOM',
+    'glExtIsProgramBinaryQCOM',
+  ],
+  'GL_QCOM_tiled_rendering': [
+    'glEndTilingQCOM',
+    'glStartTilingQCOM',
+  ],
+}
+
 _GL_GET_TYPE_INFO_FUNC = {
   'glGetBooleanv': { 'type': 'GLboolean'},
   'glGetFloatv': { 'type': 'GLfloat'},
@@ -776,6 +887,22 @@ _GL_GET_TYPE_INFO = {
     'var': 'max_vertex_uniform_vectors',
     'has_cache': True
   },
+  'GL_SUBPIXEL_BITS': {
+    'var': 'subpixel_bits',
+    'has_cache': True
+  },
+  'GL_ALIASED_LINE_WIDTH_RANGE': {
+    'var': 'aliased_line_width_range',
+    'size': 2,
+    'type': 'GLfloat',
+    'has_cache': True
+  },
+  'GL_ALIASED_POINT_SIZE_RANGE': {
+    'var': 'aliased_point_size_range',
+    'size': 2,
+    'type': 'GLfloat',
+    'has_cache': True
+  },
   'GL_POLYGON_OFFSET_UNITS': {
     'var': 'polygon_offset_units'
   },
@@ -846,6 +973,7 @@ _GL_GET_TYPE_INFO = {
   },
   'GL_MAX_TEXTURE_MAX_ANISOTROPY_EXT': {
     'var': 'max_texture_max_anisotropy',
+    'type': 'GLfloat',
     'has_cache': True
   },
   'GL_UNPACK_ROW_LENGTH': {
@@ -2823,8 +2951,11 @@ class GLGenerator(object):
   def WriteClientEntryPoints(self, filename):
     file = CWriter(filename)
     file.Write('#include "caching_client.h"\n')
+    file.Write('#include <stdlib.h>\n')
+    file.Write('#include <string.h>\n')
     self.WriteGLHeaders(file)
 
+    entry_points = []
     for func in self.functions:
         if func.name.find("eglGetProcAddress") != -1:
             continue
@@ -2833,6 +2964,11 @@ class GLGenerator(object):
         if not header:
             continue
 
+        symbol = func.name
+        if func.ShouldHideEntryPoint():
+            symbol = "__hidden_gpuproxy_" + func.name
+        entry_points.append((func.name, symbol, func.ShouldHideEntryPoint()))
+
         file.Write(header + "\n")
         file.Write("{\n")
         file.Write("    INSTRUMENT();\n")
@@ -2861,6 +2997,47 @@ class GLGenerator(object):
 
         file.Write("}\n\n")
 
+    extensions = {}
+    for extension in sorted(_EXTENSION_FUNCTIONS):
+        for name in _EXTENSION_FUNCTIONS[extension]:
+            extensions.setdefault(name, []).append(extension)
+    hidden_names = [name for (name, symbol, hidden) in entry_points if hidden]
+    for name in extensions:
+        if name not in hidden_names:
+            raise Exception("%s is not a hidden entry point" % name)
+        if len(extensions[name]) > 2:
+            raise Exception("%s is in more than two extensions" % name)
+
+    # eglGetProcAddress looks names up here rather than with dlsym. C
+    # compares the names the way Python sorts them.
+    file.Write("static const client_entry_point_t client_entry_points[] = {\n")
+    for (name, symbol, hidden) in sorted(entry_points):
+        file.Write("    { \"%s\",\n" % name)
+        file.Write("      (__eglMustCastToProperFunctionPointerType) %s, %s" %
+                   (symbol, "true" if hidden else "false"), split=False)
+        if name in extensions:
+            file.Write(",\n      { %s }" %
+                       ", ".join('"%s"' % e for e in extensions[name]), split=False)
+        file.Write(" },\n")
+    file.Write("};\n\n")
+    file.Write("#define CLIENT_ENTRY_POINT_COUNT \\\n")
+    file.Write("    (sizeof (client_entry_points) / sizeof (client_entry_point_t))\n\n")
+
+    file.Write("static int\n")
+    file.Write("client_entry_point_compare (const void *name,\n")
+    file.Write("                            const void *entry_point)\n")
+    file.Write("{\n")
+    file.Write("    return strcmp (name, ((const client_entry_point_t *) entry_point)->name);\n")
+    file.Write("}\n\n")
+
+    file.Write("const client_entry_point_t *\n")
+    file.Write("client_entry_point_find (const char *name)\n")
+    file.Write("{\n")
+    file.Write("    return bsearch (name, client_entry_points, CLIENT_ENTRY_POINT_COUNT,\n")
+    file.Write("                    sizeof (client_entry_point_t),\n")
+    file.Write("                    client_entry_point_compare);\n")
+    file.Write("}\n")
+
     file.Close()
 
   def WriteBaseClient(self, filename):
@@ -3117,6 +3294,30 @@ class GLGenerator(object):
         file.Write(");\n")
         file.Write("}\n\n")
 
+    # Each real_ pointer starts out at a resolver, which looks the symbol
+    # up the first time the function is called and points real_ at it.
+    for func in self.functions:
+        if (func.name == "eglGetProcAddress"):
+            continue
+        library = func.name.startswith('egl') and 'egl' or 'gl'
+        file.Write("static %s\n" % func.return_type)
+        func_name = "resolve_%s (" % func.name
+        indent = " " * len(func_name)
+        file.Write(func_name)
+        file.Write(func.MakeTypedOriginalArgString("", separator = ",\n" + indent), split=False)
+        file.Write(")\n")
+        file.Write("{\n")
+        file.Write("    FunctionPointerType *temp = (FunctionPointerType *) &real_%s;\n" % func.name)
+        file.Write("    *temp = find_gl_symbol (lib%s_handle (), lib%s_symbol_cache (),\n" % (library, library))
+        file.Write("                            real_eglGetProcAddress, \"%s\");\n" % func.name)
+        file.Write("    ")
+        if func.return_type != "void":
+            file.Write("return ")
+        file.Write("real_%s (" % func.name)
+        file.Write(func.MakeOriginalArgString(""))
+        file.Write(");\n")
+        file.Write("}\n\n")
+
     file.Write("void\n")
     file.Write("dispatch_table_fill_base (dispatch_table_t *dispatch)\n")
     file.Write("{\n")
@@ -3125,16 +3326,13 @@ class GLGenerator(object):
     for func in self.functions:
         file.Write('    dispatch->%s = passthrough_%s;\n' % (func.name, func.name))
 
-    file.Write("temp = (FunctionPointerType *) &real_eglGetProcAddress;\n")
-    file.Write('*temp = dlsym (libegl_handle (), "eglGetProcAddress");');
+    file.Write("    temp = (FunctionPointerType *) &real_eglGetProcAddress;\n")
+    file.Write('    *temp = dlsym (libegl_handle (), "eglGetProcAddress");\n')
 
     for func in self.functions:
         if (func.name == "eglGetProcAddress"):
             continue
-        file.Write('    temp = (FunctionPointerType *) &real_%s;\n' % func.name)
-        file.Write('    *temp = ')
-        file.Write('            find_gl_symbol (lib%s_handle (),' %(func.name.startswith('egl') and 'egl' or 'gl' ))
-        file.Write('            real_eglGetProcAddress, "%s");\n' % func.name)
+        file.Write('    real_%s = resolve_%s;\n' % (func.name, func.name))
 
     file.Write("}\n")
     file.Close()
@@ -3159,21 +3357,40 @@ class GLGenerator(object):
         for enum_name in _GL_GET_TYPE_INFO:
             file.Write("    case %s:\n" % enum_name)
             info = _GL_GET_TYPE_INFO[enum_name]
-            if 'size' in info:
+            if 'has_cache' in info:
+                var = info['var']
+                if 'size' in info:
+                    values = [("params[%d]" % i, "state->%s[%d]" % (var, i)) for i in range(info['size'])]
+                else:
+                    values = [("*params", "state->%s" % var)]
+
+                # The limits are usually all there once the prefetch of
+                # caching_client_prefetch_limits is collected.
+                file.Write("       if (! state->%s_queried)\n" % var)
+                file.Write("           caching_client_collect_limits (client, state);\n")
+                file.Write("       if (! state->%s_queried) {\n" % var)
+                file.Write("           CACHING_CLIENT(client)->super_dispatch.%s (client, pname, params);\n" % func)
+                # Only a query of the type of the state gives its value.
+                if func_info['type'] == info.get('type', 'GLint'):
+                    for (param, value) in values:
+                        file.Write("           %s = %s;\n" % (value, param))
+                    file.Write("           state->%s_queried = true;\n" % var)
+                    file.Write("           driver_capabilities_add_limits (state);\n")
+                file.Write("       } else {\n")
+                for (param, value) in values:
+                    if func_info['type'] == 'GLboolean':
+                        file.Write("           %s = %s ? GL_TRUE : GL_FALSE;\n" % (param, value))
+                    else:
+                        file.Write("           %s = %s;\n" % (param, value))
+                file.Write("       }\n")
+
+            elif 'size' in info:
                 for i in range(info['size']):
                     file.Write("        params[%s] = state->%s[%s];\n" % (i, info['var'], i))
 
             elif 'index' in info:
                 file.Write("       *params = state->%s[%s];\n" % (info['var'], info['index']))
 
-            elif 'has_cache' in info:
-                file.Write("       if (! state->%s_queried) {\n" % info['var'])
-                file.Write("           CACHING_CLIENT(client)->super_dispatch.%s (client, pname, params);\n" % func)
-                file.Write("           state->%s = *params;\n" % info['var'])
-                file.Write("           state->%s_queried = true;\n" % info['var'])
-                file.Write("       } else \n")
-                file.Write("           *params = state->%s;\n" % info['var'])
-
             elif 'fetch_server_data' in info:
                 file.Write("       CACHING_CLIENT(client)->super_dispatch.%s (client, pname, params);\n" % func)
                 file.Write("       state->%s = *params;\n" % info['var'])
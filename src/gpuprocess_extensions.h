@@ -0,0 +1,20 @@
+#ifndef GPUPROCESS_EXTENSIONS_H
+#define GPUPROCESS_EXTENSIONS_H
+
+/* Extensions implemented by the proxy itself, on top of whatever the
+ * driver exposes. They are appended to the GL_EXTENSIONS string. */
+
+/* GL_GPUPROCESS_async_read_pixels
+ *
+ * With GL_PACK_ASYNC_READ_PIXELS_GPUPROCESS set to GL_TRUE through
+ * glPixelStorei, glReadPixels returns as soon as it is queued, and the
+ * pixels are written into the application's memory later. They are ready
+ * once a command issued after the read completes: a fence from
+ * GL_NV_fence or EGL_KHR_fence_sync, or glFinish. Until then the memory
+ * must be neither read nor freed. */
+#define GL_GPUPROCESS_async_read_pixels 1
+#define GL_PACK_ASYNC_READ_PIXELS_GPUPROCESS 0x6A00
+
+#define GPUPROCESS_GL_EXTENSIONS "GL_GPUPROCESS_async_read_pixels"
+
+#endif /* GPUPROCESS_EXTENSIONS_H */
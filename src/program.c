@@ -1,23 +1,174 @@
 #include "config.h"
 #include "program.h"
 #include <stdlib.h>
+#include <string.h>
+
+void
+shader_object_init (shader_object_t *shader_object,
+                    GLuint id,
+                    int type)
+{
+    shader_object->id = id;
+    shader_object->type = type;
+    shader_object->status.value = GL_FALSE;
+    shader_object->status.pending = false;
+    shader_object->status.client = NULL;
+}
 
 program_t*
 program_new (GLuint id)
 {
     program_t *new_program = (program_t *)malloc (sizeof (program_t));
-    new_program->base.id = id;
-    new_program->base.type = SHADER_OBJECT_PROGRAM;
+    shader_object_init (&new_program->base, id, SHADER_OBJECT_PROGRAM);
     new_program->mark_for_deletion = false;
     new_program->uniform_location_cache = id ? new_hash_table(free) : NULL;
     new_program->attrib_location_cache = id ? new_hash_table(free) : NULL;
+    new_program->attached_shaders[0] = 0;
+    new_program->attached_shaders[1] = 0;
+    new_program->attrib_bindings = NULL;
     return new_program;
 }
 
+shader_t *
+shader_new (GLuint id)
+{
+    shader_t *new_shader = (shader_t *)malloc (sizeof (shader_t));
+    shader_object_init (&new_shader->base, id, SHADER_OBJECT_SHADER);
+    new_shader->source = NULL;
+    new_shader->compiled_source = NULL;
+    return new_shader;
+}
+
+static void
+attrib_binding_destroy (void *abstract_binding)
+{
+    attrib_binding_t *binding = abstract_binding;
+    free (binding->name);
+    free (binding);
+}
+
 void
 program_destroy (void *abstract_program)
 {
     program_t *program = abstract_program;
     delete_hash_table (program->attrib_location_cache);
     delete_hash_table (program->uniform_location_cache);
+    link_list_clear (&program->attrib_bindings);
+}
+
+void
+program_bind_attrib_location (program_t *program,
+                              GLuint index,
+                              const GLchar *name)
+{
+    link_list_t *current = program->attrib_bindings;
+    while (current) {
+        attrib_binding_t *binding = current->data;
+        if (! strcmp (binding->name, name)) {
+            binding->index = index;
+            return;
+        }
+        current = current->next;
+    }
+
+    attrib_binding_t *binding = malloc (sizeof (attrib_binding_t));
+    binding->index = index;
+    binding->name = strdup (name);
+    link_list_append (&program->attrib_bindings, binding, attrib_binding_destroy);
+}
+
+static void
+shader_source_destroy (void *abstract_source)
+{
+    shader_source_t *source = abstract_source;
+    free (source->text);
+    free (source);
+}
+
+HashTable *
+shader_source_cache_new (void)
+{
+    return new_hash_table (shader_source_destroy);
+}
+
+static size_t
+shader_source_piece_length (const GLchar **string,
+                            const GLint *length,
+                            GLsizei i)
+{
+    if (! length || length[i] < 0)
+        return strlen (string[i]);
+    return length[i];
+}
+
+static bool
+shader_source_matches (shader_source_t *source,
+                       GLsizei count,
+                       const GLchar **string,
+                       const GLint *length)
+{
+    size_t offset = 0;
+    GLsizei i;
+    for (i = 0; i < count; i++) {
+        size_t piece_length = shader_source_piece_length (string, length, i);
+        if (offset + piece_length > source->length ||
+            memcmp (source->text + offset, string[i], piece_length))
+            return false;
+        offset += piece_length;
+    }
+    return offset == source->length;
+}
+
+/* Returns the entry holding the concatenation of the given strings,
+ * inserting it if this is the first time the source is seen. Returns
+ * NULL when a different source already owns the hash; the caller then
+ * has to send the text itself. */
+shader_source_t *
+shader_source_cache_get (HashTable *cache,
+                         GLsizei count,
+                         const GLchar **string,
+                         const GLint *length)
+{
+    static unsigned int next_serial = 0;
+
+    /* Same function as hash_str, but over all the pieces at once. */
+    GLuint hash = 5381;
+    size_t total_length = 0;
+    GLsizei i;
+    size_t j;
+    for (i = 0; i < count; i++) {
+        size_t piece_length = shader_source_piece_length (string, length, i);
+        const signed char *p = (const signed char *) string[i];
+        for (j = 0; j < piece_length; j++)
+            hash = (hash << 5) + hash + p[j];
+        total_length += piece_length;
+    }
+
+    /* Zero is not a valid hash table key. */
+    if (! hash)
+        hash = 1;
+
+    shader_source_t *source = hash_lookup (cache, hash);
+    if (source) {
+        if (shader_source_matches (source, count, string, length))
+            return source;
+        return NULL;
+    }
+
+    source = malloc (sizeof (shader_source_t));
+    source->serial = __sync_add_and_fetch (&next_serial, 1);
+    source->hash = hash;
+    source->length = total_length;
+    source->text = malloc (total_length + 1);
+
+    size_t offset = 0;
+    for (i = 0; i < count; i++) {
+        size_t piece_length = shader_source_piece_length (string, length, i);
+        memcpy (source->text + offset, string[i], piece_length);
+        offset += piece_length;
+    }
+    source->text[total_length] = 0;
+
+    hash_insert (cache, hash, source);
+    return source;
 }
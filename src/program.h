@@ -3,6 +3,7 @@
 
 #include "hash.h"
 #include "thread_private.h"
+#include "types_private.h"
 #include <EGL/egl.h>
 #include <EGL/eglext.h>
 #include <stdbool.h>
@@ -17,8 +18,29 @@ typedef struct _shader_object shader_object_t;
 struct _shader_object {
     GLuint id;
     int type;
+
+    /* GL_COMPILE_STATUS or GL_LINK_STATUS of the last glCompileShader
+     * or glLinkProgram, filled in by the server once it has run. */
+    result_slot_t status;
 };
 
+/* Shader source text stored once per share group. Every shader whose
+ * source is identical points to the same entry, so the text is neither
+ * copied nor sent to the server again. Entries are never modified after
+ * insertion, which lets the server read them without locking. */
+typedef struct _shader_source {
+    unsigned int serial;        /* Unique for the process lifetime. */
+    GLuint       hash;
+    size_t       length;
+    char         *text;
+} shader_source_t;
+
+typedef struct _shader {
+    shader_object_t base;
+    shader_source_t *source;            /* NULL if it could not be shared. */
+    shader_source_t *compiled_source;   /* source at the last glCompileShader. */
+} shader_t;
+
 typedef struct v_program_status {
     GLboolean    delete_status;
     GLboolean    link_status;
@@ -62,17 +84,48 @@ typedef struct v_program {
     v_program_uniform_list_t    uniforms;
 } v_program_t;
 
+typedef struct _attrib_binding {
+    GLuint index;
+    char   *name;
+} attrib_binding_t;
+
 typedef struct _program {
     shader_object_t base;
     bool            mark_for_deletion;
     HashTable       *attrib_location_cache;
     HashTable       *uniform_location_cache;
+
+    /* What a link depends on, used to recognize identical links. */
+    GLuint          attached_shaders[2];
+    link_list_t     *attrib_bindings;
 } program_t;
 
+private void
+shader_object_init (shader_object_t *shader_object,
+                    GLuint id,
+                    int type);
+
+private shader_t *
+shader_new (GLuint id);
+
 private program_t *
 program_new (GLuint id);
 
 private void
 program_destroy (void *abstract_program);
 
+private void
+program_bind_attrib_location (program_t *program,
+                              GLuint index,
+                              const GLchar *name);
+
+private HashTable *
+shader_source_cache_new (void);
+
+private shader_source_t *
+shader_source_cache_get (HashTable *cache,
+                         GLsizei count,
+                         const GLchar **string,
+                         const GLint *length);
+
 #endif
@@ -3,7 +3,10 @@
 
 #include "ring_buffer.h"
 #include "dispatch_table.h"
+#include "program.h"
+#include "symbol_cache.h"
 #include "thread_private.h"
+#include <string.h>
 #include <time.h>
 
 /* This method is auto-generated into server_autogen.c
@@ -11,6 +14,57 @@
 static void
 server_fill_command_handler_table (server_t *server);
 
+/* What the commands run on this thread have made current. A pool worker
+ * runs the commands of several servers, each with its own binding. */
+static __thread EGLDisplay thread_display
+    __attribute__(( tls_model ("initial-exec"))) = EGL_NO_DISPLAY;
+static __thread EGLSurface thread_draw
+    __attribute__(( tls_model ("initial-exec"))) = EGL_NO_SURFACE;
+static __thread EGLSurface thread_read
+    __attribute__(( tls_model ("initial-exec"))) = EGL_NO_SURFACE;
+static __thread EGLContext thread_context
+    __attribute__(( tls_model ("initial-exec"))) = EGL_NO_CONTEXT;
+
+static void
+server_set_binding (server_t *server,
+                    EGLDisplay display,
+                    EGLSurface draw,
+                    EGLSurface read,
+                    EGLContext context)
+{
+    server->display = thread_display = display;
+    server->draw = thread_draw = draw;
+    server->read = thread_read = read;
+    server->context = thread_context = context;
+}
+
+static void
+server_run_command (server_t *server,
+                    command_t *command)
+{
+    server->handler_table[command->type](server, command);
+    buffer_read_advance (server->buffer, command->size);
+
+    if (command->token) {
+        server->buffer->last_token = command->token;
+        sem_post (server->client_signal);
+    }
+}
+
+/* The client frees the buffer once it sees the token. */
+static void
+server_acknowledge_shutdown (buffer_t *buffer,
+                             sem_t *client_signal,
+                             command_t *command)
+{
+    unsigned int token = command->token;
+    buffer_read_advance (buffer, command->size);
+    if (token) {
+        buffer->last_token = token;
+        sem_post (client_signal);
+    }
+}
+
 void
 server_start_work_loop (server_t *server)
 {
@@ -34,17 +88,65 @@ server_start_work_loop (server_t *server)
                                                               &data_left_to_read);
         }
 
-        if (read_command->type == COMMAND_SHUTDOWN)
+        if (read_command->type == COMMAND_SHUTDOWN) {
+            server_acknowledge_shutdown (server->buffer, server->client_signal,
+                                         read_command);
             break;
+        }
 
-        server->handler_table[read_command->type](server, read_command);
-        buffer_read_advance (server->buffer, read_command->size);
+        server_run_command (server, read_command);
+    }
+}
+
+server_pool_ring_status_t
+server_run_pooled (void *abstract_server,
+                   unsigned int budget)
+{
+    server_t *server = abstract_server;
+    unsigned int i;
+
+    /* Another server's commands may have run on this worker since. */
+    if (server->context != EGL_NO_CONTEXT &&
+        (server->context != thread_context ||
+         server->display != thread_display ||
+         server->draw != thread_draw ||
+         server->read != thread_read)) {
+        if (server->dispatch.eglMakeCurrent (server, server->display, server->draw,
+                                             server->read, server->context) == EGL_TRUE) {
+            thread_display = server->display;
+            thread_draw = server->draw;
+            thread_read = server->read;
+            thread_context = server->context;
+        }
+    }
 
-        if (read_command->token) {
-            server->buffer->last_token = read_command->token;
-            sem_post (server->client_signal);
+    for (i = 0; i < budget; i++) {
+        size_t data_left_to_read;
+        command_t *read_command = (command_t *) buffer_read_address (server->buffer,
+                                                                     &data_left_to_read);
+        if (! read_command)
+            return SERVER_POOL_RING_EMPTY;
+
+        if (read_command->type == COMMAND_SHUTDOWN) {
+            buffer_t *buffer = server->buffer;
+            sem_t *client_signal = server->client_signal;
+
+            /* Nothing of ours may stay current on a thread other
+             * servers use. */
+            if (server->context != EGL_NO_CONTEXT && server->context == thread_context) {
+                server->dispatch.eglMakeCurrent (server, EGL_NO_DISPLAY, EGL_NO_SURFACE,
+                                                 EGL_NO_SURFACE, EGL_NO_CONTEXT);
+                server_set_binding (server, EGL_NO_DISPLAY, EGL_NO_SURFACE,
+                                    EGL_NO_SURFACE, EGL_NO_CONTEXT);
+            }
+            server_destroy (server);
+            server_acknowledge_shutdown (buffer, client_signal, read_command);
+            return SERVER_POOL_RING_CLOSED;
         }
+
+        server_run_command (server, read_command);
     }
+    return SERVER_POOL_RING_PREEMPTED;
 }
 
 server_t *
@@ -111,9 +213,81 @@ server_handle_gldeletebuffers (server_t *server, command_t *abstract_command)
 
     server->dispatch.glDeleteBuffers (server, command->n, command->buffers);
 
+    /* Deleting a bound buffer unbinds it. */
+    context_streams_t *streams = server->streams;
+    for (i = 0; streams && i < command->n; i++) {
+        if (command->buffers[i] == streams->array_buffer_binding)
+            streams->array_buffer_binding = 0;
+        if (command->buffers[i] == streams->element_array_buffer_binding)
+            streams->element_array_buffer_binding = 0;
+    }
+
     command_gldeletebuffers_destroy_arguments (command);
 }
 
+static void
+server_handle_glbindbuffer (server_t *server, command_t *abstract_command)
+{
+    INSTRUMENT();
+
+    command_glbindbuffer_t *command =
+        (command_glbindbuffer_t *)abstract_command;
+
+    if (command->buffer) {
+        mutex_lock (name_mapping_mutex);
+        GLuint *buffer = hash_lookup (name_mapping, command->buffer);
+        if (! buffer) {
+            buffer = (GLuint *) malloc (sizeof (GLuint));
+            *buffer = command->buffer;
+            hash_insert (name_mapping, *buffer, buffer);
+        }
+        mutex_unlock (name_mapping_mutex);
+        command->buffer = *buffer;
+    }
+
+    server->dispatch.glBindBuffer (server, command->target, command->buffer);
+
+    if (server->streams && command->target == GL_ARRAY_BUFFER)
+        server->streams->array_buffer_binding = command->buffer;
+    else if (server->streams && command->target == GL_ELEMENT_ARRAY_BUFFER) {
+        server->streams->element_array_buffer_binding = command->buffer;
+        server->streams->element_array_buffer_binding_known = true;
+    }
+
+    command_glbindbuffer_destroy_arguments (command);
+}
+
+static void
+server_handle_glbindvertexarrayoes (server_t *server, command_t *abstract_command)
+{
+    INSTRUMENT();
+
+    command_glbindvertexarrayoes_t *command =
+        (command_glbindvertexarrayoes_t *)abstract_command;
+
+    server->dispatch.glBindVertexArrayOES (server, command->array);
+    if (server->streams)
+        server->streams->element_array_buffer_binding_known = false;
+
+    command_glbindvertexarrayoes_destroy_arguments (command);
+}
+
+static void
+server_handle_gldeletevertexarraysoes (server_t *server, command_t *abstract_command)
+{
+    INSTRUMENT();
+
+    command_gldeletevertexarraysoes_t *command =
+        (command_gldeletevertexarraysoes_t *)abstract_command;
+
+    /* Deleting the bound array object binds the default one. */
+    server->dispatch.glDeleteVertexArraysOES (server, command->n, command->arrays);
+    if (server->streams)
+        server->streams->element_array_buffer_binding_known = false;
+
+    command_gldeletevertexarraysoes_destroy_arguments (command);
+}
+
 static void
 server_handle_glgenframebuffers (server_t *server, command_t *abstract_command)
 {
@@ -330,6 +504,638 @@ server_handle_gldeleteshader (server_t *server, command_t *abstract_command)
     command_gldeleteshader_destroy_arguments (command);
 }
 
+static void
+server_fill_result_slot (result_slot_t *slot,
+                         GLint value)
+{
+    slot->value = value;
+    /* The client may be polling the slot from another thread; pairs
+     * with result_slot_is_pending. */
+    __atomic_store_n (&slot->pending, false, __ATOMIC_RELEASE);
+}
+
+static void
+server_handle_eglcreatesynckhr (server_t *server, command_t *abstract_command)
+{
+    INSTRUMENT ();
+
+    command_eglcreatesynckhr_t *command =
+            (command_eglcreatesynckhr_t *)abstract_command;
+    command->result = server->dispatch.eglCreateSyncKHR (server, command->dpy,
+                                                         command->type,
+                                                         command->attrib_list);
+
+    /* The client handed out its own handle and did not wait. */
+    if (command->client_sync) {
+        command->client_sync->driver_sync = command->result;
+        server_fill_result_slot (&command->client_sync->created,
+                                 command->result != EGL_NO_SYNC_KHR);
+    }
+}
+
+static void
+server_handle_eglswapbuffers (server_t *server, command_t *abstract_command)
+{
+    INSTRUMENT ();
+
+    command_eglswapbuffers_t *command =
+            (command_eglswapbuffers_t *)abstract_command;
+    command->result = server->dispatch.eglSwapBuffers (server, command->dpy,
+                                                       command->surface);
+
+    if (command->pending_swap) {
+        clock_gettime (CLOCK_MONOTONIC, &command->pending_swap->swapped_time);
+        server_fill_result_slot (&command->pending_swap->swapped,
+                                 command->result);
+    }
+
+    /* By the end of the first frame most of the driver's functions have
+     * been looked up. */
+    static bool symbols_saved = false;
+    if (! symbols_saved &&
+        __sync_bool_compare_and_swap (&symbols_saved, false, true))
+        symbol_cache_save_all ();
+}
+
+static void
+server_handle_glcompileshader (server_t *server, command_t *abstract_command)
+{
+    INSTRUMENT ();
+
+    command_glcompileshader_t *command =
+            (command_glcompileshader_t *)abstract_command;
+
+    mutex_lock (name_mapping_mutex);
+    GLuint *shader = hash_lookup (name_mapping, command->shader);
+    mutex_unlock (name_mapping_mutex);
+
+    /* The client answers GL_COMPILE_STATUS from this slot, so it never
+     * has to wait for the compile unless the application asks for it. */
+    GLint status = GL_FALSE;
+    if (shader) {
+        server->dispatch.glCompileShader (server, *shader);
+        if (command->status)
+            server->dispatch.glGetShaderiv (server, *shader,
+                                            GL_COMPILE_STATUS, &status);
+    }
+
+    if (command->status)
+        server_fill_result_slot (command->status, status);
+
+    command_glcompileshader_destroy_arguments (command);
+}
+
+static void
+server_handle_glshadersource (server_t *server, command_t *abstract_command)
+{
+    INSTRUMENT ();
+
+    command_glshadersource_t *command =
+            (command_glshadersource_t *)abstract_command;
+
+    mutex_lock (name_mapping_mutex);
+    GLuint *shader = hash_lookup (name_mapping, command->shader);
+    mutex_unlock (name_mapping_mutex);
+
+    if (shader && command->source) {
+        const GLchar *text = command->source->text;
+        GLint length = command->source->length;
+        server->dispatch.glShaderSource (server, *shader, 1, &text, &length);
+    } else if (shader) {
+        server->dispatch.glShaderSource (server, *shader, command->count,
+                                         (const char **) command->string,
+                                         command->length);
+    }
+
+    command_glshadersource_destroy_arguments (command);
+}
+
+/* Driver binaries of successful links, keyed by the link key the client
+ * computes from the compiled sources and attribute bindings. Replaying
+ * one with glProgramBinaryOES skips compiling the same program again.
+ * Binaries can be large, so the least recently used ones are dropped
+ * once they add up to more than the budget. */
+#define PROGRAM_BINARY_CACHE_BUDGET (16 * 1024 * 1024)
+
+typedef struct _program_binary {
+    GLuint key;
+    char *link_key;
+    GLenum format;
+    GLsizei length;
+    void *binary;
+} program_binary_t;
+
+mutex_static_init (program_binary_cache_mutex);
+static HashTable *program_binary_cache = NULL;
+/* Most recently used first; the entries belong to the hash table. */
+static link_list_t *program_binary_lru = NULL;
+static size_t program_binary_cache_size = 0;
+
+static void
+program_binary_destroy (void *abstract_binary)
+{
+    program_binary_t *binary = abstract_binary;
+    free (binary->link_key);
+    free (binary->binary);
+    free (binary);
+}
+
+static void
+program_binary_cache_evict (size_t needed)
+{
+    /* Called with program_binary_cache_mutex held. */
+    link_list_t *last = program_binary_lru;
+    while (last && last->next)
+        last = last->next;
+
+    while (last &&
+           program_binary_cache_size + needed > PROGRAM_BINARY_CACHE_BUDGET) {
+        link_list_t *previous = last == program_binary_lru ? NULL : last->prev;
+        program_binary_t *binary = last->data;
+
+        program_binary_cache_size -= binary->length;
+        link_list_delete_element (&program_binary_lru, last);
+        hash_remove (program_binary_cache, binary->key);
+        last = previous;
+    }
+}
+
+static bool
+server_supports_program_binary (server_t *server)
+{
+    /* Support depends on the driver behind the context, so it is asked
+     * once per context rather than once per process. */
+    context_streams_t *streams = server->streams;
+    if (! streams)
+        return false;
+    if (streams->program_binary_supported != -1)
+        return streams->program_binary_supported;
+
+    const char *extensions =
+        (const char *) server->dispatch.glGetString (server, GL_EXTENSIONS);
+    GLint formats = 0;
+    if (extensions && strstr (extensions, "GL_OES_get_program_binary") &&
+        server->dispatch.glGetProgramBinaryOES &&
+        server->dispatch.glProgramBinaryOES)
+        server->dispatch.glGetIntegerv (server,
+                                        GL_NUM_PROGRAM_BINARY_FORMATS_OES,
+                                        &formats);
+    streams->program_binary_supported = formats > 0;
+    return streams->program_binary_supported;
+}
+
+static bool
+server_link_program_from_binary (server_t *server,
+                                 GLuint program,
+                                 const char *link_key)
+{
+    GLint status = GL_FALSE;
+
+    mutex_lock (program_binary_cache_mutex);
+    program_binary_t *binary = program_binary_cache ?
+        hash_lookup (program_binary_cache, hash_str (link_key)) : NULL;
+    if (binary && ! strcmp (binary->link_key, link_key)) {
+        link_list_delete_first_entry_matching_data (&program_binary_lru,
+                                                    binary);
+        link_list_prepend (&program_binary_lru, binary, NULL);
+
+        server->dispatch.glProgramBinaryOES (server, program, binary->format,
+                                             binary->binary, binary->length);
+        server->dispatch.glGetProgramiv (server, program,
+                                         GL_LINK_STATUS, &status);
+    }
+    mutex_unlock (program_binary_cache_mutex);
+
+    /* A rejected binary (e.g. after a driver update) is not an error,
+     * the caller just links the program normally. */
+    return status == GL_TRUE;
+}
+
+static void
+server_save_program_binary (server_t *server,
+                            GLuint program,
+                            const char *link_key)
+{
+    GLint length = 0;
+    server->dispatch.glGetProgramiv (server, program,
+                                     GL_PROGRAM_BINARY_LENGTH_OES, &length);
+    if (length <= 0 || length > PROGRAM_BINARY_CACHE_BUDGET)
+        return;
+
+    program_binary_t *binary = malloc (sizeof (program_binary_t));
+    binary->binary = malloc (length);
+    binary->length = 0;
+    server->dispatch.glGetProgramBinaryOES (server, program, length,
+                                            &binary->length, &binary->format,
+                                            binary->binary);
+    if (binary->length <= 0) {
+        free (binary->binary);
+        free (binary);
+        return;
+    }
+
+    binary->key = hash_str (link_key);
+    mutex_lock (program_binary_cache_mutex);
+    if (! program_binary_cache)
+        program_binary_cache = new_hash_table (program_binary_destroy);
+    if (hash_lookup (program_binary_cache, binary->key)) {
+        mutex_unlock (program_binary_cache_mutex);
+        free (binary->binary);
+        free (binary);
+        return;
+    }
+
+    program_binary_cache_evict (binary->length);
+    binary->link_key = strdup (link_key);
+    hash_insert (program_binary_cache, binary->key, binary);
+    link_list_prepend (&program_binary_lru, binary, NULL);
+    program_binary_cache_size += binary->length;
+    mutex_unlock (program_binary_cache_mutex);
+}
+
+static void
+server_handle_gllinkprogram (server_t *server, command_t *abstract_command)
+{
+    INSTRUMENT ();
+
+    command_gllinkprogram_t *command =
+            (command_gllinkprogram_t *)abstract_command;
+
+    mutex_lock (name_mapping_mutex);
+    GLuint *program = hash_lookup (name_mapping, command->program);
+    mutex_unlock (name_mapping_mutex);
+
+    if (! program) {
+        if (command->status)
+            server_fill_result_slot (command->status, GL_FALSE);
+        command_gllinkprogram_destroy_arguments (command);
+        return;
+    }
+
+    bool use_binary = command->link_key && server_supports_program_binary (server);
+    GLint status = GL_FALSE;
+
+    if (use_binary &&
+        server_link_program_from_binary (server, *program, command->link_key)) {
+        status = GL_TRUE;
+    } else {
+        server->dispatch.glLinkProgram (server, *program);
+        server->dispatch.glGetProgramiv (server, *program,
+                                         GL_LINK_STATUS, &status);
+        if (use_binary && status == GL_TRUE)
+            server_save_program_binary (server, *program, command->link_key);
+    }
+
+    if (command->status)
+        server_fill_result_slot (command->status, status);
+
+    command_gllinkprogram_destroy_arguments (command);
+}
+
+/* Smallest storage allocated for a streaming buffer. */
+#define STREAMING_BUFFER_MIN_CAPACITY (1024 * 1024)
+
+mutex_static_init (context_streams_mutex);
+static link_list_t *context_streams = NULL;
+
+static void
+context_streams_unreference (context_streams_t *streams)
+{
+    /* Called with context_streams_mutex held. The buffers themselves
+     * go away with the context. */
+    if (streams && --streams->references == 0)
+        free (streams);
+}
+
+static context_streams_t *
+server_reference_context_streams (EGLContext context)
+{
+    link_list_t *entry = context_streams;
+    while (entry) {
+        context_streams_t *streams = entry->data;
+        if (streams->context == context) {
+            streams->references++;
+            return streams;
+        }
+        entry = entry->next;
+    }
+
+    context_streams_t *streams = malloc (sizeof (context_streams_t));
+    streams->context = context;
+    streams->references = 2;
+    memset (&streams->vertices, 0, sizeof (streaming_buffer_t));
+    memset (&streams->indices, 0, sizeof (streaming_buffer_t));
+    streams->vertices.target = GL_ARRAY_BUFFER;
+    streams->indices.target = GL_ELEMENT_ARRAY_BUFFER;
+    streams->array_buffer_binding = 0;
+    streams->element_array_buffer_binding = 0;
+    streams->element_array_buffer_binding_known = true;
+    streams->program_binary_supported = -1;
+    link_list_append (&context_streams, streams, NULL);
+    return streams;
+}
+
+static void
+server_handle_eglmakecurrent (server_t *server, command_t *abstract_command)
+{
+    INSTRUMENT ();
+    command_eglmakecurrent_t *command =
+            (command_eglmakecurrent_t *)abstract_command;
+    command->result = server->dispatch.eglMakeCurrent (server, command->dpy, command->draw, command->read, command->ctx);
+
+    if (command->made_current || command->released) {
+        EGLint error = command->result == EGL_TRUE ? EGL_SUCCESS :
+                                                     server->dispatch.eglGetError (server);
+        if (command->released)
+            server_fill_result_slot (command->released, error);
+        if (command->made_current)
+            server_fill_result_slot (command->made_current, error);
+    }
+    if (command->result != EGL_TRUE)
+        return;
+
+    server_set_binding (server, command->dpy, command->draw, command->read, command->ctx);
+
+    mutex_lock (context_streams_mutex);
+    context_streams_unreference (server->streams);
+    server->streams = command->ctx == EGL_NO_CONTEXT ? NULL :
+        server_reference_context_streams (command->ctx);
+    mutex_unlock (context_streams_mutex);
+
+    server->streamed_attrib_count = 0;
+}
+
+/* A queued eglMakeCurrent may have failed; the client then queries the
+ * limits again once it knows its context. */
+static void
+server_handle_prefetch_limits (server_t *server, command_t *abstract_command)
+{
+    INSTRUMENT ();
+    command_prefetch_limits_t *command =
+            (command_prefetch_limits_t *)abstract_command;
+    GLsizei i;
+
+    if (command->ctx != server->context) {
+        server_fill_result_slot (command->fetched, GL_FALSE);
+        return;
+    }
+
+    for (i = 0; i < command->count; i++) {
+        limit_value_t *limit = &command->limits[i];
+        if (limit->is_float)
+            server->dispatch.glGetFloatv (server, limit->pname, limit->value.floats);
+        else
+            server->dispatch.glGetIntegerv (server, limit->pname, limit->value.integers);
+    }
+    server_fill_result_slot (command->fetched, GL_TRUE);
+}
+
+static void
+server_handle_eglreleasethread (server_t *server, command_t *abstract_command)
+{
+    INSTRUMENT ();
+    command_eglreleasethread_t *command =
+            (command_eglreleasethread_t *)abstract_command;
+    command->result = server->dispatch.eglReleaseThread (server);
+    if (command->result != EGL_TRUE)
+        return;
+
+    server_set_binding (server, EGL_NO_DISPLAY, EGL_NO_SURFACE,
+                        EGL_NO_SURFACE, EGL_NO_CONTEXT);
+
+    mutex_lock (context_streams_mutex);
+    context_streams_unreference (server->streams);
+    server->streams = NULL;
+    mutex_unlock (context_streams_mutex);
+
+    server->streamed_attrib_count = 0;
+}
+
+static void
+server_handle_egldestroycontext (server_t *server, command_t *abstract_command)
+{
+    INSTRUMENT ();
+    command_egldestroycontext_t *command =
+            (command_egldestroycontext_t *)abstract_command;
+    command->result = server->dispatch.eglDestroyContext (server, command->dpy, command->ctx);
+    if (command->result != EGL_TRUE)
+        return;
+
+    /* A context that is current somewhere stays alive until it is
+     * released, so only drop the reference the registry holds. */
+    mutex_lock (context_streams_mutex);
+    link_list_t *entry = context_streams;
+    while (entry) {
+        context_streams_t *streams = entry->data;
+        if (streams->context == command->ctx) {
+            link_list_delete_element (&context_streams, entry);
+            context_streams_unreference (streams);
+            break;
+        }
+        entry = entry->next;
+    }
+    mutex_unlock (context_streams_mutex);
+}
+
+/* Copies data into the streaming buffer, which is left bound to its
+ * target, and returns the offset it landed at. */
+static size_t
+server_stream_data (server_t *server,
+                    streaming_buffer_t *stream,
+                    const void *data,
+                    size_t size)
+{
+    if (! stream->buffer)
+        server->dispatch.glGenBuffers (server, 1, &stream->buffer);
+    server->dispatch.glBindBuffer (server, stream->target, stream->buffer);
+
+    size_t offset = (stream->offset + 15) & ~((size_t) 15);
+    if (offset + size > stream->capacity) {
+        offset = 0;
+        while (stream->capacity < offset + size)
+            stream->capacity = stream->capacity ?
+                stream->capacity * 2 : STREAMING_BUFFER_MIN_CAPACITY;
+
+        /* Orphan the old storage rather than waiting for the draws
+         * that still read from it. */
+        server->dispatch.glBufferData (server, stream->target, stream->capacity,
+                                       NULL, GL_STREAM_DRAW);
+    }
+
+    server->dispatch.glBufferSubData (server, stream->target, offset, size, data);
+    stream->offset = offset + size;
+    return offset;
+}
+
+static bool
+server_pointer_in_buffer (server_t *server,
+                          const void *pointer)
+{
+    const char *start = server->buffer->address;
+    /* The ring is mapped twice in a row. */
+    return (const char *) pointer >= start &&
+           (const char *) pointer < start + 2 * server->buffer->length;
+}
+
+static size_t
+_vertex_attrib_type_size (GLenum type)
+{
+    if (type == GL_BYTE || type == GL_UNSIGNED_BYTE)
+        return sizeof (char);
+    else if (type == GL_SHORT || type == GL_UNSIGNED_SHORT)
+        return sizeof (short);
+    else if (type == GL_FLOAT)
+        return sizeof (float);
+    else if (type == GL_FIXED)
+        return sizeof (int);
+    return 0;
+}
+
+static void
+server_handle_glvertexattribpointer (server_t *server, command_t *abstract_command)
+{
+    INSTRUMENT ();
+    command_glvertexattribpointer_t *command =
+            (command_glvertexattribpointer_t *)abstract_command;
+    unsigned int i;
+
+    /* A later pointer for the same attribute replaces a streamed one. */
+    for (i = 0; i < server->streamed_attrib_count; i++) {
+        if (server->streamed_attribs[i].index == command->indx) {
+            server->streamed_attribs[i] =
+                server->streamed_attribs[--server->streamed_attrib_count];
+            break;
+        }
+    }
+
+    /* Client arrays only ever use attribute types with a known size, and
+     * there are never more of them than GL_MAX_VERTEX_ATTRIBS. */
+    if (! server_pointer_in_buffer (server, command->ptr) ||
+        server->streamed_attrib_count == SERVER_MAX_STREAMED_ATTRIBS ||
+        ! _vertex_attrib_type_size (command->type)) {
+        server->dispatch.glVertexAttribPointer (server, command->indx, command->size, command->type, command->normalized, command->stride, command->ptr);
+        return;
+    }
+
+    streamed_attrib_t *attrib =
+        &server->streamed_attribs[server->streamed_attrib_count++];
+    attrib->index = command->indx;
+    attrib->size = command->size;
+    attrib->type = command->type;
+    attrib->normalized = command->normalized;
+    attrib->stride = command->stride;
+    attrib->pointer = command->ptr;
+}
+
+static size_t
+_streamed_attrib_stride (streamed_attrib_t *attrib)
+{
+    if (attrib->stride)
+        return attrib->stride;
+    return _vertex_attrib_type_size (attrib->type) * attrib->size;
+}
+
+/* The attribute pointers the client sends point at `vertex_count`
+ * vertices it copied, which the draw numbers from 0. This uploads them
+ * and points the attributes at the upload. */
+static void
+server_stream_vertex_attribs (server_t *server,
+                              size_t vertex_count)
+{
+    unsigned int i;
+    if (! server->streamed_attrib_count)
+        return;
+
+    if (! server->streams) {
+        for (i = 0; i < server->streamed_attrib_count; i++) {
+            streamed_attrib_t *attrib = &server->streamed_attribs[i];
+            server->dispatch.glVertexAttribPointer (server, attrib->index, attrib->size,
+                                                    attrib->type, attrib->normalized,
+                                                    attrib->stride, attrib->pointer);
+        }
+        server->streamed_attrib_count = 0;
+        return;
+    }
+
+    const char *start = server->streamed_attribs[0].pointer;
+    const char *end = start;
+    for (i = 0; i < server->streamed_attrib_count; i++) {
+        streamed_attrib_t *attrib = &server->streamed_attribs[i];
+        const char *attrib_end = attrib->pointer + _streamed_attrib_stride (attrib) * vertex_count;
+
+        if (attrib->pointer < start)
+            start = attrib->pointer;
+        if (attrib_end > end)
+            end = attrib_end;
+    }
+
+    size_t offset = server_stream_data (server, &server->streams->vertices,
+                                        start, end - start);
+    for (i = 0; i < server->streamed_attrib_count; i++) {
+        streamed_attrib_t *attrib = &server->streamed_attribs[i];
+        size_t attrib_offset = offset + (attrib->pointer - start);
+        server->dispatch.glVertexAttribPointer (server, attrib->index, attrib->size,
+                                                attrib->type, attrib->normalized,
+                                                attrib->stride,
+                                                (const void *) attrib_offset);
+    }
+
+    server->dispatch.glBindBuffer (server, GL_ARRAY_BUFFER,
+                                   server->streams->array_buffer_binding);
+    server->streamed_attrib_count = 0;
+}
+
+static void
+server_handle_gldrawarrays (server_t *server, command_t *abstract_command)
+{
+    INSTRUMENT ();
+    command_gldrawarrays_t *command =
+            (command_gldrawarrays_t *)abstract_command;
+
+    server_stream_vertex_attribs (server, command->first + command->count);
+    server->dispatch.glDrawArrays (server, command->mode, command->first, command->count);
+}
+
+static void
+server_handle_gldrawelements (server_t *server, command_t *abstract_command)
+{
+    INSTRUMENT ();
+    command_gldrawelements_t *command =
+            (command_gldrawelements_t *)abstract_command;
+
+    if (! command->vertex_count) {
+        server->dispatch.glDrawElements (server, command->mode, command->count, command->type, command->indices);
+        return;
+    }
+
+    server_stream_vertex_attribs (server, command->vertex_count);
+
+    /* Indices are only copied when no element array buffer is bound. */
+    if (! server->streams || ! server_pointer_in_buffer (server, command->indices)) {
+        server->dispatch.glDrawElements (server, command->mode, command->count, command->type, command->indices);
+        return;
+    }
+
+    context_streams_t *streams = server->streams;
+    if (! streams->element_array_buffer_binding_known) {
+        GLint binding;
+        server->dispatch.glGetIntegerv (server, GL_ELEMENT_ARRAY_BUFFER_BINDING, &binding);
+        streams->element_array_buffer_binding = binding;
+        streams->element_array_buffer_binding_known = true;
+    }
+
+    size_t index_size = command->type == GL_UNSIGNED_BYTE ? sizeof (GLubyte) :
+                        command->type == GL_UNSIGNED_SHORT ? sizeof (GLushort) :
+                        sizeof (GLuint);
+    size_t offset = server_stream_data (server, &streams->indices,
+                                        command->indices,
+                                        index_size * command->count);
+    server->dispatch.glDrawElements (server, command->mode, command->count,
+                                     command->type, (const void *) offset);
+    server->dispatch.glBindBuffer (server, GL_ELEMENT_ARRAY_BUFFER,
+                                   streams->element_array_buffer_binding);
+}
+
 void
 server_init (server_t *server,
              buffer_t *buffer)
@@ -337,14 +1143,28 @@ server_init (server_t *server,
     server->buffer = buffer;
     server->dispatch = *dispatch_table_get_base();
     server->command_post_hook = NULL;
+    server->streams = NULL;
+    server->streamed_attrib_count = 0;
+    server->display = EGL_NO_DISPLAY;
+    server->draw = EGL_NO_SURFACE;
+    server->read = EGL_NO_SURFACE;
+    server->context = EGL_NO_CONTEXT;
 
     server->handler_table[COMMAND_NO_OP] = server_handle_no_op;
     server_fill_command_handler_table (server);
+    server->handler_table[COMMAND_PREFETCH_LIMITS] =
+        server_handle_prefetch_limits;
 
     server->handler_table[COMMAND_GLGENBUFFERS] =
         server_handle_glgenbuffers;
     server->handler_table[COMMAND_GLDELETEBUFFERS] =
         server_handle_gldeletebuffers;
+    server->handler_table[COMMAND_GLBINDBUFFER] =
+        server_handle_glbindbuffer;
+    server->handler_table[COMMAND_GLBINDVERTEXARRAYOES] =
+        server_handle_glbindvertexarrayoes;
+    server->handler_table[COMMAND_GLDELETEVERTEXARRAYSOES] =
+        server_handle_gldeletevertexarraysoes;
     server->handler_table[COMMAND_GLDELETEFRAMEBUFFERS] =
         server_handle_gldeleteframebuffers;
     server->handler_table[COMMAND_GLGENFRAMEBUFFERS] =
@@ -365,6 +1185,28 @@ server_init (server_t *server,
         server_handle_glcreateshader;
     server->handler_table[COMMAND_GLDELETESHADER] =
         server_handle_gldeleteshader;
+    server->handler_table[COMMAND_GLCOMPILESHADER] =
+        server_handle_glcompileshader;
+    server->handler_table[COMMAND_GLLINKPROGRAM] =
+        server_handle_gllinkprogram;
+    server->handler_table[COMMAND_GLSHADERSOURCE] =
+        server_handle_glshadersource;
+    server->handler_table[COMMAND_EGLMAKECURRENT] =
+        server_handle_eglmakecurrent;
+    server->handler_table[COMMAND_EGLDESTROYCONTEXT] =
+        server_handle_egldestroycontext;
+    server->handler_table[COMMAND_EGLRELEASETHREAD] =
+        server_handle_eglreleasethread;
+    server->handler_table[COMMAND_GLVERTEXATTRIBPOINTER] =
+        server_handle_glvertexattribpointer;
+    server->handler_table[COMMAND_GLDRAWARRAYS] =
+        server_handle_gldrawarrays;
+    server->handler_table[COMMAND_GLDRAWELEMENTS] =
+        server_handle_gldrawelements;
+    server->handler_table[COMMAND_EGLCREATESYNCKHR] =
+        server_handle_eglcreatesynckhr;
+    server->handler_table[COMMAND_EGLSWAPBUFFERS] =
+        server_handle_eglswapbuffers;
 
     mutex_lock (name_mapping_mutex);
     if (name_mapping) {
@@ -378,6 +1220,10 @@ server_init (server_t *server,
 bool
 server_destroy (server_t *server)
 {
+    mutex_lock (context_streams_mutex);
+    context_streams_unreference (server->streams);
+    mutex_unlock (context_streams_mutex);
+
     free (server);
     return true;
 }
@@ -8,6 +8,7 @@ typedef struct _server server_t;
 #include "compiler_private.h"
 #include "hash.h"
 #include "ring_buffer.h"
+#include "server_pool.h"
 #include "dispatch_table.h"
 #include "thread_private.h"
 #include "types_private.h"
@@ -16,6 +17,46 @@ typedef struct _server server_t;
 
 typedef void (*command_handler_t)(server_t *server, command_t *command);
 
+/* Client arrays arrive as pointers into the command buffer. Instead of
+ * handing those to the driver, which must copy them inside every draw,
+ * the server streams them into buffer objects it owns. */
+#define SERVER_MAX_STREAMED_ATTRIBS 32
+
+typedef struct _streamed_attrib {
+    GLuint index;
+    GLint size;
+    GLenum type;
+    GLboolean normalized;
+    GLsizei stride;
+    const char *pointer;
+} streamed_attrib_t;
+
+typedef struct _streaming_buffer {
+    GLenum target;
+    GLuint buffer;
+    size_t capacity;
+    size_t offset;
+} streaming_buffer_t;
+
+/* Buffer objects belong to a context, so each context gets its own.
+ * Streaming binds them, so the context's own bindings are kept here to
+ * be put back without asking the driver. Binding a vertex array object
+ * changes the element array binding to one not known until asked. */
+typedef struct _context_streams {
+    EGLContext context;
+    unsigned int references;
+    streaming_buffer_t vertices;
+    streaming_buffer_t indices;
+
+    GLuint array_buffer_binding;
+    GLuint element_array_buffer_binding;
+    bool element_array_buffer_binding_known;
+
+    /* Whether the context's driver takes program binaries, -1 until
+     * it has been asked. */
+    int program_binary_supported;
+} context_streams_t;
+
 struct _server {
     dispatch_table_t dispatch;
 
@@ -31,6 +72,17 @@ struct _server {
 
     sem_t *server_signal;
     sem_t *client_signal;
+
+    /* What this server's commands made current, which a pool worker
+     * makes current again before running them. */
+    EGLDisplay display;
+    EGLSurface draw;
+    EGLSurface read;
+    EGLContext context;
+
+    context_streams_t *streams;
+    streamed_attrib_t streamed_attribs[SERVER_MAX_STREAMED_ATTRIBS];
+    unsigned int streamed_attrib_count;
 };
 
 private void
@@ -46,6 +98,12 @@ server_destroy (server_t *server);
 private void
 server_start_work_loop (server_t *server);
 
+/* The server_pool_run_func_t of a server run by a pool worker. The server
+ * destroys itself when it reads the shutdown command. */
+private server_pool_ring_status_t
+server_run_pooled (void *abstract_server,
+                   unsigned int budget);
+
 private void
 server_custom_init (void);
 
@@ -0,0 +1,217 @@
+#include "config.h"
+#include "server_pool.h"
+#include <stdlib.h>
+
+typedef struct _server_pool_worker server_pool_worker_t;
+
+struct _server_pool_ring {
+    buffer_t *buffer;
+    server_pool_run_func_t run;
+    void *data;
+    server_pool_worker_t *worker;
+
+    /* Set while the ring is on the ready queue or being run, so that
+     * waking it again does nothing. */
+    volatile int scheduled;
+    server_pool_ring_t *next_ready;
+};
+
+struct _server_pool_worker {
+    server_pool_t *pool;
+    thread_t thread;
+
+    mutex_t mutex;
+    signal_t ready_signal;
+    server_pool_ring_t *ready_head;
+    server_pool_ring_t *ready_tail;
+    bool stopping;
+
+    /* Protected by the pool mutex. */
+    unsigned int ring_count;
+};
+
+struct _server_pool {
+    mutex_t mutex;
+    void (*thread_init) (void);
+    unsigned int worker_count;
+    server_pool_worker_t workers[SERVER_POOL_MAX_WORKERS];
+};
+
+/* Called with the worker mutex held. */
+static void
+server_pool_worker_push (server_pool_worker_t *worker,
+                         server_pool_ring_t *ring)
+{
+    ring->next_ready = NULL;
+    if (worker->ready_tail)
+        worker->ready_tail->next_ready = ring;
+    else
+        worker->ready_head = ring;
+    worker->ready_tail = ring;
+}
+
+static server_pool_ring_t *
+server_pool_worker_pop (server_pool_worker_t *worker)
+{
+    server_pool_ring_t *ring = worker->ready_head;
+    if (! ring)
+        return NULL;
+
+    worker->ready_head = ring->next_ready;
+    if (! worker->ready_head)
+        worker->ready_tail = NULL;
+    return ring;
+}
+
+static void
+server_pool_worker_requeue (server_pool_worker_t *worker,
+                            server_pool_ring_t *ring)
+{
+    mutex_lock (worker->mutex);
+    server_pool_worker_push (worker, ring);
+    mutex_unlock (worker->mutex);
+}
+
+static void *
+server_pool_worker_func (void *ptr)
+{
+    server_pool_worker_t *worker = ptr;
+    server_pool_t *pool = worker->pool;
+
+    if (pool->thread_init)
+        pool->thread_init ();
+
+    while (true) {
+        mutex_lock (worker->mutex);
+        while (! worker->ready_head && ! worker->stopping)
+            wait_signal (worker->ready_signal, worker->mutex);
+        server_pool_ring_t *ring = server_pool_worker_pop (worker);
+        mutex_unlock (worker->mutex);
+
+        if (! ring)
+            break;
+
+        switch (ring->run (ring->data, SERVER_POOL_RING_BUDGET)) {
+        case SERVER_POOL_RING_PREEMPTED:
+            server_pool_worker_requeue (worker, ring);
+            break;
+
+        case SERVER_POOL_RING_EMPTY:
+            /* A client that wrote while we were finding the ring empty
+             * saw it scheduled and did not wake it, so look again. */
+            __sync_lock_release (&ring->scheduled);
+            __sync_synchronize ();
+            if (buffer_num_entries (ring->buffer) &&
+                ! __sync_lock_test_and_set (&ring->scheduled, 1))
+                server_pool_worker_requeue (worker, ring);
+            break;
+
+        case SERVER_POOL_RING_CLOSED:
+            mutex_lock (pool->mutex);
+            worker->ring_count--;
+            mutex_unlock (pool->mutex);
+            free (ring);
+            break;
+        }
+    }
+    return NULL;
+}
+
+server_pool_t *
+server_pool_new (unsigned int worker_count,
+                 void (*thread_init) (void))
+{
+    server_pool_t *pool = malloc (sizeof (server_pool_t));
+    unsigned int i;
+
+    if (worker_count < 1)
+        worker_count = 1;
+    if (worker_count > SERVER_POOL_MAX_WORKERS)
+        worker_count = SERVER_POOL_MAX_WORKERS;
+
+    mutex_init (pool->mutex);
+    pool->thread_init = thread_init;
+    pool->worker_count = worker_count;
+
+    for (i = 0; i < worker_count; i++) {
+        server_pool_worker_t *worker = &pool->workers[i];
+        worker->pool = pool;
+        mutex_init (worker->mutex);
+        signal_init (worker->ready_signal);
+        worker->ready_head = worker->ready_tail = NULL;
+        worker->stopping = false;
+        worker->ring_count = 0;
+        pthread_create (&worker->thread, NULL, server_pool_worker_func, worker);
+    }
+    return pool;
+}
+
+void
+server_pool_destroy (server_pool_t *pool)
+{
+    unsigned int i;
+
+    for (i = 0; i < pool->worker_count; i++) {
+        server_pool_worker_t *worker = &pool->workers[i];
+        mutex_lock (worker->mutex);
+        worker->stopping = true;
+        signal (worker->ready_signal);
+        mutex_unlock (worker->mutex);
+    }
+
+    for (i = 0; i < pool->worker_count; i++) {
+        server_pool_worker_t *worker = &pool->workers[i];
+        pthread_join (worker->thread, NULL);
+        signal_destroy (worker->ready_signal);
+        mutex_destroy (worker->mutex);
+    }
+
+    mutex_destroy (pool->mutex);
+    free (pool);
+}
+
+unsigned int
+server_pool_get_worker_count (server_pool_t *pool)
+{
+    return pool->worker_count;
+}
+
+server_pool_ring_t *
+server_pool_add_ring (server_pool_t *pool,
+                      buffer_t *buffer,
+                      server_pool_run_func_t run,
+                      void *data)
+{
+    server_pool_ring_t *ring = malloc (sizeof (server_pool_ring_t));
+    unsigned int i;
+
+    ring->buffer = buffer;
+    ring->run = run;
+    ring->data = data;
+    ring->scheduled = 0;
+    ring->next_ready = NULL;
+
+    mutex_lock (pool->mutex);
+    ring->worker = &pool->workers[0];
+    for (i = 1; i < pool->worker_count; i++) {
+        if (pool->workers[i].ring_count < ring->worker->ring_count)
+            ring->worker = &pool->workers[i];
+    }
+    ring->worker->ring_count++;
+    mutex_unlock (pool->mutex);
+
+    return ring;
+}
+
+void
+server_pool_wake_ring (server_pool_ring_t *ring)
+{
+    if (__sync_lock_test_and_set (&ring->scheduled, 1))
+        return;
+
+    server_pool_worker_t *worker = ring->worker;
+    mutex_lock (worker->mutex);
+    server_pool_worker_push (worker, ring);
+    signal (worker->ready_signal);
+    mutex_unlock (worker->mutex);
+}
@@ -0,0 +1,58 @@
+#ifndef GPUPROCESS_SERVER_POOL_H
+#define GPUPROCESS_SERVER_POOL_H
+
+#include "compiler_private.h"
+#include "ring_buffer.h"
+#include "thread_private.h"
+#include <stdbool.h>
+
+/* A fixed number of worker threads that run the command rings of many
+ * clients. A ring belongs to one worker for its whole life, so whatever
+ * the ring's commands made current stays on one thread and only one
+ * worker ever runs a given context. A client wakes its ring up with
+ * server_pool_wake_ring after writing to an empty ring, which puts it on
+ * its worker's ready queue. */
+
+#define SERVER_POOL_MAX_WORKERS 16
+
+/* How many commands a ring runs before it goes to the back of the ready
+ * queue, when other rings are waiting. */
+#define SERVER_POOL_RING_BUDGET 256
+
+typedef enum _server_pool_ring_status {
+    SERVER_POOL_RING_EMPTY,
+    SERVER_POOL_RING_PREEMPTED,
+    SERVER_POOL_RING_CLOSED
+} server_pool_ring_status_t;
+
+/* Runs at most `budget` commands from the ring. After returning
+ * SERVER_POOL_RING_CLOSED, the ring is not run again. */
+typedef server_pool_ring_status_t (*server_pool_run_func_t) (void *data,
+                                                            unsigned int budget);
+
+typedef struct _server_pool server_pool_t;
+typedef struct _server_pool_ring server_pool_ring_t;
+
+/* `thread_init`, if not NULL, runs first on each worker thread. */
+private server_pool_t *
+server_pool_new (unsigned int worker_count,
+                 void (*thread_init) (void));
+
+/* Waits for the rings to be closed. */
+private void
+server_pool_destroy (server_pool_t *pool);
+
+private unsigned int
+server_pool_get_worker_count (server_pool_t *pool);
+
+/* The ring goes to the worker running the fewest rings. */
+private server_pool_ring_t *
+server_pool_add_ring (server_pool_t *pool,
+                      buffer_t *buffer,
+                      server_pool_run_func_t run,
+                      void *data);
+
+private void
+server_pool_wake_ring (server_pool_ring_t *ring);
+
+#endif /* GPUPROCESS_SERVER_POOL_H */
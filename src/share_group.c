@@ -0,0 +1,127 @@
+#include "config.h"
+#include "share_group.h"
+#include "buffer_object.h"
+#include "index_buffer_cache.h"
+#include "program.h"
+#include <stdlib.h>
+
+static void
+_shader_object_destroy (void *abstract_shader_object)
+{
+    shader_object_t *shader_object = abstract_shader_object;
+    if (shader_object->type == SHADER_OBJECT_PROGRAM)
+        program_destroy (shader_object);
+    free (shader_object);
+}
+
+share_group_t *
+share_group_new (void)
+{
+    share_group_t *group = malloc (sizeof (share_group_t));
+    pthread_mutexattr_t attributes;
+
+    group->references = 1;
+    pthread_mutexattr_init (&attributes);
+    pthread_mutexattr_settype (&attributes, PTHREAD_MUTEX_RECURSIVE);
+    pthread_mutex_init (&group->mutex, &attributes);
+    pthread_mutexattr_destroy (&attributes);
+
+    group->texture_cache = new_hash_table (free);
+    group->framebuffer_cache = new_hash_table (free);
+    group->renderbuffer_cache = new_hash_table (free);
+    group->shader_objects = new_hash_table (_shader_object_destroy);
+    group->shader_source_cache = shader_source_cache_new ();
+    group->index_buffer_cache = new_hash_table (index_buffer_destroy);
+    group->buffer_objects = new_hash_table (buffer_object_destroy);
+    group->index_buffer_cache_size = 0;
+    group->index_buffer_cache_budget = index_buffer_budget_from_environment ();
+
+    group->texture_name_handler = name_handler_create ();
+    group->framebuffer_name_handler = name_handler_create ();
+    group->renderbuffer_name_handler = name_handler_create ();
+    group->buffer_name_handler = name_handler_create ();
+    group->shader_objects_name_handler = name_handler_create ();
+
+    group->virtual_backing = NULL;
+    group->virtual_backing_client = NULL;
+
+    group->released_buffers = NULL;
+    group->released_buffer_count = 0;
+    group->released_buffer_capacity = 0;
+    return group;
+}
+
+share_group_t *
+share_group_reference (share_group_t *group)
+{
+    __sync_fetch_and_add (&group->references, 1);
+    return group;
+}
+
+void
+share_group_unreference (share_group_t *group)
+{
+    if (__sync_sub_and_fetch (&group->references, 1))
+        return;
+
+    delete_hash_table (group->texture_cache);
+    delete_hash_table (group->framebuffer_cache);
+    delete_hash_table (group->renderbuffer_cache);
+    delete_hash_table (group->shader_objects);
+    delete_hash_table (group->shader_source_cache);
+    delete_hash_table (group->index_buffer_cache);
+    delete_hash_table (group->buffer_objects);
+
+    name_handler_destroy (group->texture_name_handler);
+    name_handler_destroy (group->framebuffer_name_handler);
+    name_handler_destroy (group->renderbuffer_name_handler);
+    name_handler_destroy (group->buffer_name_handler);
+    name_handler_destroy (group->shader_objects_name_handler);
+
+    /* The server deletes them with the last context. */
+    free (group->released_buffers);
+
+    mutex_destroy (group->mutex);
+    free (group);
+}
+
+void
+share_group_lock (share_group_t *group)
+{
+    mutex_lock (group->mutex);
+}
+
+void
+share_group_unlock (share_group_t *group)
+{
+    mutex_unlock (group->mutex);
+}
+
+void
+share_group_release_buffer (share_group_t *group,
+                            GLuint buffer)
+{
+    share_group_lock (group);
+    if (group->released_buffer_count == group->released_buffer_capacity) {
+        group->released_buffer_capacity =
+            group->released_buffer_capacity ? group->released_buffer_capacity * 2 : 16;
+        group->released_buffers = realloc (group->released_buffers,
+                                           group->released_buffer_capacity * sizeof (GLuint));
+    }
+    group->released_buffers[group->released_buffer_count++] = buffer;
+    share_group_unlock (group);
+}
+
+unsigned int
+share_group_take_released_buffers (share_group_t *group,
+                                   GLuint **buffers)
+{
+    share_group_lock (group);
+    unsigned int count = group->released_buffer_count;
+    *buffers = group->released_buffers;
+    group->released_buffers = NULL;
+    group->released_buffer_count = 0;
+    group->released_buffer_capacity = 0;
+    share_group_unlock (group);
+    return count;
+}
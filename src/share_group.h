@@ -0,0 +1,90 @@
+#ifndef GPUPROCESS_SHARE_GROUP_H
+#define GPUPROCESS_SHARE_GROUP_H
+
+#include "compiler_private.h"
+#include "hash.h"
+#include "name_handler.h"
+#include "thread_private.h"
+
+struct egl_state;
+
+/* What the contexts created sharing with one another have in common: the
+ * names of textures, buffers, framebuffers, renderbuffers, shaders and
+ * programs, and what the client caches about those objects. Every context
+ * holds a reference and the group goes with the last of them.
+ *
+ * The contexts of a group may be current in several threads at once, so
+ * the tables and name handlers are only touched between share_group_lock
+ * and share_group_unlock. The lock nests, which lets a caller hold it
+ * around a lookup and the insert that depends on it. An object found in a
+ * table stays valid until a context of the group deletes it; as in GL,
+ * ordering that against its use in other contexts is up to the
+ * application. */
+
+typedef struct share_group {
+    unsigned int references;
+    mutex_t mutex;
+
+    HashTable *texture_cache;           /* texture_t */
+    HashTable *framebuffer_cache;       /* framebuffer_t */
+    HashTable *renderbuffer_cache;      /* renderbuffer_t */
+    HashTable *shader_objects;          /* program_t and shader_t */
+    HashTable *shader_source_cache;     /* shader_source_t */
+    HashTable *index_buffer_cache;      /* index_buffer_t */
+    HashTable *buffer_objects;          /* buffer_object_t */
+
+    /* Bytes of index data the index_buffer_cache shadows, and how many
+     * it may. */
+    size_t index_buffer_cache_size;
+    size_t index_buffer_cache_budget;
+
+    name_handler_t *texture_name_handler;
+    name_handler_t *framebuffer_name_handler;
+    name_handler_t *renderbuffer_name_handler;
+    name_handler_t *buffer_name_handler;
+    name_handler_t *shader_objects_name_handler;
+
+    /* Virtual contexts, see caching_client_eglMakeCurrent: the context
+     * the others of the group run on and the client that has it current.
+     * Both are guarded by cached_gl_states_mutex. */
+    struct egl_state *virtual_backing;
+    void *virtual_backing_client;
+
+    /* Buffers the proxy made for a context that is gone, see
+     * share_group_release_buffer. */
+    GLuint *released_buffers;
+    unsigned int released_buffer_count;
+    unsigned int released_buffer_capacity;
+} share_group_t;
+
+/* With one reference. */
+private share_group_t *
+share_group_new (void);
+
+private share_group_t *
+share_group_reference (share_group_t *group);
+
+private void
+share_group_unreference (share_group_t *group);
+
+private void
+share_group_lock (share_group_t *group);
+
+private void
+share_group_unlock (share_group_t *group);
+
+/* Server buffers the client made for itself in a context, such as those
+ * of the vertex cache, outlive the context while the group does. A
+ * context that goes away releases them here, and the next context of
+ * the group to take them deletes them. */
+private void
+share_group_release_buffer (share_group_t *group,
+                            GLuint buffer);
+
+/* Returns the number of released buffers and stores them in `buffers`,
+ * to be freed by the caller. The group forgets them. */
+private unsigned int
+share_group_take_released_buffers (share_group_t *group,
+                                   GLuint **buffers);
+
+#endif /* GPUPROCESS_SHARE_GROUP_H */
@@ -2,6 +2,12 @@
 #include <string.h>
 #include <stdlib.h>
 
+bool
+result_slot_is_pending (result_slot_t *slot)
+{
+    return __atomic_load_n (&slot->pending, __ATOMIC_ACQUIRE);
+}
+
 void
 link_list_append (link_list_t **list,
                   void *data,
@@ -2,6 +2,7 @@
 #define GPUPROCESS_TYPES_PRIVATE_H
 
 #include <stdbool.h>
+#include <time.h>
 
 typedef void (*list_delete_function_t)(void *data);
 
@@ -13,6 +14,40 @@ typedef struct link_list
     list_delete_function_t delete_function;
 } link_list_t;
 
+/* A value the server thread produces for a command the client did not
+ * wait on. The client only blocks when it actually needs the value. */
+typedef struct result_slot
+{
+    int value;
+    volatile bool pending;
+    void *client;
+} result_slot_t;
+
+/* An acquire load of `pending`: once it is false, `value` and whatever
+ * else the server wrote before filling the slot can be read. */
+bool
+result_slot_is_pending (result_slot_t *slot);
+
+/* The handle the client returns from eglCreateSyncKHR for a fence sync,
+ * before the server has created the driver's. The server fills `created`
+ * once it has submitted everything that came before the fence. */
+typedef struct egl_sync
+{
+    void *driver_sync;
+    result_slot_t created;
+    volatile bool signaled;
+} egl_sync_t;
+
+/* An eglSwapBuffers the client did not wait for. The server fills
+ * `swapped` with the result and notes when the driver returned. */
+typedef struct pending_swap
+{
+    result_slot_t swapped;
+    struct timespec queued_time;
+    struct timespec swapped_time;
+    bool in_flight;
+} pending_swap_t;
+
 #define v_ref_count_t unsigned int
 
 #define v_client_id_t pid_t
@@ -0,0 +1,320 @@
+#define _GNU_SOURCE
+#include <sched.h>
+
+#include "config.h"
+#include "cpu_topology.h"
+#include "thread_private.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define CPU_TOPOLOGY_DEFAULT_CAPACITY 1024
+#define CPU_TOPOLOGY_MAX_CACHES 10
+
+static bool
+_read_file (const char *path,
+            char *buffer,
+            size_t size)
+{
+    FILE *file = fopen (path, "r");
+    if (! file)
+        return false;
+
+    size_t length = fread (buffer, 1, size - 1, file);
+    fclose (file);
+    buffer[length] = 0;
+    return length > 0;
+}
+
+static int
+_read_int (const char *path,
+           int default_value)
+{
+    char buffer[32];
+    if (! _read_file (path, buffer, sizeof (buffer)))
+        return default_value;
+    return strtol (buffer, NULL, 10);
+}
+
+/* Lists look like "0-3,8-11". */
+static bool
+_read_cpu_list (const char *path,
+                cpu_set_t *set)
+{
+    char buffer[1024];
+    char *current = buffer;
+
+    CPU_ZERO (set);
+    if (! _read_file (path, buffer, sizeof (buffer)))
+        return false;
+
+    while (*current) {
+        char *end;
+        long first = strtol (current, &end, 10);
+        if (end == current)
+            break;
+
+        long last = first;
+        if (*end == '-') {
+            current = end + 1;
+            last = strtol (current, &end, 10);
+        }
+        for (; first <= last && first < CPU_TOPOLOGY_MAX_CPUS; first++)
+            CPU_SET (first, set);
+
+        if (*end != ',')
+            break;
+        current = end + 1;
+    }
+    return true;
+}
+
+static void
+_remove_cpus (cpu_set_t *set,
+              const cpu_set_t *removed)
+{
+    int cpu;
+    for (cpu = 0; cpu < CPU_TOPOLOGY_MAX_CPUS; cpu++) {
+        if (CPU_ISSET (cpu, removed))
+            CPU_CLR (cpu, set);
+    }
+}
+
+/* The smallest cache the CPU shares with another core; without one the
+ * cluster is the core itself. */
+static void
+_read_cluster (int cpu,
+               cpu_info_t *info)
+{
+    char path[128];
+    int index, best_level = 0;
+
+    info->cluster = info->smt_siblings;
+    for (index = 0; index < CPU_TOPOLOGY_MAX_CACHES; index++) {
+        cpu_set_t shared;
+
+        snprintf (path, sizeof (path),
+                  "/sys/devices/system/cpu/cpu%d/cache/index%d/level", cpu, index);
+        int level = _read_int (path, 0);
+        if (! level)
+            break;
+        if (best_level && level >= best_level)
+            continue;
+
+        snprintf (path, sizeof (path),
+                  "/sys/devices/system/cpu/cpu%d/cache/index%d/shared_cpu_list", cpu, index);
+        if (! _read_cpu_list (path, &shared))
+            continue;
+
+        cpu_set_t other_cores = shared;
+        _remove_cpus (&other_cores, &info->smt_siblings);
+        if (! CPU_COUNT (&other_cores))
+            continue;
+
+        info->cluster = shared;
+        best_level = level;
+    }
+}
+
+static bool
+_cpu_topology_read (cpu_topology_t *topology)
+{
+    char path[128];
+    int cpu;
+
+    topology->cpu_count = 0;
+    for (cpu = 0; cpu < CPU_TOPOLOGY_MAX_CPUS; cpu++) {
+        cpu_info_t *info = &topology->cpus[cpu];
+        info->online = false;
+
+        snprintf (path, sizeof (path),
+                  "/sys/devices/system/cpu/cpu%d/topology/thread_siblings_list", cpu);
+        if (! _read_cpu_list (path, &info->smt_siblings))
+            continue;
+
+        /* There is no online file for a CPU that cannot go offline. */
+        snprintf (path, sizeof (path), "/sys/devices/system/cpu/cpu%d/online", cpu);
+        info->online = _read_int (path, 1) != 0;
+
+        snprintf (path, sizeof (path), "/sys/devices/system/cpu/cpu%d/cpu_capacity", cpu);
+        info->capacity = _read_int (path, CPU_TOPOLOGY_DEFAULT_CAPACITY);
+
+        _read_cluster (cpu, info);
+        topology->cpu_count = cpu + 1;
+    }
+    return topology->cpu_count > 0;
+}
+
+const cpu_topology_t *
+cpu_topology_get (void)
+{
+    mutex_static_init (topology_mutex);
+    static cpu_topology_t *topology = NULL;
+    static bool initialized = false;
+
+    mutex_lock (topology_mutex);
+    if (! initialized) {
+        topology = malloc (sizeof (cpu_topology_t));
+        if (! _cpu_topology_read (topology)) {
+            free (topology);
+            topology = NULL;
+        }
+        initialized = true;
+    }
+    mutex_unlock (topology_mutex);
+    return topology;
+}
+
+static const char *placement_names[] = {
+    "cluster",
+    "smt",
+    "none",
+    "legacy"
+};
+
+thread_placement_t
+thread_placement_from_environment (void)
+{
+    const char *name = getenv ("GPUPROCESS_THREAD_PLACEMENT");
+    int i;
+
+    if (name) {
+        for (i = 0; i < (int) (sizeof (placement_names) / sizeof (placement_names[0])); i++) {
+            if (! strcmp (name, placement_names[i]))
+                return (thread_placement_t) i;
+        }
+    }
+    return THREAD_PLACEMENT_CLUSTER;
+}
+
+const char *
+thread_placement_get_name (thread_placement_t placement)
+{
+    return placement_names[placement];
+}
+
+/* The online CPU of `candidates` with the highest capacity, -1 if there
+ * is none. */
+static int
+_fastest_cpu (const cpu_topology_t *topology,
+              const cpu_set_t *candidates)
+{
+    int cpu, fastest = -1;
+
+    for (cpu = 0; cpu < topology->cpu_count; cpu++) {
+        if (! CPU_ISSET (cpu, candidates) || ! topology->cpus[cpu].online)
+            continue;
+        if (fastest < 0 || topology->cpus[cpu].capacity > topology->cpus[fastest].capacity)
+            fastest = cpu;
+    }
+    return fastest;
+}
+
+/* What the proxy always did. On a quad core PC the kernel spreads the
+ * client well, but on ARM with hotplug it would sometimes put the client
+ * and the server on the same core, hence the client on CPU 0. */
+static bool
+_place_pair_legacy (const cpu_set_t *allowed,
+                    cpu_set_t *client_cpus,
+                    cpu_set_t *server_cpus)
+{
+    int available_cpus = sysconf (_SC_NPROCESSORS_CONF);
+    int cpu = 1, i;
+
+    if (sysconf (_SC_NPROCESSORS_ONLN) > 1) {
+        for (i = 1; i < available_cpus; i++) {
+            if (CPU_ISSET (i, allowed)) {
+                cpu = i;
+                break;
+            }
+        }
+        CPU_SET (cpu, server_cpus);
+    }
+
+    if (available_cpus <= 4)
+        CPU_SET (0, client_cpus);
+    return true;
+}
+
+bool
+thread_placement_place_pair (thread_placement_t placement,
+                             const cpu_set_t *allowed,
+                             int client_cpu,
+                             cpu_set_t *client_cpus,
+                             cpu_set_t *server_cpus)
+{
+    const cpu_topology_t *topology = cpu_topology_get ();
+    cpu_set_t candidates;
+
+    CPU_ZERO (client_cpus);
+    CPU_ZERO (server_cpus);
+
+    if (placement == THREAD_PLACEMENT_NONE)
+        return false;
+    if (placement == THREAD_PLACEMENT_LEGACY)
+        return _place_pair_legacy (allowed, client_cpus, server_cpus);
+
+    if (! topology || client_cpu < 0 || client_cpu >= topology->cpu_count)
+        return false;
+    const cpu_info_t *client = &topology->cpus[client_cpu];
+
+    if (placement == THREAD_PLACEMENT_SMT_SIBLING) {
+        CPU_AND (&candidates, &client->smt_siblings, allowed);
+        CPU_CLR (client_cpu, &candidates);
+
+        int sibling = _fastest_cpu (topology, &candidates);
+        if (sibling >= 0) {
+            CPU_SET (client_cpu, client_cpus);
+            CPU_SET (sibling, server_cpus);
+            return true;
+        }
+        /* Without SMT, the cluster is the next closest thing. */
+    }
+
+    /* The server gets the fastest other core of the cluster, the client
+     * keeps the rest of it. */
+    CPU_AND (&candidates, &client->cluster, allowed);
+    _remove_cpus (&candidates, &client->smt_siblings);
+
+    int server_cpu = _fastest_cpu (topology, &candidates);
+    if (server_cpu < 0)
+        return false;
+
+    CPU_AND (server_cpus, &topology->cpus[server_cpu].smt_siblings, allowed);
+    CPU_AND (client_cpus, &client->cluster, allowed);
+    _remove_cpus (client_cpus, server_cpus);
+    return true;
+}
+
+bool
+thread_placement_place_workers (thread_placement_t placement,
+                                const cpu_set_t *allowed,
+                                cpu_set_t *worker_cpus)
+{
+    const cpu_topology_t *topology = cpu_topology_get ();
+    int cpu;
+
+    CPU_ZERO (worker_cpus);
+    if (! topology ||
+        (placement != THREAD_PLACEMENT_CLUSTER &&
+         placement != THREAD_PLACEMENT_SMT_SIBLING))
+        return false;
+
+    int fastest = _fastest_cpu (topology, allowed);
+    if (fastest < 0)
+        return false;
+
+    /* With cores that are all alike, the scheduler knows best. */
+    for (cpu = 0; cpu < topology->cpu_count; cpu++) {
+        if (CPU_ISSET (cpu, allowed) &&
+            topology->cpus[cpu].online &&
+            topology->cpus[cpu].capacity < topology->cpus[fastest].capacity)
+            break;
+    }
+    if (cpu == topology->cpu_count)
+        return false;
+
+    CPU_AND (worker_cpus, &topology->cpus[fastest].cluster, allowed);
+    return true;
+}
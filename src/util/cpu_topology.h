@@ -0,0 +1,69 @@
+#ifndef GPUPROCESS_CPU_TOPOLOGY_H
+#define GPUPROCESS_CPU_TOPOLOGY_H
+
+#include "compiler_private.h"
+#include <sched.h>
+#include <stdbool.h>
+
+/* Where client and server threads run. The topology comes from
+ * /sys/devices/system/cpu: SMT siblings, the CPUs sharing a cache with
+ * each CPU and, on big.LITTLE, the capacity of each core. The cluster of
+ * a CPU is the CPUs of the smallest cache it shares with another core.
+ *
+ * GPUPROCESS_THREAD_PLACEMENT picks the policy:
+ *   cluster  the server gets a core of the client's cluster, the client
+ *            the rest of the cluster. The default.
+ *   smt      the client and the server run on two SMT siblings.
+ *   none     threads are not pinned.
+ *   legacy   the server on the first CPU other than 0, the client on
+ *            CPU 0 with 4 CPUs or fewer. */
+
+#define CPU_TOPOLOGY_MAX_CPUS 256
+
+typedef enum _thread_placement {
+    THREAD_PLACEMENT_CLUSTER,
+    THREAD_PLACEMENT_SMT_SIBLING,
+    THREAD_PLACEMENT_NONE,
+    THREAD_PLACEMENT_LEGACY
+} thread_placement_t;
+
+typedef struct _cpu_info {
+    bool online;
+    int capacity;
+    cpu_set_t smt_siblings;
+    cpu_set_t cluster;
+} cpu_info_t;
+
+typedef struct _cpu_topology {
+    int cpu_count;
+    cpu_info_t cpus[CPU_TOPOLOGY_MAX_CPUS];
+} cpu_topology_t;
+
+/* Read once, NULL if sysfs has no topology. */
+private const cpu_topology_t *
+cpu_topology_get (void);
+
+private thread_placement_t
+thread_placement_from_environment (void);
+
+private const char *
+thread_placement_get_name (thread_placement_t placement);
+
+/* The CPUs for a client thread running on `client_cpu` and for its own
+ * server thread, within `allowed`. An empty set leaves that thread
+ * alone. Returns false when neither is to be pinned. */
+private bool
+thread_placement_place_pair (thread_placement_t placement,
+                             const cpu_set_t *allowed,
+                             int client_cpu,
+                             cpu_set_t *client_cpus,
+                             cpu_set_t *server_cpus);
+
+/* The CPUs for server threads shared by many clients: the cluster of
+ * the fastest cores. Returns false when they are not to be pinned. */
+private bool
+thread_placement_place_workers (thread_placement_t placement,
+                                const cpu_set_t *allowed,
+                                cpu_set_t *worker_cpus);
+
+#endif /* GPUPROCESS_CPU_TOPOLOGY_H */
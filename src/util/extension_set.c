@@ -0,0 +1,60 @@
+#include "config.h"
+#include "extension_set.h"
+#include <stdlib.h>
+#include <string.h>
+
+struct _extension_set {
+    char *names;        /* the string, with a NUL after each name */
+    size_t count;
+    const char **sorted;
+};
+
+static int
+_compare_names (const void *a,
+                const void *b)
+{
+    return strcmp (*(const char **) a, *(const char **) b);
+}
+
+extension_set_t *
+extension_set_new (const char *extensions)
+{
+    extension_set_t *set = malloc (sizeof (extension_set_t));
+    size_t length = strlen (extensions);
+    size_t i;
+
+    set->names = malloc (length + 1);
+    memcpy (set->names, extensions, length + 1);
+
+    /* At most one name for every two characters. */
+    set->sorted = malloc (sizeof (const char *) * (length / 2 + 1));
+    set->count = 0;
+
+    for (i = 0; i < length; i++) {
+        if (set->names[i] == ' ') {
+            set->names[i] = '\0';
+            continue;
+        }
+        if (i == 0 || set->names[i - 1] == '\0')
+            set->sorted[set->count++] = set->names + i;
+    }
+
+    qsort (set->sorted, set->count, sizeof (const char *), _compare_names);
+    return set;
+}
+
+void
+extension_set_destroy (extension_set_t *set)
+{
+    free (set->sorted);
+    free (set->names);
+    free (set);
+}
+
+bool
+extension_set_contains (const extension_set_t *set,
+                        const char *name)
+{
+    return bsearch (&name, set->sorted, set->count,
+                    sizeof (const char *), _compare_names) != NULL;
+}
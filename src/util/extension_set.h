@@ -0,0 +1,23 @@
+#ifndef GPUPROCESS_EXTENSION_SET_H
+#define GPUPROCESS_EXTENSION_SET_H
+
+#include "compiler_private.h"
+#include <stdbool.h>
+
+/* The names in a space separated extension string, parsed once and kept
+ * sorted, so that a lookup is a binary search over whole names rather
+ * than a scan of the string. */
+
+typedef struct _extension_set extension_set_t;
+
+private extension_set_t *
+extension_set_new (const char *extensions);
+
+private void
+extension_set_destroy (extension_set_t *set);
+
+private bool
+extension_set_contains (const extension_set_t *set,
+                        const char *name);
+
+#endif /* GPUPROCESS_EXTENSION_SET_H */
@@ -0,0 +1,178 @@
+#include "config.h"
+#include "fingerprint.h"
+#include <string.h>
+
+/* The hash follows the structure of xxHash32: four 32-bit lanes consume
+ * 16-byte stripes, then the lanes are folded together with the tail.
+ * Two different foldings of the same lanes give the 64-bit result. */
+
+#define PRIME32_1 2654435761U
+#define PRIME32_2 2246822519U
+#define PRIME32_3 3266489917U
+#define PRIME32_4 668265263U
+#define PRIME32_5 374761393U
+
+#define STRIPE_SIZE 16
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON__)
+#include <arm_neon.h>
+#endif
+
+static inline uint32_t
+_rotl32 (uint32_t value, int bits)
+{
+    return (value << bits) | (value >> (32 - bits));
+}
+
+static inline uint32_t
+_read32 (const unsigned char *p)
+{
+    uint32_t value;
+    memcpy (&value, p, sizeof (uint32_t));
+    return value;
+}
+
+#if defined(__SSE2__)
+/* SSE2 has no 32-bit low multiply, build it from two 32x32->64 ones. */
+static inline __m128i
+_mullo_epi32 (__m128i a, __m128i b)
+{
+    __m128i even = _mm_mul_epu32 (a, b);
+    __m128i odd = _mm_mul_epu32 (_mm_srli_epi64 (a, 32),
+                                 _mm_srli_epi64 (b, 32));
+    return _mm_unpacklo_epi32 (_mm_shuffle_epi32 (even, _MM_SHUFFLE (0, 0, 2, 0)),
+                               _mm_shuffle_epi32 (odd, _MM_SHUFFLE (0, 0, 2, 0)));
+}
+
+static size_t
+_consume_stripes (const unsigned char *p, size_t size, uint32_t lanes[4])
+{
+    size_t num_stripes = size / STRIPE_SIZE;
+    size_t i;
+
+    __m128i acc = _mm_loadu_si128 ((const __m128i *) lanes);
+    const __m128i prime1 = _mm_set1_epi32 ((int) PRIME32_1);
+    const __m128i prime2 = _mm_set1_epi32 ((int) PRIME32_2);
+
+    for (i = 0; i < num_stripes; i++) {
+        __m128i input = _mm_loadu_si128 ((const __m128i *) (p + i * STRIPE_SIZE));
+        acc = _mm_add_epi32 (acc, _mullo_epi32 (input, prime2));
+        acc = _mm_or_si128 (_mm_slli_epi32 (acc, 13), _mm_srli_epi32 (acc, 19));
+        acc = _mullo_epi32 (acc, prime1);
+    }
+
+    _mm_storeu_si128 ((__m128i *) lanes, acc);
+    return num_stripes * STRIPE_SIZE;
+}
+#elif defined(__ARM_NEON__)
+static size_t
+_consume_stripes (const unsigned char *p, size_t size, uint32_t lanes[4])
+{
+    size_t num_stripes = size / STRIPE_SIZE;
+    size_t i;
+
+    uint32x4_t acc = vld1q_u32 (lanes);
+    const uint32x4_t prime1 = vdupq_n_u32 (PRIME32_1);
+    const uint32x4_t prime2 = vdupq_n_u32 (PRIME32_2);
+
+    for (i = 0; i < num_stripes; i++) {
+        uint32x4_t input = vreinterpretq_u32_u8 (vld1q_u8 (p + i * STRIPE_SIZE));
+        acc = vmlaq_u32 (acc, input, prime2);
+        acc = vsriq_n_u32 (vshlq_n_u32 (acc, 13), acc, 19);
+        acc = vmulq_u32 (acc, prime1);
+    }
+
+    vst1q_u32 (lanes, acc);
+    return num_stripes * STRIPE_SIZE;
+}
+#else
+static size_t
+_consume_stripes (const unsigned char *p, size_t size, uint32_t lanes[4])
+{
+    size_t num_stripes = size / STRIPE_SIZE;
+    size_t i;
+    int lane;
+
+    for (i = 0; i < num_stripes; i++) {
+        for (lane = 0; lane < 4; lane++) {
+            uint32_t input = _read32 (p + i * STRIPE_SIZE + lane * 4);
+            lanes[lane] = _rotl32 (lanes[lane] + input * PRIME32_2, 13) * PRIME32_1;
+        }
+    }
+
+    return num_stripes * STRIPE_SIZE;
+}
+#endif
+
+static uint32_t
+_finish (uint32_t hash, const unsigned char *tail, size_t tail_size)
+{
+    while (tail_size >= 4) {
+        hash = _rotl32 (hash + _read32 (tail) * PRIME32_3, 17) * PRIME32_4;
+        tail += 4;
+        tail_size -= 4;
+    }
+    while (tail_size > 0) {
+        hash = _rotl32 (hash + (*tail) * PRIME32_5, 11) * PRIME32_1;
+        tail++;
+        tail_size--;
+    }
+
+    hash ^= hash >> 15;
+    hash *= PRIME32_2;
+    hash ^= hash >> 13;
+    hash *= PRIME32_3;
+    hash ^= hash >> 16;
+    return hash;
+}
+
+uint64_t
+fingerprint (const void *data,
+             size_t size)
+{
+    const unsigned char *p = data;
+    uint32_t lanes[4] = {
+        PRIME32_1 + PRIME32_2,
+        PRIME32_2,
+        0,
+        -PRIME32_1
+    };
+
+    size_t consumed = _consume_stripes (p, size, lanes);
+
+    uint32_t high = _rotl32 (lanes[0], 1) + _rotl32 (lanes[1], 7) +
+                    _rotl32 (lanes[2], 12) + _rotl32 (lanes[3], 18);
+    uint32_t low = _rotl32 (lanes[0], 18) + _rotl32 (lanes[1], 12) +
+                   _rotl32 (lanes[2], 7) + _rotl32 (lanes[3], 1);
+    high += (uint32_t) size;
+    low ^= (uint32_t) size * PRIME32_5;
+
+    high = _finish (high, p + consumed, size - consumed);
+    low = _finish (low, p + consumed, size - consumed);
+
+    return ((uint64_t) high << 32) | low;
+}
+
+uint64_t
+fingerprint_sampled (const void *data,
+                     size_t size,
+                     size_t sample_size,
+                     unsigned int samples)
+{
+    const unsigned char *p = data;
+    unsigned int i;
+
+    if (samples < 2 || size <= sample_size * samples)
+        return fingerprint (data, size);
+
+    uint64_t hash = size;
+    for (i = 0; i < samples; i++) {
+        size_t offset = (size - sample_size) / (samples - 1) * i;
+        if (i == samples - 1)
+            offset = size - sample_size;
+        hash = hash * PRIME32_1 + fingerprint (p + offset, sample_size);
+    }
+    return hash;
+}
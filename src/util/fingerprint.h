@@ -0,0 +1,25 @@
+#ifndef GPUPROCESS_FINGERPRINT_H
+#define GPUPROCESS_FINGERPRINT_H
+
+#include "compiler_private.h"
+#include <stddef.h>
+#include <stdint.h>
+
+/* A fast, non-cryptographic 64-bit hash of a block of memory, used to
+ * recognize data the server has already seen. The SSE2 and NEON versions
+ * compute exactly the same value as the scalar one. */
+private uint64_t
+fingerprint (const void *data,
+             size_t size);
+
+/* Like fingerprint (), but only hashes `samples` evenly spaced blocks of
+ * `sample_size` bytes (always including the first and the last one) plus
+ * the total size. Changes outside of the sampled blocks go unnoticed, so
+ * this is only meant for data too big to hash on every use. */
+private uint64_t
+fingerprint_sampled (const void *data,
+                     size_t size,
+                     size_t sample_size,
+                     unsigned int samples);
+
+#endif /* GPUPROCESS_FINGERPRINT_H */
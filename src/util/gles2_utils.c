@@ -34,6 +34,10 @@
 #include <GLES2/gl2.h>
 #include <GLES2/gl2ext.h>
 
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
 inline bool
 safe_multiply (uint32_t a,
                uint32_t b,
@@ -65,6 +69,58 @@ safe_add (uint32_t a,
   return true;
 }
 
+/* Images bigger than this are copied with non-temporal stores where the
+ * CPU has them: the copy is read by the server thread, not by the
+ * application, and would otherwise evict the application's working set
+ * from the cache. */
+#define NON_TEMPORAL_COPY_THRESHOLD (1024 * 1024)
+
+#if defined(__SSE2__)
+static void
+copy_bytes_non_temporal (char *dest,
+                         const char *source,
+                         size_t size)
+{
+    size_t head = (16 - ((uintptr_t) dest & 15)) & 15;
+    if (head > size)
+        head = size;
+    memcpy (dest, source, head);
+    dest += head;
+    source += head;
+    size -= head;
+
+    for (; size >= 64; size -= 64, source += 64, dest += 64) {
+        __m128i a = _mm_loadu_si128 ((const __m128i *) source);
+        __m128i b = _mm_loadu_si128 ((const __m128i *) (source + 16));
+        __m128i c = _mm_loadu_si128 ((const __m128i *) (source + 32));
+        __m128i d = _mm_loadu_si128 ((const __m128i *) (source + 48));
+        _mm_stream_si128 ((__m128i *) dest, a);
+        _mm_stream_si128 ((__m128i *) (dest + 16), b);
+        _mm_stream_si128 ((__m128i *) (dest + 32), c);
+        _mm_stream_si128 ((__m128i *) (dest + 48), d);
+    }
+    for (; size >= 16; size -= 16, source += 16, dest += 16)
+        _mm_stream_si128 ((__m128i *) dest,
+                          _mm_loadu_si128 ((const __m128i *) source));
+    memcpy (dest, source, size);
+}
+#endif
+
+static void
+copy_bytes (char *dest,
+            const char *source,
+            size_t size,
+            bool non_temporal)
+{
+#if defined(__SSE2__)
+    if (non_temporal) {
+        copy_bytes_non_temporal (dest, source, size);
+        return;
+    }
+#endif
+    memcpy (dest, source, size);
+}
+
 void
 copy_rect_to_buffer (const void *pixels,
                      void *buffer,
@@ -77,83 +133,102 @@ copy_rect_to_buffer (const void *pixels,
                      uint32_t pixels_padded_row_size,
                      uint32_t buffer_padded_row_size)
 {
-    uint32_t skip_elements = unpack_skip_pixels * compute_image_group_size(format, type);
+    if (! height)
+        return;
+
     const char *source = (const char *) pixels +
-                         unpack_skip_rows * pixels_padded_row_size +
-                         skip_elements;
+                         (size_t) unpack_skip_rows * pixels_padded_row_size +
+                         (size_t) unpack_skip_pixels * compute_image_group_size (format, type);
     char *dest = (char *) buffer;
-    /* XXX: We need to handle unpack values when pixels_padded_row_size != buffer_padded_row_size */
-    if (pixels_padded_row_size != buffer_padded_row_size) {
-        // The last row is copied unpadded at the end.
-        for (; height > 1; --height) {
-            memcpy(dest, source, buffer_padded_row_size);
-            dest += buffer_padded_row_size;
+    size_t size = (size_t) (height - 1) * buffer_padded_row_size + unpadded_row_size;
+    bool non_temporal = size >= NON_TEMPORAL_COPY_THRESHOLD;
 
+    /* The rows are as far apart in the application's memory as in the
+     * buffer, so the padding between them is copied along. */
+    if (pixels_padded_row_size == buffer_padded_row_size)
+        copy_bytes (dest, source, size, non_temporal);
+    else {
+        uint32_t row;
+        for (row = 0; row < height; row++) {
+            copy_bytes (dest, source, unpadded_row_size, non_temporal);
+            dest += buffer_padded_row_size;
             source += pixels_padded_row_size;
         }
-        memcpy(dest, source, unpadded_row_size);
-    } else {
-        int i;
-        for (i = 0; i < height - unpack_skip_rows - 1; i++) {
-            memcpy (dest, source, pixels_padded_row_size);
-	    source += pixels_padded_row_size + skip_elements;
-	    dest += pixels_padded_row_size;
-        }
-        memcpy(dest, source, unpadded_row_size);
-  }
+    }
+
+#if defined(__SSE2__)
+    if (non_temporal)
+        _mm_sfence ();
+#endif
 }
 
-// Returns the amount of data glTexImage2D or glTexSubImage2D will access.
+static bool
+compute_padded_row_size (uint32_t row_size,
+                         int unpack_alignment,
+                         uint32_t *padded_row_size)
+{
+    uint32_t temp;
+    if (unpack_alignment <= 0 ||
+        ! safe_add (row_size, unpack_alignment - 1, &temp))
+        return false;
+    *padded_row_size = (temp / unpack_alignment) * unpack_alignment;
+    return true;
+}
+
+// Returns the amount of data glTexImage2D or glTexSubImage2D will access
+// once the rows are packed back to back, each padded to the alignment.
 bool
 compute_image_data_sizes (int width,
                           int height,
                           int format,
                           int type,
                           int unpack_alignment,
-                          int unpack_row_length,
-                          int unpack_skip_rows,
                           uint32_t *size,
                           uint32_t *ret_unpadded_row_size,
                           uint32_t *ret_padded_row_size)
 {
-    uint32_t bytes_per_group = compute_image_group_size(format, type);
     uint32_t row_size;
+    uint32_t padded_row_size;
 
-    if (unpack_row_length > 0) {
-        if (! safe_multiply (unpack_row_length, bytes_per_group, &row_size))
-            return false;
-    } else {
-        if (! safe_multiply (width, bytes_per_group, &row_size))
-            return false;
-    }
+    if (width < 0 || height < 0)
+        return false;
+
+    if (! safe_multiply (width, compute_image_group_size (format, type), &row_size) ||
+        ! compute_padded_row_size (row_size, unpack_alignment, &padded_row_size))
+        return false;
 
     if (height > 1) {
-        uint32_t temp;
-          if (! safe_add (row_size, unpack_alignment - 1, &temp))
-              return false;
-        uint32_t padded_row_size = (temp / unpack_alignment) * unpack_alignment;
         uint32_t size_of_all_but_last_row;
-
-        if (! safe_multiply ((height - unpack_skip_rows - 1), padded_row_size, &size_of_all_but_last_row))
+        if (! safe_multiply (height - 1, padded_row_size, &size_of_all_but_last_row))
             return false;
-
         if (! safe_add (size_of_all_but_last_row, row_size, size))
             return false;
+    } else
+        *size = height ? row_size : 0;
 
-        if (ret_padded_row_size)
-            *ret_padded_row_size = padded_row_size;
-    } else {
-        if (! safe_multiply (height - unpack_skip_rows, row_size, size))
-            return false;
-
-        if (ret_padded_row_size)
-            *ret_padded_row_size = row_size;
-    }
-
+    if (ret_padded_row_size)
+        *ret_padded_row_size = padded_row_size;
     if (ret_unpadded_row_size)
-      *ret_unpadded_row_size = row_size;
+        *ret_unpadded_row_size = row_size;
+    return true;
+}
 
-  return true;
+bool
+compute_image_source_row_size (int width,
+                               int format,
+                               int type,
+                               int unpack_alignment,
+                               int unpack_row_length,
+                               uint32_t *padded_row_size)
+{
+    uint32_t row_size;
+
+    if (width < 0 || unpack_row_length < 0)
+        return false;
+    if (! safe_multiply (unpack_row_length > 0 ? unpack_row_length : width,
+                         compute_image_group_size (format, type), &row_size))
+        return false;
+    return compute_padded_row_size (row_size, unpack_alignment, padded_row_size);
 }
 
 static int
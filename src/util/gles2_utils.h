@@ -1,8 +1,11 @@
 #include "compiler_private.h"
 #include <EGL/egl.h>
+#include <stddef.h>
 #include <stdint.h>
 #include <stdbool.h>
 
+/* Copies `height` rows of `unpadded_row_size` bytes, starting at the
+ * unpack skip rows and skip pixels of `pixels`. */
 private void
 copy_rect_to_buffer (const void *pixels,
                      void *buffer,
@@ -15,18 +18,28 @@ copy_rect_to_buffer (const void *pixels,
                      uint32_t pixels_padded_row_size,
                      uint32_t buffer_padded_row_size);
 
+/* Sizes of the image data once its rows are packed back to back, each
+ * padded to the alignment, which is how the server reads it. */
 private bool
 compute_image_data_sizes (int width,
                           int height,
                           int format,
                           int type,
                           int unpack_alignment,
-                          int unpack_row_length,
-                          int unpack_skip_rows,
                           uint32_t *size,
                           uint32_t *ret_unpadded_row_size,
                           uint32_t *ret_padded_row_size);
 
+/* Distance between the rows of the application's pixels, which depends
+ * on the unpack row length. */
+private bool
+compute_image_source_row_size (int width,
+                               int format,
+                               int type,
+                               int unpack_alignment,
+                               int unpack_row_length,
+                               uint32_t *padded_row_size);
+
 private uint32_t
 compute_image_group_size (int format,
                           int type);
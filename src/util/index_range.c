@@ -0,0 +1,413 @@
+#include "config.h"
+#include "index_range.h"
+#include <stdint.h>
+
+/* Every kernel below folds `count` indices into the running minimum and
+ * maximum it is given, so that the vector versions can leave the tail
+ * of the array to the scalar ones. */
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define HAS_AVX2_DISPATCH 1
+#include <immintrin.h>
+#endif
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON__)
+#include <arm_neon.h>
+#endif
+
+#define DEFINE_SCALAR_SCAN(name, index_type)                     \
+static void                                                      \
+name (const index_type *indices, size_t count,                   \
+      GLuint *min_index, GLuint *max_index)                      \
+{                                                                \
+    GLuint min = *min_index;                                     \
+    GLuint max = *max_index;                                     \
+    size_t i;                                                    \
+    for (i = 0; i < count; i++) {                                \
+        if (indices[i] < min)                                    \
+            min = indices[i];                                    \
+        if (indices[i] > max)                                    \
+            max = indices[i];                                    \
+    }                                                            \
+    *min_index = min;                                            \
+    *max_index = max;                                            \
+}
+
+DEFINE_SCALAR_SCAN (_scan_u8_scalar, uint8_t)
+DEFINE_SCALAR_SCAN (_scan_u16_scalar, uint16_t)
+DEFINE_SCALAR_SCAN (_scan_u32_scalar, uint32_t)
+
+#if defined(HAS_AVX2_DISPATCH)
+__attribute__((target ("avx2"))) static void
+_scan_u8_avx2 (const uint8_t *indices, size_t count,
+               GLuint *min_index, GLuint *max_index)
+{
+    size_t vectors = count / 32;
+    size_t i;
+    uint8_t mins[32], maxs[32];
+
+    __m256i min = _mm256_set1_epi8 ((char) 0xff);
+    __m256i max = _mm256_setzero_si256 ();
+    for (i = 0; i < vectors; i++) {
+        __m256i v = _mm256_loadu_si256 ((const __m256i *) indices + i);
+        min = _mm256_min_epu8 (min, v);
+        max = _mm256_max_epu8 (max, v);
+    }
+
+    _mm256_storeu_si256 ((__m256i *) mins, min);
+    _mm256_storeu_si256 ((__m256i *) maxs, max);
+    _scan_u8_scalar (mins, vectors ? 32 : 0, min_index, max_index);
+    _scan_u8_scalar (maxs, vectors ? 32 : 0, min_index, max_index);
+    _scan_u8_scalar (indices + vectors * 32, count - vectors * 32,
+                     min_index, max_index);
+}
+
+__attribute__((target ("avx2"))) static void
+_scan_u16_avx2 (const uint16_t *indices, size_t count,
+                GLuint *min_index, GLuint *max_index)
+{
+    size_t vectors = count / 16;
+    size_t i;
+    uint16_t mins[16], maxs[16];
+
+    __m256i min = _mm256_set1_epi16 ((short) 0xffff);
+    __m256i max = _mm256_setzero_si256 ();
+    for (i = 0; i < vectors; i++) {
+        __m256i v = _mm256_loadu_si256 ((const __m256i *) indices + i);
+        min = _mm256_min_epu16 (min, v);
+        max = _mm256_max_epu16 (max, v);
+    }
+
+    _mm256_storeu_si256 ((__m256i *) mins, min);
+    _mm256_storeu_si256 ((__m256i *) maxs, max);
+    _scan_u16_scalar (mins, vectors ? 16 : 0, min_index, max_index);
+    _scan_u16_scalar (maxs, vectors ? 16 : 0, min_index, max_index);
+    _scan_u16_scalar (indices + vectors * 16, count - vectors * 16,
+                      min_index, max_index);
+}
+
+__attribute__((target ("avx2"))) static void
+_scan_u32_avx2 (const uint32_t *indices, size_t count,
+                GLuint *min_index, GLuint *max_index)
+{
+    size_t vectors = count / 8;
+    size_t i;
+    uint32_t mins[8], maxs[8];
+
+    __m256i min = _mm256_set1_epi32 (-1);
+    __m256i max = _mm256_setzero_si256 ();
+    for (i = 0; i < vectors; i++) {
+        __m256i v = _mm256_loadu_si256 ((const __m256i *) indices + i);
+        min = _mm256_min_epu32 (min, v);
+        max = _mm256_max_epu32 (max, v);
+    }
+
+    _mm256_storeu_si256 ((__m256i *) mins, min);
+    _mm256_storeu_si256 ((__m256i *) maxs, max);
+    _scan_u32_scalar (mins, vectors ? 8 : 0, min_index, max_index);
+    _scan_u32_scalar (maxs, vectors ? 8 : 0, min_index, max_index);
+    _scan_u32_scalar (indices + vectors * 8, count - vectors * 8,
+                      min_index, max_index);
+}
+#endif
+
+#if defined(__SSE2__)
+static void
+_scan_u8 (const uint8_t *indices, size_t count,
+          GLuint *min_index, GLuint *max_index)
+{
+    size_t vectors = count / 16;
+    size_t i;
+    uint8_t mins[16], maxs[16];
+
+    __m128i min = _mm_set1_epi8 ((char) 0xff);
+    __m128i max = _mm_setzero_si128 ();
+    for (i = 0; i < vectors; i++) {
+        __m128i v = _mm_loadu_si128 ((const __m128i *) indices + i);
+        min = _mm_min_epu8 (min, v);
+        max = _mm_max_epu8 (max, v);
+    }
+
+    _mm_storeu_si128 ((__m128i *) mins, min);
+    _mm_storeu_si128 ((__m128i *) maxs, max);
+    _scan_u8_scalar (mins, vectors ? 16 : 0, min_index, max_index);
+    _scan_u8_scalar (maxs, vectors ? 16 : 0, min_index, max_index);
+    _scan_u8_scalar (indices + vectors * 16, count - vectors * 16,
+                     min_index, max_index);
+}
+
+/* SSE2 only compares signed 16 and 32-bit integers, flipping the sign
+ * bit maps the unsigned order onto the signed one. */
+static void
+_scan_u16 (const uint16_t *indices, size_t count,
+           GLuint *min_index, GLuint *max_index)
+{
+    size_t vectors = count / 8;
+    size_t i, j;
+    uint16_t mins[8], maxs[8];
+
+    const __m128i bias = _mm_set1_epi16 ((short) 0x8000);
+    __m128i min = _mm_set1_epi16 (0x7fff);
+    __m128i max = _mm_set1_epi16 ((short) 0x8000);
+    for (i = 0; i < vectors; i++) {
+        __m128i v = _mm_xor_si128 (_mm_loadu_si128 ((const __m128i *) indices + i),
+                                   bias);
+        min = _mm_min_epi16 (min, v);
+        max = _mm_max_epi16 (max, v);
+    }
+
+    _mm_storeu_si128 ((__m128i *) mins, _mm_xor_si128 (min, bias));
+    _mm_storeu_si128 ((__m128i *) maxs, _mm_xor_si128 (max, bias));
+    for (j = 0; vectors && j < 8; j++) {
+        if (mins[j] < *min_index)
+            *min_index = mins[j];
+        if (maxs[j] > *max_index)
+            *max_index = maxs[j];
+    }
+    _scan_u16_scalar (indices + vectors * 8, count - vectors * 8,
+                      min_index, max_index);
+}
+
+static void
+_scan_u32 (const uint32_t *indices, size_t count,
+           GLuint *min_index, GLuint *max_index)
+{
+    size_t vectors = count / 4;
+    size_t i, j;
+    uint32_t mins[4], maxs[4];
+
+    const __m128i bias = _mm_set1_epi32 ((int) 0x80000000);
+    __m128i min = _mm_set1_epi32 (0x7fffffff);
+    __m128i max = _mm_set1_epi32 ((int) 0x80000000);
+    for (i = 0; i < vectors; i++) {
+        __m128i v = _mm_xor_si128 (_mm_loadu_si128 ((const __m128i *) indices + i),
+                                   bias);
+        __m128i below = _mm_cmplt_epi32 (v, min);
+        __m128i above = _mm_cmpgt_epi32 (v, max);
+        min = _mm_or_si128 (_mm_and_si128 (below, v), _mm_andnot_si128 (below, min));
+        max = _mm_or_si128 (_mm_and_si128 (above, v), _mm_andnot_si128 (above, max));
+    }
+
+    _mm_storeu_si128 ((__m128i *) mins, _mm_xor_si128 (min, bias));
+    _mm_storeu_si128 ((__m128i *) maxs, _mm_xor_si128 (max, bias));
+    for (j = 0; vectors && j < 4; j++) {
+        if (mins[j] < *min_index)
+            *min_index = mins[j];
+        if (maxs[j] > *max_index)
+            *max_index = maxs[j];
+    }
+    _scan_u32_scalar (indices + vectors * 4, count - vectors * 4,
+                      min_index, max_index);
+}
+#elif defined(__ARM_NEON__)
+static void
+_scan_u8 (const uint8_t *indices, size_t count,
+          GLuint *min_index, GLuint *max_index)
+{
+    size_t vectors = count / 16;
+    size_t i;
+    uint8_t mins[16], maxs[16];
+
+    uint8x16_t min = vdupq_n_u8 (0xff);
+    uint8x16_t max = vdupq_n_u8 (0);
+    for (i = 0; i < vectors; i++) {
+        uint8x16_t v = vld1q_u8 (indices + i * 16);
+        min = vminq_u8 (min, v);
+        max = vmaxq_u8 (max, v);
+    }
+
+    vst1q_u8 (mins, min);
+    vst1q_u8 (maxs, max);
+    _scan_u8_scalar (mins, vectors ? 16 : 0, min_index, max_index);
+    _scan_u8_scalar (maxs, vectors ? 16 : 0, min_index, max_index);
+    _scan_u8_scalar (indices + vectors * 16, count - vectors * 16,
+                     min_index, max_index);
+}
+
+static void
+_scan_u16 (const uint16_t *indices, size_t count,
+           GLuint *min_index, GLuint *max_index)
+{
+    size_t vectors = count / 8;
+    size_t i;
+    uint16_t mins[8], maxs[8];
+
+    uint16x8_t min = vdupq_n_u16 (0xffff);
+    uint16x8_t max = vdupq_n_u16 (0);
+    for (i = 0; i < vectors; i++) {
+        uint16x8_t v = vld1q_u16 (indices + i * 8);
+        min = vminq_u16 (min, v);
+        max = vmaxq_u16 (max, v);
+    }
+
+    vst1q_u16 (mins, min);
+    vst1q_u16 (maxs, max);
+    _scan_u16_scalar (mins, vectors ? 8 : 0, min_index, max_index);
+    _scan_u16_scalar (maxs, vectors ? 8 : 0, min_index, max_index);
+    _scan_u16_scalar (indices + vectors * 8, count - vectors * 8,
+                      min_index, max_index);
+}
+
+static void
+_scan_u32 (const uint32_t *indices, size_t count,
+           GLuint *min_index, GLuint *max_index)
+{
+    size_t vectors = count / 4;
+    size_t i;
+    uint32_t mins[4], maxs[4];
+
+    uint32x4_t min = vdupq_n_u32 (0xffffffff);
+    uint32x4_t max = vdupq_n_u32 (0);
+    for (i = 0; i < vectors; i++) {
+        uint32x4_t v = vld1q_u32 (indices + i * 4);
+        min = vminq_u32 (min, v);
+        max = vmaxq_u32 (max, v);
+    }
+
+    vst1q_u32 (mins, min);
+    vst1q_u32 (maxs, max);
+    _scan_u32_scalar (mins, vectors ? 4 : 0, min_index, max_index);
+    _scan_u32_scalar (maxs, vectors ? 4 : 0, min_index, max_index);
+    _scan_u32_scalar (indices + vectors * 4, count - vectors * 4,
+                      min_index, max_index);
+}
+#else
+#define _scan_u8 _scan_u8_scalar
+#define _scan_u16 _scan_u16_scalar
+#define _scan_u32 _scan_u32_scalar
+#endif
+
+typedef void (*scan_u8_function_t) (const uint8_t *indices, size_t count,
+                                    GLuint *min_index, GLuint *max_index);
+typedef void (*scan_u16_function_t) (const uint16_t *indices, size_t count,
+                                     GLuint *min_index, GLuint *max_index);
+typedef void (*scan_u32_function_t) (const uint32_t *indices, size_t count,
+                                     GLuint *min_index, GLuint *max_index);
+
+static bool
+_scan_with (scan_u8_function_t scan_u8,
+            scan_u16_function_t scan_u16,
+            scan_u32_function_t scan_u32,
+            GLenum type,
+            const void *indices,
+            size_t count,
+            GLuint *min_index,
+            GLuint *max_index)
+{
+    if (! count)
+        return false;
+
+    *min_index = 0xffffffff;
+    *max_index = 0;
+
+    if (type == GL_UNSIGNED_BYTE)
+        scan_u8 (indices, count, min_index, max_index);
+    else if (type == GL_UNSIGNED_SHORT)
+        scan_u16 (indices, count, min_index, max_index);
+    else if (type == GL_UNSIGNED_INT)
+        scan_u32 (indices, count, min_index, max_index);
+    else
+        return false;
+    return true;
+}
+
+bool
+index_range_kernel_available (index_range_kernel_t kernel)
+{
+    switch (kernel) {
+    case INDEX_RANGE_KERNEL_SCALAR:
+        return true;
+#if defined(__SSE2__)
+    case INDEX_RANGE_KERNEL_SSE2:
+        return true;
+#elif defined(__ARM_NEON__)
+    case INDEX_RANGE_KERNEL_NEON:
+        return true;
+#endif
+#if defined(HAS_AVX2_DISPATCH)
+    case INDEX_RANGE_KERNEL_AVX2:
+        return __builtin_cpu_supports ("avx2");
+#endif
+    default:
+        return false;
+    }
+}
+
+bool
+index_range_scan_with_kernel (index_range_kernel_t kernel,
+                              GLenum type,
+                              const void *indices,
+                              size_t count,
+                              GLuint *min_index,
+                              GLuint *max_index)
+{
+    if (! index_range_kernel_available (kernel))
+        return false;
+
+    switch (kernel) {
+#if defined(__SSE2__)
+    case INDEX_RANGE_KERNEL_SSE2:
+#elif defined(__ARM_NEON__)
+    case INDEX_RANGE_KERNEL_NEON:
+#endif
+#if defined(__SSE2__) || defined(__ARM_NEON__)
+        return _scan_with (_scan_u8, _scan_u16, _scan_u32,
+                           type, indices, count, min_index, max_index);
+#endif
+#if defined(HAS_AVX2_DISPATCH)
+    case INDEX_RANGE_KERNEL_AVX2:
+        return _scan_with (_scan_u8_avx2, _scan_u16_avx2, _scan_u32_avx2,
+                           type, indices, count, min_index, max_index);
+#endif
+    default:
+        return _scan_with (_scan_u8_scalar, _scan_u16_scalar, _scan_u32_scalar,
+                           type, indices, count, min_index, max_index);
+    }
+}
+
+bool
+index_range_scan (GLenum type,
+                  const void *indices,
+                  size_t count,
+                  GLuint *min_index,
+                  GLuint *max_index)
+{
+#if defined(HAS_AVX2_DISPATCH)
+    if (__builtin_cpu_supports ("avx2"))
+        return _scan_with (_scan_u8_avx2, _scan_u16_avx2, _scan_u32_avx2,
+                           type, indices, count, min_index, max_index);
+#endif
+    return _scan_with (_scan_u8, _scan_u16, _scan_u32,
+                       type, indices, count, min_index, max_index);
+}
+
+#define DEFINE_COPY_REBASED(name, index_type)                    \
+static void                                                      \
+name (index_type *destination, const index_type *indices,        \
+      size_t count, GLuint base)                                 \
+{                                                                \
+    size_t i;                                                    \
+    for (i = 0; i < count; i++)                                  \
+        destination[i] = indices[i] - (index_type) base;         \
+}
+
+DEFINE_COPY_REBASED (_copy_rebased_u8, uint8_t)
+DEFINE_COPY_REBASED (_copy_rebased_u16, uint16_t)
+DEFINE_COPY_REBASED (_copy_rebased_u32, uint32_t)
+
+void
+index_range_copy_rebased (GLenum type,
+                          void *destination,
+                          const void *indices,
+                          size_t count,
+                          GLuint base)
+{
+    if (type == GL_UNSIGNED_BYTE)
+        _copy_rebased_u8 (destination, indices, count, base);
+    else if (type == GL_UNSIGNED_SHORT)
+        _copy_rebased_u16 (destination, indices, count, base);
+    else if (type == GL_UNSIGNED_INT)
+        _copy_rebased_u32 (destination, indices, count, base);
+}
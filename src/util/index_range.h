@@ -0,0 +1,53 @@
+#ifndef GPUPROCESS_INDEX_RANGE_H
+#define GPUPROCESS_INDEX_RANGE_H
+
+#include "compiler_private.h"
+#include <GLES2/gl2.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+/* Finds the smallest and the largest index of an index array of type
+ * GL_UNSIGNED_BYTE, GL_UNSIGNED_SHORT or GL_UNSIGNED_INT. Returns false
+ * for any other type or an empty array. On x86 the widest of AVX2 and
+ * SSE2 the CPU supports is picked at runtime, on ARM NEON is used. */
+private bool
+index_range_scan (GLenum type,
+                  const void *indices,
+                  size_t count,
+                  GLuint *min_index,
+                  GLuint *max_index);
+
+/* The kernels index_range_scan () picks from, so that each of them can be
+ * checked against the scalar one. */
+typedef enum _index_range_kernel {
+    INDEX_RANGE_KERNEL_SCALAR,
+    INDEX_RANGE_KERNEL_SSE2,
+    INDEX_RANGE_KERNEL_AVX2,
+    INDEX_RANGE_KERNEL_NEON
+} index_range_kernel_t;
+
+/* Whether the kernel was built in and the CPU can run it. */
+private bool
+index_range_kernel_available (index_range_kernel_t kernel);
+
+/* Like index_range_scan (), but with the given kernel. Returns false if
+ * the kernel is not available. */
+private bool
+index_range_scan_with_kernel (index_range_kernel_t kernel,
+                              GLenum type,
+                              const void *indices,
+                              size_t count,
+                              GLuint *min_index,
+                              GLuint *max_index);
+
+/* Copies `count` indices of the given type from `indices` to
+ * `destination`, subtracting `base` from each of them. `base` must not
+ * be larger than any of the indices. */
+private void
+index_range_copy_rebased (GLenum type,
+                          void *destination,
+                          const void *indices,
+                          size_t count,
+                          GLuint base);
+
+#endif /* GPUPROCESS_INDEX_RANGE_H */
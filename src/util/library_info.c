@@ -0,0 +1,135 @@
+#define _GNU_SOURCE
+#include <dlfcn.h>
+#include <link.h>
+
+#include "config.h"
+#include "library_info.h"
+#include <errno.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#ifndef NT_GNU_BUILD_ID
+#define NT_GNU_BUILD_ID 3
+#endif
+
+static void
+_read_build_id (library_info_t *library,
+                const char *notes,
+                size_t length)
+{
+    size_t position = 0;
+
+    while (position + sizeof (ElfW(Nhdr)) <= length) {
+        const ElfW(Nhdr) *note = (const ElfW(Nhdr) *) (notes + position);
+        size_t name_size = (note->n_namesz + 3) & ~3;
+        size_t desc_size = (note->n_descsz + 3) & ~3;
+        const char *name = notes + position + sizeof (ElfW(Nhdr));
+
+        if (position + sizeof (ElfW(Nhdr)) + name_size + desc_size > length)
+            return;
+
+        if (note->n_type == NT_GNU_BUILD_ID &&
+            note->n_namesz == 4 && ! memcmp (name, "GNU", 4) &&
+            note->n_descsz <= LIBRARY_INFO_MAX_BUILD_ID) {
+            memcpy (library->build_id, name + name_size, note->n_descsz);
+            library->build_id_length = note->n_descsz;
+            return;
+        }
+        position += sizeof (ElfW(Nhdr)) + name_size + desc_size;
+    }
+}
+
+static int
+_find_library (struct dl_phdr_info *info,
+               size_t size,
+               void *data)
+{
+    library_info_t *library = data;
+    int i;
+
+    if (info->dlpi_addr != library->base)
+        return 0;
+
+    for (i = 0; i < info->dlpi_phnum; i++) {
+        const ElfW(Phdr) *header = &info->dlpi_phdr[i];
+
+        if (header->p_type == PT_LOAD &&
+            header->p_vaddr + header->p_memsz > library->size)
+            library->size = header->p_vaddr + header->p_memsz;
+
+        if (header->p_type == PT_NOTE && ! library->build_id_length)
+            _read_build_id (library,
+                            (const char *) (info->dlpi_addr + header->p_vaddr),
+                            header->p_memsz);
+    }
+    return 1;
+}
+
+bool
+library_info_get (void *library_handle,
+                  library_info_t *library)
+{
+    struct link_map *map = NULL;
+
+    if (! library_handle ||
+        dlinfo (library_handle, RTLD_DI_LINKMAP, &map) || ! map)
+        return false;
+
+    memset (library, 0, sizeof (library_info_t));
+    library->base = map->l_addr;
+    return dl_iterate_phdr (_find_library, library) &&
+           library->build_id_length && library->size;
+}
+
+/* Makes the directory and, if needed, its parent. */
+static bool
+_make_directory (char *path)
+{
+    if (! mkdir (path, 0700) || errno == EEXIST)
+        return true;
+
+    char *slash = strrchr (path, '/');
+    if (errno != ENOENT || ! slash || slash == path)
+        return false;
+
+    *slash = 0;
+    bool made_parent = ! mkdir (path, 0700) || errno == EEXIST;
+    *slash = '/';
+    return made_parent && (! mkdir (path, 0700) || errno == EEXIST);
+}
+
+bool
+library_info_cache_path (const library_info_t *libraries,
+                         int library_count,
+                         const char *prefix,
+                         char *path,
+                         size_t size)
+{
+    const char *cache_home = getenv ("XDG_CACHE_HOME");
+    const char *home = getenv ("HOME");
+    char directory[PATH_MAX];
+    int i;
+    size_t j;
+
+    if (cache_home && *cache_home)
+        snprintf (directory, sizeof (directory), "%s/gpuprocess", cache_home);
+    else if (home && *home)
+        snprintf (directory, sizeof (directory), "%s/.cache/gpuprocess", home);
+    else
+        return false;
+
+    if (! _make_directory (directory))
+        return false;
+
+    int length = snprintf (path, size, "%s/%s", directory, prefix);
+    for (i = 0; i < library_count && length + 2 < (int) size; i++) {
+        path[length++] = '-';
+        path[length] = 0;
+        for (j = 0; j < libraries[i].build_id_length && length + 3 < (int) size; j++)
+            length += snprintf (path + length, size - length, "%02x", libraries[i].build_id[j]);
+    }
+    return true;
+}
@@ -0,0 +1,39 @@
+#ifndef GPUPROCESS_LIBRARY_INFO_H
+#define GPUPROCESS_LIBRARY_INFO_H
+
+#include "compiler_private.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* Where a shared library is loaded and the GNU build-id that names its
+ * build. Caches of what the proxy learns about the driver are files in
+ * $XDG_CACHE_HOME/gpuprocess, or else ~/.cache/gpuprocess, named after
+ * the build-ids of the libraries they describe, so a new build of the
+ * driver starts new files. */
+
+#define LIBRARY_INFO_MAX_BUILD_ID 64
+
+typedef struct _library_info {
+    uintptr_t base;
+    /* The end of the last loaded segment, relative to base. */
+    uintptr_t size;
+    unsigned char build_id[LIBRARY_INFO_MAX_BUILD_ID];
+    size_t build_id_length;
+} library_info_t;
+
+/* False when the library has no build-id. */
+private bool
+library_info_get (void *library_handle,
+                  library_info_t *library);
+
+/* The path of "<prefix>-<build-id>[-<build-id>...]" in the cache
+ * directory, which is made if needed. False if there is no directory. */
+private bool
+library_info_cache_path (const library_info_t *libraries,
+                         int library_count,
+                         const char *prefix,
+                         char *path,
+                         size_t size);
+
+#endif /* GPUPROCESS_LIBRARY_INFO_H */
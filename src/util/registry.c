@@ -0,0 +1,388 @@
+#include "config.h"
+#include "registry.h"
+#include "thread_private.h"
+#include <stdint.h>
+#include <stdlib.h>
+
+#define REGISTRY_INITIAL_CAPACITY 64
+
+typedef struct _registry_entry {
+    const void *key;
+    const void *subkey;
+    void *value;
+} registry_entry_t;
+
+/* Slots are NULL, TOMBSTONE or an entry, which never changes once it is
+ * in a table. Readers only ever see whole entries. */
+typedef struct _registry_table {
+    unsigned int capacity;
+    registry_entry_t * volatile slots[1];
+} registry_table_t;
+
+struct _registry {
+    mutex_t mutex;
+    registry_table_t * volatile table;
+    unsigned int count;
+    unsigned int tombstones;
+};
+
+static registry_entry_t tombstone;
+#define TOMBSTONE (&tombstone)
+
+/* Epochs. A reader publishes the global epoch it saw when it came in,
+ * and 0 when it leaves. Something retired at epoch E was out of every
+ * registry before the epoch moved past E, so only readers that came in
+ * at E or before may hold it. */
+typedef struct _registry_reader {
+    volatile unsigned long epoch;
+    volatile int in_use;
+    struct _registry_reader *next;
+} registry_reader_t;
+
+typedef struct _registry_retired {
+    void *data;
+    registry_destroy_func_t destroy;
+    unsigned long epoch;
+    struct _registry_retired *next;
+} registry_retired_t;
+
+static registry_reader_t * volatile readers = NULL;
+static volatile unsigned long global_epoch = 1;
+static registry_retired_t *retired = NULL;
+mutex_static_init (retired_mutex);
+
+static __thread registry_reader_t *thread_reader = NULL;
+static __thread unsigned int thread_read_depth = 0;
+
+static pthread_key_t reader_key;
+static pthread_once_t reader_key_once = PTHREAD_ONCE_INIT;
+
+static void
+_release_reader (void *abstract_reader)
+{
+    registry_reader_t *reader = abstract_reader;
+    reader->epoch = 0;
+    __sync_lock_release (&reader->in_use);
+}
+
+static void
+_create_reader_key (void)
+{
+    pthread_key_create (&reader_key, _release_reader);
+}
+
+/* Readers of threads that have exited are reused, never freed, so the
+ * list can be walked without a lock. */
+static registry_reader_t *
+_get_thread_reader (void)
+{
+    registry_reader_t *reader;
+
+    if (thread_reader)
+        return thread_reader;
+
+    for (reader = readers; reader; reader = reader->next) {
+        if (! __sync_lock_test_and_set (&reader->in_use, 1))
+            break;
+    }
+
+    if (! reader) {
+        reader = malloc (sizeof (registry_reader_t));
+        reader->epoch = 0;
+        reader->in_use = 1;
+        do {
+            reader->next = readers;
+        } while (! __sync_bool_compare_and_swap (&readers, reader->next, reader));
+    }
+
+    pthread_once (&reader_key_once, _create_reader_key);
+    pthread_setspecific (reader_key, reader);
+    thread_reader = reader;
+    return reader;
+}
+
+void
+registry_read_lock (void)
+{
+    if (thread_read_depth++)
+        return;
+
+    registry_reader_t *reader = _get_thread_reader ();
+    reader->epoch = global_epoch;
+    __sync_synchronize ();
+}
+
+void
+registry_read_unlock (void)
+{
+    if (--thread_read_depth)
+        return;
+
+    __sync_synchronize ();
+    thread_reader->epoch = 0;
+}
+
+void
+registry_retire (void *data,
+                 registry_destroy_func_t destroy)
+{
+    registry_retired_t *item = malloc (sizeof (registry_retired_t));
+    registry_retired_t *done = NULL;
+    registry_retired_t **current;
+    registry_reader_t *reader;
+
+    mutex_lock (retired_mutex);
+    item->data = data;
+    item->destroy = destroy;
+    item->epoch = global_epoch;
+    item->next = retired;
+    retired = item;
+
+    /* A full barrier, so that readers coming in from now on see the
+     * registries without `data`. */
+    __sync_fetch_and_add (&global_epoch, 1);
+
+    unsigned long oldest = (unsigned long) -1;
+    for (reader = readers; reader; reader = reader->next) {
+        unsigned long epoch = reader->epoch;
+        if (epoch && epoch < oldest)
+            oldest = epoch;
+    }
+
+    current = &retired;
+    while (*current) {
+        registry_retired_t *candidate = *current;
+        if (candidate->epoch < oldest) {
+            *current = candidate->next;
+            candidate->next = done;
+            done = candidate;
+        } else
+            current = &candidate->next;
+    }
+    mutex_unlock (retired_mutex);
+
+    while (done) {
+        registry_retired_t *next = done->next;
+        if (done->destroy)
+            done->destroy (done->data);
+        free (done);
+        done = next;
+    }
+}
+
+static unsigned int
+_hash (const void *key,
+       const void *subkey)
+{
+    uint64_t hash = (uint64_t) (uintptr_t) key * 0x9E3779B97F4A7C15ull ^
+                    (uint64_t) (uintptr_t) subkey * 0xC2B2AE3D27D4EB4Full;
+    return (unsigned int) (hash ^ (hash >> 29));
+}
+
+static registry_table_t *
+_table_new (unsigned int capacity)
+{
+    registry_table_t *table = calloc (1, sizeof (registry_table_t) +
+                                         (capacity - 1) * sizeof (registry_entry_t *));
+    table->capacity = capacity;
+    return table;
+}
+
+registry_t *
+registry_new (void)
+{
+    registry_t *registry = malloc (sizeof (registry_t));
+    mutex_init (registry->mutex);
+    registry->table = _table_new (REGISTRY_INITIAL_CAPACITY);
+    registry->count = 0;
+    registry->tombstones = 0;
+    return registry;
+}
+
+/* The entry for the pair and its slot, NULL if there is none. */
+static registry_entry_t *
+_find_entry (registry_table_t *table,
+             const void *key,
+             const void *subkey,
+             unsigned int *slot)
+{
+    unsigned int mask = table->capacity - 1;
+    unsigned int index = _hash (key, subkey) & mask;
+    unsigned int probes;
+
+    for (probes = 0; probes < table->capacity; probes++) {
+        registry_entry_t *entry = table->slots[index];
+        if (! entry)
+            return NULL;
+        if (entry != TOMBSTONE && entry->key == key && entry->subkey == subkey) {
+            *slot = index;
+            return entry;
+        }
+        index = (index + 1) & mask;
+    }
+    return NULL;
+}
+
+void *
+registry_lookup (registry_t *registry,
+                 const void *key,
+                 const void *subkey)
+{
+    unsigned int slot;
+    registry_entry_t *entry = _find_entry (registry->table, key, subkey, &slot);
+    return entry ? entry->value : NULL;
+}
+
+/* Called with the registry mutex held. The entries move to the new
+ * table as they are; readers still on the old one finish there. */
+static void
+_grow_if_needed (registry_t *registry)
+{
+    registry_table_t *old_table = registry->table;
+    unsigned int capacity = old_table->capacity;
+    unsigned int i;
+
+    if ((registry->count + registry->tombstones + 1) * 4 <= capacity * 3)
+        return;
+    if ((registry->count + 1) * 2 > capacity)
+        capacity *= 2;
+
+    registry_table_t *table = _table_new (capacity);
+    for (i = 0; i < old_table->capacity; i++) {
+        registry_entry_t *entry = old_table->slots[i];
+        if (! entry || entry == TOMBSTONE)
+            continue;
+
+        unsigned int index = _hash (entry->key, entry->subkey) & (capacity - 1);
+        while (table->slots[index])
+            index = (index + 1) & (capacity - 1);
+        table->slots[index] = entry;
+    }
+
+    __sync_synchronize ();
+    registry->table = table;
+    registry->tombstones = 0;
+    registry_retire (old_table, free);
+}
+
+void *
+registry_insert (registry_t *registry,
+                 const void *key,
+                 const void *subkey,
+                 void *value)
+{
+    registry_entry_t *entry = malloc (sizeof (registry_entry_t));
+    void *old_value = NULL;
+
+    entry->key = key;
+    entry->subkey = subkey;
+    entry->value = value;
+
+    mutex_lock (registry->mutex);
+    _grow_if_needed (registry);
+
+    registry_table_t *table = registry->table;
+    unsigned int mask = table->capacity - 1;
+    unsigned int index = _hash (key, subkey) & mask;
+    int free_slot = -1;
+
+    while (table->slots[index]) {
+        registry_entry_t *existing = table->slots[index];
+        if (existing == TOMBSTONE) {
+            if (free_slot < 0)
+                free_slot = index;
+        } else if (existing->key == key && existing->subkey == subkey) {
+            old_value = existing->value;
+            __sync_synchronize ();
+            table->slots[index] = entry;
+            mutex_unlock (registry->mutex);
+
+            registry_retire (existing, free);
+            return old_value;
+        }
+        index = (index + 1) & mask;
+    }
+
+    if (free_slot >= 0)
+        registry->tombstones--;
+    else
+        free_slot = index;
+
+    __sync_synchronize ();
+    table->slots[free_slot] = entry;
+    registry->count++;
+    mutex_unlock (registry->mutex);
+    return NULL;
+}
+
+/* Called with the registry mutex held. */
+static void
+_remove_slot (registry_t *registry,
+              registry_table_t *table,
+              unsigned int slot)
+{
+    table->slots[slot] = TOMBSTONE;
+    registry->count--;
+    registry->tombstones++;
+}
+
+void *
+registry_remove (registry_t *registry,
+                 const void *key,
+                 const void *subkey)
+{
+    unsigned int slot;
+
+    mutex_lock (registry->mutex);
+    registry_table_t *table = registry->table;
+    registry_entry_t *entry = _find_entry (table, key, subkey, &slot);
+    if (! entry) {
+        mutex_unlock (registry->mutex);
+        return NULL;
+    }
+    _remove_slot (registry, table, slot);
+    mutex_unlock (registry->mutex);
+
+    void *value = entry->value;
+    registry_retire (entry, free);
+    return value;
+}
+
+void
+registry_remove_key (registry_t *registry,
+                     const void *key,
+                     registry_destroy_func_t destroy)
+{
+    unsigned int i;
+
+    mutex_lock (registry->mutex);
+    registry_table_t *table = registry->table;
+    for (i = 0; i < table->capacity; i++) {
+        registry_entry_t *entry = table->slots[i];
+        if (! entry || entry == TOMBSTONE || entry->key != key)
+            continue;
+
+        _remove_slot (registry, table, i);
+        registry_retire (entry->value, destroy);
+        registry_retire (entry, free);
+    }
+    mutex_unlock (registry->mutex);
+}
+
+void
+registry_foreach (registry_t *registry,
+                  const void *key,
+                  registry_foreach_func_t func,
+                  void *user_data)
+{
+    unsigned int i;
+
+    registry_read_lock ();
+    registry_table_t *table = registry->table;
+    for (i = 0; i < table->capacity; i++) {
+        registry_entry_t *entry = table->slots[i];
+        if (entry && entry != TOMBSTONE && entry->key == key)
+            func (entry->value, user_data);
+    }
+    registry_read_unlock ();
+}
@@ -0,0 +1,72 @@
+#ifndef GPUPROCESS_REGISTRY_H
+#define GPUPROCESS_REGISTRY_H
+
+#include "compiler_private.h"
+#include <stdbool.h>
+
+/* A hash table from a pair of pointers, such as an EGLDisplay and one of
+ * its contexts, to a value, that is read without taking a lock.
+ *
+ * Lookups run between registry_read_lock and registry_read_unlock, and
+ * the values they return stay valid until registry_read_unlock. Writers
+ * are serialized by the registry. Whatever a writer takes out of a
+ * registry goes to registry_retire, which destroys it once every thread
+ * that might still see it has left its read section. Read sections are
+ * cheap: a store and a memory barrier, and they nest. */
+
+typedef struct _registry registry_t;
+
+typedef void (*registry_destroy_func_t) (void *data);
+
+typedef void (*registry_foreach_func_t) (void *value,
+                                         void *user_data);
+
+private registry_t *
+registry_new (void);
+
+private void
+registry_read_lock (void);
+
+private void
+registry_read_unlock (void);
+
+/* Needs a read section, or the caller's own lock around every writer of
+ * the registry. NULL if there is no value for the pair. */
+private void *
+registry_lookup (registry_t *registry,
+                 const void *key,
+                 const void *subkey);
+
+/* Returns the value that was there before, which the caller retires. */
+private void *
+registry_insert (registry_t *registry,
+                 const void *key,
+                 const void *subkey,
+                 void *value);
+
+/* Returns the value, which the caller retires. */
+private void *
+registry_remove (registry_t *registry,
+                 const void *key,
+                 const void *subkey);
+
+/* Takes out every value under `key` and retires it with `destroy`. */
+private void
+registry_remove_key (registry_t *registry,
+                     const void *key,
+                     registry_destroy_func_t destroy);
+
+/* Calls `func` with every value under `key`, inside a read section of
+ * its own. It walks the whole table, so it is for the rare operations
+ * such as terminating a display; `func` may change the registry. */
+private void
+registry_foreach (registry_t *registry,
+                  const void *key,
+                  registry_foreach_func_t func,
+                  void *user_data);
+
+private void
+registry_retire (void *data,
+                 registry_destroy_func_t destroy);
+
+#endif /* GPUPROCESS_REGISTRY_H */
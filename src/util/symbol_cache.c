@@ -0,0 +1,254 @@
+#include "config.h"
+#include "symbol_cache.h"
+#include "library_info.h"
+#include "thread_private.h"
+#include <fcntl.h>
+#include <inttypes.h>
+#include <limits.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define SYMBOL_CACHE_BUCKETS 512
+#define SYMBOL_CACHE_MAX_NAME 128
+#define SYMBOL_CACHE_MAX_FILE (256 * 1024)
+
+typedef struct _symbol_cache_entry {
+    struct _symbol_cache_entry *next;
+    uintptr_t offset;
+    char name[1];
+} symbol_cache_entry_t;
+
+struct _symbol_cache {
+    struct _symbol_cache *next;
+    mutex_t mutex;
+    /* Entries were added since the file was read or written. */
+    bool dirty;
+    uintptr_t base;
+    /* The end of the last loaded segment, relative to base. */
+    uintptr_t size;
+    char path[PATH_MAX];
+    symbol_cache_entry_t *buckets[SYMBOL_CACHE_BUCKETS];
+};
+
+/* Every cache opened, to be saved at exit. They are never closed. */
+mutex_static_init (open_caches_mutex);
+static symbol_cache_t *open_caches = NULL;
+
+#define FNV_OFFSET_BASIS 2166136261u
+
+static uint32_t
+_fnv1a (uint32_t hash,
+        const char *data,
+        size_t length)
+{
+    while (length--)
+        hash = (hash ^ (unsigned char) *data++) * 16777619u;
+    return hash;
+}
+
+static unsigned int
+_hash_name (const char *name)
+{
+    return _fnv1a (FNV_OFFSET_BASIS, name, strlen (name)) % SYMBOL_CACHE_BUCKETS;
+}
+
+static symbol_cache_entry_t *
+_find_entry (symbol_cache_t *cache,
+             const char *name)
+{
+    symbol_cache_entry_t *entry = cache->buckets[_hash_name (name)];
+    while (entry && strcmp (entry->name, name))
+        entry = entry->next;
+    return entry;
+}
+
+static void
+_insert_entry (symbol_cache_t *cache,
+               const char *name,
+               uintptr_t offset)
+{
+    unsigned int bucket = _hash_name (name);
+    symbol_cache_entry_t *entry = malloc (sizeof (symbol_cache_entry_t) + strlen (name));
+
+    strcpy (entry->name, name);
+    entry->offset = offset;
+    entry->next = cache->buckets[bucket];
+    cache->buckets[bucket] = entry;
+}
+
+/* The file ends in a "checksum <fnv-1a>" line over everything before it.
+ * A file that does not, torn or edited or from an older version, is
+ * left out whole: a wrong address would be called. */
+static void
+_load (symbol_cache_t *cache)
+{
+    char name[SYMBOL_CACHE_MAX_NAME];
+    uintptr_t offset;
+    uint32_t checksum;
+
+    FILE *file = fopen (cache->path, "r");
+    if (! file)
+        return;
+
+    char *contents = malloc (SYMBOL_CACHE_MAX_FILE + 1);
+    size_t length = fread (contents, 1, SYMBOL_CACHE_MAX_FILE + 1, file);
+    fclose (file);
+    if (length > SYMBOL_CACHE_MAX_FILE || ! length || contents[length - 1] != '\n') {
+        free (contents);
+        return;
+    }
+    contents[length - 1] = '\0';
+
+    char *last_line = strrchr (contents, '\n');
+    last_line = last_line ? last_line + 1 : contents;
+    if (sscanf (last_line, "checksum %" SCNx32, &checksum) != 1 ||
+        _fnv1a (FNV_OFFSET_BASIS, contents, last_line - contents) != checksum) {
+        free (contents);
+        return;
+    }
+    *last_line = '\0';
+
+    char *saved;
+    char *line = strtok_r (contents, "\n", &saved);
+    for (; line; line = strtok_r (NULL, "\n", &saved)) {
+        if (sscanf (line, "%127s %" SCNxPTR, name, &offset) == 2 &&
+            offset < cache->size && ! _find_entry (cache, name))
+            _insert_entry (cache, name, offset);
+    }
+    free (contents);
+}
+
+/* Written whole to a temporary file and renamed over the old one, so a
+ * process reading it at the same time sees one or the other. Called
+ * with the cache locked. */
+static void
+_save (symbol_cache_t *cache)
+{
+    char temporary_path[PATH_MAX + 8];
+    char line[SYMBOL_CACHE_MAX_NAME + 32];
+    uint32_t checksum = FNV_OFFSET_BASIS;
+    unsigned int i;
+    int fd;
+
+    snprintf (temporary_path, sizeof (temporary_path), "%s.XXXXXX", cache->path);
+    fd = mkstemp (temporary_path);
+    if (fd < 0)
+        return;
+
+    FILE *file = fdopen (fd, "w");
+    if (! file) {
+        close (fd);
+        unlink (temporary_path);
+        return;
+    }
+
+    for (i = 0; i < SYMBOL_CACHE_BUCKETS; i++) {
+        symbol_cache_entry_t *entry;
+        for (entry = cache->buckets[i]; entry; entry = entry->next) {
+            int length = snprintf (line, sizeof (line), "%s %" PRIxPTR "\n",
+                                   entry->name, entry->offset);
+            checksum = _fnv1a (checksum, line, length);
+            fputs (line, file);
+        }
+    }
+    fprintf (file, "checksum %08" PRIx32 "\n", checksum);
+
+    if (fclose (file) || rename (temporary_path, cache->path))
+        unlink (temporary_path);
+}
+
+symbol_cache_t *
+symbol_cache_open (void *library_handle)
+{
+    library_info_t library;
+
+    const char *enabled = getenv ("GPUPROCESS_SYMBOL_CACHE");
+    if (enabled && ! strtol (enabled, NULL, 10))
+        return NULL;
+
+    if (! library_info_get (library_handle, &library))
+        return NULL;
+
+    symbol_cache_t *cache = calloc (1, sizeof (symbol_cache_t));
+    if (! library_info_cache_path (&library, 1, "symbols",
+                                   cache->path, sizeof (cache->path))) {
+        free (cache);
+        return NULL;
+    }
+
+    mutex_init (cache->mutex);
+    cache->base = library.base;
+    cache->size = library.size;
+    _load (cache);
+
+    mutex_lock (open_caches_mutex);
+    cache->next = open_caches;
+    open_caches = cache;
+    mutex_unlock (open_caches_mutex);
+    return cache;
+}
+
+void *
+symbol_cache_lookup (symbol_cache_t *cache,
+                     const char *name)
+{
+    mutex_lock (cache->mutex);
+    symbol_cache_entry_t *entry = _find_entry (cache, name);
+    void *address = entry ? (void *) (cache->base + entry->offset) : NULL;
+    mutex_unlock (cache->mutex);
+    return address;
+}
+
+void
+symbol_cache_add (symbol_cache_t *cache,
+                  const char *name,
+                  void *address)
+{
+    uintptr_t offset = (uintptr_t) address - cache->base;
+
+    if ((uintptr_t) address < cache->base || offset >= cache->size ||
+        strlen (name) >= SYMBOL_CACHE_MAX_NAME)
+        return;
+
+    mutex_lock (cache->mutex);
+    if (_find_entry (cache, name)) {
+        mutex_unlock (cache->mutex);
+        return;
+    }
+    _insert_entry (cache, name, offset);
+    cache->dirty = true;
+    mutex_unlock (cache->mutex);
+}
+
+void
+symbol_cache_save (symbol_cache_t *cache)
+{
+    mutex_lock (cache->mutex);
+    if (cache->dirty) {
+        _save (cache);
+        cache->dirty = false;
+    }
+    mutex_unlock (cache->mutex);
+}
+
+void
+symbol_cache_save_all (void)
+{
+    symbol_cache_t *cache;
+
+    mutex_lock (open_caches_mutex);
+    for (cache = open_caches; cache; cache = cache->next)
+        symbol_cache_save (cache);
+    mutex_unlock (open_caches_mutex);
+}
+
+/* Also runs when the library is unloaded. */
+__attribute__((destructor)) static void
+_save_open_caches (void)
+{
+    symbol_cache_save_all ();
+}
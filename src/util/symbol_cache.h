@@ -0,0 +1,43 @@
+#ifndef GPUPROCESS_SYMBOL_CACHE_H
+#define GPUPROCESS_SYMBOL_CACHE_H
+
+#include "compiler_private.h"
+
+/* Where the symbols of a shared library are, relative to its load
+ * address, remembered across runs. The cache is a text file named after
+ * the library's GNU build-id, in $XDG_CACHE_HOME/gpuprocess or else
+ * ~/.cache/gpuprocess, with one "name offset" line per symbol and a
+ * checksum at the end; a file that fails it is not used. A new build of
+ * the library has a new build-id and so starts a new file.
+ * GPUPROCESS_SYMBOL_CACHE=0 turns the cache off.
+ *
+ * Symbols added are only written out by symbol_cache_save (), which the
+ * server calls after the first frame, once most have been looked up,
+ * and when the process exits. */
+
+typedef struct _symbol_cache symbol_cache_t;
+
+/* NULL when the library has no build-id or the cache is turned off. */
+private symbol_cache_t *
+symbol_cache_open (void *library_handle);
+
+/* The address of `name`, NULL if it is not in the cache. */
+private void *
+symbol_cache_lookup (symbol_cache_t *cache,
+                     const char *name);
+
+/* Remembers `address` for `name` if it lies within the library. */
+private void
+symbol_cache_add (symbol_cache_t *cache,
+                  const char *name,
+                  void *address);
+
+/* Writes the file if symbols were added since it was read or written. */
+private void
+symbol_cache_save (symbol_cache_t *cache);
+
+/* Saves every cache opened so far. */
+private void
+symbol_cache_save_all (void);
+
+#endif /* GPUPROCESS_SYMBOL_CACHE_H */
@@ -0,0 +1,186 @@
+#include "buffer_object_test.h"
+#include "buffer_object.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define BUFFER_SIZE 10000
+
+/* Stands in for the server's copy of the buffer. */
+typedef struct server_buffer {
+    char data[BUFFER_SIZE];
+    unsigned int uploads;
+    size_t offsets[4];
+    size_t sizes[4];
+} server_buffer_t;
+
+static void
+upload (buffer_object_t *buffer, size_t offset, size_t size, void *user_data)
+{
+    server_buffer_t *server = user_data;
+    memcpy (server->data + offset, buffer->mapping + offset, size);
+    if (server->uploads < 4) {
+        server->offsets[server->uploads] = offset;
+        server->sizes[server->uploads] = size;
+    }
+    server->uploads++;
+}
+
+GPUPROCESS_START_TEST
+(test_partial_page_writes)
+{
+    server_buffer_t server;
+    memset (&server, 0, sizeof (server));
+    buffer_object_t *buffer = buffer_object_new (1);
+
+    buffer_object_set_data (buffer, BUFFER_SIZE, GL_DYNAMIC_DRAW, NULL);
+    char *mapping = buffer_object_map (buffer);
+    GPUPROCESS_ASSERT (mapping != NULL);
+    memset (mapping, 1, BUFFER_SIZE);
+    GPUPROCESS_ASSERT (buffer_object_unmap (buffer, upload, &server) == BUFFER_SIZE);
+    GPUPROCESS_ASSERT (server.uploads == 1);
+
+    /* A few bytes in the middle of a page leave the rest of it alone. */
+    mapping = buffer_object_map (buffer);
+    GPUPROCESS_ASSERT (mapping != NULL);
+    memset (mapping + 100, 2, 10);
+    buffer_object_unmap (buffer, upload, &server);
+    GPUPROCESS_ASSERT (server.data[99] == 1);
+    GPUPROCESS_ASSERT (server.data[100] == 2);
+    GPUPROCESS_ASSERT (server.data[109] == 2);
+    GPUPROCESS_ASSERT (server.data[110] == 1);
+    GPUPROCESS_ASSERT (server.data[BUFFER_SIZE - 1] == 1);
+
+    /* So do writes that only read the page first. */
+    mapping = buffer_object_map (buffer);
+    GPUPROCESS_ASSERT (mapping[5000] == 1);
+    buffer_object_unmap (buffer, upload, &server);
+    GPUPROCESS_ASSERT (server.data[5000] == 1);
+
+    buffer_object_destroy (buffer);
+}
+GPUPROCESS_END_TEST
+
+GPUPROCESS_START_TEST
+(test_data_reaches_mapping)
+{
+    server_buffer_t server;
+    memset (&server, 0, sizeof (server));
+    buffer_object_t *buffer = buffer_object_new (1);
+    char *data = malloc (BUFFER_SIZE);
+    memset (data, 3, BUFFER_SIZE);
+
+    /* Static contents given before the first map are not kept. */
+    buffer_object_set_data (buffer, BUFFER_SIZE, GL_STATIC_DRAW, data);
+    GPUPROCESS_ASSERT (buffer_object_map (buffer) == NULL);
+
+    buffer_object_set_data (buffer, BUFFER_SIZE, GL_STATIC_DRAW, NULL);
+    buffer_object_set_sub_data (buffer, 0, BUFFER_SIZE, data);
+    char *mapping = buffer_object_map (buffer);
+    GPUPROCESS_ASSERT (mapping != NULL);
+    GPUPROCESS_ASSERT (mapping[BUFFER_SIZE - 1] == 3);
+    mapping[0] = 4;
+    buffer_object_unmap (buffer, upload, &server);
+    GPUPROCESS_ASSERT (server.data[0] == 4);
+
+    /* Once there is a mapping, later data is copied into it. */
+    memset (data, 5, BUFFER_SIZE);
+    memset (server.data, 5, BUFFER_SIZE);
+    buffer_object_set_data (buffer, BUFFER_SIZE, GL_STATIC_DRAW, data);
+    buffer_object_set_sub_data (buffer, 10, 2, "\6\6");
+    mapping = buffer_object_map (buffer);
+    GPUPROCESS_ASSERT (mapping != NULL);
+    GPUPROCESS_ASSERT (mapping[0] == 5);
+    GPUPROCESS_ASSERT (mapping[10] == 6);
+    GPUPROCESS_ASSERT (mapping[12] == 5);
+    server.uploads = 0;
+    GPUPROCESS_ASSERT (buffer_object_unmap (buffer, upload, &server) == 0);
+    GPUPROCESS_ASSERT (server.uploads == 0);
+
+    /* A buffer that has been mapped keeps its contents at a new size. */
+    buffer_object_set_data (buffer, 2 * BUFFER_SIZE, GL_STATIC_DRAW, NULL);
+    buffer_object_set_data (buffer, BUFFER_SIZE / 2, GL_STATIC_DRAW, data);
+    mapping = buffer_object_map (buffer);
+    GPUPROCESS_ASSERT (mapping != NULL);
+    GPUPROCESS_ASSERT (mapping[BUFFER_SIZE / 2 - 1] == 5);
+    buffer_object_unmap (buffer, upload, &server);
+
+    /* And so do buffers likely to be mapped. */
+    buffer_object_t *dynamic = buffer_object_new (2);
+    buffer_object_set_data (dynamic, BUFFER_SIZE, GL_DYNAMIC_DRAW, data);
+    mapping = buffer_object_map (dynamic);
+    GPUPROCESS_ASSERT (mapping != NULL);
+    GPUPROCESS_ASSERT (mapping[0] == 5);
+    buffer_object_unmap (dynamic, upload, &server);
+    buffer_object_destroy (dynamic);
+
+    free (data);
+    buffer_object_destroy (buffer);
+}
+GPUPROCESS_END_TEST
+
+GPUPROCESS_START_TEST
+(test_dirty_ranges)
+{
+    server_buffer_t server;
+    memset (&server, 0, sizeof (server));
+    buffer_object_t *buffer = buffer_object_new (1);
+    char *data = calloc (1, BUFFER_SIZE);
+
+    buffer_object_set_data (buffer, BUFFER_SIZE, GL_DYNAMIC_DRAW, data);
+
+    /* Only the bytes written are uploaded. */
+    char *mapping = buffer_object_map (buffer);
+    memset (mapping + 5000, 7, 10);
+    GPUPROCESS_ASSERT (buffer_object_unmap (buffer, upload, &server) == 10);
+    GPUPROCESS_ASSERT (server.uploads == 1);
+    GPUPROCESS_ASSERT (server.offsets[0] == 5000);
+    GPUPROCESS_ASSERT (server.sizes[0] == 10);
+    GPUPROCESS_ASSERT (server.data[5000] == 7);
+
+    /* Nothing written, nothing uploaded, and writing what is already
+     * there does not count. */
+    server.uploads = 0;
+    mapping = buffer_object_map (buffer);
+    memset (mapping + 5000, 7, 10);
+    GPUPROCESS_ASSERT (buffer_object_unmap (buffer, upload, &server) == 0);
+    GPUPROCESS_ASSERT (server.uploads == 0);
+
+    /* Writes on pages apart are uploaded apart. */
+    mapping = buffer_object_map (buffer);
+    mapping[1] = 8;
+    mapping[BUFFER_SIZE - 2] = 8;
+    GPUPROCESS_ASSERT (buffer_object_unmap (buffer, upload, &server) == 2);
+    GPUPROCESS_ASSERT (server.uploads == 2);
+    GPUPROCESS_ASSERT (server.offsets[0] == 1 && server.sizes[0] == 1);
+    GPUPROCESS_ASSERT (server.offsets[1] == BUFFER_SIZE - 2 && server.sizes[1] == 1);
+
+    /* Writes across a page boundary are one range. */
+    server.uploads = 0;
+    mapping = buffer_object_map (buffer);
+    memset (mapping + 4000, 9, 200);
+    GPUPROCESS_ASSERT (buffer_object_unmap (buffer, upload, &server) == 200);
+    GPUPROCESS_ASSERT (server.uploads == 1);
+    GPUPROCESS_ASSERT (server.offsets[0] == 4000 && server.sizes[0] == 200);
+
+    /* Writing all of it uploads all of it at once. */
+    server.uploads = 0;
+    mapping = buffer_object_map (buffer);
+    memset (mapping, 10, BUFFER_SIZE);
+    GPUPROCESS_ASSERT (buffer_object_unmap (buffer, upload, &server) == BUFFER_SIZE);
+    GPUPROCESS_ASSERT (server.uploads == 1);
+    GPUPROCESS_ASSERT (server.offsets[0] == 0 && server.sizes[0] == BUFFER_SIZE);
+
+    free (data);
+    buffer_object_destroy (buffer);
+}
+GPUPROCESS_END_TEST
+
+void
+add_buffer_object_testcases (gpuprocess_suite_t *suite)
+{
+    gpuprocess_testcase_t *buffer = gpuprocess_testcase_create ("buffer_object");
+    gpuprocess_testcase_add_test (buffer, test_partial_page_writes);
+    gpuprocess_testcase_add_test (buffer, test_data_reaches_mapping);
+    gpuprocess_testcase_add_test (buffer, test_dirty_ranges);
+    gpuprocess_suite_add_testcase (suite, buffer);
+}
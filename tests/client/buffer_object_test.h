@@ -0,0 +1,9 @@
+#ifndef TEST_CLIENT_BUFFER_OBJECT_TEST_H
+#define TEST_CLIENT_BUFFER_OBJECT_TEST_H
+
+#include "gpuprocess_test.h"
+
+void
+add_buffer_object_testcases (gpuprocess_suite_t *suite);
+
+#endif /* TEST_CLIENT_BUFFER_OBJECT_TEST_H */
@@ -0,0 +1,155 @@
+#include "driver_capabilities_test.h"
+#include "driver_capabilities.h"
+#include <stdlib.h>
+#include <string.h>
+
+/* The records are shared by the whole process, so each test uses
+ * displays and driver names of its own. */
+static egl_state_t *
+new_state (uintptr_t display,
+           const char *driver)
+{
+    setenv ("GPUPROCESS_CAPABILITY_CACHE", "0", 1);
+
+    egl_state_t *state = egl_state_new ((EGLDisplay) display, (EGLContext) 1);
+    driver_capabilities_fill_state (state, driver);
+    return state;
+}
+
+/* What caching_client_glGetString does with the answer of the server. */
+static void
+answer_renderer (egl_state_t *state,
+                 const char *renderer)
+{
+    state->renderer_string = strdup (renderer);
+    driver_capabilities_add_string (state, GL_RENDERER, renderer);
+}
+
+static void
+answer_max_texture_size (egl_state_t *state,
+                         GLint size)
+{
+    state->max_texture_size = size;
+    state->max_texture_size_queried = true;
+    driver_capabilities_add_limits (state);
+}
+
+GPUPROCESS_START_TEST
+(test_other_driver_starts_empty)
+{
+    egl_state_t *first = new_state (0x101, "Vendor A 1.4");
+    answer_renderer (first, "Renderer A");
+    answer_max_texture_size (first, 4096);
+
+    egl_state_t *second = new_state (0x102, "Vendor B 1.4");
+    GPUPROCESS_ASSERT (second->renderer_string == NULL);
+    GPUPROCESS_ASSERT (! second->max_texture_size_queried);
+
+    /* Another context of the same display knows it right away. */
+    egl_state_t *third = new_state (0x101, "Vendor A 1.4");
+    GPUPROCESS_ASSERT (third->renderer_string != NULL);
+    GPUPROCESS_ASSERT (! strcmp (third->renderer_string, "Renderer A"));
+    GPUPROCESS_ASSERT (third->max_texture_size_queried);
+    GPUPROCESS_ASSERT (third->max_texture_size == 4096);
+
+    egl_state_destroy (first);
+    egl_state_destroy (second);
+    egl_state_destroy (third);
+}
+GPUPROCESS_END_TEST
+
+GPUPROCESS_START_TEST
+(test_record_used_once_confirmed)
+{
+    egl_state_t *first = new_state (0x201, "Vendor C 1.5");
+    answer_renderer (first, "Renderer C");
+    answer_max_texture_size (first, 8192);
+
+    /* A display of the same driver does not take the record on trust. */
+    egl_state_t *second = new_state (0x202, "Vendor C 1.5");
+    GPUPROCESS_ASSERT (second->renderer_string == NULL);
+    GPUPROCESS_ASSERT (! second->max_texture_size_queried);
+
+    answer_renderer (second, "Renderer C");
+    GPUPROCESS_ASSERT (second->max_texture_size_queried);
+    GPUPROCESS_ASSERT (second->max_texture_size == 8192);
+
+    egl_state_t *third = new_state (0x202, "Vendor C 1.5");
+    GPUPROCESS_ASSERT (third->renderer_string != NULL);
+    GPUPROCESS_ASSERT (third->max_texture_size == 8192);
+
+    egl_state_destroy (first);
+    egl_state_destroy (second);
+    egl_state_destroy (third);
+}
+GPUPROCESS_END_TEST
+
+GPUPROCESS_START_TEST
+(test_record_dropped_on_other_string)
+{
+    egl_state_t *first = new_state (0x301, "Vendor D 1.5");
+    answer_renderer (first, "Renderer D");
+    answer_max_texture_size (first, 4096);
+
+    egl_state_t *second = new_state (0x302, "Vendor D 1.5");
+    answer_renderer (second, "Renderer E");
+    GPUPROCESS_ASSERT (! second->max_texture_size_queried);
+
+    /* The record now holds what the second display answered. */
+    egl_state_t *third = new_state (0x303, "Vendor D 1.5");
+    answer_renderer (third, "Renderer E");
+    GPUPROCESS_ASSERT (! third->max_texture_size_queried);
+
+    egl_state_destroy (first);
+    egl_state_destroy (second);
+    egl_state_destroy (third);
+}
+GPUPROCESS_END_TEST
+
+GPUPROCESS_START_TEST
+(test_record_dropped_on_other_limit)
+{
+    egl_state_t *first = new_state (0x401, "Vendor F 1.5");
+    answer_renderer (first, "Renderer F");
+    answer_max_texture_size (first, 4096);
+
+    egl_state_t *second = new_state (0x402, "Vendor F 1.5");
+    answer_max_texture_size (second, 2048);
+    answer_renderer (second, "Renderer F");
+
+    egl_state_t *third = new_state (0x403, "Vendor F 1.5");
+    answer_renderer (third, "Renderer F");
+    GPUPROCESS_ASSERT (third->max_texture_size_queried);
+    GPUPROCESS_ASSERT (third->max_texture_size == 2048);
+
+    egl_state_destroy (first);
+    egl_state_destroy (second);
+    egl_state_destroy (third);
+}
+GPUPROCESS_END_TEST
+
+GPUPROCESS_START_TEST
+(test_unknown_driver_is_not_shared)
+{
+    egl_state_t *first = new_state (0x501, NULL);
+    answer_renderer (first, "Renderer G");
+
+    egl_state_t *second = new_state (0x502, NULL);
+    GPUPROCESS_ASSERT (second->renderer_string == NULL);
+
+    egl_state_destroy (first);
+    egl_state_destroy (second);
+}
+GPUPROCESS_END_TEST
+
+void
+add_driver_capabilities_testcases (gpuprocess_suite_t *suite)
+{
+    gpuprocess_testcase_t *capabilities = gpuprocess_testcase_create ("driver_capabilities");
+    gpuprocess_testcase_add_test (capabilities, test_other_driver_starts_empty);
+    gpuprocess_testcase_add_test (capabilities, test_record_used_once_confirmed);
+    gpuprocess_testcase_add_test (capabilities, test_record_dropped_on_other_string);
+    gpuprocess_testcase_add_test (capabilities, test_record_dropped_on_other_limit);
+    gpuprocess_testcase_add_test (capabilities, test_unknown_driver_is_not_shared);
+    gpuprocess_suite_add_testcase (suite, capabilities);
+}
@@ -0,0 +1,179 @@
+#include "egl_state_diff_test.h"
+#include "egl_state_diff.h"
+#include <string.h>
+
+/* Records the calls a diff makes, the ones these tests expect. */
+typedef struct _recorded_calls {
+    GLenum enabled;
+    GLint viewport[4];
+    GLenum active_textures[4];
+    unsigned int active_texture_count;
+    GLuint bound_texture;
+    GLuint attrib_indices[4];
+    GLfloat attrib_values[4][4];
+    unsigned int attrib_count;
+} recorded_calls_t;
+
+static void
+record_glEnable (void *object, GLenum cap)
+{
+    ((recorded_calls_t *) object)->enabled = cap;
+}
+
+static void
+record_glViewport (void *object, GLint x, GLint y, GLsizei width, GLsizei height)
+{
+    recorded_calls_t *calls = object;
+    calls->viewport[0] = x;
+    calls->viewport[1] = y;
+    calls->viewport[2] = width;
+    calls->viewport[3] = height;
+}
+
+static void
+record_glActiveTexture (void *object, GLenum texture)
+{
+    recorded_calls_t *calls = object;
+    if (calls->active_texture_count < 4)
+        calls->active_textures[calls->active_texture_count++] = texture;
+}
+
+static void
+record_glBindTexture (void *object, GLenum target, GLuint texture)
+{
+    ((recorded_calls_t *) object)->bound_texture = texture;
+}
+
+static void
+record_glVertexAttrib4fv (void *object, GLuint index, const GLfloat *values)
+{
+    recorded_calls_t *calls = object;
+    if (calls->attrib_count < 4) {
+        calls->attrib_indices[calls->attrib_count] = index;
+        memcpy (calls->attrib_values[calls->attrib_count], values, 4 * sizeof (GLfloat));
+        calls->attrib_count++;
+    }
+}
+
+static void
+init_recording_dispatch (dispatch_table_t *dispatch)
+{
+    memset (dispatch, 0, sizeof (dispatch_table_t));
+    dispatch->glEnable = record_glEnable;
+    dispatch->glViewport = record_glViewport;
+    dispatch->glActiveTexture = record_glActiveTexture;
+    dispatch->glBindTexture = record_glBindTexture;
+    dispatch->glVertexAttrib4fv = record_glVertexAttrib4fv;
+}
+
+GPUPROCESS_START_TEST
+(test_diff_of_equal_states)
+{
+    dispatch_table_t dispatch;
+    recorded_calls_t calls;
+    egl_state_t *from = egl_state_new (EGL_NO_DISPLAY, EGL_NO_CONTEXT);
+    egl_state_t *to = egl_state_new (EGL_NO_DISPLAY, EGL_NO_CONTEXT);
+
+    init_recording_dispatch (&dispatch);
+    memset (&calls, 0, sizeof (calls));
+    GPUPROCESS_ASSERT (egl_state_write_diff (from, to, &dispatch, &calls) == 0);
+
+    egl_state_destroy (from);
+    egl_state_destroy (to);
+}
+GPUPROCESS_END_TEST
+
+GPUPROCESS_START_TEST
+(test_diff_writes_only_changes)
+{
+    dispatch_table_t dispatch;
+    recorded_calls_t calls;
+    egl_state_t *from = egl_state_new (EGL_NO_DISPLAY, EGL_NO_CONTEXT);
+    egl_state_t *to = egl_state_new (EGL_NO_DISPLAY, EGL_NO_CONTEXT);
+
+    to->blend = GL_TRUE;
+    to->viewport[2] = 640;
+    to->viewport[3] = 480;
+
+    init_recording_dispatch (&dispatch);
+    memset (&calls, 0, sizeof (calls));
+    GPUPROCESS_ASSERT (egl_state_write_diff (from, to, &dispatch, &calls) == 2);
+    GPUPROCESS_ASSERT (calls.enabled == GL_BLEND);
+    GPUPROCESS_ASSERT (calls.viewport[2] == 640);
+    GPUPROCESS_ASSERT (calls.viewport[3] == 480);
+
+    egl_state_destroy (from);
+    egl_state_destroy (to);
+}
+GPUPROCESS_END_TEST
+
+GPUPROCESS_START_TEST
+(test_diff_restores_active_texture)
+{
+    dispatch_table_t dispatch;
+    recorded_calls_t calls;
+    egl_state_t *from = egl_state_new (EGL_NO_DISPLAY, EGL_NO_CONTEXT);
+    egl_state_t *to = egl_state_new (EGL_NO_DISPLAY, EGL_NO_CONTEXT);
+
+    /* A texture bound to another unit than the active one. */
+    to->texture_unit_binding[3][0] = 7;
+
+    init_recording_dispatch (&dispatch);
+    memset (&calls, 0, sizeof (calls));
+    GPUPROCESS_ASSERT (egl_state_write_diff (from, to, &dispatch, &calls) == 3);
+    GPUPROCESS_ASSERT (calls.bound_texture == 7);
+    GPUPROCESS_ASSERT (calls.active_texture_count == 2);
+    GPUPROCESS_ASSERT (calls.active_textures[0] == GL_TEXTURE3);
+    GPUPROCESS_ASSERT (calls.active_textures[1] == GL_TEXTURE0);
+
+    egl_state_destroy (from);
+    egl_state_destroy (to);
+}
+GPUPROCESS_END_TEST
+
+GPUPROCESS_START_TEST
+(test_diff_vertex_attrib_values)
+{
+    dispatch_table_t dispatch;
+    recorded_calls_t calls;
+    egl_state_t *from = egl_state_new (EGL_NO_DISPLAY, EGL_NO_CONTEXT);
+    egl_state_t *to = egl_state_new (EGL_NO_DISPLAY, EGL_NO_CONTEXT);
+    GLfloat color[4] = { 1, 0.5, 0.25, 1 };
+    GLfloat normal[4] = { 0, 0, 1, 1 };
+
+    /* Set in `to` only, set to the same value in both, and set in `from`
+     * only, which goes back to the initial value. */
+    memcpy (to->vertex_attrib_values[2], color, sizeof (color));
+    to->vertex_attrib_values_set |= 1 << 2;
+    memcpy (from->vertex_attrib_values[3], normal, sizeof (normal));
+    memcpy (to->vertex_attrib_values[3], normal, sizeof (normal));
+    from->vertex_attrib_values_set |= 1 << 3;
+    to->vertex_attrib_values_set |= 1 << 3;
+    memcpy (from->vertex_attrib_values[5], color, sizeof (color));
+    from->vertex_attrib_values_set |= 1 << 5;
+
+    init_recording_dispatch (&dispatch);
+    memset (&calls, 0, sizeof (calls));
+    GPUPROCESS_ASSERT (egl_state_write_diff (from, to, &dispatch, &calls) == 2);
+    GPUPROCESS_ASSERT (calls.attrib_count == 2);
+    GPUPROCESS_ASSERT (calls.attrib_indices[0] == 2);
+    GPUPROCESS_ASSERT (! memcmp (calls.attrib_values[0], color, sizeof (color)));
+    GPUPROCESS_ASSERT (calls.attrib_indices[1] == 5);
+    GPUPROCESS_ASSERT (calls.attrib_values[1][0] == 0);
+    GPUPROCESS_ASSERT (calls.attrib_values[1][3] == 1);
+
+    egl_state_destroy (from);
+    egl_state_destroy (to);
+}
+GPUPROCESS_END_TEST
+
+void
+add_egl_state_diff_testcases (gpuprocess_suite_t *suite)
+{
+    gpuprocess_testcase_t *diff = gpuprocess_testcase_create ("egl_state_diff");
+    gpuprocess_testcase_add_test (diff, test_diff_of_equal_states);
+    gpuprocess_testcase_add_test (diff, test_diff_writes_only_changes);
+    gpuprocess_testcase_add_test (diff, test_diff_restores_active_texture);
+    gpuprocess_testcase_add_test (diff, test_diff_vertex_attrib_values);
+    gpuprocess_suite_add_testcase (suite, diff);
+}
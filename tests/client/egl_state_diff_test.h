@@ -0,0 +1,9 @@
+#ifndef TEST_CLIENT_EGL_STATE_DIFF_TEST_H
+#define TEST_CLIENT_EGL_STATE_DIFF_TEST_H
+
+#include "gpuprocess_test.h"
+
+void
+add_egl_state_diff_testcases (gpuprocess_suite_t *suite);
+
+#endif /* TEST_CLIENT_EGL_STATE_DIFF_TEST_H */
@@ -0,0 +1,39 @@
+#include "extension_set_test.h"
+#include "extension_set.h"
+
+GPUPROCESS_START_TEST
+(test_extension_set_matches_whole_names)
+{
+    extension_set_t *set =
+        extension_set_new ("GL_QCOM_extended_get2 GL_OES_mapbuffer  GL_NV_fence ");
+
+    GPUPROCESS_ASSERT (extension_set_contains (set, "GL_OES_mapbuffer"));
+    GPUPROCESS_ASSERT (extension_set_contains (set, "GL_NV_fence"));
+    GPUPROCESS_ASSERT (extension_set_contains (set, "GL_QCOM_extended_get2"));
+
+    /* Prefixes and suffixes of a name are not in the set. */
+    GPUPROCESS_ASSERT (! extension_set_contains (set, "GL_QCOM_extended_get"));
+    GPUPROCESS_ASSERT (! extension_set_contains (set, "OES_mapbuffer"));
+    GPUPROCESS_ASSERT (! extension_set_contains (set, ""));
+
+    extension_set_destroy (set);
+}
+GPUPROCESS_END_TEST
+
+GPUPROCESS_START_TEST
+(test_extension_set_empty)
+{
+    extension_set_t *set = extension_set_new ("");
+    GPUPROCESS_ASSERT (! extension_set_contains (set, "GL_OES_mapbuffer"));
+    extension_set_destroy (set);
+}
+GPUPROCESS_END_TEST
+
+void
+add_extension_set_testcases (gpuprocess_suite_t *suite)
+{
+    gpuprocess_testcase_t *extension_set = gpuprocess_testcase_create ("extension_set");
+    gpuprocess_testcase_add_test (extension_set, test_extension_set_matches_whole_names);
+    gpuprocess_testcase_add_test (extension_set, test_extension_set_empty);
+    gpuprocess_suite_add_testcase (suite, extension_set);
+}
@@ -0,0 +1,9 @@
+#ifndef TEST_CLIENT_EXTENSION_SET_TEST_H
+#define TEST_CLIENT_EXTENSION_SET_TEST_H
+
+#include "gpuprocess_test.h"
+
+void
+add_extension_set_testcases (gpuprocess_suite_t *suite);
+
+#endif /* TEST_CLIENT_EXTENSION_SET_TEST_H */
@@ -0,0 +1,154 @@
+#include "fingerprint_test.h"
+#include "fingerprint.h"
+#include <string.h>
+
+/* The scalar version of the hash, written out one byte at a time, which
+ * the SSE2 and NEON versions must agree with. */
+static uint32_t
+rotl32 (uint32_t value, int bits)
+{
+    return (value << bits) | (value >> (32 - bits));
+}
+
+static uint32_t
+read32 (const unsigned char *p)
+{
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t) p[3] << 24);
+}
+
+static uint32_t
+finish (uint32_t hash, const unsigned char *tail, size_t tail_size)
+{
+    for (; tail_size >= 4; tail += 4, tail_size -= 4)
+        hash = rotl32 (hash + read32 (tail) * 3266489917U, 17) * 668265263U;
+    for (; tail_size > 0; tail++, tail_size--)
+        hash = rotl32 (hash + (*tail) * 374761393U, 11) * 2654435761U;
+
+    hash ^= hash >> 15;
+    hash *= 2246822519U;
+    hash ^= hash >> 13;
+    hash *= 3266489917U;
+    hash ^= hash >> 16;
+    return hash;
+}
+
+static uint64_t
+reference_fingerprint (const unsigned char *p, size_t size)
+{
+    uint32_t lanes[4] = { 2654435761U + 2246822519U, 2246822519U, 0, -2654435761U };
+    size_t consumed;
+    int lane;
+
+    for (consumed = 0; consumed + 16 <= size; consumed += 16) {
+        for (lane = 0; lane < 4; lane++) {
+            uint32_t input = read32 (p + consumed + lane * 4);
+            lanes[lane] = rotl32 (lanes[lane] + input * 2246822519U, 13) * 2654435761U;
+        }
+    }
+
+    uint32_t high = rotl32 (lanes[0], 1) + rotl32 (lanes[1], 7) +
+                    rotl32 (lanes[2], 12) + rotl32 (lanes[3], 18);
+    uint32_t low = rotl32 (lanes[0], 18) + rotl32 (lanes[1], 12) +
+                   rotl32 (lanes[2], 7) + rotl32 (lanes[3], 1);
+    high += (uint32_t) size;
+    low ^= (uint32_t) size * 374761393U;
+
+    high = finish (high, p + consumed, size - consumed);
+    low = finish (low, p + consumed, size - consumed);
+    return ((uint64_t) high << 32) | low;
+}
+
+static void
+fill (unsigned char *data, size_t size, unsigned int seed)
+{
+    size_t i;
+    for (i = 0; i < size; i++) {
+        seed = seed * 1103515245 + 12345;
+        data[i] = seed >> 16;
+    }
+}
+
+GPUPROCESS_START_TEST
+(test_fingerprint_matches_reference)
+{
+    unsigned char data[300];
+    size_t size;
+
+    fill (data, sizeof (data), 1);
+
+    /* Every tail length, and stripes read at unaligned addresses. */
+    for (size = 0; size < 80; size++) {
+        GPUPROCESS_ASSERT (fingerprint (data, size) ==
+                           reference_fingerprint (data, size));
+        GPUPROCESS_ASSERT (fingerprint (data + 3, size) ==
+                           reference_fingerprint (data + 3, size));
+    }
+    GPUPROCESS_ASSERT (fingerprint (data, sizeof (data)) ==
+                       reference_fingerprint (data, sizeof (data)));
+}
+GPUPROCESS_END_TEST
+
+GPUPROCESS_START_TEST
+(test_fingerprint_notices_changes)
+{
+    unsigned char data[64];
+    size_t i;
+
+    fill (data, sizeof (data), 2);
+    uint64_t hash = fingerprint (data, sizeof (data));
+
+    /* One changed byte, whether in a stripe or in the tail. */
+    for (i = 0; i < sizeof (data); i++) {
+        data[i] ^= 1;
+        GPUPROCESS_ASSERT (fingerprint (data, sizeof (data)) != hash);
+        data[i] ^= 1;
+    }
+    GPUPROCESS_ASSERT (fingerprint (data, sizeof (data)) == hash);
+
+    /* The size is part of the hash, even for zeros. */
+    memset (data, 0, sizeof (data));
+    GPUPROCESS_ASSERT (fingerprint (data, 16) != fingerprint (data, 17));
+    GPUPROCESS_ASSERT (fingerprint (data, 0) != fingerprint (data, 1));
+}
+GPUPROCESS_END_TEST
+
+GPUPROCESS_START_TEST
+(test_fingerprint_sampled)
+{
+    static unsigned char data[64 * 1024];
+    fill (data, sizeof (data), 3);
+
+    /* Data no bigger than the samples is hashed whole. */
+    GPUPROCESS_ASSERT (fingerprint_sampled (data, 4096, 1024, 4) ==
+                       fingerprint (data, 4096));
+    GPUPROCESS_ASSERT (fingerprint_sampled (data, 4096, 1024, 1) ==
+                       fingerprint (data, 4096));
+
+    uint64_t hash = fingerprint_sampled (data, sizeof (data), 256, 8);
+
+    /* The first and the last block are always sampled. */
+    data[0] ^= 1;
+    GPUPROCESS_ASSERT (fingerprint_sampled (data, sizeof (data), 256, 8) != hash);
+    data[0] ^= 1;
+    data[sizeof (data) - 1] ^= 1;
+    GPUPROCESS_ASSERT (fingerprint_sampled (data, sizeof (data), 256, 8) != hash);
+    data[sizeof (data) - 1] ^= 1;
+
+    /* Bytes between the samples are not. */
+    data[256] ^= 1;
+    GPUPROCESS_ASSERT (fingerprint_sampled (data, sizeof (data), 256, 8) == hash);
+    data[256] ^= 1;
+
+    GPUPROCESS_ASSERT (fingerprint_sampled (data, sizeof (data) - 1, 256, 8) != hash);
+}
+GPUPROCESS_END_TEST
+
+void
+add_fingerprint_testcases (gpuprocess_suite_t *suite)
+{
+    gpuprocess_testcase_t *hash = gpuprocess_testcase_create ("fingerprint");
+    gpuprocess_testcase_add_test (hash, test_fingerprint_matches_reference);
+    gpuprocess_testcase_add_test (hash, test_fingerprint_notices_changes);
+    gpuprocess_testcase_add_test (hash, test_fingerprint_sampled);
+    gpuprocess_suite_add_testcase (suite, hash);
+}
@@ -0,0 +1,9 @@
+#ifndef TEST_CLIENT_FINGERPRINT_TEST_H
+#define TEST_CLIENT_FINGERPRINT_TEST_H
+
+#include "gpuprocess_test.h"
+
+void
+add_fingerprint_testcases (gpuprocess_suite_t *suite);
+
+#endif /* TEST_CLIENT_FINGERPRINT_TEST_H */
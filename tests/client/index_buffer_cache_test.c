@@ -0,0 +1,213 @@
+#include "index_buffer_cache_test.h"
+#include "index_buffer_cache.h"
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Enough indices for several leaves of the segment tree and a partial
+ * last block. */
+#define INDEX_COUNT 1000
+
+static size_t
+index_size (GLenum type)
+{
+    return type == GL_UNSIGNED_BYTE ? 1 : type == GL_UNSIGNED_SHORT ? 2 : 4;
+}
+
+static GLuint
+get_index (GLenum type, const void *indices, size_t i)
+{
+    if (type == GL_UNSIGNED_BYTE)
+        return ((const uint8_t *) indices)[i];
+    if (type == GL_UNSIGNED_SHORT)
+        return ((const uint16_t *) indices)[i];
+    return ((const uint32_t *) indices)[i];
+}
+
+static void
+set_index (GLenum type, void *indices, size_t i, GLuint value)
+{
+    if (type == GL_UNSIGNED_BYTE)
+        ((uint8_t *) indices)[i] = value;
+    else if (type == GL_UNSIGNED_SHORT)
+        ((uint16_t *) indices)[i] = value;
+    else
+        ((uint32_t *) indices)[i] = value;
+}
+
+static void
+fill_indices (GLenum type, void *indices, size_t count, uint32_t seed)
+{
+    size_t i;
+    for (i = 0; i < count; i++) {
+        seed = seed * 1103515245 + 12345;
+        set_index (type, indices, i, seed >> 4);
+    }
+}
+
+/* Compares the ranges the buffer reports with a plain scan of `indices`,
+ * for ranges that start and end inside, on and across block
+ * boundaries. */
+static void
+check_ranges (index_buffer_t *buffer, GLenum type, const void *indices)
+{
+    static const size_t starts[] = { 0, 1, 63, 64, 65, 127, 500, 999 };
+    static const size_t counts[] = { 1, 2, 63, 64, 65, 128, 129, 300, 1000 };
+    size_t size = index_size (type);
+    size_t s, c, i;
+
+    for (s = 0; s < sizeof (starts) / sizeof (starts[0]); s++) {
+        for (c = 0; c < sizeof (counts) / sizeof (counts[0]); c++) {
+            size_t first = starts[s], count = counts[c];
+            GLuint min = 0, max = 0;
+            bool inside = first + count <= INDEX_COUNT;
+
+            GPUPROCESS_ASSERT (index_buffer_get_range (buffer, type,
+                                                       first * size, count,
+                                                       &min, &max) == inside);
+            if (! inside)
+                continue;
+
+            GLuint expected_min = 0xffffffff, expected_max = 0;
+            for (i = first; i < first + count; i++) {
+                GLuint value = get_index (type, indices, i);
+                if (value < expected_min)
+                    expected_min = value;
+                if (value > expected_max)
+                    expected_max = value;
+            }
+            GPUPROCESS_ASSERT (min == expected_min);
+            GPUPROCESS_ASSERT (max == expected_max);
+        }
+    }
+}
+
+static void
+check_type (GLenum type)
+{
+    size_t size = index_size (type);
+    char *indices = malloc (INDEX_COUNT * size);
+    index_buffer_t *buffer = index_buffer_new (1);
+    size_t i;
+
+    fill_indices (type, indices, INDEX_COUNT, 7);
+    index_buffer_set_data (buffer, INDEX_COUNT * size, indices);
+    check_ranges (buffer, type, indices);
+
+    /* Updates once the tree is built reach its inner nodes: a new
+     * extreme inside one block, then a run across several blocks. */
+    set_index (type, indices, 100, 0);
+    index_buffer_set_sub_data (buffer, 100 * size, size, indices + 100 * size);
+    check_ranges (buffer, type, indices);
+
+    for (i = 300; i < 700; i++)
+        set_index (type, indices, i, type == GL_UNSIGNED_BYTE ? 0xff :
+                                     type == GL_UNSIGNED_SHORT ? 0xffff :
+                                     0xffffffff);
+    GPUPROCESS_ASSERT (index_buffer_set_sub_data (buffer, 300 * size,
+                                                  400 * size,
+                                                  indices + 300 * size));
+    check_ranges (buffer, type, indices);
+
+    /* Nothing outside of the buffer is written. */
+    GPUPROCESS_ASSERT (! index_buffer_set_sub_data (buffer, (INDEX_COUNT - 1) * size,
+                                                    2 * size, indices));
+    check_ranges (buffer, type, indices);
+
+    /* New data replaces the old, trees and all. */
+    fill_indices (type, indices, INDEX_COUNT, 99);
+    index_buffer_set_data (buffer, INDEX_COUNT * size, indices);
+    check_ranges (buffer, type, indices);
+
+    index_buffer_destroy (buffer);
+    free (indices);
+}
+
+GPUPROCESS_START_TEST
+(test_index_buffer_u8)
+{
+    check_type (GL_UNSIGNED_BYTE);
+}
+GPUPROCESS_END_TEST
+
+GPUPROCESS_START_TEST
+(test_index_buffer_u16)
+{
+    check_type (GL_UNSIGNED_SHORT);
+}
+GPUPROCESS_END_TEST
+
+GPUPROCESS_START_TEST
+(test_index_buffer_u32)
+{
+    check_type (GL_UNSIGNED_INT);
+}
+GPUPROCESS_END_TEST
+
+GPUPROCESS_START_TEST
+(test_index_buffer_mixed_types)
+{
+    uint16_t indices[256];
+    index_buffer_t *buffer = index_buffer_new (1);
+    GLuint min = 0, max = 0;
+    size_t i;
+
+    for (i = 0; i < 256; i++)
+        indices[i] = 0x0100 + i;
+    index_buffer_set_data (buffer, sizeof (indices), indices);
+
+    /* The same bytes read as other types. */
+    GPUPROCESS_ASSERT (index_buffer_get_range (buffer, GL_UNSIGNED_SHORT,
+                                               0, 256, &min, &max));
+    GPUPROCESS_ASSERT (min == 0x0100 && max == 0x01ff);
+    GPUPROCESS_ASSERT (index_buffer_get_range (buffer, GL_UNSIGNED_BYTE,
+                                               0, 512, &min, &max));
+    GPUPROCESS_ASSERT (min == 0x00 && max == 0xff);
+
+    /* Offsets must be aligned to the type and other types have no
+     * range. */
+    GPUPROCESS_ASSERT (! index_buffer_get_range (buffer, GL_UNSIGNED_SHORT,
+                                                 1, 4, &min, &max));
+    GPUPROCESS_ASSERT (! index_buffer_get_range (buffer, GL_FLOAT,
+                                                 0, 4, &min, &max));
+    GPUPROCESS_ASSERT (! index_buffer_get_range (buffer, GL_UNSIGNED_SHORT,
+                                                 0, 0, &min, &max));
+
+    /* A NULL upload leaves zeros. */
+    index_buffer_set_data (buffer, 64, NULL);
+    GPUPROCESS_ASSERT (index_buffer_get_range (buffer, GL_UNSIGNED_INT,
+                                               0, 16, &min, &max));
+    GPUPROCESS_ASSERT (min == 0 && max == 0);
+
+    index_buffer_destroy (buffer);
+}
+GPUPROCESS_END_TEST
+
+GPUPROCESS_START_TEST
+(test_index_buffer_budget)
+{
+    unsetenv ("GPUPROCESS_INDEX_SHADOW_SIZE");
+    GPUPROCESS_ASSERT (index_buffer_budget_from_environment () ==
+                       INDEX_BUFFER_DEFAULT_BUDGET);
+
+    setenv ("GPUPROCESS_INDEX_SHADOW_SIZE", "64", 1);
+    GPUPROCESS_ASSERT (index_buffer_budget_from_environment () == 64 * 1024);
+
+    setenv ("GPUPROCESS_INDEX_SHADOW_SIZE", "0", 1);
+    GPUPROCESS_ASSERT (index_buffer_budget_from_environment () == 0);
+
+    unsetenv ("GPUPROCESS_INDEX_SHADOW_SIZE");
+}
+GPUPROCESS_END_TEST
+
+void
+add_index_buffer_cache_testcases (gpuprocess_suite_t *suite)
+{
+    gpuprocess_testcase_t *cache = gpuprocess_testcase_create ("index_buffer_cache");
+    gpuprocess_testcase_add_test (cache, test_index_buffer_u8);
+    gpuprocess_testcase_add_test (cache, test_index_buffer_u16);
+    gpuprocess_testcase_add_test (cache, test_index_buffer_u32);
+    gpuprocess_testcase_add_test (cache, test_index_buffer_mixed_types);
+    gpuprocess_testcase_add_test (cache, test_index_buffer_budget);
+    gpuprocess_suite_add_testcase (suite, cache);
+}
@@ -0,0 +1,9 @@
+#ifndef TEST_CLIENT_INDEX_BUFFER_CACHE_TEST_H
+#define TEST_CLIENT_INDEX_BUFFER_CACHE_TEST_H
+
+#include "gpuprocess_test.h"
+
+void
+add_index_buffer_cache_testcases (gpuprocess_suite_t *suite);
+
+#endif /* TEST_CLIENT_INDEX_BUFFER_CACHE_TEST_H */
@@ -0,0 +1,168 @@
+#include "index_range_test.h"
+#include "index_range.h"
+#include <stdint.h>
+#include <string.h>
+
+/* Longer than two vectors of the widest kernel (32 bytes of AVX2) plus
+ * the largest start offset, so every kernel runs its vector loop and its
+ * scalar tail. */
+#define MAX_COUNT 100
+#define MAX_OFFSET 7
+
+static const index_range_kernel_t simd_kernels[] = {
+    INDEX_RANGE_KERNEL_SSE2,
+    INDEX_RANGE_KERNEL_AVX2,
+    INDEX_RANGE_KERNEL_NEON
+};
+
+static size_t
+index_size (GLenum type)
+{
+    return type == GL_UNSIGNED_BYTE ? 1 : type == GL_UNSIGNED_SHORT ? 2 : 4;
+}
+
+static void
+set_index (GLenum type, void *indices, size_t i, GLuint value)
+{
+    if (type == GL_UNSIGNED_BYTE)
+        ((uint8_t *) indices)[i] = value;
+    else if (type == GL_UNSIGNED_SHORT)
+        ((uint16_t *) indices)[i] = value;
+    else
+        ((uint32_t *) indices)[i] = value;
+}
+
+/* Checks every vector kernel this build and CPU have against the scalar
+ * one, for all starts and lengths the buffer allows. */
+static void
+compare_kernels (GLenum type, const void *indices)
+{
+    size_t size = index_size (type);
+    size_t k, offset, count;
+
+    for (k = 0; k < sizeof (simd_kernels) / sizeof (simd_kernels[0]); k++) {
+        if (! index_range_kernel_available (simd_kernels[k]))
+            continue;
+
+        for (offset = 0; offset <= MAX_OFFSET; offset++) {
+            const char *start = (const char *) indices + offset * size;
+            for (count = 0; count <= MAX_COUNT; count++) {
+                GLuint expected_min = 0, expected_max = 0;
+                GLuint min = 0, max = 0;
+                bool expected =
+                    index_range_scan_with_kernel (INDEX_RANGE_KERNEL_SCALAR,
+                                                  type, start, count,
+                                                  &expected_min, &expected_max);
+                bool scanned =
+                    index_range_scan_with_kernel (simd_kernels[k],
+                                                  type, start, count,
+                                                  &min, &max);
+                GPUPROCESS_ASSERT (scanned == expected);
+                if (! expected)
+                    continue;
+                GPUPROCESS_ASSERT (min == expected_min);
+                GPUPROCESS_ASSERT (max == expected_max);
+            }
+        }
+    }
+}
+
+static void
+check_type (GLenum type, GLuint max_value)
+{
+    char indices[(MAX_COUNT + MAX_OFFSET) * 4];
+    size_t n = MAX_COUNT + MAX_OFFSET;
+    uint32_t seed = 12345;
+    size_t i, j;
+
+    /* All zeros and all the largest value. */
+    memset (indices, 0, sizeof (indices));
+    compare_kernels (type, indices);
+    for (i = 0; i < n; i++)
+        set_index (type, indices, i, max_value);
+    compare_kernels (type, indices);
+
+    /* Values spread over the whole range, half of them with the sign bit
+     * set, which the u16 and u32 kernels bias before comparing. */
+    for (i = 0; i < n; i++) {
+        seed = seed * 1103515245 + 12345;
+        GLuint value = (seed >> 8) & max_value;
+        if (i & 1)
+            value |= (max_value >> 1) + 1;
+        set_index (type, indices, i, value);
+    }
+    compare_kernels (type, indices);
+
+    /* A single extreme in every lane position, so a lane that is not
+     * folded into the result shows up. */
+    for (j = 0; j < n; j += 5) {
+        for (i = 0; i < n; i++)
+            set_index (type, indices, i, (max_value >> 1) + 1);
+        set_index (type, indices, j, max_value);
+        if (j + 1 < n)
+            set_index (type, indices, j + 1, 0);
+        compare_kernels (type, indices);
+    }
+
+    /* Values on both sides of the sign bit. */
+    for (i = 0; i < n; i++)
+        set_index (type, indices, i, i & 1 ? max_value >> 1 : (max_value >> 1) + 1);
+    compare_kernels (type, indices);
+}
+
+GPUPROCESS_START_TEST
+(test_index_range_u8)
+{
+    check_type (GL_UNSIGNED_BYTE, 0xff);
+}
+GPUPROCESS_END_TEST
+
+GPUPROCESS_START_TEST
+(test_index_range_u16)
+{
+    check_type (GL_UNSIGNED_SHORT, 0xffff);
+}
+GPUPROCESS_END_TEST
+
+GPUPROCESS_START_TEST
+(test_index_range_u32)
+{
+    check_type (GL_UNSIGNED_INT, 0xffffffff);
+}
+GPUPROCESS_END_TEST
+
+GPUPROCESS_START_TEST
+(test_index_range_scalar)
+{
+    uint16_t indices[] = { 7, 0xffff, 3, 0x8000, 0x7fff };
+    GLuint min = 0, max = 0;
+
+    GPUPROCESS_ASSERT (index_range_scan_with_kernel (INDEX_RANGE_KERNEL_SCALAR,
+                                                     GL_UNSIGNED_SHORT, indices,
+                                                     5, &min, &max));
+    GPUPROCESS_ASSERT (min == 3);
+    GPUPROCESS_ASSERT (max == 0xffff);
+
+    /* Empty arrays and other types have no range. */
+    GPUPROCESS_ASSERT (! index_range_scan (GL_UNSIGNED_SHORT, indices, 0,
+                                           &min, &max));
+    GPUPROCESS_ASSERT (! index_range_scan (GL_FLOAT, indices, 5, &min, &max));
+
+    /* Whatever index_range_scan () picks agrees with the scalar kernel. */
+    GPUPROCESS_ASSERT (index_range_scan (GL_UNSIGNED_SHORT, indices, 5,
+                                         &min, &max));
+    GPUPROCESS_ASSERT (min == 3);
+    GPUPROCESS_ASSERT (max == 0xffff);
+}
+GPUPROCESS_END_TEST
+
+void
+add_index_range_testcases (gpuprocess_suite_t *suite)
+{
+    gpuprocess_testcase_t *range = gpuprocess_testcase_create ("index_range");
+    gpuprocess_testcase_add_test (range, test_index_range_scalar);
+    gpuprocess_testcase_add_test (range, test_index_range_u8);
+    gpuprocess_testcase_add_test (range, test_index_range_u16);
+    gpuprocess_testcase_add_test (range, test_index_range_u32);
+    gpuprocess_suite_add_testcase (suite, range);
+}
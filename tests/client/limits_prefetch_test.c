@@ -0,0 +1,157 @@
+#include "limits_prefetch_test.h"
+#include "caching_client_private.h"
+#include "server.h"
+#include <stdlib.h>
+#include <string.h>
+
+/* A prefetch of GL_MAX_TEXTURE_SIZE as caching_client_prefetch_limits
+ * leaves it, with the server still to answer. */
+static egl_state_t *
+new_prefetching_state (uintptr_t display)
+{
+    setenv ("GPUPROCESS_CAPABILITY_CACHE", "0", 1);
+
+    egl_state_t *state = egl_state_new ((EGLDisplay) display, (EGLContext) 1);
+    limits_prefetch_t *prefetch = calloc (1, sizeof (limits_prefetch_t));
+    prefetch->count = 1;
+    prefetch->limits[0].pname = GL_MAX_TEXTURE_SIZE;
+    prefetch->limits[0].is_float = false;
+
+    state->limits_prefetched = true;
+    state->limits_prefetch = prefetch;
+    state->limits_fetched.pending = true;
+    state->limits_fetched.client = NULL;
+    return state;
+}
+
+/* What server_handle_prefetch_limits does when the context is current. */
+static void
+answer_prefetch (egl_state_t *state,
+                 GLint max_texture_size)
+{
+    state->limits_prefetch->limits[0].value.integers[0] = max_texture_size;
+    state->limits_fetched.value = GL_TRUE;
+    state->limits_fetched.pending = false;
+}
+
+GPUPROCESS_START_TEST
+(test_collect_on_get)
+{
+    egl_state_t *state = new_prefetching_state (0x1001);
+    answer_prefetch (state, 2048);
+
+    caching_client_t *client = caching_client_new ();
+    client->super.active_state = state;
+
+    /* Answered from the prefetch, without asking the server. */
+    GLint size = 0;
+    client->super.dispatch.glGetIntegerv (client, GL_MAX_TEXTURE_SIZE, &size);
+    GPUPROCESS_ASSERT (size == 2048);
+    GPUPROCESS_ASSERT (state->max_texture_size_queried);
+    GPUPROCESS_ASSERT (state->limits_prefetch == NULL);
+
+    client->super.active_state = NULL;
+    caching_client_destroy (client);
+    egl_state_destroy (state);
+}
+GPUPROCESS_END_TEST
+
+GPUPROCESS_START_TEST
+(test_collect_on_switch_away)
+{
+    egl_state_t *state = new_prefetching_state (0x1002);
+
+    /* Leaving the context does not wait for the server. */
+    caching_client_collect_fetched_limits (NULL, state);
+    GPUPROCESS_ASSERT (state->limits_prefetch != NULL);
+    GPUPROCESS_ASSERT (! state->max_texture_size_queried);
+
+    answer_prefetch (state, 4096);
+    caching_client_collect_fetched_limits (NULL, state);
+    GPUPROCESS_ASSERT (state->limits_prefetch == NULL);
+    GPUPROCESS_ASSERT (state->max_texture_size_queried);
+    GPUPROCESS_ASSERT (state->max_texture_size == 4096);
+
+    egl_state_destroy (state);
+}
+GPUPROCESS_END_TEST
+
+static GLint fake_max_texture_size;
+
+static void
+fake_glGetIntegerv (void *server,
+                    GLenum pname,
+                    GLint *params)
+{
+    params[0] = pname == GL_MAX_TEXTURE_SIZE ? fake_max_texture_size : 0;
+}
+
+static void
+run_prefetch_command (egl_state_t *state,
+                      EGLContext server_context)
+{
+    command_prefetch_limits_t command;
+    buffer_t buffer;
+
+    server_t *server = server_new (&buffer);
+    server->dispatch.glGetIntegerv = fake_glGetIntegerv;
+    server->context = server_context;
+
+    memset (&command, 0, sizeof (command));
+    command.header.type = COMMAND_PREFETCH_LIMITS;
+    command.ctx = state->context;
+    command.count = state->limits_prefetch->count;
+    command.limits = state->limits_prefetch->limits;
+    command.fetched = &state->limits_fetched;
+    server->handler_table[COMMAND_PREFETCH_LIMITS] (server, &command.header);
+
+    server_destroy (server);
+}
+
+GPUPROCESS_START_TEST
+(test_server_fetches_for_current_context)
+{
+    egl_state_t *state = new_prefetching_state (0x1003);
+
+    fake_max_texture_size = 1024;
+    run_prefetch_command (state, state->context);
+    GPUPROCESS_ASSERT (! result_slot_is_pending (&state->limits_fetched));
+    GPUPROCESS_ASSERT (state->limits_fetched.value == GL_TRUE);
+
+    caching_client_collect_limits (NULL, state);
+    GPUPROCESS_ASSERT (state->max_texture_size_queried);
+    GPUPROCESS_ASSERT (state->max_texture_size == 1024);
+
+    egl_state_destroy (state);
+}
+GPUPROCESS_END_TEST
+
+GPUPROCESS_START_TEST
+(test_server_refuses_other_context)
+{
+    egl_state_t *state = new_prefetching_state (0x1004);
+
+    /* A queued eglMakeCurrent that failed leaves another context current. */
+    fake_max_texture_size = 1024;
+    run_prefetch_command (state, (EGLContext) 2);
+    GPUPROCESS_ASSERT (! result_slot_is_pending (&state->limits_fetched));
+    GPUPROCESS_ASSERT (state->limits_fetched.value == GL_FALSE);
+
+    caching_client_collect_limits (NULL, state);
+    GPUPROCESS_ASSERT (state->limits_prefetch == NULL);
+    GPUPROCESS_ASSERT (! state->max_texture_size_queried);
+
+    egl_state_destroy (state);
+}
+GPUPROCESS_END_TEST
+
+void
+add_limits_prefetch_testcases (gpuprocess_suite_t *suite)
+{
+    gpuprocess_testcase_t *prefetch = gpuprocess_testcase_create ("limits_prefetch");
+    gpuprocess_testcase_add_test (prefetch, test_collect_on_get);
+    gpuprocess_testcase_add_test (prefetch, test_collect_on_switch_away);
+    gpuprocess_testcase_add_test (prefetch, test_server_fetches_for_current_context);
+    gpuprocess_testcase_add_test (prefetch, test_server_refuses_other_context);
+    gpuprocess_suite_add_testcase (suite, prefetch);
+}
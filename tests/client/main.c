@@ -1,5 +1,18 @@
 #include "basic_test.h"
+#include "buffer_object_test.h"
+#include "driver_capabilities_test.h"
+#include "egl_state_diff_test.h"
+#include "extension_set_test.h"
+#include "fingerprint_test.h"
 #include "gpuprocess_test.h"
+#include "index_buffer_cache_test.h"
+#include "index_range_test.h"
+#include "limits_prefetch_test.h"
+#include "pixel_copy_test.h"
+#include "registry_test.h"
+#include "symbol_cache_test.h"
+#include "texture_update_batch_test.h"
+#include "vertex_cache_test.h"
 #include <getopt.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -10,6 +23,19 @@ int main(int argc, char *argv[])
     gpuprocess_suite_t *client_suite = gpuprocess_suite_create ("basic");
 
     add_basic_testcases(client_suite);
+    add_buffer_object_testcases(client_suite);
+    add_driver_capabilities_testcases(client_suite);
+    add_egl_state_diff_testcases(client_suite);
+    add_extension_set_testcases(client_suite);
+    add_fingerprint_testcases(client_suite);
+    add_index_buffer_cache_testcases(client_suite);
+    add_index_range_testcases(client_suite);
+    add_limits_prefetch_testcases(client_suite);
+    add_pixel_copy_testcases(client_suite);
+    add_registry_testcases(client_suite);
+    add_symbol_cache_testcases(client_suite);
+    add_texture_update_batch_testcases(client_suite);
+    add_vertex_cache_testcases(client_suite);
 
     gpuprocess_suite_run_all(client_suite);
     gpuprocess_suite_destroy(client_suite);
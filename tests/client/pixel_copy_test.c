@@ -0,0 +1,155 @@
+#include "pixel_copy_test.h"
+#include "gles2_utils.h"
+#include <GLES2/gl2.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Repacks the image one byte at a time, the way GL describes unpacking. */
+static void
+reference_copy (const unsigned char *pixels,
+                unsigned char *buffer,
+                int width,
+                int height,
+                int group_size,
+                int alignment,
+                int row_length,
+                int skip_pixels,
+                int skip_rows)
+{
+    int source_row_size = (row_length ? row_length : width) * group_size;
+    int source_stride = (source_row_size + alignment - 1) / alignment * alignment;
+    int dest_stride = (width * group_size + alignment - 1) / alignment * alignment;
+    int x, y;
+
+    for (y = 0; y < height; y++) {
+        const unsigned char *source = pixels +
+                                      (y + skip_rows) * source_stride +
+                                      skip_pixels * group_size;
+        for (x = 0; x < width * group_size; x++)
+            buffer[y * dest_stride + x] = source[x];
+    }
+}
+
+static bool
+check_copy (int width,
+            int height,
+            GLenum format,
+            int alignment,
+            int row_length,
+            int skip_pixels,
+            int skip_rows,
+            size_t dest_offset)
+{
+    uint32_t size, unpadded_row_size, padded_row_size, source_padded_row_size;
+    int group_size = compute_image_group_size (format, GL_UNSIGNED_BYTE);
+    bool ok = true;
+    int y;
+
+    if (! compute_image_data_sizes (width, height, format, GL_UNSIGNED_BYTE, alignment,
+                                    &size, &unpadded_row_size, &padded_row_size) ||
+        ! compute_image_source_row_size (width, format, GL_UNSIGNED_BYTE, alignment,
+                                         row_length, &source_padded_row_size))
+        return false;
+
+    /* Exactly the bytes GL would read, so that reading past them shows up
+     * under valgrind or ASan. */
+    size_t source_size = (size_t) (skip_rows + height - 1) * source_padded_row_size +
+                         (skip_pixels + width) * group_size;
+    unsigned char *pixels = malloc (source_size);
+    size_t i;
+    for (i = 0; i < source_size; i++)
+        pixels[i] = i * 131 + 7;
+
+    unsigned char *expected = calloc (size, 1);
+    unsigned char *storage = calloc (size + dest_offset, 1);
+    unsigned char *buffer = storage + dest_offset;
+
+    reference_copy (pixels, expected, width, height, group_size, alignment,
+                    row_length, skip_pixels, skip_rows);
+    copy_rect_to_buffer (pixels, buffer, format, GL_UNSIGNED_BYTE, height,
+                         skip_pixels, skip_rows, unpadded_row_size,
+                         source_padded_row_size, padded_row_size);
+
+    /* Padding between the rows is left undefined. */
+    for (y = 0; y < height; y++)
+        ok &= ! memcmp (buffer + y * padded_row_size, expected + y * padded_row_size,
+                        unpadded_row_size);
+
+    free (pixels);
+    free (expected);
+    free (storage);
+    return ok;
+}
+
+GPUPROCESS_START_TEST
+(test_image_data_sizes)
+{
+    uint32_t size, unpadded_row_size, padded_row_size, source_padded_row_size;
+
+    GPUPROCESS_ASSERT (compute_image_data_sizes (5, 3, GL_RGB, GL_UNSIGNED_BYTE, 4,
+                                                 &size, &unpadded_row_size,
+                                                 &padded_row_size));
+    GPUPROCESS_ASSERT (unpadded_row_size == 15);
+    GPUPROCESS_ASSERT (padded_row_size == 16);
+    GPUPROCESS_ASSERT (size == 2 * 16 + 15);
+
+    GPUPROCESS_ASSERT (compute_image_data_sizes (5, 1, GL_RGB, GL_UNSIGNED_BYTE, 4,
+                                                 &size, NULL, NULL));
+    GPUPROCESS_ASSERT (size == 15);
+
+    GPUPROCESS_ASSERT (compute_image_source_row_size (5, GL_RGB, GL_UNSIGNED_BYTE, 4,
+                                                      0, &source_padded_row_size));
+    GPUPROCESS_ASSERT (source_padded_row_size == 16);
+    GPUPROCESS_ASSERT (compute_image_source_row_size (5, GL_RGB, GL_UNSIGNED_BYTE, 8,
+                                                      9, &source_padded_row_size));
+    GPUPROCESS_ASSERT (source_padded_row_size == 32);
+
+    GPUPROCESS_ASSERT (! compute_image_data_sizes (0x10000, 0x10000, GL_RGBA, GL_UNSIGNED_BYTE,
+                                                   4, &size, NULL, NULL));
+}
+GPUPROCESS_END_TEST
+
+GPUPROCESS_START_TEST
+(test_copy_rect_tight)
+{
+    GPUPROCESS_ASSERT (check_copy (64, 64, GL_RGBA, 4, 0, 0, 0, 0));
+    GPUPROCESS_ASSERT (check_copy (5, 7, GL_RGB, 4, 0, 0, 0, 0));
+    GPUPROCESS_ASSERT (check_copy (3, 1, GL_LUMINANCE, 1, 0, 0, 0, 0));
+}
+GPUPROCESS_END_TEST
+
+GPUPROCESS_START_TEST
+(test_copy_rect_unpack_parameters)
+{
+    GPUPROCESS_ASSERT (check_copy (5, 7, GL_RGB, 4, 9, 0, 0, 0));
+    GPUPROCESS_ASSERT (check_copy (5, 7, GL_RGB, 4, 0, 0, 3, 0));
+    GPUPROCESS_ASSERT (check_copy (5, 7, GL_RGB, 4, 9, 4, 0, 0));
+    GPUPROCESS_ASSERT (check_copy (5, 7, GL_RGB, 8, 11, 2, 5, 0));
+    GPUPROCESS_ASSERT (check_copy (17, 3, GL_LUMINANCE_ALPHA, 2, 40, 23, 1, 0));
+    GPUPROCESS_ASSERT (check_copy (8, 8, GL_RGBA, 4, 8, 0, 2, 0));
+}
+GPUPROCESS_END_TEST
+
+/* Large enough to take the non-temporal path, with destinations that do
+ * not start on a 16 byte boundary. */
+GPUPROCESS_START_TEST
+(test_copy_rect_large)
+{
+    GPUPROCESS_ASSERT (check_copy (1024, 512, GL_RGBA, 4, 0, 0, 0, 0));
+    GPUPROCESS_ASSERT (check_copy (1024, 512, GL_RGBA, 4, 0, 0, 0, 3));
+    GPUPROCESS_ASSERT (check_copy (701, 600, GL_RGB, 4, 1000, 13, 7, 5));
+    GPUPROCESS_ASSERT (check_copy (1500, 1000, GL_LUMINANCE, 8, 0, 0, 0, 9));
+}
+GPUPROCESS_END_TEST
+
+void
+add_pixel_copy_testcases (gpuprocess_suite_t *suite)
+{
+    gpuprocess_testcase_t *pixel_copy = gpuprocess_testcase_create ("pixel_copy");
+    gpuprocess_testcase_add_test (pixel_copy, test_image_data_sizes);
+    gpuprocess_testcase_add_test (pixel_copy, test_copy_rect_tight);
+    gpuprocess_testcase_add_test (pixel_copy, test_copy_rect_unpack_parameters);
+    gpuprocess_testcase_add_test (pixel_copy, test_copy_rect_large);
+    gpuprocess_suite_add_testcase (suite, pixel_copy);
+}
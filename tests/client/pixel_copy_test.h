@@ -0,0 +1,9 @@
+#ifndef TEST_CLIENT_PIXEL_COPY_TEST_H
+#define TEST_CLIENT_PIXEL_COPY_TEST_H
+
+#include "gpuprocess_test.h"
+
+void
+add_pixel_copy_testcases (gpuprocess_suite_t *suite);
+
+#endif /* TEST_CLIENT_PIXEL_COPY_TEST_H */
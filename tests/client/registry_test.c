@@ -0,0 +1,198 @@
+#include "registry_test.h"
+#include "egl_state.h"
+#include "registry.h"
+#include <stdint.h>
+
+static int destroyed_count;
+
+static void
+count_destroyed (void *data)
+{
+    destroyed_count++;
+}
+
+#define KEY(n) ((void *) (uintptr_t) (n))
+
+GPUPROCESS_START_TEST
+(test_registry_lookup_after_growing)
+{
+    registry_t *registry = registry_new ();
+    uintptr_t i;
+
+    /* Enough entries that the table grows a few times. */
+    for (i = 1; i <= 500; i++)
+        GPUPROCESS_ASSERT (registry_insert (registry, KEY (i % 3), KEY (i), KEY (i * 2)) == NULL);
+
+    registry_read_lock ();
+    for (i = 1; i <= 500; i++)
+        GPUPROCESS_ASSERT (registry_lookup (registry, KEY (i % 3), KEY (i)) == KEY (i * 2));
+    GPUPROCESS_ASSERT (registry_lookup (registry, KEY (1), KEY (3)) == NULL);
+    registry_read_unlock ();
+}
+GPUPROCESS_END_TEST
+
+GPUPROCESS_START_TEST
+(test_registry_remove)
+{
+    registry_t *registry = registry_new ();
+
+    registry_insert (registry, KEY (1), KEY (10), KEY (100));
+    registry_insert (registry, KEY (1), KEY (11), KEY (110));
+    registry_insert (registry, KEY (2), KEY (10), KEY (200));
+    GPUPROCESS_ASSERT (registry_insert (registry, KEY (1), KEY (10), KEY (101)) == KEY (100));
+
+    GPUPROCESS_ASSERT (registry_remove (registry, KEY (1), KEY (11)) == KEY (110));
+    GPUPROCESS_ASSERT (registry_remove (registry, KEY (1), KEY (11)) == NULL);
+    GPUPROCESS_ASSERT (registry_lookup (registry, KEY (1), KEY (10)) == KEY (101));
+
+    destroyed_count = 0;
+    registry_remove_key (registry, KEY (1), count_destroyed);
+    GPUPROCESS_ASSERT (registry_lookup (registry, KEY (1), KEY (10)) == NULL);
+    GPUPROCESS_ASSERT (registry_lookup (registry, KEY (2), KEY (10)) == KEY (200));
+    GPUPROCESS_ASSERT (destroyed_count == 1);
+}
+GPUPROCESS_END_TEST
+
+GPUPROCESS_START_TEST
+(test_registry_retire_waits_for_readers)
+{
+    destroyed_count = 0;
+
+    registry_read_lock ();
+    registry_retire (NULL, count_destroyed);
+    GPUPROCESS_ASSERT (destroyed_count == 0);
+    registry_read_unlock ();
+
+    /* What was retired in a read section goes with the next retire. */
+    registry_retire (NULL, count_destroyed);
+    GPUPROCESS_ASSERT (destroyed_count == 2);
+}
+GPUPROCESS_END_TEST
+
+static void
+sum_values (void *value,
+            void *sum)
+{
+    *(uintptr_t *) sum += (uintptr_t) value;
+}
+
+GPUPROCESS_START_TEST
+(test_registry_foreach)
+{
+    registry_t *registry = registry_new ();
+    uintptr_t sum = 0;
+    uintptr_t i;
+
+    for (i = 1; i <= 100; i++)
+        registry_insert (registry, KEY (i % 2), KEY (i), KEY (i));
+    registry_remove (registry, KEY (1), KEY (99));
+
+    registry_foreach (registry, KEY (1), sum_values, &sum);
+    GPUPROCESS_ASSERT (sum == 50 * 50 - 99);
+}
+GPUPROCESS_END_TEST
+
+static bool
+surface_has_state (EGLDisplay display,
+                   EGLSurface surface,
+                   egl_state_t *state)
+{
+    unsigned int count;
+    unsigned int i;
+    bool found = false;
+
+    registry_read_lock ();
+    egl_state_t **states = cached_gl_surface_find_states (display, surface, &count);
+    for (i = 0; i < count; i++)
+        found |= states[i] == state;
+    registry_read_unlock ();
+    return found;
+}
+
+static unsigned int
+surface_state_count (EGLDisplay display,
+                     EGLSurface surface)
+{
+    unsigned int count;
+
+    registry_read_lock ();
+    cached_gl_surface_find_states (display, surface, &count);
+    registry_read_unlock ();
+    return count;
+}
+
+GPUPROCESS_START_TEST
+(test_surface_states_follow_surfaces)
+{
+    EGLDisplay display = KEY (0x5100);
+    egl_state_t *first = egl_state_new (display, KEY (1));
+    egl_state_t *second = egl_state_new (display, KEY (2));
+    cached_gl_state_add (first);
+    cached_gl_state_add (second);
+
+    egl_state_set_surfaces (first, KEY (10), KEY (10));
+    egl_state_set_surfaces (second, KEY (10), KEY (11));
+    GPUPROCESS_ASSERT (surface_state_count (display, KEY (10)) == 2);
+    GPUPROCESS_ASSERT (surface_has_state (display, KEY (11), second));
+    GPUPROCESS_ASSERT (surface_state_count (KEY (0x5200), KEY (10)) == 0);
+
+    egl_state_set_surfaces (first, KEY (11), KEY (12));
+    GPUPROCESS_ASSERT (surface_state_count (display, KEY (10)) == 1);
+    GPUPROCESS_ASSERT (surface_has_state (display, KEY (10), second));
+    GPUPROCESS_ASSERT (surface_state_count (display, KEY (11)) == 2);
+    GPUPROCESS_ASSERT (surface_has_state (display, KEY (12), first));
+
+    /* A surface made again with the same handle starts with no states. */
+    cached_gl_surface_destroy (display, KEY (12));
+    GPUPROCESS_ASSERT (surface_state_count (display, KEY (12)) == 0);
+
+    cached_gl_state_remove (second);
+    GPUPROCESS_ASSERT (surface_state_count (display, KEY (10)) == 0);
+    GPUPROCESS_ASSERT (surface_state_count (display, KEY (11)) == 1);
+    GPUPROCESS_ASSERT (surface_has_state (display, KEY (11), first));
+
+    egl_state_set_surfaces (first, EGL_NO_SURFACE, EGL_NO_SURFACE);
+    GPUPROCESS_ASSERT (surface_state_count (display, KEY (11)) == 0);
+    cached_gl_state_remove (first);
+}
+GPUPROCESS_END_TEST
+
+static void
+count_state (egl_state_t *state,
+             void *count)
+{
+    (*(unsigned int *) count)++;
+}
+
+GPUPROCESS_START_TEST
+(test_states_foreach_display)
+{
+    EGLDisplay display = KEY (0x5300);
+    unsigned int count = 0;
+    uintptr_t i;
+
+    for (i = 1; i <= 3; i++)
+        cached_gl_state_add (egl_state_new (display, KEY (i)));
+    cached_gl_state_add (egl_state_new (KEY (0x5400), KEY (1)));
+
+    cached_gl_states_foreach (display, count_state, &count);
+    GPUPROCESS_ASSERT (count == 3);
+
+    for (i = 1; i <= 3; i++)
+        cached_gl_state_remove (cached_gl_state_find (display, KEY (i)));
+    cached_gl_state_remove (cached_gl_state_find (KEY (0x5400), KEY (1)));
+}
+GPUPROCESS_END_TEST
+
+void
+add_registry_testcases (gpuprocess_suite_t *suite)
+{
+    gpuprocess_testcase_t *registry = gpuprocess_testcase_create ("registry");
+    gpuprocess_testcase_add_test (registry, test_registry_lookup_after_growing);
+    gpuprocess_testcase_add_test (registry, test_registry_remove);
+    gpuprocess_testcase_add_test (registry, test_registry_retire_waits_for_readers);
+    gpuprocess_testcase_add_test (registry, test_registry_foreach);
+    gpuprocess_testcase_add_test (registry, test_surface_states_follow_surfaces);
+    gpuprocess_testcase_add_test (registry, test_states_foreach_display);
+    gpuprocess_suite_add_testcase (suite, registry);
+}
@@ -0,0 +1,184 @@
+#include "symbol_cache_test.h"
+#include "library_info.h"
+#include "symbol_cache.h"
+#include <dlfcn.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+/* The C library stands in for the driver: it is loaded and has a
+ * build-id. Each test gets a cache directory of its own. */
+static void *
+open_library (char *path, size_t size)
+{
+    char directory[] = "/tmp/gpuprocess-symbol-cache-XXXXXX";
+    library_info_t library;
+
+    GPUPROCESS_ASSERT (mkdtemp (directory) != NULL);
+    setenv ("XDG_CACHE_HOME", directory, 1);
+    unsetenv ("GPUPROCESS_SYMBOL_CACHE");
+
+    void *handle = dlopen ("libc.so.6", RTLD_NOW | RTLD_NOLOAD);
+    GPUPROCESS_ASSERT (handle != NULL);
+    GPUPROCESS_ASSERT (library_info_get (handle, &library));
+    GPUPROCESS_ASSERT (library_info_cache_path (&library, 1, "symbols", path, size));
+    return handle;
+}
+
+static void
+remove_cache (char *path)
+{
+    unlink (path);
+    *strrchr (path, '/') = '\0';
+    rmdir (path);
+    *strrchr (path, '/') = '\0';
+    rmdir (path);
+}
+
+static void
+fill_cache (void *handle)
+{
+    symbol_cache_t *cache = symbol_cache_open (handle);
+    GPUPROCESS_ASSERT (cache != NULL);
+    symbol_cache_add (cache, "strlen", dlsym (handle, "strlen"));
+    symbol_cache_add (cache, "memcpy", dlsym (handle, "memcpy"));
+    symbol_cache_save (cache);
+}
+
+static size_t
+read_file (const char *path, char *contents, size_t size)
+{
+    FILE *file = fopen (path, "r");
+    GPUPROCESS_ASSERT (file != NULL);
+    size_t length = fread (contents, 1, size - 1, file);
+    contents[length] = '\0';
+    fclose (file);
+    return length;
+}
+
+static void
+write_file (const char *path, const char *contents, size_t length)
+{
+    FILE *file = fopen (path, "w");
+    GPUPROCESS_ASSERT (file != NULL);
+    GPUPROCESS_ASSERT (fwrite (contents, 1, length, file) == length);
+    fclose (file);
+}
+
+GPUPROCESS_START_TEST
+(test_symbols_persist)
+{
+    char path[PATH_MAX];
+    void *handle = open_library (path, sizeof (path));
+
+    fill_cache (handle);
+
+    symbol_cache_t *cache = symbol_cache_open (handle);
+    GPUPROCESS_ASSERT (cache != NULL);
+    GPUPROCESS_ASSERT (symbol_cache_lookup (cache, "strlen") == dlsym (handle, "strlen"));
+    GPUPROCESS_ASSERT (symbol_cache_lookup (cache, "memcpy") == dlsym (handle, "memcpy"));
+    GPUPROCESS_ASSERT (symbol_cache_lookup (cache, "memmove") == NULL);
+    remove_cache (path);
+}
+GPUPROCESS_END_TEST
+
+GPUPROCESS_START_TEST
+(test_corrupted_file_is_ignored)
+{
+    char path[PATH_MAX];
+    char contents[1024];
+    void *handle = open_library (path, sizeof (path));
+
+    fill_cache (handle);
+    size_t length = read_file (path, contents, sizeof (contents));
+
+    /* An offset changed by one digit still lies within the library. */
+    char *offset = strchr (strstr (contents, "strlen"), ' ') + 1;
+    *offset = *offset == '1' ? '2' : '1';
+    write_file (path, contents, length);
+
+    symbol_cache_t *cache = symbol_cache_open (handle);
+    GPUPROCESS_ASSERT (cache != NULL);
+    GPUPROCESS_ASSERT (symbol_cache_lookup (cache, "strlen") == NULL);
+    GPUPROCESS_ASSERT (symbol_cache_lookup (cache, "memcpy") == NULL);
+
+    /* Looking the symbols up again writes a good file. */
+    symbol_cache_add (cache, "strlen", dlsym (handle, "strlen"));
+    symbol_cache_save (cache);
+    cache = symbol_cache_open (handle);
+    GPUPROCESS_ASSERT (symbol_cache_lookup (cache, "strlen") == dlsym (handle, "strlen"));
+    remove_cache (path);
+}
+GPUPROCESS_END_TEST
+
+GPUPROCESS_START_TEST
+(test_truncated_file_is_ignored)
+{
+    char path[PATH_MAX];
+    char contents[1024];
+    void *handle = open_library (path, sizeof (path));
+
+    fill_cache (handle);
+    read_file (path, contents, sizeof (contents));
+
+    /* Cut off in the middle of the checksum line. */
+    size_t length = strstr (contents, "checksum") - contents + 4;
+    write_file (path, contents, length);
+
+    symbol_cache_t *cache = symbol_cache_open (handle);
+    GPUPROCESS_ASSERT (cache != NULL);
+    GPUPROCESS_ASSERT (symbol_cache_lookup (cache, "strlen") == NULL);
+
+    /* Without the checksum line at all. */
+    length = strstr (contents, "checksum") - contents;
+    write_file (path, contents, length);
+
+    cache = symbol_cache_open (handle);
+    GPUPROCESS_ASSERT (symbol_cache_lookup (cache, "strlen") == NULL);
+    remove_cache (path);
+}
+GPUPROCESS_END_TEST
+
+GPUPROCESS_START_TEST
+(test_written_once_when_saved)
+{
+    char path[PATH_MAX];
+    void *handle = open_library (path, sizeof (path));
+
+    /* Adding does not touch the file. */
+    symbol_cache_t *cache = symbol_cache_open (handle);
+    GPUPROCESS_ASSERT (cache != NULL);
+    symbol_cache_add (cache, "strlen", dlsym (handle, "strlen"));
+    symbol_cache_add (cache, "memcpy", dlsym (handle, "memcpy"));
+    GPUPROCESS_ASSERT (access (path, F_OK) != 0);
+
+    /* Saving writes everything at once. */
+    symbol_cache_save_all ();
+    GPUPROCESS_ASSERT (access (path, F_OK) == 0);
+
+    /* With nothing new, saving again writes nothing. */
+    unlink (path);
+    symbol_cache_save (cache);
+    GPUPROCESS_ASSERT (access (path, F_OK) != 0);
+
+    symbol_cache_add (cache, "memmove", dlsym (handle, "memmove"));
+    symbol_cache_save (cache);
+    cache = symbol_cache_open (handle);
+    GPUPROCESS_ASSERT (symbol_cache_lookup (cache, "strlen") == dlsym (handle, "strlen"));
+    GPUPROCESS_ASSERT (symbol_cache_lookup (cache, "memmove") == dlsym (handle, "memmove"));
+    remove_cache (path);
+}
+GPUPROCESS_END_TEST
+
+void
+add_symbol_cache_testcases (gpuprocess_suite_t *suite)
+{
+    gpuprocess_testcase_t *tc = gpuprocess_testcase_create ("symbol_cache");
+    gpuprocess_testcase_add_test (tc, test_symbols_persist);
+    gpuprocess_testcase_add_test (tc, test_corrupted_file_is_ignored);
+    gpuprocess_testcase_add_test (tc, test_truncated_file_is_ignored);
+    gpuprocess_testcase_add_test (tc, test_written_once_when_saved);
+    gpuprocess_suite_add_testcase (suite, tc);
+}
@@ -0,0 +1,117 @@
+#include "texture_update_batch_test.h"
+#include "texture_update_batch.h"
+#include <string.h>
+
+/* Luminance updates with alignment 1, so rows are width bytes apart. */
+static void
+add_update (texture_update_batch_t *batch,
+            GLint x, GLint y, GLsizei width, GLsizei height,
+            unsigned char value)
+{
+    void *data = texture_update_batch_add (batch, GL_TEXTURE_2D, 0, x, y,
+                                           width, height, GL_LUMINANCE,
+                                           GL_UNSIGNED_BYTE, 1, width * height);
+    GPUPROCESS_ASSERT (data != NULL);
+    memset (data, value, width * height);
+}
+
+static unsigned char
+pixel_at (texture_update_batch_t *batch,
+          unsigned int index,
+          GLint x, GLint y)
+{
+    texture_update_t *update = &batch->updates[index];
+    return batch->data[update->offset +
+                       (y - update->yoffset) * update->width +
+                       (x - update->xoffset)];
+}
+
+GPUPROCESS_START_TEST
+(test_merge_adjacent_updates)
+{
+    texture_update_batch_t *batch = texture_update_batch_new ();
+
+    /* A row of glyphs of the same height, then a strip below them. */
+    add_update (batch, 0, 0, 8, 16, 1);
+    add_update (batch, 8, 0, 8, 16, 2);
+    add_update (batch, 16, 0, 4, 16, 3);
+    add_update (batch, 0, 16, 20, 4, 4);
+    texture_update_batch_merge (batch);
+
+    GPUPROCESS_ASSERT (batch->count == 1);
+    GPUPROCESS_ASSERT (batch->updates_merged == 3);
+    GPUPROCESS_ASSERT (batch->updates[0].xoffset == 0);
+    GPUPROCESS_ASSERT (batch->updates[0].yoffset == 0);
+    GPUPROCESS_ASSERT (batch->updates[0].width == 20);
+    GPUPROCESS_ASSERT (batch->updates[0].height == 20);
+    GPUPROCESS_ASSERT (pixel_at (batch, 0, 7, 15) == 1);
+    GPUPROCESS_ASSERT (pixel_at (batch, 0, 8, 0) == 2);
+    GPUPROCESS_ASSERT (pixel_at (batch, 0, 19, 15) == 3);
+    GPUPROCESS_ASSERT (pixel_at (batch, 0, 19, 19) == 4);
+
+    texture_update_batch_destroy (batch);
+}
+GPUPROCESS_END_TEST
+
+GPUPROCESS_START_TEST
+(test_merge_keeps_update_order)
+{
+    texture_update_batch_t *batch = texture_update_batch_new ();
+
+    /* The second update overwrites part of the first; the third could
+     * only merge with the first by moving it past the second. */
+    add_update (batch, 0, 0, 8, 8, 1);
+    add_update (batch, 4, 4, 8, 8, 2);
+    add_update (batch, 0, 8, 8, 8, 3);
+    texture_update_batch_merge (batch);
+
+    GPUPROCESS_ASSERT (batch->count == 3);
+    GPUPROCESS_ASSERT (batch->updates_merged == 0);
+
+    texture_update_batch_clear (batch);
+
+    /* A later update that covers an earlier one replaces it. */
+    add_update (batch, 2, 2, 4, 4, 1);
+    add_update (batch, 0, 0, 8, 8, 2);
+    texture_update_batch_merge (batch);
+
+    GPUPROCESS_ASSERT (batch->count == 1);
+    GPUPROCESS_ASSERT (pixel_at (batch, 0, 3, 3) == 2);
+
+    texture_update_batch_destroy (batch);
+}
+GPUPROCESS_END_TEST
+
+GPUPROCESS_START_TEST
+(test_batch_limits)
+{
+    texture_update_batch_t *batch = texture_update_batch_new ();
+    unsigned int i;
+
+    for (i = 0; i < TEXTURE_UPDATE_BATCH_MAX_UPDATES; i++)
+        add_update (batch, i * 2, 0, 1, 1, i);
+    GPUPROCESS_ASSERT (! texture_update_batch_add (batch, GL_TEXTURE_2D, 0, 0, 4, 1, 1,
+                                                   GL_LUMINANCE, GL_UNSIGNED_BYTE, 1, 1));
+
+    /* Disjoint updates stay apart. */
+    texture_update_batch_merge (batch);
+    GPUPROCESS_ASSERT (batch->count == TEXTURE_UPDATE_BATCH_MAX_UPDATES);
+
+    texture_update_batch_clear (batch);
+    GPUPROCESS_ASSERT (! texture_update_batch_add (batch, GL_TEXTURE_2D, 0, 0, 0, 1, 1,
+                                                   GL_LUMINANCE, GL_UNSIGNED_BYTE, 1,
+                                                   TEXTURE_UPDATE_BATCH_MAX_SIZE + 1));
+
+    texture_update_batch_destroy (batch);
+}
+GPUPROCESS_END_TEST
+
+void
+add_texture_update_batch_testcases (gpuprocess_suite_t *suite)
+{
+    gpuprocess_testcase_t *batch = gpuprocess_testcase_create ("texture_update_batch");
+    gpuprocess_testcase_add_test (batch, test_merge_adjacent_updates);
+    gpuprocess_testcase_add_test (batch, test_merge_keeps_update_order);
+    gpuprocess_testcase_add_test (batch, test_batch_limits);
+    gpuprocess_suite_add_testcase (suite, batch);
+}
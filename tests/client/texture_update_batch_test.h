@@ -0,0 +1,9 @@
+#ifndef TEST_CLIENT_TEXTURE_UPDATE_BATCH_TEST_H
+#define TEST_CLIENT_TEXTURE_UPDATE_BATCH_TEST_H
+
+#include "gpuprocess_test.h"
+
+void
+add_texture_update_batch_testcases (gpuprocess_suite_t *suite);
+
+#endif /* TEST_CLIENT_TEXTURE_UPDATE_BATCH_TEST_H */
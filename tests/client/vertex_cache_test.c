@@ -0,0 +1,173 @@
+#include "vertex_cache_test.h"
+#include "vertex_cache.h"
+
+typedef struct deleted_buffers {
+    GLuint buffers[8];
+    unsigned int count;
+} deleted_buffers_t;
+
+static void
+delete_buffer (GLuint buffer, void *user_data)
+{
+    deleted_buffers_t *deleted = user_data;
+    deleted->buffers[deleted->count++] = buffer;
+}
+
+/* Looks up a chunk in a new draw and gives it a buffer as the caching
+ * client does, once it has been seen twice. */
+static vertex_cache_entry_t *
+draw_chunk (vertex_cache_t *cache,
+            uint64_t fingerprint,
+            size_t size,
+            GLuint buffer,
+            deleted_buffers_t *deleted)
+{
+    vertex_cache_begin_draw (cache);
+    vertex_cache_entry_t *entry = vertex_cache_lookup (cache, fingerprint, size,
+                                                       delete_buffer, deleted);
+    if (entry && ! entry->buffer && entry->uses >= 2 &&
+        vertex_cache_make_room (cache, size, delete_buffer, deleted))
+        vertex_cache_set_buffer (cache, entry, buffer);
+    return entry;
+}
+
+GPUPROCESS_START_TEST
+(test_vertex_cache_hits)
+{
+    deleted_buffers_t deleted = { { 0 }, 0 };
+    vertex_cache_t *cache = vertex_cache_new (4096);
+
+    /* Seen once, it is only recorded. */
+    vertex_cache_entry_t *entry = draw_chunk (cache, 42, 1024, 1, &deleted);
+    GPUPROCESS_ASSERT (entry != NULL);
+    GPUPROCESS_ASSERT (entry->buffer == 0);
+    GPUPROCESS_ASSERT (entry->uses == 1);
+
+    /* Looking it up again in the same draw does not count as a use. */
+    entry = vertex_cache_lookup (cache, 42, 1024, delete_buffer, &deleted);
+    GPUPROCESS_ASSERT (entry->uses == 1);
+
+    /* The second draw uploads it, the third finds it. */
+    entry = draw_chunk (cache, 42, 1024, 1, &deleted);
+    GPUPROCESS_ASSERT (entry->buffer == 1);
+    GPUPROCESS_ASSERT (cache->size == 1024);
+    GPUPROCESS_ASSERT (cache->hits == 0);
+
+    entry = draw_chunk (cache, 42, 1024, 2, &deleted);
+    GPUPROCESS_ASSERT (entry->buffer == 1);
+    GPUPROCESS_ASSERT (cache->hits == 1);
+    GPUPROCESS_ASSERT (cache->bytes_saved == 1024);
+    GPUPROCESS_ASSERT (cache->bytes_uploaded == 1024);
+
+    /* The same fingerprint with another size is another chunk. */
+    entry = draw_chunk (cache, 42, 2048, 3, &deleted);
+    GPUPROCESS_ASSERT (entry->buffer == 0);
+    GPUPROCESS_ASSERT (deleted.count == 1);
+    GPUPROCESS_ASSERT (deleted.buffers[0] == 1);
+    GPUPROCESS_ASSERT (cache->size == 0);
+
+    vertex_cache_destroy (cache);
+}
+GPUPROCESS_END_TEST
+
+GPUPROCESS_START_TEST
+(test_vertex_cache_eviction)
+{
+    deleted_buffers_t deleted = { { 0 }, 0 };
+    vertex_cache_t *cache = vertex_cache_new (2048);
+
+    draw_chunk (cache, 1, 1024, 0, &deleted);
+    draw_chunk (cache, 1, 1024, 1, &deleted);
+    draw_chunk (cache, 2, 1024, 0, &deleted);
+    draw_chunk (cache, 2, 1024, 2, &deleted);
+    draw_chunk (cache, 1, 1024, 0, &deleted);
+    GPUPROCESS_ASSERT (cache->size == 2048);
+
+    /* The least recently used buffer goes to make room. */
+    draw_chunk (cache, 3, 1024, 0, &deleted);
+    vertex_cache_entry_t *entry = draw_chunk (cache, 3, 1024, 3, &deleted);
+    GPUPROCESS_ASSERT (entry->buffer == 3);
+    GPUPROCESS_ASSERT (deleted.count == 1);
+    GPUPROCESS_ASSERT (deleted.buffers[0] == 2);
+    GPUPROCESS_ASSERT (cache->size == 2048);
+
+    /* Buffers used by the draw being set up are kept. */
+    vertex_cache_begin_draw (cache);
+    vertex_cache_lookup (cache, 1, 1024, delete_buffer, &deleted);
+    vertex_cache_lookup (cache, 3, 1024, delete_buffer, &deleted);
+    GPUPROCESS_ASSERT (! vertex_cache_make_room (cache, 1024, delete_buffer, &deleted));
+    GPUPROCESS_ASSERT (deleted.count == 1);
+
+    /* Nothing bigger than the budget ever fits. */
+    GPUPROCESS_ASSERT (! vertex_cache_make_room (cache, 4096, delete_buffer, &deleted));
+
+    vertex_cache_destroy (cache);
+}
+GPUPROCESS_END_TEST
+
+GPUPROCESS_START_TEST
+(test_vertex_cache_key_collision)
+{
+    deleted_buffers_t deleted = { { 0 }, 0 };
+    vertex_cache_t *cache = vertex_cache_new (4096);
+
+    /* Both fingerprints fold to the same key. */
+    uint64_t first = 1;
+    uint64_t second = (2ULL << 32) | 3;
+
+    draw_chunk (cache, first, 1024, 0, &deleted);
+    draw_chunk (cache, first, 1024, 1, &deleted);
+
+    /* The newer chunk replaces the older, unless both are in one draw. */
+    vertex_cache_begin_draw (cache);
+    GPUPROCESS_ASSERT (vertex_cache_lookup (cache, first, 1024,
+                                            delete_buffer, &deleted) != NULL);
+    GPUPROCESS_ASSERT (vertex_cache_lookup (cache, second, 1024,
+                                            delete_buffer, &deleted) == NULL);
+
+    vertex_cache_entry_t *entry = draw_chunk (cache, second, 1024, 0, &deleted);
+    GPUPROCESS_ASSERT (entry != NULL);
+    GPUPROCESS_ASSERT (entry->fingerprint == second);
+    GPUPROCESS_ASSERT (deleted.count == 1);
+    GPUPROCESS_ASSERT (deleted.buffers[0] == 1);
+    GPUPROCESS_ASSERT (cache->entry_count == 1);
+
+    vertex_cache_destroy (cache);
+}
+GPUPROCESS_END_TEST
+
+GPUPROCESS_START_TEST
+(test_vertex_cache_release_buffers)
+{
+    deleted_buffers_t deleted = { { 0 }, 0 };
+    vertex_cache_t *cache = vertex_cache_new (4096);
+
+    draw_chunk (cache, 1, 1024, 0, &deleted);
+    draw_chunk (cache, 1, 1024, 1, &deleted);
+    draw_chunk (cache, 2, 1024, 0, &deleted);
+    draw_chunk (cache, 2, 1024, 2, &deleted);
+    draw_chunk (cache, 3, 1024, 0, &deleted);
+
+    vertex_cache_release_buffers (cache, delete_buffer, &deleted);
+    GPUPROCESS_ASSERT (deleted.count == 2);
+    GPUPROCESS_ASSERT (cache->size == 0);
+
+    /* The chunks must be uploaded again. */
+    vertex_cache_entry_t *entry = draw_chunk (cache, 1, 1024, 4, &deleted);
+    GPUPROCESS_ASSERT (entry->buffer == 4);
+    GPUPROCESS_ASSERT (cache->size == 1024);
+
+    vertex_cache_destroy (cache);
+}
+GPUPROCESS_END_TEST
+
+void
+add_vertex_cache_testcases (gpuprocess_suite_t *suite)
+{
+    gpuprocess_testcase_t *cache = gpuprocess_testcase_create ("vertex_cache");
+    gpuprocess_testcase_add_test (cache, test_vertex_cache_hits);
+    gpuprocess_testcase_add_test (cache, test_vertex_cache_eviction);
+    gpuprocess_testcase_add_test (cache, test_vertex_cache_key_collision);
+    gpuprocess_testcase_add_test (cache, test_vertex_cache_release_buffers);
+    gpuprocess_suite_add_testcase (suite, cache);
+}
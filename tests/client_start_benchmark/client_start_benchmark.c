@@ -0,0 +1,195 @@
+#include <pthread.h>
+#include <semaphore.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "ring_buffer.h"
+#include "server_pool.h"
+#include "texture_update_batch.h"
+
+/* Measures what a thread's first command costs, and what a thread that
+ * never sends one no longer allocates.
+ *
+ * Eager is what client_init used to do for every thread: create a ring
+ * and a server thread, then send the first command. Lazy takes a ring
+ * made ahead of time and hands it to an existing pool worker. There is
+ * no GL driver here, the command does nothing. */
+
+#define RING_SIZE_KB 1024
+#define ITERATIONS 50
+
+/* As in texture_update_batch.c. */
+#define TEXTURE_UPDATE_BATCH_DATA_SIZE (4 * TEXTURE_UPDATE_BATCH_MAX_SIZE)
+
+typedef struct _command {
+    unsigned int token;
+    bool shutdown;
+} command_t;
+
+typedef struct _bench_client {
+    buffer_t ring;
+    sem_t server_signal;
+    sem_t client_signal;
+    server_pool_ring_t *pool_ring;
+} bench_client_t;
+
+static inline double
+get_tick ()
+{
+    struct timespec now;
+    clock_gettime (CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1000000.0 + now.tv_nsec / 1000.0;
+}
+
+/* Returns false for the shutdown command. */
+static bool
+server_run_command (bench_client_t *client,
+                    command_t *command)
+{
+    bool shutdown = command->shutdown;
+    unsigned int token = command->token;
+
+    buffer_read_advance (&client->ring, sizeof (command_t));
+    client->ring.last_token = token;
+    sem_post (&client->client_signal);
+    return ! shutdown;
+}
+
+static void *
+dedicated_server_func (void *ptr)
+{
+    bench_client_t *client = ptr;
+    while (true) {
+        size_t available;
+        command_t *command = buffer_read_address (&client->ring, &available);
+        while (! command) {
+            sem_wait (&client->server_signal);
+            command = buffer_read_address (&client->ring, &available);
+        }
+        if (! server_run_command (client, command))
+            return NULL;
+    }
+}
+
+static server_pool_ring_status_t
+pooled_server_run (void *data,
+                   unsigned int budget)
+{
+    bench_client_t *client = data;
+    size_t available;
+
+    while (budget--) {
+        command_t *command = buffer_read_address (&client->ring, &available);
+        if (! command)
+            return SERVER_POOL_RING_EMPTY;
+        if (! server_run_command (client, command))
+            return SERVER_POOL_RING_CLOSED;
+    }
+    return SERVER_POOL_RING_PREEMPTED;
+}
+
+static void
+run_command (bench_client_t *client,
+             unsigned int token,
+             bool shutdown)
+{
+    size_t writable;
+    command_t *command = buffer_write_address (&client->ring, &writable);
+    command->token = token;
+    command->shutdown = shutdown;
+    buffer_write_advance (&client->ring, sizeof (command_t));
+
+    if (client->pool_ring)
+        server_pool_wake_ring (client->pool_ring);
+    else
+        sem_post (&client->server_signal);
+
+    while (client->ring.last_token != token)
+        sem_wait (&client->client_signal);
+}
+
+static double
+first_command_eager (void)
+{
+    bench_client_t client;
+    pthread_t server;
+
+    double start = get_tick ();
+    buffer_create (&client.ring, RING_SIZE_KB, "client_start_benchmark");
+    client.ring.last_token = 0;
+    sem_init (&client.server_signal, 0, 0);
+    sem_init (&client.client_signal, 0, 0);
+    client.pool_ring = NULL;
+    pthread_create (&server, NULL, dedicated_server_func, &client);
+    run_command (&client, 1, false);
+    double elapsed = get_tick () - start;
+
+    run_command (&client, 2, true);
+    pthread_join (server, NULL);
+    buffer_free (&client.ring);
+    sem_destroy (&client.server_signal);
+    sem_destroy (&client.client_signal);
+    return elapsed;
+}
+
+static double
+first_command_lazy (server_pool_t *pool,
+                    buffer_t *warm_ring)
+{
+    bench_client_t client;
+
+    double start = get_tick ();
+    client.ring = *warm_ring;
+    sem_init (&client.server_signal, 0, 0);
+    sem_init (&client.client_signal, 0, 0);
+    client.pool_ring = server_pool_add_ring (pool, &client.ring, pooled_server_run, &client);
+    run_command (&client, 1, false);
+    double elapsed = get_tick () - start;
+
+    run_command (&client, 2, true);
+    buffer_clear (&client.ring);
+    client.ring.last_token = 0;
+    *warm_ring = client.ring;
+    sem_destroy (&client.server_signal);
+    sem_destroy (&client.client_signal);
+    return elapsed;
+}
+
+int
+main (int argc, char **argv)
+{
+    double eager = 0, lazy = 0;
+    buffer_t warm_ring;
+    size_t stack_size;
+    int i;
+
+    server_pool_t *pool = server_pool_new (1, NULL);
+    buffer_create (&warm_ring, RING_SIZE_KB, "client_start_benchmark");
+
+    for (i = 0; i < ITERATIONS; i++) {
+        eager += first_command_eager ();
+        lazy += first_command_lazy (pool, &warm_ring);
+    }
+
+    printf ("first command  eager %8.1f us  lazy with a warm ring %8.1f us  %5.2fx\n",
+            eager / ITERATIONS, lazy / ITERATIONS, eager / lazy);
+
+    pthread_attr_t attributes;
+    pthread_attr_init (&attributes);
+    pthread_attr_getstacksize (&attributes, &stack_size);
+    pthread_attr_destroy (&attributes);
+
+    printf ("a thread that never sends a command no longer allocates:\n"
+            "  ring                  %6zu KB shared memory, mapped twice\n"
+            "  texture update batch  %6d KB heap\n"
+            "  server thread stack   %6zu KB reserved, with a server thread per client\n",
+            buffer_size (&warm_ring) / 1024, TEXTURE_UPDATE_BATCH_DATA_SIZE / 1024,
+            stack_size / 1024);
+
+    buffer_free (&warm_ring);
+    server_pool_destroy (pool);
+    return 0;
+}
@@ -0,0 +1,147 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "index_range.h"
+
+/* Index buffers are scanned on every client-array glDrawElements, so
+ * this measures the scan over the kind of data applications draw:
+ * triangle lists over a grid mesh, where neighbouring indices are close
+ * together and the range covers a slice of a bigger vertex array. */
+
+#define ITERATIONS 2000
+
+static inline double
+get_tick ()
+{
+    struct timespec now;
+    clock_gettime (CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1000000.0 + now.tv_nsec / 1000.0;
+}
+
+static size_t
+fill_grid_indices (void *indices,
+                   GLenum type,
+                   unsigned int columns,
+                   unsigned int rows,
+                   unsigned int first_vertex)
+{
+    size_t count = 0;
+    unsigned int x, y, k;
+
+    for (y = 0; y + 1 < rows; y++) {
+        for (x = 0; x + 1 < columns; x++) {
+            GLuint quad[6] = {
+                y * columns + x, (y + 1) * columns + x, y * columns + x + 1,
+                y * columns + x + 1, (y + 1) * columns + x, (y + 1) * columns + x + 1
+            };
+            for (k = 0; k < 6; k++, count++) {
+                GLuint index = first_vertex + quad[k];
+                if (type == GL_UNSIGNED_BYTE)
+                    ((uint8_t *) indices)[count] = index;
+                else if (type == GL_UNSIGNED_SHORT)
+                    ((uint16_t *) indices)[count] = index;
+                else
+                    ((uint32_t *) indices)[count] = index;
+            }
+        }
+    }
+    return count;
+}
+
+#define REFERENCE_SCAN(index_type)                       \
+    do {                                                 \
+        const index_type *typed = indices;               \
+        for (i = 0; i < count; i++) {                    \
+            if (typed[i] < *min_index)                   \
+                *min_index = typed[i];                   \
+            if (typed[i] > *max_index)                   \
+                *max_index = typed[i];                   \
+        }                                                \
+    } while (0)
+
+/* The plain loop the proxy used before. */
+static void
+reference_scan (GLenum type, const void *indices, size_t count,
+                GLuint *min_index, GLuint *max_index)
+{
+    size_t i;
+    *min_index = 0xffffffff;
+    *max_index = 0;
+    if (type == GL_UNSIGNED_BYTE)
+        REFERENCE_SCAN (uint8_t);
+    else if (type == GL_UNSIGNED_SHORT)
+        REFERENCE_SCAN (uint16_t);
+    else
+        REFERENCE_SCAN (uint32_t);
+}
+
+static bool
+run_case (const char *name,
+          GLenum type,
+          unsigned int columns,
+          unsigned int rows,
+          unsigned int first_vertex)
+{
+    size_t max_count = (size_t) (columns - 1) * (rows - 1) * 6;
+    void *indices = malloc (max_count * sizeof (uint32_t));
+    size_t count = fill_grid_indices (indices, type, columns, rows, first_vertex);
+    GLuint expected_min, expected_max, min = 0, max = 0;
+    volatile GLuint sink = 0;
+    int i;
+
+    reference_scan (type, indices, count, &expected_min, &expected_max);
+
+    double start = get_tick ();
+    for (i = 0; i < ITERATIONS; i++) {
+        reference_scan (type, indices, count, &min, &max);
+        sink += max;
+    }
+    double scalar_time = (get_tick () - start) / ITERATIONS;
+
+    start = get_tick ();
+    for (i = 0; i < ITERATIONS; i++) {
+        index_range_scan (type, indices, count, &min, &max);
+        sink += max;
+    }
+    double simd_time = (get_tick () - start) / ITERATIONS;
+
+    bool ok = min == expected_min && max == expected_max;
+    printf ("%-28s %8zu indices  scalar %9.2f us  simd %9.2f us  %5.1fx  %s\n",
+            name, count, scalar_time, simd_time,
+            simd_time > 0 ? scalar_time / simd_time : 0,
+            ok ? "ok" : "MISMATCH");
+
+    /* Unaligned starts and short tails take the scalar remainder path. */
+    for (i = 1; i < 40 && (size_t) i < count; i++) {
+        size_t size = type == GL_UNSIGNED_BYTE ? 1 :
+                      type == GL_UNSIGNED_SHORT ? 2 : 4;
+        const char *offset_indices = (const char *) indices + i * size;
+        reference_scan (type, offset_indices, count - 2 * i, &expected_min, &expected_max);
+        index_range_scan (type, offset_indices, count - 2 * i, &min, &max);
+        if (min != expected_min || max != expected_max) {
+            printf ("  mismatch at offset %d\n", i);
+            ok = false;
+        }
+    }
+
+    free (indices);
+    return ok;
+}
+
+int
+main (int argc, char **argv)
+{
+    bool ok = true;
+
+    ok &= run_case ("u8 16x16 grid", GL_UNSIGNED_BYTE, 16, 16, 0);
+    ok &= run_case ("u16 64x64 grid", GL_UNSIGNED_SHORT, 64, 64, 0);
+    ok &= run_case ("u16 128x128 grid at 40000", GL_UNSIGNED_SHORT, 128, 128, 40000);
+    ok &= run_case ("u16 250x250 grid", GL_UNSIGNED_SHORT, 250, 250, 0);
+    ok &= run_case ("u32 256x256 grid", GL_UNSIGNED_INT, 256, 256, 0);
+    ok &= run_case ("u32 512x512 grid at 1M", GL_UNSIGNED_INT, 512, 512, 1000000);
+
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,223 @@
+#include <pthread.h>
+#include <semaphore.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "ring_buffer.h"
+#include "server_pool.h"
+
+/* Measures how command throughput scales with the number of client
+ * threads, with a server thread per client and with the server pool.
+ * There is no GL driver here: each command costs a little spinning, and
+ * every SYNC_INTERVAL commands the client waits for the server, the way
+ * a glGet or an eglMakeCurrent would. */
+
+#define RING_SIZE_KB 512
+#define COMMANDS_PER_CLIENT 20000
+#define SYNC_INTERVAL 64
+#define COMMAND_WORK 200
+#define MAX_CLIENTS 64
+
+typedef struct _command {
+    unsigned int token;
+    bool shutdown;
+    char padding[24];
+} command_t;
+
+typedef struct _bench_client {
+    buffer_t ring;
+    volatile unsigned int last_token;
+    sem_t server_signal;
+    sem_t client_signal;
+    server_pool_ring_t *pool_ring;
+    pthread_t thread;
+    pthread_t server_thread;
+} bench_client_t;
+
+static bench_client_t clients[MAX_CLIENTS];
+static volatile unsigned int sink;
+
+static inline double
+get_tick ()
+{
+    struct timespec now;
+    clock_gettime (CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1000000.0 + now.tv_nsec / 1000.0;
+}
+
+static void
+null_driver_run (command_t *command)
+{
+    unsigned int i, sum = 0;
+    for (i = 0; i < COMMAND_WORK; i++)
+        sum += i ^ command->token;
+    sink += sum;
+}
+
+/* Returns false for the shutdown command. */
+static bool
+server_run_command (bench_client_t *client,
+                    command_t *command)
+{
+    unsigned int token = command->token;
+    bool shutdown = command->shutdown;
+
+    if (! shutdown)
+        null_driver_run (command);
+    buffer_read_advance (&client->ring, sizeof (command_t));
+    if (token) {
+        client->last_token = token;
+        sem_post (&client->client_signal);
+    }
+    return ! shutdown;
+}
+
+static void *
+dedicated_server_func (void *ptr)
+{
+    bench_client_t *client = ptr;
+    while (true) {
+        size_t available;
+        command_t *command = buffer_read_address (&client->ring, &available);
+        while (! command) {
+            sem_wait (&client->server_signal);
+            command = buffer_read_address (&client->ring, &available);
+        }
+        if (! server_run_command (client, command))
+            return NULL;
+    }
+}
+
+static server_pool_ring_status_t
+pooled_server_run (void *data,
+                   unsigned int budget)
+{
+    bench_client_t *client = data;
+    unsigned int i;
+
+    for (i = 0; i < budget; i++) {
+        size_t available;
+        command_t *command = buffer_read_address (&client->ring, &available);
+        if (! command)
+            return SERVER_POOL_RING_EMPTY;
+        if (! server_run_command (client, command))
+            return SERVER_POOL_RING_CLOSED;
+    }
+    return SERVER_POOL_RING_PREEMPTED;
+}
+
+static void
+client_send (bench_client_t *client,
+             unsigned int token,
+             bool shutdown)
+{
+    size_t writable;
+    command_t *command = buffer_write_address (&client->ring, &writable);
+    while (! command || writable < sizeof (command_t)) {
+        sched_yield ();
+        command = buffer_write_address (&client->ring, &writable);
+    }
+
+    command->token = token;
+    command->shutdown = shutdown;
+    buffer_write_advance (&client->ring, sizeof (command_t));
+
+    if (client->ring.fill_count == sizeof (command_t)) {
+        if (client->pool_ring)
+            server_pool_wake_ring (client->pool_ring);
+        else
+            sem_post (&client->server_signal);
+    }
+
+    while (token && client->last_token != token)
+        sem_wait (&client->client_signal);
+}
+
+static void *
+client_func (void *ptr)
+{
+    bench_client_t *client = ptr;
+    unsigned int i, token = 0;
+
+    for (i = 1; i <= COMMANDS_PER_CLIENT; i++)
+        client_send (client, i % SYNC_INTERVAL ? 0 : ++token, false);
+    client_send (client, ++token, true);
+    return NULL;
+}
+
+/* Returns the commands run per second. */
+static double
+run (unsigned int client_count,
+     server_pool_t *pool)
+{
+    unsigned int i;
+
+    for (i = 0; i < client_count; i++) {
+        bench_client_t *client = &clients[i];
+        buffer_clear (&client->ring);
+        client->last_token = 0;
+        sem_init (&client->server_signal, 0, 0);
+        sem_init (&client->client_signal, 0, 0);
+        if (pool) {
+            client->pool_ring = server_pool_add_ring (pool, &client->ring,
+                                                      pooled_server_run, client);
+        } else {
+            client->pool_ring = NULL;
+            pthread_create (&client->server_thread, NULL, dedicated_server_func, client);
+        }
+    }
+
+    double start = get_tick ();
+    for (i = 0; i < client_count; i++)
+        pthread_create (&clients[i].thread, NULL, client_func, &clients[i]);
+    for (i = 0; i < client_count; i++)
+        pthread_join (clients[i].thread, NULL);
+    double elapsed = get_tick () - start;
+
+    for (i = 0; i < client_count; i++) {
+        if (! pool)
+            pthread_join (clients[i].server_thread, NULL);
+        sem_destroy (&clients[i].server_signal);
+        sem_destroy (&clients[i].client_signal);
+    }
+
+    return (double) client_count * COMMANDS_PER_CLIENT / elapsed * 1000000.0;
+}
+
+int
+main (int argc, char **argv)
+{
+    static const unsigned int client_counts[] = { 1, 2, 4, 8, 16, 32, 64 };
+    unsigned int worker_count = argc > 1 ? atoi (argv[1]) : 0;
+    unsigned int i;
+
+    if (! worker_count) {
+        long cpus = sysconf (_SC_NPROCESSORS_ONLN) - 1;
+        worker_count = cpus < 1 ? 1 : cpus > 4 ? 4 : cpus;
+    }
+
+    for (i = 0; i < MAX_CLIENTS; i++)
+        buffer_create (&clients[i].ring, RING_SIZE_KB, "server_pool_benchmark");
+
+    server_pool_t *pool = server_pool_new (worker_count, NULL);
+    printf ("%u pool workers\n", server_pool_get_worker_count (pool));
+
+    for (i = 0; i < sizeof (client_counts) / sizeof (client_counts[0]); i++) {
+        unsigned int count = client_counts[i];
+        double dedicated = run (count, NULL);
+        double pooled = run (count, pool);
+        printf ("%2u clients  dedicated %8.0f kcmd/s (%2u threads)  "
+                "pool %8.0f kcmd/s (%2u threads)  %5.2fx\n",
+                count, dedicated / 1000, count, pooled / 1000,
+                server_pool_get_worker_count (pool), pooled / dedicated);
+    }
+
+    server_pool_destroy (pool);
+    for (i = 0; i < MAX_CLIENTS; i++)
+        buffer_free (&clients[i].ring);
+    return 0;
+}
@@ -0,0 +1,191 @@
+#include <pthread.h>
+#include <sched.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "ring_buffer.h"
+#include "gles2_utils.h"
+#include <GLES2/gl2.h>
+
+/* Measures how fast texture data goes from the application to the thread
+ * that would hand it to the driver. There is no GL driver here: the
+ * consumer thread plays a null driver that copies each upload into the
+ * texture's storage, so the numbers cover the proxy's own copies and the
+ * one the driver makes. The ring has the size of the client's command
+ * buffer, whose pages stay warm from one command to the next.
+ *
+ * The heap path is what the proxy used to do: repack the pixels into a
+ * malloc'ed block, send a pointer to it and free it on the other side.
+ * The ring path writes the pixels right after the command in the ring
+ * buffer, in bands of at most a quarter of the ring. */
+
+#define RING_SIZE (1024 * 1024)
+#define COMMAND_SIZE 64
+#define ITERATIONS 50
+
+typedef struct _upload {
+    size_t size;
+    size_t offset;
+    char *heap_pixels;
+    bool last;
+    char padding[COMMAND_SIZE - 2 * sizeof (size_t) - sizeof (char *) - sizeof (bool)];
+} upload_t;
+
+static buffer_t ring;
+static volatile uint32_t checksum;
+
+static inline double
+get_tick ()
+{
+    struct timespec now;
+    clock_gettime (CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1000000.0 + now.tv_nsec / 1000.0;
+}
+
+static char *texture_storage;
+
+/* A driver copies the pixels into its own storage before returning. */
+static uint32_t
+null_driver_upload (const char *pixels, size_t size, size_t offset)
+{
+    memcpy (texture_storage + offset, pixels, size);
+    return texture_storage[offset];
+}
+
+static void *
+consumer_thread_func (void *ptr)
+{
+    while (true) {
+        size_t available;
+        upload_t *upload = buffer_read_address (&ring, &available);
+        if (! upload) {
+            sched_yield ();
+            continue;
+        }
+
+        size_t command_size = sizeof (upload_t) + upload->size;
+        bool last = upload->last;
+        if (upload->heap_pixels) {
+            checksum += null_driver_upload (upload->heap_pixels, upload->size,
+                                            upload->offset);
+            free (upload->heap_pixels);
+            command_size = sizeof (upload_t);
+        } else
+            checksum += null_driver_upload ((const char *) (upload + 1), upload->size,
+                                            upload->offset);
+
+        buffer_read_advance (&ring, command_size);
+        if (last)
+            return NULL;
+    }
+}
+
+static upload_t *
+get_space (size_t size)
+{
+    while (true) {
+        size_t writable;
+        void *address = buffer_write_address (&ring, &writable);
+        if (address && writable >= size)
+            return address;
+        sched_yield ();
+    }
+}
+
+static void
+send_heap (const char *pixels, int width, int height, bool last)
+{
+    uint32_t size, unpadded_row_size, padded_row_size;
+    compute_image_data_sizes (width, height, GL_RGBA, GL_UNSIGNED_BYTE, 4,
+                              &size, &unpadded_row_size, &padded_row_size);
+
+    upload_t *upload = get_space (sizeof (upload_t));
+    upload->size = size;
+    upload->offset = 0;
+    upload->heap_pixels = malloc (size);
+    upload->last = last;
+    copy_rect_to_buffer (pixels, upload->heap_pixels, GL_RGBA, GL_UNSIGNED_BYTE,
+                         height, 0, 0, unpadded_row_size, padded_row_size,
+                         padded_row_size);
+    buffer_write_advance (&ring, sizeof (upload_t));
+}
+
+static void
+send_in_ring (const char *pixels, int width, int height, bool last)
+{
+    uint32_t size, unpadded_row_size, padded_row_size;
+    compute_image_data_sizes (width, height, GL_RGBA, GL_UNSIGNED_BYTE, 4,
+                              &size, &unpadded_row_size, &padded_row_size);
+
+    size_t budget = RING_SIZE / 4;
+    int band_rows = 1 + (budget - sizeof (upload_t) - unpadded_row_size) / padded_row_size;
+    int row;
+    for (row = 0; row < height; row += band_rows) {
+        int rows = height - row < band_rows ? height - row : band_rows;
+        size_t band_size = (rows - 1) * padded_row_size + unpadded_row_size;
+
+        upload_t *upload = get_space (sizeof (upload_t) + band_size);
+        upload->size = band_size;
+        upload->offset = row * padded_row_size;
+        upload->heap_pixels = NULL;
+        upload->last = last && row + rows >= height;
+        memcpy (upload + 1, pixels + row * padded_row_size, band_size);
+        buffer_write_advance (&ring, sizeof (upload_t) + band_size);
+    }
+}
+
+static double
+run (void (*send) (const char *, int, int, bool),
+     const char *pixels, int width, int height)
+{
+    pthread_t consumer;
+    buffer_clear (&ring);
+    pthread_create (&consumer, NULL, consumer_thread_func, NULL);
+
+    double start = get_tick ();
+    int i;
+    for (i = 0; i < ITERATIONS; i++)
+        send (pixels, width, height, i == ITERATIONS - 1);
+    pthread_join (consumer, NULL);
+    double elapsed = get_tick () - start;
+
+    return (double) width * height * 4 * ITERATIONS / elapsed;
+}
+
+static void
+run_case (const char *name, int width, int height)
+{
+    char *pixels = malloc ((size_t) width * height * 4);
+    memset (pixels, 0x5a, (size_t) width * height * 4);
+    texture_storage = malloc ((size_t) width * height * 4);
+    memset (texture_storage, 0, (size_t) width * height * 4);
+
+    double heap = run (send_heap, pixels, width, height);
+    double in_ring = run (send_in_ring, pixels, width, height);
+    printf ("%-16s heap %8.1f MB/s  ring %8.1f MB/s  %5.2fx\n",
+            name, heap, in_ring, in_ring / heap);
+
+    free (texture_storage);
+    free (pixels);
+}
+
+int
+main (int argc, char **argv)
+{
+    /* The size is in kilobytes, as for the client's command buffer. */
+    buffer_create (&ring, RING_SIZE / 1024, "texture_upload_benchmark");
+
+    run_case ("64x64 RGBA", 64, 64);
+    run_case ("256x256 RGBA", 256, 256);
+    run_case ("512x512 RGBA", 512, 512);
+    run_case ("1024x1024 RGBA", 1024, 1024);
+    run_case ("2048x2048 RGBA", 2048, 2048);
+    run_case ("4096x4096 RGBA", 4096, 4096);
+
+    buffer_free (&ring);
+    return 0;
+}
@@ -0,0 +1,156 @@
+#define _GNU_SOURCE
+#include <pthread.h>
+#include <sched.h>
+#include <semaphore.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "cpu_topology.h"
+
+/* Measures the round trip between a client thread and its server thread
+ * for each placement policy. The client waits the way client.c does:
+ * it polls for a while, then sleeps on a semaphore. The server answers
+ * each request right away, so the numbers are the cost of the placement
+ * alone. */
+
+#define ROUND_TRIPS 20000
+#define SPIN_ITERATIONS 2000
+
+typedef struct _channel {
+    volatile unsigned int value;
+    sem_t signal;
+} channel_t;
+
+static channel_t request;
+static channel_t reply;
+static unsigned int spin_iterations;
+
+static inline double
+get_tick ()
+{
+    struct timespec now;
+    clock_gettime (CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1000000.0 + now.tv_nsec / 1000.0;
+}
+
+static void
+channel_post (channel_t *channel,
+              unsigned int value)
+{
+    channel->value = value;
+    sem_post (&channel->signal);
+}
+
+static void
+channel_wait (channel_t *channel,
+              unsigned int value)
+{
+    unsigned int i;
+
+    for (i = 0; i < spin_iterations; i++) {
+        if (channel->value == value) {
+            while (sem_trywait (&channel->signal) == 0)
+                ;
+            return;
+        }
+#if defined(__i386__) || defined(__x86_64__)
+        __builtin_ia32_pause ();
+#endif
+    }
+
+    while (channel->value != value)
+        sem_wait (&channel->signal);
+}
+
+static void *
+server_func (void *ptr)
+{
+    unsigned int i;
+    for (i = 1; i <= ROUND_TRIPS; i++) {
+        channel_wait (&request, i);
+        channel_post (&reply, i);
+    }
+    return NULL;
+}
+
+static void
+print_cpus (const char *name,
+            const cpu_set_t *cpus)
+{
+    int cpu;
+
+    printf (" %s", name);
+    if (! CPU_COUNT (cpus)) {
+        printf (" -");
+        return;
+    }
+    for (cpu = 0; cpu < CPU_TOPOLOGY_MAX_CPUS; cpu++) {
+        if (CPU_ISSET (cpu, cpus))
+            printf (" %d", cpu);
+    }
+}
+
+static void
+run (thread_placement_t placement,
+     const cpu_set_t *allowed)
+{
+    cpu_set_t client_cpus, server_cpus;
+    pthread_t server;
+    unsigned int i;
+
+    request.value = reply.value = 0;
+    sem_init (&request.signal, 0, 0);
+    sem_init (&reply.signal, 0, 0);
+
+    pthread_setaffinity_np (pthread_self (), sizeof (cpu_set_t), allowed);
+    pthread_create (&server, NULL, server_func, NULL);
+    if (thread_placement_place_pair (placement, allowed, sched_getcpu (),
+                                     &client_cpus, &server_cpus)) {
+        if (CPU_COUNT (&server_cpus))
+            pthread_setaffinity_np (server, sizeof (cpu_set_t), &server_cpus);
+        if (CPU_COUNT (&client_cpus))
+            pthread_setaffinity_np (pthread_self (), sizeof (cpu_set_t), &client_cpus);
+    }
+
+    double start = get_tick ();
+    for (i = 1; i <= ROUND_TRIPS; i++) {
+        channel_post (&request, i);
+        channel_wait (&reply, i);
+    }
+    double elapsed = get_tick () - start;
+    pthread_join (server, NULL);
+
+    printf ("%-8s %7.2f us per round trip  ", thread_placement_get_name (placement),
+            elapsed / ROUND_TRIPS);
+    print_cpus ("client", &client_cpus);
+    print_cpus (" server", &server_cpus);
+    printf ("\n");
+
+    sem_destroy (&request.signal);
+    sem_destroy (&reply.signal);
+}
+
+int
+main (int argc, char **argv)
+{
+    static const thread_placement_t placements[] = {
+        THREAD_PLACEMENT_NONE,
+        THREAD_PLACEMENT_LEGACY,
+        THREAD_PLACEMENT_CLUSTER,
+        THREAD_PLACEMENT_SMT_SIBLING
+    };
+    cpu_set_t allowed;
+    unsigned int i;
+
+    pthread_getaffinity_np (pthread_self (), sizeof (cpu_set_t), &allowed);
+    spin_iterations = sysconf (_SC_NPROCESSORS_ONLN) > 1 ? SPIN_ITERATIONS : 0;
+    printf ("%ld online CPUs, topology %s\n", sysconf (_SC_NPROCESSORS_ONLN),
+            cpu_topology_get () ? "read" : "unavailable");
+
+    for (i = 0; i < sizeof (placements) / sizeof (placements[0]); i++)
+        run (placements[i], &allowed);
+    return 0;
+}